@@ -0,0 +1,394 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <cmath>
+#include <opencv2/core/core.hpp>
+
+#include "ORBmatcher.h"
+#include "HammingDistance.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "Frame.h"
+#include "MapPoint.h"
+
+// Candidate set shapes of the descriptor comparisons, one query against nB candidates
+// (nA == 1) or all pairs of nA x nB descriptors
+struct Workload {
+    std::string name;
+    int nA;
+    int nB;
+};
+
+static const int scenePoints = 1000;
+static const int sceneLevels = 8;
+
+// Synthetic scene for the ORBmatcher search functions: scenePoints points 5-10 m in front of a
+// frame and three keyframes on a short baseline along x. Every view has a keypoint for each point
+// it sees, with the point descriptor off by a few bits, plus half as many distractor keypoints.
+// KF0 has its own map point for each of its keypoints (fuse candidates), KF1 and KF2 share the
+// map points of the even points, the odd points are left to triangulate.
+struct Scene {
+    ORB_SLAM2::Map map;
+    ORB_SLAM2::Frame frame;
+    ORB_SLAM2::KeyFrame *pKF0 = NULL, *pKF1 = NULL, *pKF2 = NULL;
+    std::vector<ORB_SLAM2::MapPoint *> vpShared, vpKF0;
+    std::map<ORB_SLAM2::MapPoint *, int> pointIndex;
+
+    // Outputs of the search under test
+    int nMatches = 0;
+    std::vector<ORB_SLAM2::MapPoint *> vpMatches;
+    std::vector<std::pair<size_t, size_t>> vMatchedPairs;
+
+    explicit Scene(int seed);
+    ~Scene();
+
+    // Index of each matched map point in the scene (-1 for none), after the match count
+    std::vector<int> Signature(const std::vector<ORB_SLAM2::MapPoint *> &vpMPs) const;
+};
+
+// View from camera center (centerX,0,0) looking along z. keyPointOf[j] is the keypoint of point j
+// or -1 if it falls outside the image.
+static void createView(ORB_SLAM2::Frame &F, int id, float centerX, const std::vector<cv::Point3f> &points,
+                       const cv::Mat &descriptors, std::mt19937 &rng, std::vector<int> &keyPointOf) {
+    F.fx = F.fy = 500;
+    F.cx = 320;
+    F.cy = 240;
+    F.invfx = F.invfy = 1.0f / 500;
+    F.mnMinX = F.mnMinY = 0;
+    F.mnMaxX = 640;
+    F.mnMaxY = 480;
+    F.mfGridElementWidthInv = FRAME_GRID_COLS / 640.0f;
+    F.mfGridElementHeightInv = FRAME_GRID_ROWS / 480.0f;
+    F.mbf = F.mb = F.mThDepth = 0;
+    F.mnScaleLevels = sceneLevels;
+    F.mfScaleFactor = 1.2f;
+    F.mfLogScaleFactor = std::log(1.2f);
+    F.mvScaleFactors.resize(sceneLevels);
+    F.mvLevelSigma2.resize(sceneLevels);
+    F.mvInvLevelSigma2.resize(sceneLevels);
+    for (int l = 0; l < sceneLevels; l++) {
+        F.mvScaleFactors[l] = std::pow(1.2f, l);
+        F.mvLevelSigma2[l] = F.mvScaleFactors[l] * F.mvScaleFactors[l];
+        F.mvInvLevelSigma2[l] = 1.0f / F.mvLevelSigma2[l];
+    }
+    F.mK = (cv::Mat_<float>(3, 3) << 500, 0, 320, 0, 500, 240, 0, 0, 1);
+    F.mpORBvocabulary = NULL;
+    F.mnId = id;
+    F.mTimeStamp = id * 0.1;
+    cv::Mat Tcw = cv::Mat::eye(4, 4, CV_32F);
+    Tcw.at<float>(0, 3) = -centerX;
+    F.SetPose(Tcw);
+
+    const int nNodes = scenePoints / 6;
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    cv::Mat viewDescriptors;
+    keyPointOf.assign(points.size(), -1);
+    for (size_t j = 0; j < points.size() + points.size() / 2; j++) {
+        cv::KeyPoint kp;
+        cv::Mat d(1, 32, CV_8U);
+        int node;
+        if (j < points.size()) {
+            const cv::Point3f &P = points[j];
+            kp = cv::KeyPoint(cv::Point2f(F.fx * (P.x - centerX) / P.z + F.cx + noise(rng),
+                                          F.fy * P.y / P.z + F.cy + noise(rng)),
+                              31.0f, (float) ((j * 37) % 360) + noise(rng), 1.0f, (int) j % 4);
+            if (kp.pt.x < 0 || kp.pt.x >= 640 || kp.pt.y < 0 || kp.pt.y >= 480)
+                continue;
+            descriptors.row(j).copyTo(d);
+            for (int flips = rng() % 6; flips > 0; flips--)
+                d.at<unsigned char>(rng() % 32) ^= (unsigned char) (1 << (rng() % 8));
+            keyPointOf[j] = F.mvKeys.size();
+            node = j % nNodes;
+        } else {
+            kp = cv::KeyPoint(cv::Point2f((float) (rng() % 640), (float) (rng() % 480)), 31.0f,
+                              (float) (rng() % 360), 1.0f, rng() % 4);
+            for (int b = 0; b < 32; b++)
+                d.at<unsigned char>(b) = (unsigned char) rng();
+            node = rng() % nNodes;
+        }
+        F.mFeatVec.addFeature(node, F.mvKeys.size());
+        F.mvKeys.push_back(kp);
+        viewDescriptors.push_back(d);
+    }
+
+    F.N = F.mvKeys.size();
+    F.mvKeysUn = F.mvKeys;
+    F.mvuRight = F.mvDepth = std::vector<float>(F.N, -1);
+    F.mDescriptors.Assign(viewDescriptors);
+    F.mvpMapPoints = std::vector<ORB_SLAM2::MapPoint *>(F.N, static_cast<ORB_SLAM2::MapPoint *>(NULL));
+    std::vector<int> cells(F.N, -1);
+    for (int i = 0; i < F.N; i++) {
+        int x, y;
+        if (F.PosInGrid(F.mvKeysUn[i], x, y))
+            cells[i] = x * FRAME_GRID_ROWS + y;
+    }
+    F.mGrid.Build(FRAME_GRID_COLS, FRAME_GRID_ROWS, cells);
+}
+
+static ORB_SLAM2::KeyFrame *createKeyFrame(ORB_SLAM2::Map *pMap, int id, float centerX,
+                                           const std::vector<cv::Point3f> &points, const cv::Mat &descriptors,
+                                           std::mt19937 &rng, std::vector<int> &keyPointOf) {
+    ORB_SLAM2::Frame F;
+    createView(F, id, centerX, points, descriptors, rng, keyPointOf);
+    return new ORB_SLAM2::KeyFrame(F, pMap, NULL);
+}
+
+static ORB_SLAM2::MapPoint *createMapPoint(ORB_SLAM2::Map *pMap, const cv::Point3f &P,
+                                           const std::vector<std::pair<ORB_SLAM2::KeyFrame *, int>> &observations) {
+    auto *pMP = new ORB_SLAM2::MapPoint((cv::Mat_<float>(3, 1) << P.x, P.y, P.z), observations[0].first, pMap);
+    for (const auto &observation: observations) {
+        pMP->AddObservation(observation.first, observation.second);
+        observation.first->AddMapPoint(pMP, observation.second);
+    }
+    pMP->ComputeDistinctiveDescriptors();
+    pMP->UpdateNormalAndDepth();
+    return pMP;
+}
+
+Scene::Scene(int seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> x(-3, 3), y(-2, 2), z(5, 10);
+    std::vector<cv::Point3f> points(scenePoints);
+    for (cv::Point3f &P: points)
+        P = cv::Point3f(x(rng), y(rng), z(rng));
+    cv::Mat descriptors(scenePoints, 32, CV_8U);
+    cv::randu(descriptors, cv::Scalar(0), cv::Scalar(256));
+
+    std::vector<int> kp0, kp1, kp2, kpF;
+    pKF0 = createKeyFrame(&map, 0, -0.25f, points, descriptors, rng, kp0);
+    pKF1 = createKeyFrame(&map, 1, 0.0f, points, descriptors, rng, kp1);
+    pKF2 = createKeyFrame(&map, 2, 0.25f, points, descriptors, rng, kp2);
+    createView(frame, 3, 0.1f, points, descriptors, rng, kpF);
+
+    for (int j = 0; j < scenePoints; j++) {
+        if (kp0[j] >= 0) {
+            vpKF0.push_back(createMapPoint(&map, points[j], {{pKF0, kp0[j]}}));
+            pointIndex[vpKF0.back()] = j;
+        }
+        if (j % 2 == 0 && kp1[j] >= 0 && kp2[j] >= 0) {
+            vpShared.push_back(createMapPoint(&map, points[j], {{pKF1, kp1[j]}, {pKF2, kp2[j]}}));
+            pointIndex[vpShared.back()] = j;
+            frame.isInFrustum(vpShared.back(), 0.5);
+        }
+    }
+}
+
+Scene::~Scene() {
+    for (ORB_SLAM2::MapPoint *pMP: vpShared)
+        delete pMP;
+    for (ORB_SLAM2::MapPoint *pMP: vpKF0)
+        delete pMP;
+    delete pKF0;
+    delete pKF1;
+    delete pKF2;
+}
+
+std::vector<int> Scene::Signature(const std::vector<ORB_SLAM2::MapPoint *> &vpMPs) const {
+    std::vector<int> signature(1, nMatches);
+    for (ORB_SLAM2::MapPoint *pMP: vpMPs)
+        signature.push_back(pMP ? pointIndex.at(pMP) : -1);
+    return signature;
+}
+
+// Fundamental matrix from keyframe 1 to keyframe 2, as LocalMapping::ComputeF12
+static cv::Mat computeF12(ORB_SLAM2::KeyFrame *pKF1, ORB_SLAM2::KeyFrame *pKF2) {
+    cv::Mat R12 = pKF1->GetRotation() * pKF2->GetRotation().t();
+    cv::Mat t12 = -R12 * pKF2->GetTranslation() + pKF1->GetTranslation();
+    cv::Mat t12x = (cv::Mat_<float>(3, 3) << 0, -t12.at<float>(2), t12.at<float>(1),
+            t12.at<float>(2), 0, -t12.at<float>(0),
+            -t12.at<float>(1), t12.at<float>(0), 0);
+    return pKF1->mK.t().inv() * t12x * R12 * pKF2->mK.inv();
+}
+
+// One ORBmatcher search on a scene: call runs the search, result reads its outputs afterwards
+struct Search {
+    std::string name;
+    std::function<void(Scene &)> call;
+    std::function<std::vector<int>(Scene &)> result;
+};
+
+/**
+ * @brief Times the Hamming distance kernels on the candidate set sizes seen in the ORBmatcher
+ * search functions, against the pairwise ORBmatcher::DescriptorDistance on cv::Mat rows.
+ * Descriptors are random rows picked in random order, like the keypoint indices of a search window.
+ * Then times the search functions themselves on synthetic scenes, with one DescriptorDistance per
+ * candidate (pairwise) and with the batch distances of each kernel, and checks their matches agree.
+ * @param argv argv[1]=repetitions per workload (default 20000), argv[2]=scenes per search function (default 30)
+ */
+int main(int argc, char **argv) {
+    int repetitions = argc > 1 ? std::stoi(argv[1]) : 20000;
+    int scenes = argc > 2 ? std::stoi(argv[2]) : 30;
+
+    const std::vector<Workload> workloads = {
+            {"SearchByProjection(local map)", 1, 24},
+            {"SearchByProjection(last frame)", 1, 12},
+            {"SearchByProjection(relocalization)", 1, 16},
+            {"SearchByProjection(Sim3)", 1, 16},
+            {"SearchByBoW", 1, 8},
+            {"SearchForInitialization", 1, 64},
+            {"SearchForTriangulation", 1, 8},
+            {"SearchBySim3", 1, 16},
+            {"Fuse", 1, 16},
+            {"ComputeStereoMatches", 1, 32},
+            {"ComputeDistinctiveDescriptors", 20, 20},
+    };
+
+    const int nDescriptors = 2000;
+    std::mt19937 rng(42);
+    cv::Mat descriptors(nDescriptors, 32, CV_8U);
+    cv::randu(descriptors, cv::Scalar(0), cv::Scalar(256));
+
+    std::vector<int> vIndices(nDescriptors);
+    for (int i = 0; i < nDescriptors; i++)
+        vIndices[i] = i;
+    std::shuffle(vIndices.begin(), vIndices.end(), rng);
+
+    std::vector<std::string> kernels = ORB_SLAM2::GetAvailableHammingKernels();
+    std::cout << "default kernel: " << ORB_SLAM2::GetHammingKernel() << std::endl;
+    std::cout << "workload,kernel,ns_per_distance,speedup,identical" << std::endl;
+
+    volatile int sink = 0;
+    for (const Workload &workload : workloads) {
+        const int nDistances = workload.nA * workload.nB;
+        const int nSets = nDescriptors / (workload.nA + workload.nB);
+
+        // Baseline: pairwise distances on cv::Mat rows, as the search functions did
+        std::vector<int> reference(nSets * nDistances);
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repetitions; r++) {
+            const int set = r % nSets;
+            const int *pA = &vIndices[set * (workload.nA + workload.nB)];
+            const int *pB = pA + workload.nA;
+            for (int i = 0; i < workload.nA; i++) {
+                const cv::Mat &a = descriptors.row(pA[i]);
+                for (int j = 0; j < workload.nB; j++)
+                    reference[set * nDistances + i * workload.nB + j] =
+                            ORB_SLAM2::ORBmatcher::DescriptorDistance(a, descriptors.row(pB[j]));
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        const double baselineNs =
+                std::chrono::duration<double, std::nano>(end - start).count() / repetitions / nDistances;
+        std::cout << workload.name << ",pairwise," << baselineNs << ",1,yes" << std::endl;
+
+        for (const std::string &kernel : kernels) {
+            ORB_SLAM2::SetHammingKernel(kernel);
+
+            std::vector<const unsigned char *> vpA(workload.nA), vpB(workload.nB);
+            std::vector<int> distances(nSets * nDistances);
+            start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repetitions; r++) {
+                const int set = r % nSets;
+                const int *pA = &vIndices[set * (workload.nA + workload.nB)];
+                const int *pB = pA + workload.nA;
+                // Gathering the rows is part of the cost at the call sites
+                for (int i = 0; i < workload.nA; i++)
+                    vpA[i] = descriptors.ptr<unsigned char>(pA[i]);
+                for (int j = 0; j < workload.nB; j++)
+                    vpB[j] = descriptors.ptr<unsigned char>(pB[j]);
+
+                if (workload.nA == 1)
+                    ORB_SLAM2::DescriptorDistances(vpA[0], &vpB[0], workload.nB, &distances[set * nDistances]);
+                else
+                    ORB_SLAM2::DescriptorDistanceMatrix(&vpA[0], workload.nA, &vpB[0], workload.nB,
+                                                        &distances[set * nDistances]);
+            }
+            end = std::chrono::steady_clock::now();
+            sink = sink + distances[0];
+
+            const double ns = std::chrono::duration<double, std::nano>(end - start).count() / repetitions / nDistances;
+            const bool identical = distances == reference;
+            std::cout << workload.name << "," << kernel << "," << ns << "," << baselineNs / ns << ","
+                      << (identical ? "yes" : "NO") << std::endl;
+        }
+    }
+
+    const std::vector<Search> searches = {
+            {"SearchByProjection(local map)",
+                    [](Scene &scene) {
+                        ORB_SLAM2::ORBmatcher matcher(0.8);
+                        scene.nMatches = matcher.SearchByProjection(scene.frame, scene.vpShared, 1);
+                    },
+                    [](Scene &scene) { return scene.Signature(scene.frame.mvpMapPoints); }},
+            {"SearchByBoW",
+                    [](Scene &scene) {
+                        ORB_SLAM2::ORBmatcher matcher(0.7, true);
+                        scene.nMatches = matcher.SearchByBoW(scene.pKF1, scene.frame, scene.vpMatches);
+                    },
+                    [](Scene &scene) { return scene.Signature(scene.vpMatches); }},
+            {"SearchForTriangulation",
+                    [](Scene &scene) {
+                        ORB_SLAM2::ORBmatcher matcher(0.6, false);
+                        cv::Mat F12 = computeF12(scene.pKF1, scene.pKF2);
+                        scene.nMatches = matcher.SearchForTriangulation(scene.pKF1, scene.pKF2, F12,
+                                                                        scene.vMatchedPairs, false);
+                    },
+                    [](Scene &scene) {
+                        std::vector<int> signature(1, scene.nMatches);
+                        for (const auto &pair: scene.vMatchedPairs) {
+                            signature.push_back(pair.first);
+                            signature.push_back(pair.second);
+                        }
+                        return signature;
+                    }},
+            {"Fuse",
+                    [](Scene &scene) {
+                        ORB_SLAM2::ORBmatcher matcher;
+                        scene.nMatches = matcher.Fuse(scene.pKF2, scene.vpKF0, 3);
+                    },
+                    [](Scene &scene) { return scene.Signature(scene.pKF2->GetMapPointMatches()); }},
+            {"SearchBySim3",
+                    [](Scene &scene) {
+                        ORB_SLAM2::ORBmatcher matcher(0.75, true);
+                        cv::Mat R12 = scene.pKF1->GetRotation() * scene.pKF2->GetRotation().t();
+                        cv::Mat t12 = -R12 * scene.pKF2->GetTranslation() + scene.pKF1->GetTranslation();
+                        scene.vpMatches.assign(scene.pKF1->N, static_cast<ORB_SLAM2::MapPoint *>(NULL));
+                        scene.nMatches = matcher.SearchBySim3(scene.pKF1, scene.pKF2, scene.vpMatches, 1.0f, R12, t12,
+                                                              7.5f);
+                    },
+                    [](Scene &scene) { return scene.Signature(scene.vpMatches); }},
+    };
+
+    // Pairwise first, it is the reference of the speedups and of the matches
+    std::vector<std::string> modes(1, "pairwise");
+    modes.insert(modes.end(), kernels.begin(), kernels.end());
+
+    std::cout << "search,kernel,us_per_call,speedup,identical" << std::endl;
+    for (const Search &search: searches) {
+        std::vector<std::vector<int>> reference;
+        double baselineUs = 0;
+        for (const std::string &mode: modes) {
+            ORB_SLAM2::ORBmatcher::SetBatchDistances(mode != "pairwise");
+            if (mode != "pairwise")
+                ORB_SLAM2::SetHammingKernel(mode);
+
+            // The searches change the scene (Fuse adds observations), so each call gets a fresh one
+            double us = 0;
+            std::vector<std::vector<int>> results;
+            for (int seed = 0; seed < scenes; seed++) {
+                Scene scene(seed);
+                auto start = std::chrono::steady_clock::now();
+                search.call(scene);
+                auto end = std::chrono::steady_clock::now();
+                us += std::chrono::duration<double, std::micro>(end - start).count();
+                results.push_back(search.result(scene));
+            }
+            us /= scenes;
+
+            if (mode == "pairwise") {
+                reference = results;
+                baselineUs = us;
+            }
+            std::cout << search.name << "," << mode << "," << us << "," << baselineUs / us << ","
+                      << (results == reference ? "yes" : "NO") << std::endl;
+        }
+    }
+    ORB_SLAM2::ORBmatcher::SetBatchDistances(true);
+
+    return 0;
+}
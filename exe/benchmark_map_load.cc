@@ -0,0 +1,260 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <opencv2/core/core.hpp>
+
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "Frame.h"
+#include "TaskPool.h"
+#include "MapFile.h"
+#include "MapFileLoader.h"
+
+// Keypoints of every synthetic keyframe, and number of consecutive keyframes that observe a point.
+// Neighbouring keyframes share 16 points, above the covisibility threshold of UpdateConnections.
+static const int keysPerKeyFrame = 64;
+static const int observationsPerPoint = 4;
+
+/**
+ * @brief Synthetic map of a camera moving along x: every keyframe creates
+ * keysPerKeyFrame / observationsPerPoint points, which are observed by it and the next keyframes.
+ * The covisibility graph and spanning tree are built as the local mapping would.
+ */
+ORB_SLAM2::Map *createMap(int nKeyFrames) {
+    auto *pMap = new ORB_SLAM2::Map();
+
+    ORB_SLAM2::Frame F;
+    F.fx = F.fy = 500;
+    F.cx = 320;
+    F.cy = 240;
+    F.invfx = F.invfy = 1.0f / 500;
+    F.mbf = F.mb = F.mThDepth = 0;
+    F.N = keysPerKeyFrame;
+    F.mnScaleLevels = 8;
+    F.mfScaleFactor = 1.2f;
+    F.mfLogScaleFactor = std::log(1.2f);
+    F.mvScaleFactors = F.mvLevelSigma2 = F.mvInvLevelSigma2 = std::vector<float>(8, 1.0f);
+    F.mK = cv::Mat::eye(3, 3, CV_32F);
+    F.mpORBvocabulary = NULL;
+    std::vector<int> cells(keysPerKeyFrame);
+    for (int i = 0; i < keysPerKeyFrame; i++) {
+        F.mvKeys.emplace_back(cv::Point2f(16.0f * i, 12.0f * i), 31.0f);
+        cells[i] = i % (FRAME_GRID_COLS * FRAME_GRID_ROWS);
+    }
+    F.mvKeysUn = F.mvKeys;
+    F.mvuRight = F.mvDepth = std::vector<float>(keysPerKeyFrame, -1);
+    F.mDescriptors.Assign(cv::Mat(keysPerKeyFrame, 32, CV_8U, cv::Scalar(0x5a)));
+    F.mvpMapPoints = std::vector<ORB_SLAM2::MapPoint *>(keysPerKeyFrame, static_cast<ORB_SLAM2::MapPoint *>(NULL));
+    F.mGrid.Build(FRAME_GRID_COLS, FRAME_GRID_ROWS, cells);
+
+    const int newPointsPerKeyFrame = keysPerKeyFrame / observationsPerPoint;
+    std::vector<ORB_SLAM2::KeyFrame *> keyFrames;
+    for (int k = 0; k < nKeyFrames; k++) {
+        F.mnId = k;
+        F.mTimeStamp = k * 0.1;
+        F.mTcw = cv::Mat::eye(4, 4, CV_32F);
+        F.mTcw.at<float>(0, 3) = -0.1f * k;
+        auto *pKF = new ORB_SLAM2::KeyFrame(F, pMap, NULL);
+        keyFrames.push_back(pKF);
+        pMap->AddKeyFrame(pKF);
+        if (k == 0)
+            pMap->mvpKeyFrameOrigins.push_back(pKF);
+
+        // Slot s of keyframe k observes point s % newPointsPerKeyFrame of keyframe k - s / newPointsPerKeyFrame
+        for (int s = 0; s < keysPerKeyFrame; s++) {
+            int age = s / newPointsPerKeyFrame;
+            if (age > k)
+                continue;
+            ORB_SLAM2::MapPoint *pMP;
+            if (age == 0) {
+                cv::Mat pos = (cv::Mat_<float>(3, 1) << 0.1f * k, 0.05f * s, 5.0f);
+                pMP = new ORB_SLAM2::MapPoint(pos, pKF, pMap);
+                pMap->AddMapPoint(pMP);
+            } else {
+                pMP = keyFrames[k - age]->GetMapPoint(s % newPointsPerKeyFrame);
+            }
+            pMP->AddObservation(pKF, s);
+            pKF->AddMapPoint(pMP, s);
+        }
+        pKF->UpdateConnections();
+    }
+    return pMap;
+}
+
+// Keyframe links that the relinking restores, by id
+struct KeyFrameLinks {
+    std::vector<long> mapPoints;
+    long parent;
+    std::vector<long> covisibles;
+    std::vector<long> children;
+    std::vector<long> loopEdges;
+
+    bool operator==(const KeyFrameLinks &other) const {
+        return mapPoints == other.mapPoints && parent == other.parent && covisibles == other.covisibles &&
+               children == other.children && loopEdges == other.loopEdges;
+    }
+};
+
+// Map point links, by id
+struct MapPointLinks {
+    long refKeyFrame;
+    std::vector<std::pair<long, size_t>> observations;
+
+    bool operator==(const MapPointLinks &other) const {
+        return refKeyFrame == other.refKeyFrame && observations == other.observations;
+    }
+};
+
+std::map<long, KeyFrameLinks> getLinks(ORB_SLAM2::Map *pMap) {
+    std::map<long, KeyFrameLinks> links;
+    for (auto *pKF: pMap->GetAllKeyFrames()) {
+        KeyFrameLinks &kfLinks = links[pKF->mnId];
+        for (auto *pMP: pKF->GetMapPointMatches())
+            kfLinks.mapPoints.push_back(pMP ? (long) pMP->mnId : -1);
+        kfLinks.parent = pKF->GetParent() ? (long) pKF->GetParent()->mnId : -1;
+        // Keyframes of equal weight are ordered by address, which differs between the maps
+        for (auto *pCovisible: pKF->GetVectorCovisibleKeyFrames())
+            kfLinks.covisibles.push_back(pCovisible->mnId);
+        std::sort(kfLinks.covisibles.begin(), kfLinks.covisibles.end());
+        for (auto *pChild: pKF->GetChilds())
+            kfLinks.children.push_back(pChild->mnId);
+        std::sort(kfLinks.children.begin(), kfLinks.children.end());
+        for (auto *pLoop: pKF->GetLoopEdges())
+            kfLinks.loopEdges.push_back(pLoop->mnId);
+        std::sort(kfLinks.loopEdges.begin(), kfLinks.loopEdges.end());
+    }
+    return links;
+}
+
+std::map<long, MapPointLinks> getPointLinks(ORB_SLAM2::Map *pMap) {
+    std::map<long, MapPointLinks> links;
+    for (auto *pMP: pMap->GetAllMapPoints()) {
+        MapPointLinks &mpLinks = links[pMP->mnId];
+        mpLinks.refKeyFrame = pMP->GetReferenceKeyFrame() ? (long) pMP->GetReferenceKeyFrame()->mnId : -1;
+        for (auto &observation: pMP->GetObservations())
+            mpLinks.observations.emplace_back(observation.first->mnId, observation.second);
+        std::sort(mpLinks.observations.begin(), mpLinks.observations.end());
+    }
+    return links;
+}
+
+/**
+ * @brief Times loading synthetic maps as System does with reuse=true, from a boost archive
+ * (deserialization and Map::RestoreLinks on a pool of all cores), from a native map file and
+ * progressively with MapFileLoader. Checks that the links of the loaded maps are those of the saved
+ * one, and that a loader aborted midway (as Tracking::Reset does) stops before the map is cleared.
+ * @param argv keyframe counts (default 1000 5000 10000 50000)
+ */
+int main(int argc, char **argv) {
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; i++)
+        sizes.push_back(std::stoi(argv[i]));
+    if (sizes.empty())
+        sizes = {1000, 5000, 10000, 50000};
+    ORB_SLAM2::TaskPool pool(std::max(std::thread::hardware_concurrency(), 1u));
+
+    for (int nKeyFrames: sizes) {
+        ORB_SLAM2::Map *pMap = createMap(nKeyFrames);
+        std::map<long, KeyFrameLinks> savedLinks = getLinks(pMap);
+        std::map<long, MapPointLinks> savedPointLinks = getPointLinks(pMap);
+
+        std::stringstream buffer;
+        {
+            boost::archive::binary_oarchive oa(buffer, boost::archive::no_header);
+            oa << pMap;
+        }
+        const std::string mapFilename = "benchmark_map_load.map";
+        if (!ORB_SLAM2::MapFile::Save(pMap, mapFilename))
+            return 1;
+        pMap->clear();
+        delete pMap;
+
+        auto t0 = std::chrono::steady_clock::now();
+        ORB_SLAM2::Map *pLoaded;
+        {
+            boost::archive::binary_iarchive ia(buffer, boost::archive::no_header);
+            ia >> pLoaded;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        pLoaded->RestoreLinks(&pool);
+        auto t2 = std::chrono::steady_clock::now();
+
+        bool same = savedLinks == getLinks(pLoaded);
+        std::cout << nKeyFrames << " keyframes, " << pLoaded->MapPointsInMap() << " map points: deserialize "
+                  << std::chrono::duration<double>(t1 - t0).count() << " s, relink "
+                  << std::chrono::duration<double>(t2 - t1).count() << " s on " << pool.GetNumThreads()
+                  << " threads, links "
+                  << (same ? "identical" : "DIFFERENT") << std::endl;
+        pLoaded->clear();
+        delete pLoaded;
+
+        t0 = std::chrono::steady_clock::now();
+        ORB_SLAM2::Map *pNative = ORB_SLAM2::MapFile::Load(mapFilename);
+        t1 = std::chrono::steady_clock::now();
+        bool sameNative = pNative && savedLinks == getLinks(pNative) && savedPointLinks == getPointLinks(pNative);
+        std::cout << "    map file: load " << std::chrono::duration<double>(t1 - t0).count() << " s, links "
+                  << (sameNative ? "identical" : "DIFFERENT") << std::endl;
+        if (pNative) {
+            pNative->clear();
+            delete pNative;
+        }
+
+        // Progressive load: a first batch on this thread, the rest on the loader thread. Without a
+        // vocabulary or keyframe database only the map is loaded.
+        const size_t batch = std::max(nKeyFrames / 20, 1);
+        t0 = std::chrono::steady_clock::now();
+        auto *pProgressive = new ORB_SLAM2::Map();
+        bool sameProgressive;
+        {
+            ORB_SLAM2::MapFileLoader loader(pProgressive, NULL, NULL);
+            sameProgressive = loader.Open(mapFilename);
+            if (sameProgressive) {
+                loader.LoadNext(batch);
+                loader.LoadRemaining(batch);
+                loader.Join();
+                sameProgressive = loader.isFinished();
+            }
+        }
+        t1 = std::chrono::steady_clock::now();
+        sameProgressive = sameProgressive && pProgressive->KeyFramesInMap() == (size_t) nKeyFrames &&
+                          savedLinks == getLinks(pProgressive) && savedPointLinks == getPointLinks(pProgressive);
+        std::cout << "    map file in batches of " << batch << ": load "
+                  << std::chrono::duration<double>(t1 - t0).count() << " s, links "
+                  << (sameProgressive ? "identical" : "DIFFERENT") << std::endl;
+        pProgressive->clear();
+        delete pProgressive;
+
+        // Reset while loading: nothing may be linked to or added to the map once it is cleared
+        auto *pReset = new ORB_SLAM2::Map();
+        bool resetStopped;
+        {
+            ORB_SLAM2::MapFileLoader loader(pReset, NULL, NULL);
+            resetStopped = loader.Open(mapFilename);
+            if (resetStopped) {
+                loader.LoadNext(1);
+                loader.LoadRemaining(1);
+                loader.Abort();
+                pReset->clear();
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                resetStopped = loader.isFinished() && loader.LoadNext(batch) == 0 && pReset->KeyFramesInMap() == 0;
+            }
+        }
+        std::cout << "    map file reset while loading: " << (resetStopped ? "stopped" : "NOT STOPPED") << std::endl;
+        delete pReset;
+        std::remove(mapFilename.c_str());
+
+        if (!same || !sameNative || !sameProgressive || !resetStopped)
+            return 1;
+    }
+    return 0;
+}
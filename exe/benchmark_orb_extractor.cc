@@ -0,0 +1,183 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include "ORBextractor.h"
+#include "TaskPool.h"
+#include "FASTDetector.h"
+
+#include "include/Auxiliary.h"
+
+// Counts every heap allocation of the process, used to check that the extractor
+// does not allocate in steady state
+static std::atomic<size_t> allocationCount(0);
+
+void *operator new(std::size_t size) {
+    allocationCount++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag MatAccessFlags;
+#else
+typedef int MatAccessFlags;
+#endif
+
+// cv::Mat buffers come from cv::fastMalloc and bypass operator new, they are counted through
+// the default Mat allocator instead
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    explicit CountingMatAllocator(cv::MatAllocator *base) : base(base) {}
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, MatAccessFlags flags,
+                           cv::UMatUsageFlags usageFlags) const override {
+        cv::UMatData *u = base->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        if (u) {
+            if (!data)
+                allocationCount++;
+            u->currAllocator = this;
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData *data, MatAccessFlags flags, cv::UMatUsageFlags usageFlags) const override {
+        return base->allocate(data, flags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *data) const override {
+        base->deallocate(data);
+    }
+
+private:
+    cv::MatAllocator *base;
+};
+
+bool sameFeatures(const std::vector<cv::KeyPoint> &keypoints1, const cv::Mat &descriptors1,
+                  const std::vector<cv::KeyPoint> &keypoints2, const cv::Mat &descriptors2) {
+    if (keypoints1.size() != keypoints2.size() || descriptors1.size() != descriptors2.size())
+        return false;
+    for (size_t i = 0; i < keypoints1.size(); i++) {
+        if (keypoints1[i].pt != keypoints2[i].pt || keypoints1[i].octave != keypoints2[i].octave ||
+            keypoints1[i].angle != keypoints2[i].angle || keypoints1[i].response != keypoints2[i].response)
+            return false;
+    }
+    return descriptors1.empty() || cv::norm(descriptors1, descriptors2, cv::NORM_HAMMING) == 0;
+}
+
+// Compares FASTScoreRow against cv::FAST without non-maximum suppression on the whole image
+bool sameFASTCorners(const cv::Mat &img, int threshold) {
+    std::vector<cv::KeyPoint> cvCorners;
+    cv::FAST(img, cvCorners, threshold, false);
+
+    std::vector<unsigned char> scores(img.cols);
+    std::vector<int> corners(img.cols);
+    size_t n = 0;
+    for (int y = 3; y < img.rows - 3; y++) {
+        int nRow = ORB_SLAM2::FASTScoreRow(img.ptr<uchar>(y), (int) img.step, 3, img.cols - 3, threshold,
+                                           scores.data(), corners.data());
+        for (int k = 0; k < nRow; k++, n++) {
+            if (n >= cvCorners.size() || cvCorners[n].pt != cv::Point2f(corners[k], y))
+                return false;
+        }
+    }
+    return n == cvCorners.size();
+}
+
+/**
+ * @brief Times ORBextractor on one image for 1 to 16 threads and checks that the
+ * multi-threaded output is identical to the single threaded one. Also counts the heap
+ * allocations per frame once the extractor buffers are warm, operator new and cv::Mat buffers.
+ * Returns nonzero if a warm frame allocates or FAST or a thread count gives different features.
+ * @param argv argv[1]=grayscale image, argv[2]=iterations per thread count (default 50)
+ */
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "usage: benchmark_orb_extractor <image> [iterations]" << std::endl;
+        return 1;
+    }
+    int iterations = argc > 2 ? std::stoi(argv[2]) : 50;
+
+    std::string settingPath = Auxiliary::GetGeneralSettingsPath();
+    std::ifstream programData(settingPath);
+    nlohmann::json data;
+    programData >> data;
+    programData.close();
+
+    std::string droneYamlPathSlam = data["DroneYamlPathSlam"];
+    cv::FileStorage fSettings(droneYamlPathSlam, cv::FileStorage::READ);
+    int nFeatures = fSettings["ORBextractor.nFeatures"];
+    float fScaleFactor = fSettings["ORBextractor.scaleFactor"];
+    int nLevels = fSettings["ORBextractor.nLevels"];
+    int fIniThFAST = fSettings["ORBextractor.iniThFAST"];
+    int fMinThFAST = fSettings["ORBextractor.minThFAST"];
+
+    cv::Mat img = cv::imread(argv[1], cv::IMREAD_GRAYSCALE);
+    if (img.empty()) {
+        std::cerr << "Cannot open image: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    bool sameFAST = sameFASTCorners(img, fIniThFAST) && sameFASTCorners(img, fMinThFAST);
+    std::cout << "FAST matches cv::FAST: " << (sameFAST ? "yes" : "NO") << std::endl;
+
+    CountingMatAllocator matAllocator(cv::Mat::getStdAllocator());
+    cv::Mat::setDefaultAllocator(&matAllocator);
+
+    ORB_SLAM2::ORBextractor extractor(nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST);
+
+    std::vector<cv::KeyPoint> referenceKeypoints;
+    cv::Mat referenceDescriptors;
+    extractor(img, cv::Mat(), referenceKeypoints, referenceDescriptors);
+
+    double singleThreadMs = 0;
+    bool ok = sameFAST;
+    std::cout << "threads,ms_per_frame,speedup,identical,allocations_per_frame" << std::endl;
+    for (int nThreads = 1; nThreads <= 16; nThreads++) {
+        std::unique_ptr<ORB_SLAM2::TaskPool> pool(nThreads > 1 ? new ORB_SLAM2::TaskPool(nThreads) : nullptr);
+        extractor.SetTaskPool(pool.get());
+
+        std::vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+        extractor(img, cv::Mat(), keypoints, descriptors);
+        bool identical = sameFeatures(referenceKeypoints, referenceDescriptors, keypoints, descriptors);
+
+        size_t allocationsBefore = allocationCount;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            extractor(img, cv::Mat(), keypoints, descriptors);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double allocations = double(allocationCount - allocationsBefore) / iterations;
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+        if (nThreads == 1)
+            singleThreadMs = ms;
+
+        std::cout << nThreads << "," << ms << "," << singleThreadMs / ms << "," << (identical ? "yes" : "NO") << ","
+                  << allocations << std::endl;
+        ok = ok && identical && allocations == 0;
+    }
+    extractor.SetTaskPool(NULL);
+    cv::Mat::setDefaultAllocator(NULL);
+
+    if (!ok)
+        std::cerr << "FAILED: FAST or a thread count gave different features, or a warm frame allocated" << std::endl;
+    return ok ? 0 : 1;
+}
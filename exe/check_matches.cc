@@ -1,16 +1,30 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #include <filesystem>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/features2d.hpp>
 #include "System.h"
+#include "Converter.h"
 #include "ORBextractor.h"
 #include "ORBmatcher.h"
 
 #include "include/Auxiliary.h"
 
+struct TextureMatches {
+  std::string path;
+  cv::Mat image;
+  std::vector<cv::KeyPoint> keypoints;
+  cv::Mat descriptors;
+  // Retrieved keyframes with the ratio-test matches against each of them
+  std::vector<ORB_SLAM2::KeyFrame*> keyframes;
+  std::vector<std::vector<cv::DMatch>> matches;
+};
+
 int main(int argc, char **argv)
 {
   std::string settingPath = Auxiliary::GetGeneralSettingsPath();
@@ -23,19 +37,21 @@ int main(int argc, char **argv)
   std::string droneYamlPathSlam = data["DroneYamlPathSlam"];
   std::string map_input_dir = data["mapInputDir"];
   std::string frames_folder = data["framesFolder"];
-
-  // Load ORB_SLAM2 map and extract its descriptors
+  std::string output_dir = data["framesOutput"];
+  // When useBoW is false every texture is matched against every keyframe (the old brute force behaviour)
+  bool use_bow = data["checkMatchesUseBoW"];
+  int top_k = data["checkMatchesTopK"];
+  int n_threads = data["checkMatchesThreads"];
+  if (n_threads <= 0)
+      n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  // Load ORB_SLAM2 map, the keyframe database is filled from it while loading
   ORB_SLAM2::System system(vocPath, droneYamlPathSlam, ORB_SLAM2::System::MONOCULAR, true, true, map_input_dir + "simulatorMap.bin", true, false);
-  std::vector<cv::Mat> orb_slam_kf_descriptors_vector;
-  std::vector<std::vector<cv::KeyPoint>> orb_slam_kf_keypoints_vector;
-  std::vector<cv::Mat> orb_slam_kf_image_vector;
-  for (auto& KF : system.GetMap()->GetAllKeyFrames()) {
-      if (KF->image.empty())
-          continue;
-      orb_slam_kf_image_vector.emplace_back(KF->image);
-      orb_slam_kf_descriptors_vector.emplace_back(KF->mDescriptors);
-      orb_slam_kf_keypoints_vector.emplace_back(KF->mvKeys);
-  }
+  ORB_SLAM2::ORBVocabulary* vocabulary = system.GetVocabulary();
+  ORB_SLAM2::KeyFrameDatabase* keyframe_database = system.GetKeyFrameDatabase();
+
+  std::vector<ORB_SLAM2::KeyFrame*> all_keyframes = system.GetMap()->GetAllKeyFrames();
+  std::sort(all_keyframes.begin(), all_keyframes.end(), ORB_SLAM2::KeyFrame::lId);
 
   cv::FileStorage fSettings(droneYamlPathSlam, cv::FileStorage::READ);
   int nFeatures = fSettings["ORBextractor.nFeatures"];
@@ -44,103 +60,104 @@ int main(int argc, char **argv)
   int fIniThFAST = fSettings["ORBextractor.iniThFAST"];
   int fMinThFAST = fSettings["ORBextractor.minThFAST"];
 
-  ORB_SLAM2::ORBextractor* mpORBextractorLeft = new ORB_SLAM2::ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
-
-  // Set up ORB feature detector and matcher
-  // cv::Ptr<cv::ORB> orb = cv::ORB::create(1000, 1.2, 8);
-  cv::BFMatcher matcher(cv::NORM_HAMMING, false);
-
-  // Process images in the input folder and find the one that matches the most
-  std::string input_folder_path = frames_folder;
-    std::vector<std::string> image_paths;
-    std::vector<cv::Mat> images;
-  std::vector<std::vector<cv::KeyPoint>> keypoints_images;
-  std::vector<cv::Mat> descriptors_images;
-    std::vector<std::vector<std::vector<cv::DMatch>>> scores;
-    std::vector<std::vector<std::vector<std::vector<cv::DMatch>>>> all_matches;
   std::vector<std::string> textures;
-  for (const auto& entry : std::filesystem::directory_iterator(input_folder_path)) {
+  for (const auto& entry : std::filesystem::directory_iterator(frames_folder)) {
       textures.emplace_back(entry.path().string());
   }
-  for (int i = 0; i < textures.size(); i++) {
-    // Load image
-    std::cout << textures[i] << std::endl;
-    cv::Mat img = cv::imread(textures[i], cv::IMREAD_GRAYSCALE);
-
-    // Extract ORB keypoints and descriptors from the image
-    std::vector<cv::KeyPoint> keypoints;
-    cv::Mat descriptors;
-    (*mpORBextractorLeft)(img,cv::Mat(),keypoints, descriptors);
-    // orb->detectAndCompute(img, cv::Mat(), keypoints, descriptors);
-
-    keypoints_images.emplace_back(keypoints);
-    image_paths.push_back(textures[i]);
-    images.push_back(img);
-    descriptors_images.push_back(descriptors);
-
-    scores.emplace_back();
-    all_matches.emplace_back();
-    for (int j = 0; j < orb_slam_kf_descriptors_vector.size(); j++)
-    {
-        // Match descriptors with the map
-        std::vector<std::vector<cv::DMatch>> matches;
-        matcher.knnMatch(descriptors, orb_slam_kf_descriptors_vector[i], matches, 2);
-
-        // Find good matches
-        std::vector<cv::DMatch> good_matches;
-        for (auto& match: matches) {
-            if (match[0].distance < 0.7 * match[1].distance) {
-                good_matches.push_back(match[0]);
-            }
-        }
-
-        all_matches[i].emplace_back(std::vector<std::vector<cv::DMatch>>{good_matches});
-
-        // Save the image path and descriptors
-        scores[i].push_back(good_matches);
-    }
+  std::sort(textures.begin(), textures.end());
+
+  // Every worker owns its extractor and matcher, textures are handed out through a shared counter
+  std::vector<TextureMatches> results(textures.size());
+  std::atomic<size_t> next_texture(0);
+  auto worker = [&]() {
+      ORB_SLAM2::ORBextractor extractor(nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST);
+      cv::BFMatcher matcher(cv::NORM_HAMMING, false);
+
+      for (size_t i = next_texture++; i < textures.size(); i = next_texture++) {
+          TextureMatches& result = results[i];
+          result.path = textures[i];
+          result.image = cv::imread(textures[i], cv::IMREAD_GRAYSCALE);
+          if (result.image.empty())
+              continue;
+
+          extractor(result.image, cv::Mat(), result.keypoints, result.descriptors);
+          if (result.descriptors.empty())
+              continue;
+
+          if (use_bow) {
+              DBoW2::BowVector bow_vector;
+              DBoW2::FeatureVector feature_vector;
+              vocabulary->transform(ORB_SLAM2::Converter::toDescriptorVector(result.descriptors), bow_vector, feature_vector, 4);
+              for (auto& candidate : keyframe_database->DetectBestCandidates(bow_vector, top_k)) {
+                  result.keyframes.push_back(candidate.second);
+              }
+          } else {
+              result.keyframes = all_keyframes;
+          }
+
+          for (auto& KF : result.keyframes) {
+              // Find good matches
+              std::vector<std::vector<cv::DMatch>> matches;
+              std::vector<cv::DMatch> good_matches;
+              ORB_SLAM2::KeyFramePayloadPin pin(KF);
+              if (!KF->mDescriptors.empty())
+                  matcher.knnMatch(result.descriptors, KF->mDescriptors.AsMat(), matches, 2);
+              for (auto& match: matches) {
+                  if (match.size() == 2 && match[0].distance < 0.7 * match[1].distance) {
+                      good_matches.push_back(match[0]);
+                  }
+              }
+              result.matches.emplace_back(good_matches);
+          }
+          std::cout << result.path << ": " << result.keyframes.size() << " candidate keyframes" << std::endl;
+      }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < n_threads; t++) {
+      workers.emplace_back(worker);
+  }
+  for (auto& t : workers) {
+      t.join();
   }
 
-  // Find the image with the highest similarity score
-  int best_index_i = 0;
-  int best_index_j = 0;
-  int best_score = 0;
-  for (int i = 0; i < image_paths.size(); ++i) {
-      for (int j = 0; j < orb_slam_kf_descriptors_vector.size(); j++)
+  // Find the texture and keyframe with the most matches
+  int best_index_i = -1;
+  int best_index_j = -1;
+  size_t best_score = 0;
+  for (int i = 0; i < results.size(); ++i) {
+      for (int j = 0; j < results[i].matches.size(); j++)
       {
-          if (scores[i][j].size() > best_score) {
+          if (results[i].matches[j].size() > best_score) {
               best_index_i = i;
               best_index_j = j;
-              best_score = scores[i][j].size();
+              best_score = results[i].matches[j].size();
           }
       }
   }
 
-  std::cout << "Best Image: " << image_paths[best_index_i] << " with keyframe:" << best_index_j << ", Score: " << best_score << std::endl;
-
-  std::cout << "image_paths size: " << image_paths.size() << std::endl;
-  std::cout << "keypoints_images size: " << keypoints_images.size() << std::endl;
-  std::cout << "orb_slam_kf_image_vector size: " << orb_slam_kf_image_vector.size() << std::endl;
-  std::cout << "orb_slam_kf_keypoints_vector size: " << orb_slam_kf_keypoints_vector.size() << std::endl;
-  std::cout << "all_matches size: " << all_matches.size() << std::endl;
-  std::cout << "all_matches[best_index_i] size: " << all_matches[best_index_i].size() << std::endl;
-  std::cout << "all_matches[best_index_i][best_index_j] size: " << all_matches[best_index_i][best_index_j].size() << std::endl;
-
-  if (image_paths.empty() || keypoints_images.empty() || orb_slam_kf_image_vector.empty() || orb_slam_kf_keypoints_vector.empty() || all_matches.empty() || all_matches[best_index_i].empty() || all_matches[best_index_i][best_index_j].empty()) {
-      std::cerr << "Error: empty vectors" << std::endl;
+  if (best_index_i < 0) {
+      std::cerr << "Error: no texture matched any keyframe" << std::endl;
       return -1;
   }
 
-  cv::Mat final_image;
-  cv::drawMatches(images[best_index_i], keypoints_images[best_index_i], orb_slam_kf_image_vector[best_index_j], orb_slam_kf_keypoints_vector[best_index_j], all_matches[best_index_i][best_index_j], final_image);
-  cv::imwrite("/home/liam/Downloads/a/best_matching_texture" + std::to_string(best_index_i) + "_frame" + std::to_string(best_index_j) + ".png", final_image);
+  ORB_SLAM2::KeyFrame* best_keyframe = results[best_index_i].keyframes[best_index_j];
+  std::cout << "Best Image: " << results[best_index_i].path << " with keyframe:" << best_keyframe->mnId << ", Score: " << best_score << std::endl;
 
-  for (int i = 0; i < images.size(); i++)
+  cv::Mat final_image;
+  for (int i = 0; i < results.size(); i++)
   {
-      for (int j=0; j < orb_slam_kf_image_vector.size(); j++)
+      for (int j = 0; j < results[i].keyframes.size(); j++)
       {
-          cv::drawMatches(images[i], keypoints_images[i], orb_slam_kf_image_vector[j], orb_slam_kf_keypoints_vector[j], all_matches[i][j], final_image);
-          cv::imwrite("/home/liam/Downloads/a/matching_texture" + std::to_string(i) + "_frame" + std::to_string(j) + ".png", final_image);
+          ORB_SLAM2::KeyFrame* KF = results[i].keyframes[j];
+          cv::Mat keyFrameImage = KF->GetImage();
+          if (keyFrameImage.empty())
+              continue;
+
+          ORB_SLAM2::KeyFramePayloadPin pin(KF);
+          cv::drawMatches(results[i].image, results[i].keypoints, keyFrameImage, KF->mvKeys, results[i].matches[j], final_image);
+          std::string prefix = (i == best_index_i && j == best_index_j) ? "best_matching_texture" : "matching_texture";
+          cv::imwrite(output_dir + prefix + std::to_string(i) + "_frame" + std::to_string(KF->mnId) + ".png", final_image);
       }
   }
 
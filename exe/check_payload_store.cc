@@ -0,0 +1,134 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <opencv2/core/core.hpp>
+
+#include "Map.h"
+#include "KeyFrame.h"
+#include "Frame.h"
+#include "MapFile.h"
+#include "KeyFramePayloadStore.h"
+
+static const int keysPerKeyFrame = 256;
+
+// Synthetic keyframe k: keypoints, descriptors and grid cells all depend on k and the keypoint
+ORB_SLAM2::KeyFrame *createKeyFrame(int k, ORB_SLAM2::Map *pMap) {
+    ORB_SLAM2::Frame F;
+    F.fx = F.fy = 500;
+    F.cx = 320;
+    F.cy = 240;
+    F.invfx = F.invfy = 1.0f / 500;
+    F.mbf = F.mb = F.mThDepth = 0;
+    F.N = keysPerKeyFrame;
+    F.mnScaleLevels = 8;
+    F.mfScaleFactor = 1.2f;
+    F.mfLogScaleFactor = std::log(1.2f);
+    F.mvScaleFactors = F.mvLevelSigma2 = F.mvInvLevelSigma2 = std::vector<float>(8, 1.0f);
+    F.mK = cv::Mat::eye(3, 3, CV_32F);
+    F.mpORBvocabulary = NULL;
+    F.mnId = k;
+    F.mTimeStamp = k * 0.1;
+    F.mTcw = cv::Mat::eye(4, 4, CV_32F);
+
+    cv::Mat descriptors(keysPerKeyFrame, 32, CV_8U);
+    std::vector<int> cells(keysPerKeyFrame);
+    for (int i = 0; i < keysPerKeyFrame; i++) {
+        F.mvKeys.emplace_back(cv::Point2f((float) ((7 * i + k) % 640), 1.75f * i), 31.0f, (float) ((i * 13 + k) % 360),
+                              1.0f / (i + 1), (i + k) % 8);
+        for (int b = 0; b < 32; b++)
+            descriptors.at<unsigned char>(i, b) = (unsigned char) (i * 31 + b * 7 + k * 3);
+        cells[i] = (i * 5 + k) % (FRAME_GRID_COLS * FRAME_GRID_ROWS);
+    }
+    F.mvKeysUn = F.mvKeys;
+    F.mvuRight = F.mvDepth = std::vector<float>(keysPerKeyFrame, -1);
+    F.mDescriptors.Assign(descriptors);
+    F.mvpMapPoints = std::vector<ORB_SLAM2::MapPoint *>(keysPerKeyFrame, static_cast<ORB_SLAM2::MapPoint *>(NULL));
+    F.mGrid.Build(FRAME_GRID_COLS, FRAME_GRID_ROWS, cells);
+    return new ORB_SLAM2::KeyFrame(F, pMap, NULL);
+}
+
+// Waits until every keyframe is paged out, false after a few seconds
+bool waitPagedOut(ORB_SLAM2::KeyFramePayloadStore &store, size_t n) {
+    auto t0 = std::chrono::steady_clock::now();
+    while (store.GetPagedOutCount() < n) {
+        if (std::chrono::steady_clock::now() - t0 > std::chrono::seconds(10))
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+/**
+ * @brief Checks the keyframe payload store: under a budget of one byte every keyframe is paged out,
+ * and pinning one again from several threads at once restores keypoints, descriptors and feature
+ * grid identical to those it was built with (compared through the map journal keyframe bytes).
+ * Returns nonzero on any difference.
+ * @param argv argv[1]=number of keyframes (default 500), argv[2]=number of pinning threads (default 4)
+ */
+int main(int argc, char **argv) {
+    const int nKeyFrames = argc > 1 ? std::stoi(argv[1]) : 500;
+    const int nThreads = argc > 2 ? std::stoi(argv[2]) : 4;
+
+    auto *pMap = new ORB_SLAM2::Map();
+    std::vector<ORB_SLAM2::KeyFrame *> keyFrames;
+    std::vector<std::vector<char>> saved(nKeyFrames);
+    for (int k = 0; k < nKeyFrames; k++) {
+        keyFrames.push_back(createKeyFrame(k, pMap));
+        pMap->AddKeyFrame(keyFrames.back());
+        ORB_SLAM2::MapFile::AppendKeyFrame(keyFrames.back(), saved[k]);
+    }
+
+    const std::string storeFilename = "check_payload_store.bin";
+    bool ok;
+    {
+        ORB_SLAM2::KeyFramePayloadStore store(storeFilename, 1);
+        if (!store.IsOpen())
+            return 1;
+        pMap->SetPayloadStore(&store);
+
+        auto t0 = std::chrono::steady_clock::now();
+        bool evicted = waitPagedOut(store, nKeyFrames);
+        auto t1 = std::chrono::steady_clock::now();
+        for (int k = 0; evicted && k < nKeyFrames; k++)
+            evicted = keyFrames[k]->mvKeys.empty() && keyFrames[k]->mDescriptors.empty();
+        std::cout << nKeyFrames << " keyframes " << (evicted ? "paged out" : "NOT PAGED OUT") << " in "
+                  << std::chrono::duration<double>(t1 - t0).count() << " s" << std::endl;
+
+        // Every thread pins all keyframes, each from its own starting point, while the store keeps
+        // evicting the unpinned ones
+        std::atomic<int> differences(0);
+        std::vector<std::thread> threads;
+        t0 = std::chrono::steady_clock::now();
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back([&, t]() {
+                std::vector<char> bytes;
+                for (int i = 0; i < nKeyFrames; i++) {
+                    const int k = (i + t * nKeyFrames / nThreads) % nKeyFrames;
+                    bytes.clear();
+                    ORB_SLAM2::MapFile::AppendKeyFrame(keyFrames[k], bytes);
+                    if (bytes != saved[k])
+                        differences++;
+                }
+            });
+        }
+        for (auto &thread: threads)
+            thread.join();
+        t1 = std::chrono::steady_clock::now();
+        bool evictedAgain = waitPagedOut(store, nKeyFrames);
+        std::cout << nThreads << " threads pinned every keyframe in " << std::chrono::duration<double>(t1 - t0).count()
+                  << " s: " << differences << " differences, "
+                  << (evictedAgain ? "paged out again" : "NOT PAGED OUT AGAIN") << std::endl;
+
+        ok = evicted && differences == 0 && evictedAgain;
+        pMap->clear();
+        pMap->SetPayloadStore(static_cast<ORB_SLAM2::KeyFramePayloadStore *>(NULL));
+    }
+    delete pMap;
+    std::remove(storeFilename.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <boost/archive/text_oarchive.hpp>
+#include <opencv2/core/core.hpp>
+
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "Frame.h"
+#include "Serialization.h"
+#include "RaspberryMapFile.h"
+#include "RaspberryMapView.h"
+
+// Keypoints of every synthetic keyframe. The first half observe map points, each seen by
+// observationsPerPoint consecutive keyframes, the second half none (as most ORB features).
+static const int keysPerKeyFrame = 128;
+static const int matchedPerKeyFrame = 64;
+static const int observationsPerPoint = 4;
+
+/**
+ * @brief Synthetic map of a camera moving along x, with subpixel keypoints and one map point far
+ * away from the others (observed by the last keyframe).
+ */
+ORB_SLAM2::Map *createMap(int nKeyFrames) {
+    auto *pMap = new ORB_SLAM2::Map();
+
+    ORB_SLAM2::Frame F;
+    F.fx = F.fy = 500;
+    F.cx = 320;
+    F.cy = 240;
+    F.invfx = F.invfy = 1.0f / 500;
+    F.mbf = F.mb = F.mThDepth = 0;
+    F.N = keysPerKeyFrame;
+    F.mnScaleLevels = 8;
+    F.mfScaleFactor = 1.2f;
+    F.mfLogScaleFactor = std::log(1.2f);
+    F.mvScaleFactors = F.mvLevelSigma2 = F.mvInvLevelSigma2 = std::vector<float>(8, 1.0f);
+    F.mK = cv::Mat::eye(3, 3, CV_32F);
+    F.mpORBvocabulary = NULL;
+    cv::Mat descriptors(keysPerKeyFrame, 32, CV_8U);
+    std::vector<int> cells(keysPerKeyFrame);
+    for (int i = 0; i < keysPerKeyFrame; i++) {
+        F.mvKeys.emplace_back(cv::Point2f(4.97f * i + 0.123f, 3.71f * i + 0.456f), 31.0f, -1, 0, i % 8);
+        for (int b = 0; b < 32; b++)
+            descriptors.at<unsigned char>(i, b) = (unsigned char) (i * 31 + b * 7);
+        cells[i] = i % (FRAME_GRID_COLS * FRAME_GRID_ROWS);
+    }
+    F.mvKeysUn = F.mvKeys;
+    for (auto &keyUn: F.mvKeysUn)
+        keyUn.pt = cv::Point2f(keyUn.pt.x - F.cx, keyUn.pt.y - F.cy);
+    F.mvuRight = F.mvDepth = std::vector<float>(keysPerKeyFrame, -1);
+    F.mDescriptors.Assign(descriptors);
+    F.mvpMapPoints = std::vector<ORB_SLAM2::MapPoint *>(keysPerKeyFrame, static_cast<ORB_SLAM2::MapPoint *>(NULL));
+    F.mGrid.Build(FRAME_GRID_COLS, FRAME_GRID_ROWS, cells);
+
+    const int newPointsPerKeyFrame = matchedPerKeyFrame / observationsPerPoint;
+    std::vector<ORB_SLAM2::KeyFrame *> keyFrames;
+    for (int k = 0; k < nKeyFrames; k++) {
+        F.mnId = k;
+        F.mTimeStamp = k * 0.1;
+        F.mTcw = cv::Mat::eye(4, 4, CV_32F);
+        F.mTcw.at<float>(0, 3) = -0.1f * k;
+        auto *pKF = new ORB_SLAM2::KeyFrame(F, pMap, NULL);
+        keyFrames.push_back(pKF);
+        pMap->AddKeyFrame(pKF);
+
+        for (int s = 0; s < matchedPerKeyFrame; s++) {
+            int age = s / newPointsPerKeyFrame;
+            if (age > k)
+                continue;
+            ORB_SLAM2::MapPoint *pMP;
+            if (age == 0) {
+                cv::Mat pos = (cv::Mat_<float>(3, 1) << 0.1f * k + 0.0123f * s, 0.05f * s - 1.0f, 5.0f + 0.01f * s);
+                pMP = new ORB_SLAM2::MapPoint(pos, pKF, pMap);
+                pMap->AddMapPoint(pMP);
+            } else {
+                pMP = keyFrames[k - age]->GetMapPoint(s % newPointsPerKeyFrame);
+            }
+            pMP->AddObservation(pKF, s);
+            pKF->AddMapPoint(pMP, s);
+        }
+    }
+
+    ORB_SLAM2::KeyFrame *pLast = keyFrames.back();
+    cv::Mat far = (cv::Mat_<float>(3, 1) << 5000.0f, -3000.0f, 8000.0f);
+    auto *pOutlier = new ORB_SLAM2::MapPoint(far, pLast, pMap);
+    pMap->AddMapPoint(pOutlier);
+    pOutlier->AddObservation(pLast, keysPerKeyFrame - 1);
+    pLast->AddMapPoint(pOutlier, keysPerKeyFrame - 1);
+    return pMap;
+}
+
+// Bytes of the boost text archive KeyFrame::rpi_save wrote for a keyframe before the Raspberry map
+// files (RaspberryKeyFrame): every keypoint with its 3D point, zero if it had none
+size_t oldArchiveSize(ORB_SLAM2::KeyFrame *pKF) {
+    std::vector<cv::Point2f> keys, keysUn;
+    std::vector<int> octaves;
+    std::vector<cv::Point3f> points;
+    const std::vector<ORB_SLAM2::MapPoint *> matches = pKF->GetMapPointMatches();
+    for (size_t i = 0; i < pKF->mvKeys.size(); i++) {
+        keys.push_back(pKF->mvKeys[i].pt);
+        keysUn.push_back(pKF->mvKeysUn[i].pt);
+        octaves.push_back(pKF->mvKeysUn[i].octave);
+        if (matches[i] && !matches[i]->isBad()) {
+            cv::Mat pos = matches[i]->GetWorldPos();
+            points.emplace_back(pos.at<float>(0), pos.at<float>(1), pos.at<float>(2));
+        } else {
+            points.emplace_back(0, 0, 0);
+        }
+    }
+    cv::Mat Tcw = pKF->GetPose();
+    cv::Mat R = Tcw.rowRange(0, 3).colRange(0, 3).clone();
+    cv::Mat t = Tcw.rowRange(0, 3).col(3).clone();
+    cv::Mat descriptors = pKF->mDescriptors.AsMat().clone();
+
+    std::ostringstream os;
+    {
+        boost::archive::text_oarchive oa(os);
+        oa << descriptors << keys << keysUn << octaves << points << R << t;
+        oa << pKF->fx << pKF->fy << pKF->cx << pKF->cy << pKF->invfx << pKF->invfy;
+    }
+    return os.str().size();
+}
+
+/**
+ * @brief Checks the Raspberry map files: writes a synthetic map, reopens it with RaspberryMapView
+ * and fails unless the map point positions and keypoints are within half a quantization step (the
+ * one far outlier clamped, without coarsening the others), the observations and ids trace back to
+ * the map, a corrupted copy is rejected by its checksum, and the file is at least 5 times smaller
+ * than the boost text archives of the keyframes it replaces.
+ * @param argv argv[1]=number of keyframes (default 200)
+ */
+int main(int argc, char **argv) {
+    const int nKeyFrames = argc > 1 ? std::stoi(argv[1]) : 200;
+    ORB_SLAM2::Map *pMap = createMap(nKeyFrames);
+    const std::string filename = "check_raspberry_map.rpm";
+    const std::string corruptFilename = "check_raspberry_map_corrupt.rpm";
+
+    std::vector<ORB_SLAM2::KeyFrame *> keyFrames = pMap->GetAllKeyFrames();
+    std::sort(keyFrames.begin(), keyFrames.end(), ORB_SLAM2::KeyFrame::lId);
+    std::vector<ORB_SLAM2::MapPoint *> mapPoints = pMap->GetAllMapPoints();
+    std::sort(mapPoints.begin(), mapPoints.end(),
+              [](ORB_SLAM2::MapPoint *p1, ORB_SLAM2::MapPoint *p2) { return p1->mnId < p2->mnId; });
+
+    ORB_SLAM2::RaspberryMapView view;
+    if (!ORB_SLAM2::RaspberryMapFile::Save(pMap, filename) || !view.Open(filename)) {
+        std::cerr << "Failed to write or reopen " << filename << std::endl;
+        return 1;
+    }
+    const ORB_SLAM2::RaspberryMapHeader &header = view.Header();
+
+    // Ids and counts
+    std::vector<uint64_t> kfIds, mpIds;
+    bool idsOk = view.ReadIds(kfIds, mpIds) && kfIds.size() == keyFrames.size() && mpIds.size() == mapPoints.size();
+    for (size_t i = 0; idsOk && i < keyFrames.size(); i++)
+        idsOk = kfIds[i] == keyFrames[i]->mnId;
+    for (size_t i = 0; idsOk && i < mapPoints.size(); i++)
+        idsOk = mpIds[i] == mapPoints[i]->mnId;
+
+    // Positions within half a step, except the outlier (the last map point) which is clamped. The
+    // step must stay about that of the map without the outlier.
+    float minPos[3] = {1e9f, 1e9f, 1e9f}, maxPos[3] = {-1e9f, -1e9f, -1e9f};
+    for (size_t i = 0; i + 1 < mapPoints.size(); i++) {
+        cv::Mat world = mapPoints[i]->GetWorldPos();
+        for (int j = 0; j < 3; j++) {
+            minPos[j] = std::min(minPos[j], world.at<float>(j));
+            maxPos[j] = std::max(maxPos[j], world.at<float>(j));
+        }
+    }
+    const float inlierHalfExtent = 0.5f * std::max({maxPos[0] - minPos[0], maxPos[1] - minPos[1], maxPos[2] - minPos[2]});
+    const float pointBound = 0.5f * header.pointScale * 1.001f;
+    float maxPointError = 0;
+    int clamped = 0;
+    for (size_t i = 0; idsOk && i < mapPoints.size(); i++) {
+        float pos[3];
+        view.Position(i, pos);
+        cv::Mat world = mapPoints[i]->GetWorldPos();
+        float error = 0;
+        for (int j = 0; j < 3; j++)
+            error = std::max(error, std::fabs(pos[j] - world.at<float>(j)) - 1e-6f * std::fabs(world.at<float>(j)));
+        if (error > pointBound)
+            clamped++;
+        else
+            maxPointError = std::max(maxPointError, error);
+    }
+    const bool pointsOk = idsOk && clamped == 1 && header.pointScale * 32767 <= 2 * inlierHalfExtent;
+
+    // Observations in keypoint order, keypoints within half a step
+    const float keyBound = 0.5f * header.keyPointScale * 1.001f;
+    float maxKeyError = 0;
+    bool observationsOk = idsOk;
+    const ORB_SLAM2::RaspberryMapKeyFrame *records = view.KeyFrames();
+    const ORB_SLAM2::RaspberryMapObservation *observations = view.Observations();
+    for (size_t i = 0; observationsOk && i < keyFrames.size(); i++) {
+        ORB_SLAM2::KeyFrame *pKF = keyFrames[i];
+        const std::vector<ORB_SLAM2::MapPoint *> matches = pKF->GetMapPointMatches();
+        uint32_t o = records[i].observationBegin;
+        for (size_t k = 0; observationsOk && k < matches.size(); k++) {
+            if (!matches[k])
+                continue;
+            observationsOk = o < records[i].observationBegin + records[i].nObservations &&
+                             mpIds[observations[o].mapPoint] == matches[k]->mnId &&
+                             observations[o].octave == pKF->mvKeysUn[k].octave;
+            if (!observationsOk)
+                break;
+            float x, y, ux, uy;
+            view.KeyPoint(observations[o], x, y);
+            view.KeyPointUn(observations[o], ux, uy);
+            maxKeyError = std::max({maxKeyError, std::fabs(x - pKF->mvKeys[k].pt.x), std::fabs(y - pKF->mvKeys[k].pt.y),
+                                    std::fabs(ux - pKF->mvKeysUn[k].pt.x), std::fabs(uy - pKF->mvKeysUn[k].pt.y)});
+            o++;
+        }
+        observationsOk = observationsOk && o == records[i].observationBegin + records[i].nObservations;
+    }
+    observationsOk = observationsOk && maxKeyError <= keyBound;
+
+    // A flipped bit in the map point positions must be caught by the checksum
+    std::vector<char> bytes(header.fileSize);
+    {
+        std::ifstream f(filename, std::ios::binary);
+        f.read(bytes.data(), bytes.size());
+    }
+    bytes[header.pointsOffset] ^= 1;
+    {
+        std::ofstream f(corruptFilename, std::ios::binary | std::ios::trunc);
+        f.write(bytes.data(), bytes.size());
+    }
+    ORB_SLAM2::RaspberryMapView corrupt;
+    const bool checksumOk = !corrupt.Open(corruptFilename);
+
+    size_t oldSize = 0;
+    for (auto *pKF: keyFrames)
+        oldSize += oldArchiveSize(pKF);
+    const double ratio = (double) oldSize / header.fileSize;
+    const bool sizeOk = ratio >= 5.0;
+
+    std::cout << header.nKeyFrames << " keyframes, " << header.nMapPoints << " map points, "
+              << header.nObservations << " observations: ids " << (idsOk ? "identical" : "DIFFERENT") << std::endl;
+    std::cout << "position step " << header.pointScale << ", max error " << maxPointError << ", " << clamped
+              << " clamped " << (pointsOk ? "(ok)" : "(FAILED)") << std::endl;
+    std::cout << "keypoint step " << header.keyPointScale << " px, max error " << maxKeyError << " px, observations "
+              << (observationsOk ? "identical" : "DIFFERENT") << std::endl;
+    std::cout << "corrupted copy " << (checksumOk ? "rejected" : "ACCEPTED") << std::endl;
+    std::cout << "file " << header.fileSize << " bytes, text archives " << oldSize << " bytes: " << ratio << "x"
+              << (sizeOk ? "" : " (FAILED, below 5x)") << std::endl;
+
+    view.Close();
+    std::remove(filename.c_str());
+    std::remove(corruptFilename.c_str());
+    pMap->clear();
+    delete pMap;
+    return idsOk && pointsOk && observationsOk && checksumOk && sizeOk ? 0 : 1;
+}
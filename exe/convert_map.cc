@@ -0,0 +1,100 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <boost/archive/binary_iarchive.hpp>
+
+#include "Map.h"
+#include "MapFile.h"
+#include "KeyFrame.h"
+#include "KeyFrameDatabase.h"
+#include "ORBVocabulary.h"
+#include "TaskPool.h"
+
+/**
+ * @brief Converts a map saved as a boost archive (.bin of older versions) to the native map file,
+ * then loads the new file back and checks that it holds the same keyframes and map points.
+ * With a vocabulary the BoW vectors and the keyframe database are stored too, so loading the
+ * map with that vocabulary does not recompute them.
+ * @param argv argv[1]=boost archive map, argv[2]=output map file, argv[3]=ORB vocabulary (optional)
+ */
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "usage: convert_map <archive map> <output map file> [vocabulary]" << std::endl;
+        return 1;
+    }
+    if (ORB_SLAM2::MapFile::IsMapFile(argv[1])) {
+        std::cerr << argv[1] << " is already a map file" << std::endl;
+        return 1;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    ORB_SLAM2::Map *pMap;
+    {
+        std::ifstream is(argv[1], std::ios::binary);
+        if (!is.is_open()) {
+            std::cerr << "Failed to open " << argv[1] << std::endl;
+            return 1;
+        }
+        boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+        ia >> pMap;
+    }
+    ORB_SLAM2::TaskPool pool(std::max(std::thread::hardware_concurrency(), 1u));
+    pMap->RestoreLinks(&pool);
+    auto t1 = std::chrono::steady_clock::now();
+
+    ORB_SLAM2::ORBVocabulary vocabulary;
+    ORB_SLAM2::KeyFrameDatabase *pKFDB = NULL;
+    if (argc > 3) {
+        std::string vocFile = argv[3];
+        bool bVocLoad = vocFile.size() > 4 && vocFile.compare(vocFile.size() - 4, 4, ".txt") == 0 ?
+                        vocabulary.loadFromTextFile(vocFile) : vocabulary.loadFromBinaryFile(vocFile);
+        if (!bVocLoad) {
+            std::cerr << "Failed to open vocabulary " << vocFile << std::endl;
+            return 1;
+        }
+        pKFDB = new ORB_SLAM2::KeyFrameDatabase(vocabulary);
+
+        std::vector<ORB_SLAM2::KeyFrame *> vpKFs = pMap->GetAllKeyFrames();
+        std::sort(vpKFs.begin(), vpKFs.end(), ORB_SLAM2::KeyFrame::lId);
+        for (ORB_SLAM2::KeyFrame *pKF : vpKFs)
+            pKF->SetORBvocabulary(&vocabulary);
+        pool.ParallelFor(vpKFs.size(), [&](int i) {
+            vpKFs[i]->ComputeBoW();
+        });
+        for (ORB_SLAM2::KeyFrame *pKF : vpKFs)
+            pKFDB->add(pKF);
+    }
+
+    if (!ORB_SLAM2::MapFile::Save(pMap, argv[2], pKFDB))
+        return 1;
+    auto t2 = std::chrono::steady_clock::now();
+
+    ORB_SLAM2::KeyFrameDatabase *pLoadedKFDB = pKFDB ? new ORB_SLAM2::KeyFrameDatabase(vocabulary) : NULL;
+    bool bBowLoaded = false;
+    ORB_SLAM2::Map *pLoaded = ORB_SLAM2::MapFile::Load(argv[2], pLoadedKFDB, &bBowLoaded);
+    auto t3 = std::chrono::steady_clock::now();
+    if (!pLoaded)
+        return 1;
+
+    bool same = pLoaded->KeyFramesInMap() == pMap->KeyFramesInMap() &&
+                pLoaded->MapPointsInMap() == pMap->MapPointsInMap() &&
+                pLoaded->GetMaxKFid() == pMap->GetMaxKFid() &&
+                (!pKFDB || bBowLoaded);
+    std::cout << pMap->KeyFramesInMap() << " keyframes, " << pMap->MapPointsInMap() << " map points" << std::endl;
+    std::cout << "archive load " << std::chrono::duration<double>(t1 - t0).count() << " s, save "
+              << std::chrono::duration<double>(t2 - t1).count() << " s, map file load "
+              << std::chrono::duration<double>(t3 - t2).count() << " s" << std::endl;
+    if (!same)
+        std::cerr << "The converted map differs from the archive" << std::endl;
+
+    pMap->clear();
+    delete pMap;
+    pLoaded->clear();
+    delete pLoaded;
+    delete pKFDB;
+    delete pLoadedKFDB;
+    return same ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <sys/stat.h>
+
+#include "Map.h"
+#include "MapFile.h"
+#include "KeyFrameDatabase.h"
+#include "ORBVocabulary.h"
+#include "RaspberryMapFile.h"
+
+/**
+ * @brief Builds the localization package of a map for the onboard localizer (tools/localizer): the
+ * Raspberry map file of the map with the BoW vectors of the keyframes and their inverted index.
+ * BoW vectors stored in the map file are reused when they were computed with this vocabulary.
+ * @param argv argv[1]=native map file, argv[2]=ORB vocabulary, argv[3]=output package
+ */
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        std::cerr << "usage: export_localization_package <map file> <vocabulary> <output package>" << std::endl;
+        return 1;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    ORB_SLAM2::ORBVocabulary vocabulary;
+    std::string vocFile = argv[2];
+    bool bVocLoad = vocFile.size() > 4 && vocFile.compare(vocFile.size() - 4, 4, ".txt") == 0 ?
+                    vocabulary.loadFromTextFile(vocFile) : vocabulary.loadFromBinaryFile(vocFile);
+    if (!bVocLoad) {
+        std::cerr << "Failed to open vocabulary " << vocFile << std::endl;
+        return 1;
+    }
+
+    ORB_SLAM2::KeyFrameDatabase keyFrameDatabase(vocabulary);
+    bool bBowLoaded = false;
+    ORB_SLAM2::Map *pMap = ORB_SLAM2::MapFile::Load(argv[1], &keyFrameDatabase, &bBowLoaded);
+    if (!pMap) {
+        std::cerr << "Failed to load " << argv[1] << std::endl;
+        return 1;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    bool bSaved = ORB_SLAM2::RaspberryMapFile::Save(pMap, argv[3], &vocabulary);
+    auto t2 = std::chrono::steady_clock::now();
+
+    ORB_SLAM2::RaspberryMapView view;
+    bool bValid = bSaved && view.Open(argv[3]);
+    if (bValid) {
+        const ORB_SLAM2::RaspberryMapHeader &header = view.Header();
+        struct stat mapStat;
+        stat(argv[1], &mapStat);
+        std::cout << header.nKeyFrames << " keyframes, " << header.nMapPoints << " map points, "
+                  << header.nObservations << " observations, " << header.nInvertedWords << " words" << std::endl;
+        std::cout << "map file " << mapStat.st_size << " bytes, package " << header.fileSize << " bytes" << std::endl;
+        std::cout << "map load " << std::chrono::duration<double>(t1 - t0).count() << " s ("
+                  << (bBowLoaded ? "stored" : "computed") << " BoW), package save "
+                  << std::chrono::duration<double>(t2 - t1).count() << " s" << std::endl;
+    } else {
+        std::cerr << "Failed to write " << argv[3] << std::endl;
+    }
+
+    pMap->clear();
+    delete pMap;
+    return bValid ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "ORBextractor.h"
+#include "TaskPool.h"
+#include "FeatureCache.h"
+
+// Same sequence format as mono_tum: a header line, then one "<timestamp in ns>,..." line per image
+// stored as <image folder>/<timestamp in ns>.png
+void loadImages(const std::string &imagePath, const std::string &timesPath,
+                std::vector<std::string> &images, std::vector<double> &timestamps) {
+    std::ifstream times(timesPath.c_str());
+    std::string line;
+    std::getline(times, line);
+    while (std::getline(times, line)) {
+        if (line.empty())
+            continue;
+        std::stringstream ss(line);
+        std::string name;
+        std::getline(ss, name, ',');
+        images.push_back(imagePath + "/" + name + ".png");
+        timestamps.push_back(std::stod(name) / 1e9);
+    }
+}
+
+/**
+ * @brief Extracts the ORB features of an image sequence once and stores them in a feature cache,
+ * which replay_feature_cache feeds to System::TrackMonocular(descriptors, keypoints, timestamp).
+ * The features are those of the tracking extractor (ORBextractor.nFeatures), the same input the
+ * descriptor based TrackMonocular receives from the simulator. Frames are extracted in parallel, each
+ * thread with its own extractor, and written in sequence order.
+ * @param argv argv[1]=settings, argv[2]=image folder, argv[3]=times file, argv[4]=output cache,
+ * argv[5]=threads (default: all cores)
+ */
+int main(int argc, char **argv) {
+    if (argc < 5) {
+        std::cerr << "usage: extract_feature_cache <settings> <image folder> <times file> <output> [threads]"
+                  << std::endl;
+        return 1;
+    }
+
+    cv::FileStorage fSettings(argv[1], cv::FileStorage::READ);
+    if (!fSettings.isOpened()) {
+        std::cerr << "Failed to open settings file at: " << argv[1] << std::endl;
+        return 1;
+    }
+    int nFeatures = fSettings["ORBextractor.nFeatures"];
+    float fScaleFactor = fSettings["ORBextractor.scaleFactor"];
+    int nLevels = fSettings["ORBextractor.nLevels"];
+    int fIniThFAST = fSettings["ORBextractor.iniThFAST"];
+    int fMinThFAST = fSettings["ORBextractor.minThFAST"];
+    bool bRGB = (int) fSettings["Camera.RGB"] != 0;
+
+    std::vector<std::string> images;
+    std::vector<double> timestamps;
+    loadImages(argv[2], argv[3], images, timestamps);
+    if (images.empty()) {
+        std::cerr << "Failed to load images" << std::endl;
+        return 1;
+    }
+
+    int nThreads = argc > 5 ? std::stoi(argv[5]) : (int) std::thread::hardware_concurrency();
+    nThreads = std::max(nThreads, 1);
+
+    std::vector<std::unique_ptr<ORB_SLAM2::ORBextractor>> extractors;
+    for (int t = 0; t < nThreads; t++)
+        extractors.emplace_back(new ORB_SLAM2::ORBextractor(nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST));
+    ORB_SLAM2::TaskPool pool(nThreads);
+
+    ORB_SLAM2::FeatureCacheWriter writer;
+    bool bOpened = false;
+
+    // One chunk at a time keeps the memory bounded, frame i of a chunk goes to extractor i % nThreads
+    const int chunkSize = 8 * nThreads;
+    std::vector<std::vector<cv::KeyPoint>> chunkKeys(chunkSize);
+    std::vector<cv::Mat> chunkDescriptors(chunkSize);
+    std::vector<cv::Size> chunkSizes(chunkSize);
+    std::vector<char> chunkLoaded(chunkSize); // not vector<bool>, written from several threads
+
+    auto start = std::chrono::steady_clock::now();
+    size_t nKeys = 0;
+    for (size_t first = 0; first < images.size(); first += chunkSize) {
+        const int n = (int) std::min<size_t>(chunkSize, images.size() - first);
+        pool.ParallelFor(nThreads, [&](int t) {
+            for (int i = t; i < n; i += nThreads) {
+                cv::Mat im = cv::imread(images[first + i], cv::IMREAD_UNCHANGED);
+                chunkLoaded[i] = !im.empty();
+                if (im.empty())
+                    continue;
+                if (im.channels() == 3)
+                    cv::cvtColor(im, im, bRGB ? cv::COLOR_RGB2GRAY : cv::COLOR_BGR2GRAY);
+                else if (im.channels() == 4)
+                    cv::cvtColor(im, im, bRGB ? cv::COLOR_RGBA2GRAY : cv::COLOR_BGRA2GRAY);
+                chunkSizes[i] = im.size();
+                (*extractors[t])(im, cv::Mat(), chunkKeys[i], chunkDescriptors[i]);
+            }
+        });
+
+        for (int i = 0; i < n; i++) {
+            if (!chunkLoaded[i]) {
+                std::cerr << "Failed to load image at: " << images[first + i] << std::endl;
+                return 1;
+            }
+            if (!bOpened) {
+                if (!writer.Open(argv[4], chunkSizes[i].width, chunkSizes[i].height))
+                    return 1;
+                bOpened = true;
+            }
+            writer.AddFrame(timestamps[first + i], chunkKeys[i], chunkDescriptors[i]);
+            nKeys += chunkKeys[i].size();
+        }
+        std::cout << "\r" << first + n << "/" << images.size() << " frames" << std::flush;
+    }
+    std::cout << std::endl;
+
+    if (!writer.Close()) {
+        std::cerr << "Failed to write feature cache: " << argv[4] << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Extracted " << nKeys << " keypoints from " << images.size() << " frames in " << seconds
+              << " s with " << nThreads << " threads" << std::endl;
+    return 0;
+}
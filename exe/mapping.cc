@@ -91,7 +91,9 @@ int main(int argc, char **argv) {
     std::cout << "Finished..." << std::endl;
 
     SLAM.Shutdown();
-    SLAM.SaveMap(Slam_lastest_Map_location);
+    // With a map journal the final state is already on disk
+    if (!SLAM.GetMapJournal())
+        SLAM.SaveMap(Slam_lastest_Map_location);
     cvDestroyAllWindows();
 
     return 0;
@@ -1,9 +1,12 @@
 #include <memory>
 #include <string>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <set>
 #include <iostream>
 #include <unistd.h>
-#include <unordered_set>
 #include <nlohmann/json.hpp>
 #include <opencv2/videoio.hpp>
 #include <opencv2/highgui.hpp>
@@ -18,12 +21,21 @@ std::unique_ptr<ORB_SLAM2::System> SLAM;
 std::string simulatorOutputDir;
 
 
-void saveFrame(cv::Mat &img, cv::Mat pose, int currentFrameId, int number_of_points) {
-    if (img.empty()) 
+std::string frameImagePath(int currentFrameId) {
+    return simulatorOutputDir + "frame_" + std::to_string(currentFrameId) + ".png";
+}
+
+void saveFrameImage(const cv::Mat &img, int currentFrameId) {
+    if (img.empty())
     {
         std::cout << "Image is empty!!!" << std::endl;
         return;
     }
+    cv::imwrite(frameImagePath(currentFrameId), img);
+}
+
+// Pose and point count are written when the map is saved, after bundle adjustment refined them
+void saveFrameData(const cv::Mat &pose, int currentFrameId, int number_of_points) {
     std::ofstream frameData;
     frameData.open(simulatorOutputDir + "frameData" +
                    std::to_string(currentFrameId) + ".csv");
@@ -49,52 +61,141 @@ void saveFrame(cv::Mat &img, cv::Mat pose, int currentFrameId, int number_of_poi
 
     frameData << currentFrameId << ',' << camera_position.x << ',' << camera_position.y << ',' << camera_position.z << ','
               << yaw << ',' << pitch << ',' << roll << std::endl;
-    cv::imwrite(simulatorOutputDir + "frame_" + std::to_string(currentFrameId) + ".png", img);
     frameData.close();
 }
 
+struct FrameJob {
+    cv::Mat image;
+    int frameId;
+};
+
+// Encodes keyframe images on a pool of threads fed through a bounded queue, so the
+// producer stalls instead of holding every keyframe image in memory at once
+class FrameWriterPool {
+public:
+    FrameWriterPool(size_t nThreads, size_t maxQueued) : mMaxQueued(maxQueued), mbFinished(false) {
+        for (size_t i = 0; i < nThreads; ++i)
+            mvThreads.emplace_back(&FrameWriterPool::Run, this);
+    }
+
+    ~FrameWriterPool() {
+        Finish();
+    }
+
+    void Push(FrameJob job) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondNotFull.wait(lock, [this]() { return mqJobs.size() < mMaxQueued; });
+            mqJobs.push(std::move(job));
+        }
+        mCondNotEmpty.notify_one();
+    }
+
+    // Blocks until every queued frame is written
+    void Finish() {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mbFinished = true;
+        }
+        mCondNotEmpty.notify_all();
+        for (auto &t: mvThreads)
+            if (t.joinable())
+                t.join();
+    }
+
+private:
+    void Run() {
+        while (true) {
+            FrameJob job;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCondNotEmpty.wait(lock, [this]() { return !mqJobs.empty() || mbFinished; });
+                if (mqJobs.empty())
+                    return;
+                job = std::move(mqJobs.front());
+                mqJobs.pop();
+            }
+            mCondNotFull.notify_one();
+            saveFrameImage(job.image, job.frameId);
+        }
+    }
+
+    size_t mMaxQueued;
+    bool mbFinished;
+    std::queue<FrameJob> mqJobs;
+    std::mutex mMutex;
+    std::condition_variable mCondNotEmpty;
+    std::condition_variable mCondNotFull;
+    std::vector<std::thread> mvThreads;
+};
+
+std::unique_ptr<FrameWriterPool> frameWriters;
+std::set<long unsigned int> submittedKeyFrames;
+long unsigned int lastMaxKFid = 0;
+
+// Hands the images of the keyframes added to the map since the last call to the writer pool,
+// so they are encoded while tracking goes on
+void submitNewKeyFrames() {
+    long unsigned int maxKFid = SLAM->GetMap()->GetMaxKFid();
+    if (maxKFid == lastMaxKFid && !submittedKeyFrames.empty())
+        return;
+    lastMaxKFid = maxKFid;
+    for (auto &kf: SLAM->GetMap()->GetAllKeyFrames()) {
+        if (kf == nullptr || kf->isBad() || submittedKeyFrames.count(kf->mnId))
+            continue;
+        cv::Mat image = kf->GetImage();
+        if (image.empty())
+            continue;
+        submittedKeyFrames.insert(kf->mnId);
+        frameWriters->Push({image, (int)kf->mnId});
+    }
+}
+
 void saveMap(int mapNumber) {
-    std::ofstream pointData;
-    std::unordered_set<int> seen_frames;
+    // Images of the keyframes still pending go to the writer pool, the cloud csv is written meanwhile on this thread
+    submitNewKeyFrames();
+    std::set<long unsigned int> goodKeyFrames;
+    for (auto &kf: SLAM->GetMap()->GetAllKeyFrames()) {
+        if (kf == nullptr || kf->isBad() || !submittedKeyFrames.count(kf->mnId))
+            continue;
+        saveFrameData(kf->GetPose(), (int)kf->mnId, (int)kf->GetMapPoints().size());
+        goodKeyFrames.insert(kf->mnId);
+    }
 
+    std::ofstream pointData;
     pointData.open(simulatorOutputDir + "cloud" + std::to_string(mapNumber) + ".csv");
     for (auto &p: SLAM->GetMap()->GetAllMapPoints()) {
         if (p != nullptr && !p->isBad()) {
             auto point = p->GetWorldPos();
             Eigen::Matrix<double, 3, 1> vector = ORB_SLAM2::Converter::toVector3d(point);
-            cv::Mat worldPos = cv::Mat::zeros(3, 1, CV_64F);
-            worldPos.at<double>(0) = vector.x();
-            worldPos.at<double>(1) = vector.y();
-            worldPos.at<double>(2) = vector.z();
             p->UpdateNormalAndDepth();
             cv::Mat Pn = p->GetNormal();
             Pn.convertTo(Pn, CV_64F);
-            pointData << worldPos.at<double>(0) << "," << worldPos.at<double>(1) << "," << worldPos.at<double>(2);
+            pointData << vector.x() << "," << vector.y() << "," << vector.z();
             pointData << "," << p->GetMinDistanceInvariance() << "," << p->GetMaxDistanceInvariance() << "," << Pn.at<double>(0) << "," << Pn.at<double>(1) << "," << Pn.at<double>(2);
             std::map<ORB_SLAM2::KeyFrame*, size_t> observations = p->GetObservations();
             for (auto obs : observations) {
                 ORB_SLAM2::KeyFrame *currentFrame = obs.first;
-                if (!currentFrame->image.empty())
+                // Keyframes with an image written, as in frameData (with an image store they release theirs)
+                if (goodKeyFrames.count(currentFrame->mnId))
                 {
-                    size_t pointIndex = obs.second;
-                    cv::KeyPoint keyPoint = currentFrame->mvKeysUn[pointIndex];
-                    cv::Point2f featurePoint = keyPoint.pt;
+                    ORB_SLAM2::KeyFramePayloadPin pin(currentFrame);
+                    const cv::Point2f &featurePoint = currentFrame->mvKeysUn[obs.second].pt;
                     pointData << "," << currentFrame->mnId << "," << featurePoint.x << "," << featurePoint.y;
-                    if (seen_frames.count(currentFrame->mnId) <= 0)
-                    {
-                        saveFrame(currentFrame->image, currentFrame->GetPose(), currentFrame->mnId, currentFrame->GetMapPoints().size());
-                        seen_frames.insert(currentFrame->mnId);
-                    }
-                    // cv::Mat image = cv::imread(simulatorOutputDir + "frame_" + std::to_string(currentFrame->mnId) + ".png");
-                    // cv::arrowedLine(image, featurePoint, cv::Point2f(featurePoint.x, featurePoint.y - 100), cv::Scalar(0, 0, 255), 2, 8, 0, 0.1);
-                    // cv::imshow("image", image);
-                    // cv::waitKey(0);
                 }
             }
             pointData << std::endl;
         }
     }
     pointData.close();
+
+    // Keyframes culled after their image was written are not part of the map
+    frameWriters->Finish();
+    for (long unsigned int id: submittedKeyFrames)
+        if (!goodKeyFrames.count(id))
+            std::filesystem::remove(frameImagePath((int)id));
+    submittedKeyFrames = goodKeyFrames;
+    frameWriters = std::make_unique<FrameWriterPool>(std::max(1u, std::thread::hardware_concurrency()), 32);
     std::cout << "saved map" << std::endl;
 
 }
@@ -132,9 +233,12 @@ int main() {
     bool isSavingMap = data["saveMap"];
     std::string loadMapPath = data["loadMapPath"];
     std::string simulatorOutputDirPath = data["simulatorOutputDir"];
+    // Extract the next frame while tracking the current one
+    bool pipelineTracking = data.value("pipelineTracking", false);
     simulatorOutputDir = simulatorOutputDirPath + currentTime + "/";
     std::filesystem::create_directory(simulatorOutputDir);
     SLAM = std::make_unique<ORB_SLAM2::System>(vocPath, droneYamlPathSlam, ORB_SLAM2::System::MONOCULAR, true);
+    frameWriters = std::make_unique<FrameWriterPool>(std::max(1u, std::thread::hardware_concurrency()), 32);
     int amountOfAttepmpts = 0;
     while (amountOfAttepmpts++ < 1) {
         cv::VideoCapture capture(videoPath);
@@ -153,7 +257,13 @@ int main() {
         int amount_of_frames = 1;
 
         for (;;) {
-            SLAM->TrackMonocular(frame, capture.get(CV_CAP_PROP_POS_MSEC));
+            if (pipelineTracking) {
+                double trackedTimestamp;
+                SLAM->TrackMonocularPipelined(frame, capture.get(CV_CAP_PROP_POS_MSEC), trackedTimestamp);
+            } else {
+                SLAM->TrackMonocular(frame, capture.get(CV_CAP_PROP_POS_MSEC));
+            }
+            submitNewKeyFrames();
 
             capture >> frame;
 
@@ -161,6 +271,8 @@ int main() {
                 break;
             }
         }
+        if (pipelineTracking)
+            SLAM->FlushMonocularPipeline();
         saveMap(amountOfAttepmpts);
         std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
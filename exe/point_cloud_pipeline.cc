@@ -0,0 +1,274 @@
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <future>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/registration/gicp.h>
+#include <pcl/common/transforms.h>
+#include <pcl/common/centroid.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/io/pcd_io.h>
+
+#include "include/Auxiliary.h"
+
+/**
+ * @brief Single-process replacement for the csv_to_xyz -> remove_outliers -> pcd_to_xyz -> icp_model_orbs_slam
+ * chain. Every stage works on an in-memory cloud, the source (orb-slam map) and target (combined frames) chains
+ * run concurrently, and only the final aligned cloud and its transformation matrix are written to framesOutput.
+ */
+
+typedef pcl::PointCloud<pcl::PointXYZ> Cloud;
+
+struct PipelineStage {
+    std::string name;
+    std::function<void(Cloud::Ptr &)> apply;
+};
+
+bool endsWith(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Load a .csv (x,y,z,...), .xyz (x y z) or .pcd file straight into a pcl cloud
+Cloud::Ptr loadCloud(const std::string &filePath) {
+    Cloud::Ptr cloud(new Cloud);
+
+    if (endsWith(filePath, ".pcd")) {
+        if (pcl::io::loadPCDFile<pcl::PointXYZ>(filePath, *cloud) < 0) {
+            std::cerr << "Cannot open file: " << filePath << std::endl;
+        }
+        return cloud;
+    }
+
+    std::ifstream file(filePath);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open file: " << filePath << std::endl;
+        return cloud;
+    }
+
+    char delimiter = endsWith(filePath, ".csv") ? ',' : ' ';
+    std::string line;
+    size_t lineNumber = 0, skipped = 0, firstSkipped = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        if (line.empty())
+            continue;
+        std::stringstream lineStream(line);
+        std::string cell;
+        float xyz[3];
+        int i = 0;
+        for (; i < 3 && std::getline(lineStream, cell, delimiter); ++i) {
+            // Header rows and malformed cells are skipped, std::stof would throw on them
+            char *end = nullptr;
+            xyz[i] = std::strtof(cell.c_str(), &end);
+            if (end == cell.c_str())
+                break;
+        }
+        if (i == 3) {
+            cloud->push_back(pcl::PointXYZ(xyz[0], xyz[1], xyz[2]));
+        } else if (skipped++ == 0) {
+            firstSkipped = lineNumber;
+        }
+    }
+    if (skipped > 0)
+        std::cerr << filePath << ": skipped " << skipped << " non-numeric lines, the first at line " << firstSkipped
+                  << std::endl;
+
+    return cloud;
+}
+
+// Drop the given percent of points farthest from the centroid, keeping the input order of the remaining points
+void removeFarthestPoints(Cloud::Ptr &cloud, double percent_to_remove) {
+    const size_t n = cloud->size();
+    size_t removeCount = static_cast<size_t>(n * percent_to_remove / 100.0);
+    if (n == 0 || removeCount == 0)
+        return;
+
+    Eigen::Vector4f centroid;
+    pcl::compute3DCentroid(*cloud, centroid);
+
+    std::vector<float> distances(n);
+    for (size_t i = 0; i < n; ++i) {
+        distances[i] = (cloud->points[i].getVector3fMap() - centroid.head<3>()).squaredNorm();
+    }
+
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    size_t keepCount = n - removeCount;
+    std::nth_element(order.begin(), order.begin() + keepCount, order.end(),
+                     [&distances](size_t a, size_t b) { return distances[a] < distances[b]; });
+    order.resize(keepCount);
+    std::sort(order.begin(), order.end());
+
+    Cloud::Ptr filtered(new Cloud);
+    filtered->reserve(keepCount);
+    for (size_t idx : order) {
+        filtered->push_back(cloud->points[idx]);
+    }
+    cloud = filtered;
+}
+
+void voxelDownsample(Cloud::Ptr &cloud, float leafSize) {
+    if (leafSize <= 0 || cloud->empty())
+        return;
+
+    Cloud::Ptr filtered(new Cloud);
+    pcl::VoxelGrid<pcl::PointXYZ> grid;
+    grid.setInputCloud(cloud);
+    grid.setLeafSize(leafSize, leafSize, leafSize);
+    grid.filter(*filtered);
+    cloud = filtered;
+}
+
+// Compute scale using centroids and mean distance from them
+float compute_scale(const Cloud::Ptr src, const Cloud::Ptr tgt) {
+    Eigen::Vector4f src_centroid, tgt_centroid;
+    pcl::compute3DCentroid(*src, src_centroid);
+    pcl::compute3DCentroid(*tgt, tgt_centroid);
+
+    float src_avg_dist = 0.0, tgt_avg_dist = 0.0;
+    for (const auto &point : *src) {
+        src_avg_dist += (point.getVector3fMap() - src_centroid.head<3>()).norm();
+    }
+    src_avg_dist /= src->size();
+
+    for (const auto &point : *tgt) {
+        tgt_avg_dist += (point.getVector3fMap() - tgt_centroid.head<3>()).norm();
+    }
+    tgt_avg_dist /= tgt->size();
+
+    return tgt_avg_dist / src_avg_dist;
+}
+
+Cloud::Ptr runStages(const std::string &chainName, const std::vector<PipelineStage> &stages) {
+    Cloud::Ptr cloud(new Cloud);
+    for (const auto &stage : stages) {
+        auto start = std::chrono::steady_clock::now();
+        stage.apply(cloud);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "[" << chainName << "] " << stage.name << ": " << cloud->size() << " points, "
+                  << elapsed.count() << "ms" << std::endl;
+    }
+    return cloud;
+}
+
+void saveMatrixToFile(const Eigen::Matrix4f &matrix, const std::string &filename) {
+    std::ofstream outfile(filename);
+    if (!outfile.is_open()) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return;
+    }
+
+    for (int row = 0; row < matrix.rows(); ++row) {
+        for (int col = 0; col < matrix.cols(); ++col) {
+            outfile << matrix(row, col);
+            if (col != matrix.cols() - 1) {
+                outfile << ",";
+            }
+        }
+        outfile << "\n";
+    }
+    outfile.close();
+}
+
+void savePointsToXYZ(const std::string &filePath, const Cloud &cloud) {
+    std::ofstream file(filePath);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open file: " << filePath << std::endl;
+        return;
+    }
+
+    for (const auto &point : cloud) {
+        file << point.x << " " << point.y << " " << point.z << "\n";
+    }
+    file.close();
+}
+
+int main() {
+    std::string settingPath = Auxiliary::GetGeneralSettingsPath();
+    std::ifstream programData(settingPath);
+    nlohmann::json data;
+    programData >> data;
+    programData.close();
+
+    std::string orbs_csv_dir = data["framesOutput"];
+    std::string sourceCloudPath = orbs_csv_dir + std::string(data["pipelineSourceCloud"]);
+    std::string targetCloudPath = orbs_csv_dir + std::string(data["pipelineTargetCloud"]);
+    double sourceOutlierPercent = data["pipelineSourceOutlierPercent"];
+    double targetOutlierPercent = data["pipelineTargetOutlierPercent"];
+    float voxelSize = data["pipelineVoxelSize"];
+    bool downsampleSource = data.value("pipelineDownsampleSource", false);
+    bool binaryOutput = data["pipelineBinaryOutput"];
+    bool is_predefined_scale = data["usePredefinedScale"];
+    float predefinedScale = data["predefinedScale"];
+
+    // Source: orb-slam map points, Target: combined frames points (model units)
+    std::vector<PipelineStage> sourceStages = {
+            {"load " + sourceCloudPath, [&](Cloud::Ptr &cloud) { cloud = loadCloud(sourceCloudPath); }},
+            {"outliers", [&](Cloud::Ptr &cloud) { removeFarthestPoints(cloud, sourceOutlierPercent); }},
+    };
+    std::vector<PipelineStage> targetStages = {
+            {"load " + targetCloudPath, [&](Cloud::Ptr &cloud) { cloud = loadCloud(targetCloudPath); }},
+            {"outliers", [&](Cloud::Ptr &cloud) { removeFarthestPoints(cloud, targetOutlierPercent); }},
+            {"voxel", [&](Cloud::Ptr &cloud) { voxelDownsample(cloud, voxelSize); }},
+    };
+
+    auto sourceFuture = std::async(std::launch::async, runStages, "source", std::cref(sourceStages));
+    auto targetFuture = std::async(std::launch::async, runStages, "target", std::cref(targetStages));
+    Cloud::Ptr source = sourceFuture.get();
+    Cloud::Ptr target = targetFuture.get();
+
+    if (source->empty() || target->empty()) {
+        std::cerr << "Empty input cloud, source: " << source->size() << " target: " << target->size() << std::endl;
+        return 1;
+    }
+
+    // The scale depends on both clouds, so the source transform and its downsampling run after the join.
+    // The voxel size is given in target units, hence downsampling the source only once it is scaled.
+    // As icp_model_orbs_slam, the whole scaled source is what gets transformed and written, the
+    // downsampled copy (pipelineDownsampleSource) is only the GICP input.
+    float scale = is_predefined_scale ? predefinedScale : compute_scale(source, target);
+    std::cout << (is_predefined_scale ? "Using predefined scale: " : "Computed scale: ") << scale << std::endl;
+
+    Eigen::Affine3f scaling(Eigen::Scaling(scale));
+    pcl::transformPointCloud(*source, *source, scaling);
+    Cloud::Ptr gicpSource = source;
+    if (downsampleSource) {
+        gicpSource = Cloud::Ptr(new Cloud(*source));
+        voxelDownsample(gicpSource, voxelSize);
+    }
+
+    pcl::GeneralizedIterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ> gicp;
+    gicp.setInputSource(gicpSource);
+    gicp.setInputTarget(target);
+
+    Cloud gicpAligned;
+    gicp.align(gicpAligned);
+
+    if (!gicp.hasConverged()) {
+        std::cout << "ICP did not converge." << std::endl;
+        return 1;
+    }
+
+    Eigen::Matrix4f transformation = gicp.getFinalTransformation();
+    std::cout << "ICP has converged with score: " << gicp.getFitnessScore() << std::endl;
+    std::cout << "ICP Transformation Matrix with scale:\n" << transformation << std::endl;
+
+    Cloud aligned;
+    pcl::transformPointCloud(*source, aligned, transformation);
+
+    saveMatrixToFile(transformation, orbs_csv_dir + "frames_transformation_matrix.csv");
+    if (binaryOutput) {
+        pcl::PCDWriter().writeBinary(orbs_csv_dir + "transformed_points.pcd", aligned);
+    } else {
+        savePointsToXYZ(orbs_csv_dir + "transformed_points.xyz", aligned);
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <opencv2/core/core.hpp>
+
+#include "System.h"
+#include "FeatureCache.h"
+
+/**
+ * @brief Runs the monocular tracking on a feature cache written by extract_feature_cache, without
+ * decoding images or extracting ORB features. Frames are fed as fast as the tracking takes them.
+ * @param argv argv[1]=vocabulary, argv[2]=settings, argv[3]=feature cache,
+ * argv[4]=1 to show the viewer (default 0)
+ */
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        std::cerr << "usage: replay_feature_cache <vocabulary> <settings> <feature cache> [viewer]" << std::endl;
+        return 1;
+    }
+    bool bUseViewer = argc > 4 && std::stoi(argv[4]) != 0;
+
+    ORB_SLAM2::FeatureCache cache;
+    if (!cache.Open(argv[3]))
+        return 1;
+    const size_t nFrames = cache.size();
+    std::cout << "Frames in the cache: " << nFrames << " (" << cache.GetCols() << "x" << cache.GetRows() << ")"
+              << std::endl;
+    if (nFrames == 0)
+        return 1;
+
+    ORB_SLAM2::System SLAM(argv[1], argv[2], ORB_SLAM2::System::MONOCULAR, bUseViewer);
+
+    std::vector<float> timesTrack(nFrames);
+    std::vector<cv::KeyPoint> keyPoints;
+    cv::Mat descriptors;
+    size_t nLost = 0;
+    for (size_t i = 0; i < nFrames; i++) {
+        auto t1 = std::chrono::steady_clock::now();
+        cache.GetFrame(i, keyPoints, descriptors);
+        cv::Mat Tcw = SLAM.TrackMonocular(descriptors, keyPoints, cache.GetTimestamp(i));
+        auto t2 = std::chrono::steady_clock::now();
+
+        timesTrack[i] = std::chrono::duration<float>(t2 - t1).count();
+        if (Tcw.empty())
+            nLost++;
+    }
+
+    SLAM.Shutdown();
+
+    float totalTime = 0;
+    for (float t : timesTrack)
+        totalTime += t;
+    std::sort(timesTrack.begin(), timesTrack.end());
+    std::cout << "-------" << std::endl << std::endl;
+    std::cout << "median tracking time: " << timesTrack[nFrames / 2] << std::endl;
+    std::cout << "mean tracking time: " << totalTime / nFrames << std::endl;
+    std::cout << "frames per second: " << nFrames / totalTime << std::endl;
+    std::cout << "frames without pose: " << nLost << std::endl;
+
+    SLAM.SaveKeyFrameTrajectoryTUM("KeyFrameTrajectory.txt");
+    return 0;
+}
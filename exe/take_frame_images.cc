@@ -1,6 +1,10 @@
 #include <thread>
 #include <future>
 #include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <cmath>
 
 #include <pangolin/pangolin.h>
 #include <pangolin/geometry/geometry.h>
@@ -53,9 +57,116 @@ Eigen::Matrix4d read_matrix_4d_from_csv(std::string filename)
 }
 
 
-int main(int argc, char **argv) {
+struct FramePose {
+    int id;
+    pangolin::OpenGlMatrix mv;
+    pangolin::OpenGlMatrix proj;
+};
+
+struct RenderedFrame {
+    int id;
+    cv::Mat rgba;
+};
+
+/**
+ * @brief Collects the poses to render according to takeFrameImagesBatch:
+ * "" renders frameNumber only (frame_N_mv.csv / frame_N_proj.csv),
+ * "frames" renders every frame_N_mv.csv found in framesOutput,
+ * "frameData" renders every frameDataN.csv of mapInputDir (id,x,y,z,yaw,pitch,roll of Tcw), moved into the model
+ * with the SLAM to model transformation of framesOutput (frames_lab_transformation_matrix.csv with useLabICP),
+ * anything else is a pose list file with lines "id,mv(16)[,proj(16)]" in row-major order.
+ * Frames without their own projection use the one built from the camera intrinsics.
+ */
+std::vector<FramePose> read_frame_poses(const nlohmann::json &data, const pangolin::OpenGlMatrix &default_proj)
+{
+    std::vector<FramePose> poses;
+    std::string frames_output = data["framesOutput"];
+    std::string batch = data["takeFrameImagesBatch"];
+
+    auto add_frame_csv = [&](int frame_id) {
+        std::string mv_filename = frames_output + "frame_" + std::to_string(frame_id) + "_mv.csv";
+        std::string proj_filename = frames_output + "frame_" + std::to_string(frame_id) + "_proj.csv";
+        pangolin::OpenGlMatrix proj = default_proj;
+        if (std::filesystem::exists(proj_filename))
+            proj = pangolin::OpenGlMatrix(read_matrix_4d_from_csv(proj_filename));
+        poses.push_back({frame_id, pangolin::OpenGlMatrix(read_matrix_4d_from_csv(mv_filename)), proj});
+    };
+
+    if (batch.empty()) {
+        add_frame_csv(data["frameNumber"]);
+    } else if (batch == "frames") {
+        for (const auto &entry : std::filesystem::directory_iterator(frames_output)) {
+            int frame_id;
+            char suffix[8] = {0};
+            if (std::sscanf(entry.path().filename().string().c_str(), "frame_%d_%7[a-z].csv", &frame_id, suffix) == 2 &&
+                std::string(suffix) == "mv")
+                add_frame_csv(frame_id);
+        }
+    } else if (batch == "frameData") {
+        // Same alignment as the run_model tools: model point = transformation * SLAM point, with a scale
+        std::string transformation_csv = frames_output + (bool(data["useLabICP"]) ? "frames_lab_transformation_matrix.csv"
+                                                                                 : "frames_transformation_matrix.csv");
+        if (!std::filesystem::exists(transformation_csv)) {
+            std::cerr << "Error: no SLAM to model transformation '" << transformation_csv << "'." << std::endl;
+            return poses;
+        }
+        Eigen::Matrix4d transformation = read_matrix_4d_from_csv(transformation_csv);
+        Eigen::Matrix4d model_to_slam = transformation.inverse();
+        // Scaling the camera frame back to model units keeps the depth range of the projection
+        double scale = std::cbrt(transformation.block<3, 3>(0, 0).determinant());
+        Eigen::Matrix4d unscale = Eigen::Vector4d(scale, scale, scale, 1).asDiagonal();
+
+        // OpenGL cameras look down -z with y up, ORB_SLAM2 cameras look down +z with y down
+        Eigen::Matrix4d gl_from_cv = Eigen::Vector4d(1, -1, -1, 1).asDiagonal();
+        for (const auto &filename : Auxiliary::GetAllFrameDatas()) {
+            std::ifstream csv_file(filename);
+            std::string line;
+            std::getline(csv_file, line);
+            std::stringstream line_stream(line);
+            std::string cell;
+            std::vector<double> values;
+            while (std::getline(line_stream, cell, ','))
+                values.push_back(std::stod(cell));
+            if (values.size() < 7)
+                continue;
+
+            Eigen::Matrix4d Tcw = Eigen::Matrix4d::Identity();
+            Tcw.block<3, 3>(0, 0) = (Eigen::AngleAxisd(values[4], Eigen::Vector3d::UnitZ()) *
+                                     Eigen::AngleAxisd(values[5], Eigen::Vector3d::UnitY()) *
+                                     Eigen::AngleAxisd(values[6], Eigen::Vector3d::UnitX())).toRotationMatrix();
+            Tcw.block<3, 1>(0, 3) = Eigen::Vector3d(values[1], values[2], values[3]);
+            Eigen::Matrix4d Tcm = unscale * Tcw * model_to_slam;
+            poses.push_back({(int)values[0], pangolin::OpenGlMatrix(Eigen::Matrix4d(gl_from_cv * Tcm)), default_proj});
+        }
+    } else {
+        std::ifstream pose_file(batch);
+        if (!pose_file.is_open()) {
+            std::cerr << "Error: could not open file '" << batch << "' for reading." << std::endl;
+            return poses;
+        }
+        std::string line;
+        while (std::getline(pose_file, line)) {
+            std::stringstream line_stream(line);
+            std::string cell;
+            std::vector<double> values;
+            while (std::getline(line_stream, cell, ','))
+                values.push_back(std::stod(cell));
+            if (values.size() != 17 && values.size() != 33)
+                continue;
+
+            Eigen::Matrix4d mv = Eigen::Map<Eigen::Matrix<double, 4, 4, Eigen::RowMajor>>(&values[1]);
+            pangolin::OpenGlMatrix proj = default_proj;
+            if (values.size() == 33)
+                proj = pangolin::OpenGlMatrix(Eigen::Matrix4d(Eigen::Map<Eigen::Matrix<double, 4, 4, Eigen::RowMajor>>(&values[17])));
+            poses.push_back({(int)values[0], pangolin::OpenGlMatrix(mv), proj});
+        }
+    }
 
-    using namespace pangolin;
+    std::sort(poses.begin(), poses.end(), [](const FramePose &a, const FramePose &b) { return a.id < b.id; });
+    return poses;
+}
+
+int main(int argc, char **argv) {
 
     std::string settingPath = Auxiliary::GetGeneralSettingsPath();
     std::ifstream programData(settingPath);
@@ -65,126 +176,99 @@ int main(int argc, char **argv) {
 
     std::string configPath = data["DroneYamlPathSlam"];
     cv::FileStorage fSettings(configPath, cv::FileStorage::READ);
+    std::string frames_output = data["framesOutput"];
 
-    // Read matrices
-    int frame_to_check = data["frameNumber"];
-    std::string mv_filename = std::string(data["framesOutput"]) + "frame_" + std::to_string(frame_to_check) + "_mv.csv";
-    Eigen::Matrix4d mv_mat = read_matrix_4d_from_csv(mv_filename);
-    std::string proj_filename = std::string(data["framesOutput"]) + "frame_" + std::to_string(frame_to_check) + "_proj.csv";
-    Eigen::Matrix4d proj_mat = read_matrix_4d_from_csv(proj_filename);
-    
     float fx = fSettings["Camera.fx"];
     float fy = fSettings["Camera.fy"];
     float cx = fSettings["Camera.cx"];
     float cy = fSettings["Camera.cy"];
-    float viewpointX = fSettings["RunModel.ViewpointX"];
-    float viewpointY = fSettings["RunModel.ViewpointY"];
-    float viewpointZ = fSettings["RunModel.ViewpointZ"];
-
-    Eigen::Matrix3d K;
-    K << fx, 0.0, cx, 0.0, fy, cy, 0.0, 0.0, 1.0;
-    Eigen::Vector2f viewport_size(fSettings["Camera.width"], fSettings["Camera.height"]);
+    int width = fSettings["Camera.width"];
+    int height = fSettings["Camera.height"];
 
-
-    // Options
-    bool show_bounds = false;
-    bool show_axis = false;
-    bool show_x0 = false;
-    bool show_y0 = false;
-    bool show_z0 = false;
-    bool cull_backfaces = false;
-
-    // Create Window for rendering
-    pangolin::CreateWindowAndBind("Main", viewport_size[0], viewport_size[1]);
+    // Headless context (EGL) without a window, every frame is drawn into an offscreen framebuffer
+    pangolin::CreateWindowAndBind("Main", width, height, pangolin::Params({{"scheme", "headless"}}));
     glEnable(GL_DEPTH_TEST);
 
-    // Define Projection and initial ModelView matrix
-    pangolin::OpenGlRenderState s_cam(
-            pangolin::ProjectionMatrix(viewport_size(0), viewport_size(1), K(0, 0), K(1, 1), K(0, 2), K(1, 2), 0.1, 10000),
-            pangolin::ModelViewLookAt(viewpointX, viewpointY, viewpointZ, 0, 0, 0, 0.0, -1.0, pangolin::AxisY)
-    );
+    pangolin::OpenGlMatrix default_proj = pangolin::ProjectionMatrix(width, height, fx, fy, cx, cy, 0.1, 10000);
+    std::vector<FramePose> poses = read_frame_poses(data, default_proj);
+    std::cout << "Rendering " << poses.size() << " frames" << std::endl;
 
-    // Create Interactive View in window
-    pangolin::Handler3D handler(s_cam);
-    pangolin::View &d_cam = pangolin::CreateDisplay()
-            .SetBounds(0.0, 1.0, 0.0, 1.0, -viewport_size[0] / viewport_size[1])
-            .SetHandler(&handler);
-
-    // Load Geometry asynchronously
+    // Upload the model once for all the frames
     std::string model_path = data["modelPath"];
     const pangolin::Geometry geom_to_load = pangolin::LoadGeometry(model_path);
-    auto aabb = pangolin::GetAxisAlignedBox(geom_to_load);
-    Eigen::AlignedBox3f total_aabb;
-    total_aabb.extend(aabb);
-    s_cam.SetModelViewMatrix(mv_mat);
-    s_cam.SetProjectionMatrix(proj_mat);
     const pangolin::GlGeometry geomToRender = pangolin::ToGlGeometry(geom_to_load);
-    // Render tree for holding object position
     pangolin::GlSlProgram default_prog;
-    auto LoadProgram = [&]() {
-        default_prog.ClearShaders();
-        default_prog.AddShader(pangolin::GlSlAnnotatedShader, shader);
-        default_prog.Link();
-    };
-    LoadProgram();
-    pangolin::RegisterKeyPressCallback('b', [&]() { show_bounds = !show_bounds; });
-    pangolin::RegisterKeyPressCallback('0', [&]() { cull_backfaces = !cull_backfaces; });
-
-    // Show axis and axis planes
-    pangolin::RegisterKeyPressCallback('a', [&]() { show_axis = !show_axis; });
-    pangolin::RegisterKeyPressCallback('x', [&]() { show_x0 = !show_x0; });
-    pangolin::RegisterKeyPressCallback('y', [&]() { show_y0 = !show_y0; });
-    pangolin::RegisterKeyPressCallback('z', [&]() { show_z0 = !show_z0; });
-
-    Eigen::Vector3d Pick_w = handler.Selected_P_w();
-    std::vector<Eigen::Vector3d> Picks_w;
-    cv::Mat img;
-
-    while (!pangolin::ShouldQuit()) {
-        if ((handler.Selected_P_w() - Pick_w).norm() > 1E-6) {
-            Pick_w = handler.Selected_P_w();
-            Picks_w.push_back(Pick_w);
-            std::cout << pangolin::FormatString("\"Translation\": [%,%,%]", Pick_w[0], Pick_w[1], Pick_w[2])
-                      << std::endl;
-        }
+    default_prog.AddShader(pangolin::GlSlAnnotatedShader, shader);
+    default_prog.Link();
+
+    pangolin::GlTexture color_buffer(width, height, GL_RGBA8);
+    pangolin::GlRenderBuffer depth_buffer(width, height);
+    pangolin::GlFramebuffer framebuffer(color_buffer, depth_buffer);
+
+    // Conversion and png encoding run on writer threads fed through a bounded queue,
+    // so the GL thread only blocks when the writers fall behind
+    const size_t max_queued_frames = 16;
+    std::queue<RenderedFrame> queued_frames;
+    std::mutex queue_mutex;
+    std::condition_variable queue_not_empty, queue_not_full;
+    bool rendering_done = false;
+
+    auto writer = [&]() {
+        while (true) {
+            RenderedFrame frame;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_not_empty.wait(lock, [&]() { return !queued_frames.empty() || rendering_done; });
+                if (queued_frames.empty())
+                    return;
+                frame = std::move(queued_frames.front());
+                queued_frames.pop();
+            }
+            queue_not_full.notify_one();
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            cv::Mat img;
+            cv::cvtColor(frame.rgba, img, cv::COLOR_RGBA2BGR);
+            cv::flip(img, img, 0);
+            cv::imwrite(frames_output + "frame_" + std::to_string(frame.id) + ".png", img);
+        }
+    };
 
-        // Load any pending geometry to the GPU.
-        if (d_cam.IsShown()) {
-            d_cam.Activate();
+    std::vector<std::thread> writers;
+    unsigned int n_writers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    for (unsigned int i = 0; i < n_writers; i++)
+        writers.emplace_back(writer);
 
-            if (cull_backfaces) {
-                glEnable(GL_CULL_FACE);
-                glCullFace(GL_BACK);
-            }
-            default_prog.Bind();
-            default_prog.SetUniform("KT_cw",  s_cam.GetProjectionMatrix() *  s_cam.GetModelViewMatrix());
-            pangolin::GlDraw( default_prog, geomToRender, nullptr);
-            default_prog.Unbind();
-
-            s_cam.Apply();
-
-            glDisable(GL_CULL_FACE);
-
-            pangolin::Image<unsigned char> buffer;
-            pangolin::VideoPixelFormat fmt = pangolin::VideoFormatFromString("RGBA32");
-            buffer.Alloc(viewport_size[0], viewport_size[1], viewport_size[0] * fmt.bpp/8 );
-            glReadBuffer(GL_BACK);
-            glPixelStorei(GL_PACK_ALIGNMENT, 1);
-            glReadPixels(0, 0, viewport_size[0], viewport_size[1], GL_RGBA, GL_UNSIGNED_BYTE, buffer.ptr );
- 
-            cv::Mat  imgBuffer = cv::Mat(viewport_size[1], viewport_size[0], CV_8UC4, buffer.ptr);
-            cv::cvtColor(imgBuffer, img,  cv::COLOR_RGBA2BGR);
-            cv::flip(img, img, 0);
+    for (const auto &pose : poses) {
+        framebuffer.Bind();
+        glViewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-            pangolin::FinishFrame();
-            break;
+        default_prog.Bind();
+        default_prog.SetUniform("KT_cw", pose.proj * pose.mv);
+        pangolin::GlDraw(default_prog, geomToRender, nullptr);
+        default_prog.Unbind();
+
+        RenderedFrame frame{pose.id, cv::Mat(height, width, CV_8UC4)};
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, frame.rgba.data);
+        framebuffer.Unbind();
+
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_not_full.wait(lock, [&]() { return queued_frames.size() < max_queued_frames; });
+            queued_frames.push(std::move(frame));
         }
+        queue_not_empty.notify_one();
     }
 
-    std::string frame_location = std::string(data["framesOutput"]) + "frame_" + std::to_string(frame_to_check) + ".png";
-    cv::imwrite(frame_location, img);
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        rendering_done = true;
+    }
+    queue_not_empty.notify_all();
+    for (auto &t : writers)
+        t.join();
 
     return 0;
 }
@@ -0,0 +1,59 @@
+#ifndef DESCRIPTOR_H
+#define DESCRIPTOR_H
+
+#include <vector>
+#include <cstring>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+// 256 bit ORB descriptor, aligned so that it is a single 32 byte vector load
+struct alignas(32) ORBDescriptor
+{
+    unsigned char data[32];
+};
+
+// Descriptors of a Frame or KeyFrame, one per keypoint, contiguous and 32 byte aligned.
+// Copies are deep, like the cv::Mat clones they replace.
+class DescriptorArray
+{
+public:
+    DescriptorArray(){}
+    explicit DescriptorArray(const cv::Mat &descriptors){ Assign(descriptors); }
+
+    // Copies the rows of a N x 32 CV_8U descriptor Mat
+    void Assign(const cv::Mat &descriptors)
+    {
+        mvDescriptors.resize(descriptors.rows);
+        for(int i=0; i<descriptors.rows; i++)
+            memcpy(mvDescriptors[i].data, descriptors.ptr<unsigned char>(i), sizeof(ORBDescriptor));
+    }
+
+    // Frees the memory, the array is empty until assigned again
+    void Release() { std::vector<ORBDescriptor>().swap(mvDescriptors); }
+
+    size_t size() const { return mvDescriptors.size(); }
+    bool empty() const { return mvDescriptors.empty(); }
+
+    const ORBDescriptor& operator[](size_t i) const { return mvDescriptors[i]; }
+    ORBDescriptor& operator[](size_t i) { return mvDescriptors[i]; }
+    const unsigned char* ptr(size_t i) const { return mvDescriptors[i].data; }
+
+    // Zero-copy N x 32 CV_8U view for cv::Mat consumers (DBoW2 transform, serialization, OpenCV
+    // matchers). It is valid while the array is alive and not reassigned.
+    cv::Mat AsMat() const
+    {
+        if(mvDescriptors.empty())
+            return cv::Mat();
+        return cv::Mat(mvDescriptors.size(), sizeof(ORBDescriptor), CV_8U, const_cast<ORBDescriptor*>(&mvDescriptors[0]));
+    }
+    operator cv::Mat() const { return AsMat(); }
+
+protected:
+    std::vector<ORBDescriptor> mvDescriptors;
+};
+
+} //namespace ORB_SLAM
+
+#endif // DESCRIPTOR_H
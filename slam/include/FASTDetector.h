@@ -0,0 +1,20 @@
+#ifndef FASTDETECTOR_H
+#define FASTDETECTOR_H
+
+namespace ORB_SLAM2
+{
+
+// FAST-9 on the 16 pixel circle of radius 3, the same test and score as cv::FAST (TYPE_9_16).
+// Uses OpenCV universal intrinsics, so it runs on SSE2/AVX2/NEON depending on the build.
+
+// Scans the pixels [x0,x1) of the row pointed by pRow, step is the image row stride in bytes.
+// 3 pixels around the scanned range must be readable.
+// For every pixel that is a corner at threshold, scores[x] receives its corner score (the largest
+// threshold it survives, >= threshold) and x is appended to corners. Other pixels of scores[x0,x1)
+// are set to 0. Returns the number of corners, corners must have room for x1-x0 entries.
+int FASTScoreRow(const unsigned char* pRow, int step, int x0, int x1, int threshold,
+                 unsigned char* scores, int* corners);
+
+} //namespace ORB_SLAM
+
+#endif // FASTDETECTOR_H
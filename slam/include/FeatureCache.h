@@ -0,0 +1,99 @@
+#ifndef FEATURECACHE_H
+#define FEATURECACHE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+// Binary cache of the ORB features of an image sequence, so that the tracking can be replayed
+// through System::TrackMonocular(descriptors, keypoints, timestamp) without extracting again.
+//
+// Layout (host byte order):
+//   FeatureCacheHeader
+//   per frame, 32 byte aligned: CachedKeyPoint[nKeys], padding to 32 bytes, descriptors[nKeys][32]
+//   FeatureCacheFrame[nFrames] at header.indexOffset
+struct FeatureCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nFrames;
+    float cols;
+    float rows;
+    uint64_t indexOffset;
+    uint32_t descriptorSize;
+    uint32_t reserved[7];
+};
+
+struct FeatureCacheFrame
+{
+    double timestamp;
+    uint64_t offset;
+    uint32_t nKeys;
+    uint32_t reserved;
+};
+
+struct CachedKeyPoint
+{
+    float x;
+    float y;
+    float size;
+    float angle;
+    float response;
+    int32_t octave;
+};
+
+// Writes the frames in the order they are added
+class FeatureCacheWriter
+{
+public:
+    FeatureCacheWriter();
+    ~FeatureCacheWriter();
+
+    bool Open(const std::string &filename, float cols, float rows);
+    void AddFrame(double timestamp, const std::vector<cv::KeyPoint> &vKeys, const cv::Mat &descriptors);
+    // Writes the frame index. Returns false if any write failed.
+    bool Close();
+
+protected:
+    void Pad();
+
+    std::ofstream mFile;
+    FeatureCacheHeader mHeader;
+    std::vector<FeatureCacheFrame> mvFrames;
+    uint64_t mnOffset;
+};
+
+// Read-only memory mapped cache
+class FeatureCache
+{
+public:
+    FeatureCache();
+    ~FeatureCache();
+
+    bool Open(const std::string &filename);
+    void Close();
+
+    size_t size() const { return mnFrames; }
+    float GetCols() const { return mpHeader->cols; }
+    float GetRows() const { return mpHeader->rows; }
+    double GetTimestamp(size_t i) const { return mpFrames[i].timestamp; }
+
+    // Keypoints are copied, descriptors is a N x 32 CV_8U view into the mapping (valid until Close)
+    void GetFrame(size_t i, std::vector<cv::KeyPoint> &vKeys, cv::Mat &descriptors) const;
+
+protected:
+    void* mpData;
+    size_t mnSize;
+    const FeatureCacheHeader* mpHeader;
+    const FeatureCacheFrame* mpFrames;
+    size_t mnFrames;
+};
+
+} //namespace ORB_SLAM
+
+#endif // FEATURECACHE_H
@@ -0,0 +1,51 @@
+#ifndef FEATUREGRID_H
+#define FEATUREGRID_H
+
+#include <vector>
+#include <cstddef>
+
+namespace ORB_SLAM2
+{
+
+// Grid of keypoint indices in compressed sparse row layout: the indices of cell (x,y) are
+// mvIndices[mvOffsets[c]] .. mvIndices[mvOffsets[c+1]-1], with c = x*rows+y. Inside a cell the
+// indices are in increasing order, as in the vector<size_t>[cols][rows] grid it replaces.
+class FeatureGrid
+{
+public:
+    FeatureGrid();
+
+    // Counting sort of the keypoints by cell. vCells[i] is the cell x*rows+y of keypoint i,
+    // or -1 if it is outside the grid.
+    void Build(int nCols, int nRows, const std::vector<int> &vCells);
+
+    // Conversion from/to the nested vector grid, used by the map file
+    void FromNested(const std::vector< std::vector< std::vector<size_t> > > &vGrid);
+    std::vector< std::vector< std::vector<size_t> > > ToNested() const;
+
+    // Raw arrays, used by the native map file. Offsets() has Cols()*Rows()+1 entries and the indices
+    // of the grid are the first Offsets().back() of Indices().
+    const std::vector<unsigned int> &Offsets() const { return mvOffsets; }
+    const std::vector<unsigned int> &Indices() const { return mvIndices; }
+    void Assign(int nCols, int nRows, const unsigned int* pOffsets, const unsigned int* pIndices);
+
+    // Frees the memory, the grid is empty until built or assigned again
+    void Release();
+
+    int Cols() const { return mnCols; }
+    int Rows() const { return mnRows; }
+
+    const unsigned int* CellBegin(int x, int y) const { return &mvIndices[0] + mvOffsets[x*mnRows+y]; }
+    const unsigned int* CellEnd(int x, int y) const { return &mvIndices[0] + mvOffsets[x*mnRows+y+1]; }
+    bool CellEmpty(int x, int y) const { return mvOffsets[x*mnRows+y]==mvOffsets[x*mnRows+y+1]; }
+
+protected:
+    int mnCols;
+    int mnRows;
+    std::vector<unsigned int> mvOffsets;
+    std::vector<unsigned int> mvIndices;
+};
+
+} //namespace ORB_SLAM
+
+#endif // FEATUREGRID_H
@@ -29,6 +29,8 @@
 #include "ORBVocabulary.h"
 #include "KeyFrame.h"
 #include "ORBextractor.h"
+#include "Descriptor.h"
+#include "FeatureGrid.h"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/features2d.hpp>
@@ -61,6 +63,12 @@ namespace ORB_SLAM2 {
         Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor *extractor, ORBVocabulary *voc, cv::Mat &K,
               cv::Mat &distCoef, const float &bf, const float &thDepth);
 
+        // Constructor for Monocular cameras with the features already extracted from imGray by extractor
+        // (pipelined extraction, see FramePipeline).
+        Frame(const cv::Mat &imGray, const vector<cv::KeyPoint> &vKeys, const cv::Mat &descriptors,
+              const double &timeStamp, ORBextractor *extractor, ORBVocabulary *voc, cv::Mat &K, cv::Mat &distCoef,
+              const float &bf, const float &thDepth);
+
         Frame(const cv::Mat &descriptors, vector<cv::KeyPoint> &keyPoints, const float cols, const float rows,
               const double &timeStamp,
               ORBextractor *extractor, ORBVocabulary *voc, cv::Mat &K, cv::Mat &distCoef,
@@ -102,6 +110,44 @@ namespace ORB_SLAM2 {
         vector<size_t> GetFeaturesInArea(const float &x, const float &y, const float &r, const int minLevel = -1,
                                          const int maxLevel = -1) const;
 
+        // Same, filling a caller buffer so that repeated queries do not allocate.
+        void GetFeaturesInArea(const float &x, const float &y, const float &r, const int minLevel,
+                               const int maxLevel, vector<size_t> &vIndices) const;
+
+        // Calls callback(idx) for each keypoint in the area, in the order GetFeaturesInArea returns them.
+        template<typename Callback>
+        void ForEachFeatureInArea(const float &x, const float &y, const float &r, const int minLevel,
+                                  const int maxLevel, Callback callback) const {
+            const int nMinCellX = max(0, (int) floor((x - mnMinX - r) * mfGridElementWidthInv));
+            const int nMaxCellX = min((int) FRAME_GRID_COLS - 1, (int) ceil((x - mnMinX + r) * mfGridElementWidthInv));
+            const int nMinCellY = max(0, (int) floor((y - mnMinY - r) * mfGridElementHeightInv));
+            const int nMaxCellY = min((int) FRAME_GRID_ROWS - 1, (int) ceil((y - mnMinY + r) * mfGridElementHeightInv));
+
+            const bool bCheckLevels = (minLevel > 0) || (maxLevel >= 0);
+
+            for (int ix = nMinCellX; ix <= nMaxCellX; ix++) {
+                for (int iy = nMinCellY; iy <= nMaxCellY; iy++) {
+                    for (const unsigned int *pIdx = mGrid.CellBegin(ix, iy), *pEnd = mGrid.CellEnd(ix, iy);
+                         pIdx != pEnd; pIdx++) {
+                        const cv::KeyPoint &kpUn = mvKeysUn[*pIdx];
+                        if (bCheckLevels) {
+                            if (kpUn.octave < minLevel)
+                                continue;
+                            if (maxLevel >= 0)
+                                if (kpUn.octave > maxLevel)
+                                    continue;
+                        }
+
+                        const float distx = kpUn.pt.x - x;
+                        const float disty = kpUn.pt.y - y;
+
+                        if (fabs(distx) < r && fabs(disty) < r)
+                            callback((size_t) *pIdx);
+                    }
+                }
+            }
+        }
+
         // Search a match for each keypoint in the left image to a keypoint in the right image.
         // If there is a match, depth is computed and the right coordinate associated to the left keypoint is stored.
         void ComputeStereoMatches();
@@ -120,7 +166,6 @@ namespace ORB_SLAM2 {
 
         // Feature extractor. The right is used only in the stereo case.
         ORBextractor *mpORBextractorLeft, *mpORBextractorRight;
-        cv::Ptr<cv::ORB> orb;
 
         // Frame timestamp.
         double mTimeStamp;
@@ -163,8 +208,8 @@ namespace ORB_SLAM2 {
         DBoW2::BowVector mBowVec;
         DBoW2::FeatureVector mFeatVec;
 
-        // ORB descriptor, each row associated to a keypoint.
-        cv::Mat mDescriptors, mDescriptorsRight;
+        // ORB descriptor, each one associated to a keypoint.
+        DescriptorArray mDescriptors, mDescriptorsRight;
 
         // MapPoints associated to keypoints, NULL pointer if no association.
         std::vector<MapPoint *> mvpMapPoints;
@@ -175,7 +220,7 @@ namespace ORB_SLAM2 {
         // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
         static float mfGridElementWidthInv;
         static float mfGridElementHeightInv;
-        std::vector<std::size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+        FeatureGrid mGrid;
 
         // Camera pose.
         cv::Mat mTcw;
@@ -220,6 +265,10 @@ namespace ORB_SLAM2 {
         // Assign keypoints to the grid for speed up feature matching (called in the constructor).
         void AssignFeaturesToGrid();
 
+        // Undistortion, image bounds and grid of a monocular frame once its features are set
+        // (called in the constructor).
+        void InitMonocular(const cv::Mat &imGray);
+
         // Rotation, translation and camera center
         cv::Mat mRcw;
         cv::Mat mtcw;
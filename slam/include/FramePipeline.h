@@ -0,0 +1,78 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+class ORBextractor;
+
+// First stage of the pipelined monocular tracking: grayscale conversion and ORB extraction of the
+// queued images on a background thread, while the tracking thread works on the previous frame.
+// Images come out in the order they were pushed. At most nQueueSize images are waiting or in
+// extraction, Push blocks when the queue is full. nQueueSize is at least 2, so that a caller that
+// pushes and pops on the same thread always has one image in extraction.
+class FramePipeline
+{
+public:
+    struct Item
+    {
+        cv::Mat im;
+        double timestamp;
+        ORBextractor* pExtractor;
+        std::vector<cv::KeyPoint> vKeys;
+        cv::Mat descriptors;
+    };
+
+    FramePipeline(ORBextractor* pIniExtractor, ORBextractor* pExtractor, bool bRGB, int nQueueSize);
+    ~FramePipeline();
+
+    void Push(const cv::Mat &im, const double &timestamp);
+
+    // Waits until the oldest image is extracted and takes it. Returns false if the queue is empty.
+    bool Pop(Item &item);
+
+    // Images pushed and not popped yet
+    size_t size();
+
+    // Extractor for the images not extracted yet: the initialization extractor while the tracking
+    // is not initialized (as Tracking::GrabImageMonocular)
+    void SetUseIniExtractor(bool bUseIni);
+
+    // Extracts item.im again with another extractor, for images extracted before the tracking
+    // state changed. Extractors are only used by one thread at a time.
+    void Extract(ORBextractor* pExtractor, Item &item);
+
+    // Stops the extraction thread, images not popped yet are dropped
+    void Finish();
+
+protected:
+    void Run();
+
+    ORBextractor* mpIniExtractor;
+    ORBextractor* mpExtractor;
+    bool mbRGB;
+    size_t mnQueueSize;
+
+    std::mutex mMutexQueue;
+    std::condition_variable mCondQueue;
+    // Items in push order, the first mnExtracted of them are ready
+    std::deque<Item> mqItems;
+    size_t mnExtracted;
+    bool mbUseIniExtractor;
+    bool mbFinish;
+
+    std::mutex mMutexExtractor;
+
+    std::thread* mptExtraction;
+};
+
+} //namespace ORB_SLAM
+
+#endif // FRAMEPIPELINE_H
@@ -0,0 +1,31 @@
+#ifndef HAMMINGDISTANCE_H
+#define HAMMINGDISTANCE_H
+
+#include <string>
+#include <vector>
+
+namespace ORB_SLAM2
+{
+
+// Hamming distances between 256 bit ORB descriptors (32 bytes, rows of a CV_8U descriptor Mat).
+// The kernel is chosen on first use from the CPU features: AVX-512 VPOPCNTDQ, AVX2, popcnt or
+// portable bit counting. All kernels give the same results as ORBmatcher::DescriptorDistance.
+
+int DescriptorDistance(const unsigned char* a, const unsigned char* b);
+
+// dist[i] = distance between a and pB[i], for i<n
+void DescriptorDistances(const unsigned char* a, const unsigned char* const* pB, int n, int* dist);
+
+// dist[i*nB+j] = distance between pA[i] and pB[j]
+void DescriptorDistanceMatrix(const unsigned char* const* pA, int nA, const unsigned char* const* pB, int nB, int* dist);
+
+// Kernel in use, and the kernels this CPU can run (best first)
+std::string GetHammingKernel();
+std::vector<std::string> GetAvailableHammingKernels();
+
+// Forces one of the available kernels (for benchmarks). Returns false if it cannot run here.
+bool SetHammingKernel(const std::string &name);
+
+} //namespace ORB_SLAM
+
+#endif // HAMMINGDISTANCE_H
@@ -28,6 +28,7 @@ using namespace std;
 #include "ORBVocabulary.h"
 #include "ORBextractor.h"
 #include "Frame.h"
+#include "FeatureGrid.h"
 #include "KeyFrameDatabase.h"
 #include "Converter.h"
 #include "Serialization.h"
@@ -57,6 +58,7 @@ class Map;
 class MapPoint;
 class Frame;
 class KeyFrameDatabase;
+class MapIdIndex;
 struct id_map;
 
 // class CameraMatrix{
@@ -123,6 +125,10 @@ public:
     void AddConnection(KeyFrame* pKF, const int &weight);
     void EraseConnection(KeyFrame* pKF);
     void UpdateConnections();
+    // UpdateConnections in two steps. CountCovisibles only reads the map points, so it can run for
+    // several keyframes in parallel. The connections are then updated one keyframe at a time.
+    std::map<KeyFrame*,int> CountCovisibles();
+    void UpdateConnections(const std::map<KeyFrame*,int> &KFcounter);
     void UpdateBestCovisibles();
     std::set<KeyFrame *> GetConnectedKeyFrames();
     std::vector<KeyFrame* > GetVectorCovisibleKeyFrames();
@@ -154,6 +160,33 @@ public:
 
     // KeyPoint functions
     std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r) const;
+    // Same, filling a caller buffer so that repeated queries do not allocate
+    void GetFeaturesInArea(const float &x, const float  &y, const float  &r, std::vector<size_t> &vIndices) const;
+    // Calls callback(idx) for each keypoint in the area, in the order GetFeaturesInArea returns them
+    template<typename Callback>
+    void ForEachFeatureInArea(const float &x, const float  &y, const float  &r, Callback callback) const
+    {
+        const int nMinCellX = std::max(0,(int)floor((x-mnMinX-r)*mfGridElementWidthInv));
+        const int nMaxCellX = std::min((int)mnGridCols-1,(int)ceil((x-mnMinX+r)*mfGridElementWidthInv));
+        const int nMinCellY = std::max(0,(int)floor((y-mnMinY-r)*mfGridElementHeightInv));
+        const int nMaxCellY = std::min((int)mnGridRows-1,(int)ceil((y-mnMinY+r)*mfGridElementHeightInv));
+
+        for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
+        {
+            for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
+            {
+                for(const unsigned int *pIdx=mGrid.CellBegin(ix,iy), *pEnd=mGrid.CellEnd(ix,iy); pIdx!=pEnd; pIdx++)
+                {
+                    const cv::KeyPoint &kpUn = mvKeysUn[*pIdx];
+                    const float distx = kpUn.pt.x-x;
+                    const float disty = kpUn.pt.y-y;
+
+                    if(fabs(distx)<r && fabs(disty)<r)
+                        callback((size_t)*pIdx);
+                }
+            }
+        }
+    }
     cv::Mat UnprojectStereo(int i);
 
     // Image
@@ -170,6 +203,16 @@ public:
     // Compute Scene Depth (q=2 median). Used in monocular.
     float ComputeSceneMedianDepth(const int q);
 
+    // Keyframe image, read from the image store of the map if the keyframe does not keep it.
+    // Empty if there is none.
+    cv::Mat GetImage();
+    bool HasImage();
+
+    // Keeps mvKeys, mDescriptors and the grid in memory while they are read, reading them back
+    // from the payload store of the map if they were paged out. Prefer KeyFramePayloadPin.
+    void PinPayload();
+    void UnpinPayload();
+
     static bool weightComp( int a, int b){
         return a>b;
     }
@@ -181,15 +224,17 @@ public:
 	void SetMap(Map* map);
 	void SetKeyFrameDatabase(KeyFrameDatabase* pKeyFrameDB);
 	void SetORBvocabulary(ORBVocabulary* pORBvocabulary);
-	void SetMapPoints(std::vector<MapPoint*> spMapPoints);
-	void SetSpanningTree(std::vector<KeyFrame*> vpKeyFrames);
-	void SetGridParams(std::vector<KeyFrame*> vpKeyFrames);
+	// Resolve the ids read by load
+	void SetMapPoints(const MapIdIndex &index);
+	void SetSpanningTree(const MapIdIndex &index);
+	void SetGridParams(const MapIdIndex &index);
 
 
 
     // The following variables are accesed from only 1 thread or never change (no mutex needed).
 public:
 
+    // Empty if only the image store of the map has it (see GetImage)
     cv::Mat image;
 
     static long unsigned int nNextId;
@@ -236,7 +281,7 @@ public:
     const std::vector<cv::KeyPoint> mvKeysUn;
     const std::vector<float> mvuRight; // negative value for monocular points
     const std::vector<float> mvDepth; // negative value for monocular points
-    cv::Mat mDescriptors;
+    DescriptorArray mDescriptors;
 
     //BoW
     DBoW2::BowVector mBowVec;
@@ -280,7 +325,7 @@ protected:
     ORBVocabulary* mpORBvocabulary;
 
     // Grid over the image to speed up feature matching
-    std::vector< std::vector <std::vector<size_t> > > mGrid;
+    FeatureGrid mGrid;
 
     std::map<KeyFrame*,int> mConnectedKeyFrameWeights;
 		std::map<long unsigned int, int> 	   mConnectedKeyFrameWeights_nId;
@@ -307,6 +352,9 @@ protected:
 
     Map* mpMap;
 // #ifndef _BAR_
+	friend class MapFile;
+	friend class MapJournal;
+	friend class KeyFramePayloadStore;
 	friend class boost::serialization::access;
  	template<class Archive>
     void serialize(Archive & ar, const unsigned int version)
@@ -327,6 +375,7 @@ protected:
     std::mutex mMutexFeatures;
   
   public:
+  // Compact export of this keyframe and the map points it observes (RaspberryMapFile)
   void rpi_save(const std::string& file_name);
   // {
     
@@ -405,6 +454,20 @@ protected:
 
 
 
+};
+
+// Pins the payload of a keyframe for the lifetime of the object. NULL is allowed.
+class KeyFramePayloadPin
+{
+public:
+    explicit KeyFramePayloadPin(KeyFrame* pKF): mpKF(pKF) { if(mpKF) mpKF->PinPayload(); }
+    ~KeyFramePayloadPin() { if(mpKF) mpKF->UnpinPayload(); }
+
+private:
+    KeyFramePayloadPin(const KeyFramePayloadPin&);
+    KeyFramePayloadPin& operator=(const KeyFramePayloadPin&);
+
+    KeyFrame* mpKF;
 };
 
 } //namespace ORB_SLAM
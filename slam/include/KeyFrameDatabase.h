@@ -66,6 +66,11 @@ public:
    // Relocalization
    std::vector<KeyFrame*> DetectRelocalizationCandidates(Frame* F);
 
+   // Image retrieval. Scores the keyframes sharing words with vBowVec through the inverted file and returns
+   // the best nMaxCandidates (score, keyframe) pairs, best first. Does not touch the keyframes query
+   // bookkeeping, so it can be called from several threads at once.
+   std::vector<std::pair<float,KeyFrame*> > DetectBestCandidates(const DBoW2::BowVector &vBowVec, int nMaxCandidates);
+
 protected:
 
   // Associated vocabulary
@@ -77,6 +82,7 @@ protected:
   // Mutex
   std::mutex mMutex;
 
+	friend class MapFile;
 	friend class boost::serialization::access;
 
     template<class Archive>
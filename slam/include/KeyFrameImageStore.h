@@ -0,0 +1,97 @@
+#ifndef KEYFRAMEIMAGESTORE_H
+#define KEYFRAMEIMAGESTORE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+// Keyframe images kept out of the map: every image is PNG compressed on a background thread and
+// appended to a blob file, and read back by keyframe id when an export needs it. With bRetain
+// false the keyframes drop their image once it is queued, so images only take memory while they
+// wait to be written.
+//
+// Layout (host byte order): KeyFrameImageHeader, then for every image a KeyFrameImageRecord
+// followed by the encoded bytes. If an id is written twice (ids restart after a reset) the last
+// image is the one read. A record cut short by a crash is dropped when the file is opened again.
+// Ids are only meaningful for the map the store was written with: a run that starts without a map
+// truncates the store, a run that loads a map must use the store that map was saved with.
+struct KeyFrameImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct KeyFrameImageRecord
+{
+    uint64_t id;
+    uint64_t size;
+};
+
+class KeyFrameImageStore
+{
+public:
+    // Opens (or creates) the blob file. nCompression is the PNG compression level, 0-9. With
+    // bTruncate the images of previous runs are dropped.
+    KeyFrameImageStore(const std::string &filename, bool bRetain, int nCompression, bool bTruncate = false);
+    ~KeyFrameImageStore();
+
+    // False if the file could not be opened or is not an image store, nothing is written then
+    bool IsOpen() const { return mFd>=0; }
+
+    // True if keyframes keep their image in memory once it is queued
+    bool RetainsImages() const { return mbRetain; }
+
+    // Queues the image of keyframe id for writing. The image is shared, not copied, it must not
+    // be written afterwards. Returns false if the image was not queued.
+    bool Add(long unsigned int id, const cv::Mat &image);
+
+    bool Has(long unsigned int id);
+
+    // Image of keyframe id (from the queue if it is not written yet), empty if there is none
+    cv::Mat Get(long unsigned int id);
+
+    // Waits until every queued image is in the file
+    void Flush();
+
+    // Writes the queued images and stops the writer thread
+    void Finish();
+
+protected:
+    struct Location
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    bool Open(const std::string &filename, bool bTruncate);
+    void Run();
+
+    bool mbRetain;
+    std::vector<int> mvEncodeParams;
+
+    int mFd;
+    uint64_t mnFileSize;
+
+    std::mutex mMutexStore;
+    std::condition_variable mCondStore;
+    // Images waiting to be written, the front one is being written
+    std::deque<std::pair<long unsigned int, cv::Mat> > mqPending;
+    std::map<long unsigned int, Location> mmLocations;
+    bool mbFinish;
+
+    std::thread* mptWriter;
+};
+
+} //namespace ORB_SLAM
+
+#endif // KEYFRAMEIMAGESTORE_H
@@ -0,0 +1,114 @@
+#ifndef KEYFRAMEPAYLOADSTORE_H
+#define KEYFRAMEPAYLOADSTORE_H
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+namespace ORB_SLAM2
+{
+
+class KeyFrame;
+
+// Out-of-core storage of the keyframe payloads: the distorted keypoints, descriptors and feature
+// grid of a keyframe are paged out to a scratch file once the resident payloads exceed a memory
+// budget, least recently used first, and read back when a keyframe is pinned again. Pose,
+// covisibility, BoW, undistorted keypoints and stereo stay resident, as bundle adjustment and
+// keyframe culling read them for every observing keyframe.
+//
+// A reader pins a keyframe (KeyFramePayloadPin) for as long as it uses the payload; a pinned
+// keyframe is never evicted. A payload does not change once the keyframe is built, so it is written
+// once and evicting it again only frees the memory. The file is read and written without the store
+// mutex: the keyframe is marked in transit meanwhile and pins of it wait.
+//
+// Layout (host byte order): KeyFramePayloadRecord, then the keypoints, descriptors, grid offsets
+// and grid indices, for every keyframe paged out. The file only lives as long as the store, it is
+// truncated when opened.
+struct KeyFramePayloadRecord
+{
+    uint64_t id;
+    uint32_t nKeys;
+    int32_t gridCols;
+    int32_t gridRows;
+    uint32_t nGridIndices;
+};
+
+class KeyFramePayloadStore
+{
+public:
+    // nBudgetBytes is the memory the resident payloads may take
+    KeyFramePayloadStore(const std::string &filename, uint64_t nBudgetBytes);
+    ~KeyFramePayloadStore();
+
+    // False if the file could not be opened, nothing is paged out then
+    bool IsOpen() const { return mFd>=0; }
+
+    // A keyframe of the map, with its payload resident. Keyframes erased from the map stay in the
+    // store, they are not deleted and may still be referenced.
+    void Add(KeyFrame* pKF);
+    // All the keyframes are deleted (Map::clear)
+    void Clear();
+
+    // Reads the payload back if it was paged out and keeps it resident until Unpin. Keyframes that
+    // were not added are left alone.
+    void Pin(KeyFrame* pKF);
+    void Unpin(KeyFrame* pKF);
+
+    uint64_t GetResidentBytes();
+    size_t GetPagedOutCount();
+
+    // Stops the eviction thread, every payload stays where it is
+    void Finish();
+
+protected:
+    struct Entry
+    {
+        std::list<KeyFrame*>::iterator itLRU;
+        uint64_t nBytes;
+        int nPins;
+        bool bResident;
+        // Being written out or read back, its payload belongs to that thread
+        bool bInTransit;
+        // Location in the file, once written
+        bool bWritten;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    static uint64_t PayloadBytes(KeyFrame* pKF);
+
+    // Called without mMutexStore, the keyframe in transit. Write appends the payload to the file
+    // (only the eviction thread does) and returns its size, 0 if it failed.
+    uint64_t Write(KeyFrame* pKF);
+    bool Read(KeyFrame* pKF, uint64_t offset, uint64_t size);
+
+    // mMutexStore must be held
+    void Evict(KeyFrame* pKF, Entry &entry);
+
+    void Run();
+
+    uint64_t mnBudgetBytes;
+
+    int mFd;
+    uint64_t mnFileSize;
+
+    std::mutex mMutexStore;
+    std::condition_variable mCondStore;
+    std::unordered_map<KeyFrame*,Entry> mmEntries;
+    // Most recently pinned first
+    std::list<KeyFrame*> mlLRU;
+    uint64_t mnResidentBytes;
+    size_t mnPagedOut;
+    int mnInTransit;
+    bool mbFinish;
+
+    std::thread* mptEvictor;
+};
+
+} //namespace ORB_SLAM
+
+#endif // KEYFRAMEPAYLOADSTORE_H
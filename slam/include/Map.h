@@ -33,6 +33,7 @@
 #include <boost/serialization/split_member.hpp>
 
 #include <mutex>
+#include <atomic>
 
 
 
@@ -41,6 +42,38 @@ namespace ORB_SLAM2
 
 class MapPoint;
 class KeyFrame;
+class TaskPool;
+class KeyFrameImageStore;
+class KeyFramePayloadStore;
+class MapJournal;
+
+// Copy of the map taken under a short lock, it can be read from any thread afterwards.
+// Poses, positions and normals are deep copies.
+struct KeyFrameSnapshot
+{
+    long unsigned int mnId;
+    cv::Mat mTcw;
+    // Images are fetched with KeyFrame::GetImage when needed, they may be on disk only
+    bool mbHasImage;
+    int mnMapPoints;
+};
+
+struct MapPointSnapshot
+{
+    long unsigned int mnId;
+    cv::Mat mWorldPos;
+    cv::Mat mNormal;
+    float mfMinDistance;
+    float mfMaxDistance;
+    // (keyframe id, undistorted keypoint) of every observation
+    std::vector<std::pair<long unsigned int, cv::Point2f> > mvObservations;
+};
+
+struct MapSnapshot
+{
+    std::vector<KeyFrameSnapshot> mvKeyFrames;
+    std::vector<MapPointSnapshot> mvMapPoints;
+};
 
 class Map
 {
@@ -67,10 +100,46 @@ public:
 
     void clear();
 
+    // After load: turns the keyframe and map point ids read from the file into pointers and
+    // rebuilds the covisibility graph. Linear in the size of the map, spread over the pool if given.
+    void RestoreLinks(TaskPool* pPool = NULL);
+
+    // Captures the good keyframes and map points. Holds mMutexMapUpdate only while copying poses,
+    // positions and observations, the keypoints of the observations are looked up afterwards.
+    MapSnapshot CreateSnapshot();
+
+    // Store of the keyframe images, NULL if keyframes keep their image in memory only.
+    // Set before keyframes are created, the map does not own it.
+    void SetImageStore(KeyFrameImageStore* pImageStore);
+    KeyFrameImageStore* GetImageStore();
+
+    // Store the keyframe payloads are paged out to, NULL if they stay in memory. The keyframes
+    // already in the map are added to it. The map does not own it. Read without mMutexMap, every
+    // keyframe pin asks for it.
+    void SetPayloadStore(KeyFramePayloadStore* pPayloadStore);
+    KeyFramePayloadStore* GetPayloadStore();
+
+    // Journal of the map changes, NULL if there is none. The map does not own it. Read without
+    // mMutexMap: every pose, position and observation change asks for it.
+    void SetJournal(MapJournal* pJournal);
+    MapJournal* GetJournal();
+
+    // Tells the journal, if any, that a keyframe or map point of the map changed
+    void MarkChanged(KeyFrame* pKF);
+    void MarkChanged(MapPoint* pMP);
+
+    bool HasKeyFrame(KeyFrame* pKF);
+    bool HasMapPoint(MapPoint* pMP);
+
     vector<KeyFrame*> mvpKeyFrameOrigins;
 
     mutable std::mutex mMutexMapUpdate;
 
+    // Held by savers from the moment they capture the map under mMutexMapUpdate until they are done
+    // reading the keyframes and map points it refers to (MapFile::Write). clear() takes it before
+    // deleting them.
+    std::mutex mMutexSave;
+
     // This avoid that two points are created simultaneously in separate threads (id conflict)
     mutable std::mutex mMutexPointCreation;
 
@@ -82,6 +151,10 @@ protected:
 
     long unsigned int mnMaxKFid;
 
+    KeyFrameImageStore* mpImageStore;
+    std::atomic<KeyFramePayloadStore*> mpPayloadStore;
+    std::atomic<MapJournal*> mpJournal;
+
     std::mutex mMutexMap;
 
 	friend class boost::serialization::access;
@@ -0,0 +1,90 @@
+#ifndef MAPEXPORTER_H
+#define MAPEXPORTER_H
+
+#include "Map.h"
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <functional>
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrameDatabase;
+class LocalMapping;
+class LoopClosing;
+
+// Writes the map on a background thread so tracking and rendering do not stall.
+// The cloud csv is written from a MapSnapshot taken by the caller. For the binary map the
+// changing state of the map is captured (MapFile::Capture) while local mapping is paused and
+// the map update mutex is held, tracking only waits for that copy. The file is written from
+// the capture afterwards.
+class MapExporter
+{
+public:
+    enum eExportState{
+        IDLE=0,
+        WRITING_CSV=1,
+        WRITING_BINARY=2,
+        DONE=3
+    };
+
+    MapExporter(Map* pMap, KeyFrameDatabase* pKFDB, LocalMapping* pLocalMapper, LoopClosing* pLoopCloser);
+    ~MapExporter();
+
+    // Takes the snapshot on the calling thread and returns. An empty filename skips that output.
+    // Returns false if the previous export is still running.
+    bool RequestExport(const std::string &csvFilename, const std::string &binFilename);
+
+    bool isRunning();
+    eExportState GetState();
+
+    // Fraction of the current stage already written, in [0,1]
+    float GetProgress();
+
+    // Waits for the running export, if any
+    void Join();
+
+    // Writes the native map file from the calling thread. Local mapping is paused and tracking
+    // waits only while the map is captured. Concurrent calls are serialized. progress, if set,
+    // gets the fraction of the file written.
+    bool SaveBinary(const std::string &filename, const std::function<void(float)> &progress = nullptr);
+
+    // Writes the compact Raspberry Pi export of the map (RaspberryMapFile) from the calling thread,
+    // blocking tracking only while the map is captured. With pVoc it is a localization package,
+    // with the BoW of the keyframes and their inverted index.
+    bool SaveRaspberry(const std::string &filename, const ORBVocabulary* pVoc = NULL);
+
+    // One line per map point: position, min/max distance, normal and "kfId,u,v" for every
+    // observation from a keyframe with an image. Same format as the simulator cloud csv.
+    static void SaveCloudCsv(const MapSnapshot &snapshot, const std::string &filename,
+                             const std::function<void(float)> &progress = nullptr);
+
+protected:
+    void Run(MapSnapshot snapshot, std::string csvFilename, std::string binFilename);
+    void SetState(eExportState state, float progress);
+
+    // Runs capture with local mapping paused, no global bundle adjustment running and the map
+    // update mutex held, then write without them. The keyframes and map points stay alive until
+    // write returns (Map::mMutexSave).
+    bool SaveCaptured(const std::function<void()> &capture, const std::function<bool()> &write);
+
+    Map* mpMap;
+    KeyFrameDatabase* mpKeyFrameDB;
+    LocalMapping* mpLocalMapper;
+    LoopClosing* mpLoopCloser;
+
+    std::thread* mptExport;
+    std::mutex mMutexSave;
+
+    std::mutex mMutexState;
+    eExportState meState;
+    float mfProgress;
+    bool mbRunning;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPEXPORTER_H
@@ -0,0 +1,410 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+#include "ORBVocabulary.h"
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrame;
+class MapPoint;
+class KeyFrameDatabase;
+class KeyFrameImageStore;
+struct ORBDescriptor;
+
+// Native map file. Replaces the boost archive of System::SaveMap: the map is stored as fixed width
+// arrays, one section per array, so that loading is a bulk copy out of a memory mapping and the
+// references between keyframes and map points are array indices (no id lookup).
+//
+// Layout (host byte order):
+//   MapFileHeader
+//   MapFileSection[nSections]
+//   section data, each section 64 byte aligned
+//
+// Keyframes and map points are stored in id order. The per keypoint sections (keypoints,
+// descriptors, map point matches, ...) hold the keypoints of all keyframes back to back, a keyframe
+// record points to its first keypoint. A version change is required for any change of a record.
+//
+// The BoW sections are optional: they hold the BowVector and FeatureVector of every keyframe and the
+// inverted file of the KeyFrameDatabase, valid for the vocabulary of MapFileBowInfo only.
+static const uint32_t MAP_FILE_VERSION = 1;
+static const uint32_t MAP_FILE_NONE = 0xFFFFFFFF;
+
+enum eMapFileSection
+{
+    MAP_FILE_INFO = 1,              // MapFileInfo, one element
+    MAP_FILE_KEYFRAMES = 2,         // MapFileKeyFrame
+    MAP_FILE_KEYFRAME_ORIGINS = 3,  // uint32_t keyframe index
+    MAP_FILE_SCALE_LEVELS = 4,      // MapFileScaleLevel, mnScaleLevels per keyframe
+    MAP_FILE_KEYPOINTS = 5,         // MapFileKeyPoint (mvKeys)
+    MAP_FILE_KEYPOINTS_UN = 6,      // MapFileKeyPoint (mvKeysUn)
+    MAP_FILE_STEREO = 7,            // MapFileStereo
+    MAP_FILE_DESCRIPTORS = 8,       // 32 bytes per keypoint
+    MAP_FILE_MATCHES = 9,           // uint32_t map point index per keypoint, or MAP_FILE_NONE
+    MAP_FILE_GRID_OFFSETS = 10,     // uint32_t, FeatureGrid offsets of each keyframe
+    MAP_FILE_GRID_INDICES = 11,     // uint32_t, FeatureGrid indices of each keyframe
+    MAP_FILE_CONNECTIONS = 12,      // MapFileConnection (mConnectedKeyFrameWeights)
+    MAP_FILE_ORDERED = 13,          // MapFileConnection (mvpOrderedConnectedKeyFrames, mvOrderedWeights)
+    MAP_FILE_TREE = 14,             // uint32_t keyframe index: children, then loop edges of each keyframe
+    MAP_FILE_IMAGES = 15,           // keyframe image bytes (none if the map has a KeyFrameImageStore)
+    MAP_FILE_MAPPOINTS = 16,        // MapFileMapPoint
+    MAP_FILE_OBSERVATIONS = 17,     // MapFileObservation
+    MAP_FILE_BOW_INFO = 18,         // MapFileBowInfo, one element
+    MAP_FILE_BOW_RANGES = 19,       // MapFileBowRange, one per keyframe
+    MAP_FILE_BOW_WORDS = 20,        // MapFileBowWord (mBowVec)
+    MAP_FILE_FEATURE_NODES = 21,    // MapFileFeatureNode (mFeatVec)
+    MAP_FILE_FEATURE_INDICES = 22,  // uint32_t keypoint indices of the feature nodes
+    MAP_FILE_INVERTED_WORDS = 23,   // MapFileInvertedWord, the non empty words of the inverted file
+    MAP_FILE_INVERTED_KEYFRAMES = 24 // uint32_t keyframe index, in inverted file order
+};
+
+struct MapFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nSections;
+    uint64_t fileSize;
+    uint64_t reserved[5];
+};
+
+struct MapFileSection
+{
+    uint32_t id;
+    uint32_t elemSize;
+    uint64_t offset;
+    uint64_t count;
+    // 64 bit FNV-1a of the section bytes
+    uint64_t checksum;
+};
+
+struct MapFileInfo
+{
+    uint64_t nextKeyFrameId;
+    uint64_t nextMapPointId;
+    uint64_t maxKeyFrameId;
+};
+
+struct MapFileKeyFrame
+{
+    uint64_t id;
+    uint64_t frameId;
+    double timestamp;
+
+    // Bookkeeping of tracking, local mapping and loop closing
+    uint64_t trackReferenceForFrame;
+    uint64_t fuseTargetForKF;
+    uint64_t BALocalForKF;
+    uint64_t BAFixedForKF;
+    uint64_t loopQuery;
+    uint64_t relocQuery;
+    uint64_t BAGlobalForKF;
+
+    // First element in the per keypoint sections, the scale levels, the grid and the graph tables
+    uint64_t keyBegin;
+    uint64_t levelBegin;
+    uint64_t gridOffsetBegin;
+    uint64_t gridIndexBegin;
+    uint64_t connectionBegin;
+    uint64_t orderedBegin;
+    uint64_t treeBegin;
+    uint64_t imageOffset;
+
+    float Tcw[16];
+    float Tcp[16];
+
+    float fx, fy, cx, cy, invfx, invfy;
+    float bf, b, thDepth, halfBaseline;
+    float gridElementWidthInv, gridElementHeightInv;
+    float scaleFactor, logScaleFactor;
+    float loopScore, relocScore;
+
+    int32_t N;
+    int32_t gridCols, gridRows;
+    int32_t minX, minY, maxX, maxY;
+    int32_t scaleLevels;
+    int32_t loopWords, relocWords;
+    int32_t imageRows, imageCols, imageType;
+
+    uint32_t nConnections;
+    uint32_t nOrdered;
+    uint32_t parent;
+    uint32_t nChildren;
+    uint32_t nLoopEdges;
+
+    uint8_t hasTcp;
+    uint8_t firstConnection;
+    uint8_t notErase;
+    uint8_t toBeErased;
+    uint8_t bad;
+    uint8_t reserved[3];
+};
+
+struct MapFileScaleLevel
+{
+    float scaleFactor;
+    float levelSigma2;
+    float invLevelSigma2;
+};
+
+struct MapFileKeyPoint
+{
+    float x, y;
+    float size;
+    float angle;
+    float response;
+    int32_t octave;
+    int32_t classId;
+};
+
+struct MapFileStereo
+{
+    float uRight;
+    float depth;
+};
+
+struct MapFileConnection
+{
+    uint32_t keyFrame;
+    int32_t weight;
+};
+
+struct MapFileMapPoint
+{
+    uint64_t id;
+    int64_t firstKFid;
+    int64_t firstFrame;
+
+    uint64_t trackReferenceForFrame;
+    uint64_t lastFrameSeen;
+    uint64_t BALocalForKF;
+    uint64_t fuseCandidateForKF;
+    uint64_t loopPointForKF;
+    uint64_t correctedByKF;
+    uint64_t correctedReference;
+    uint64_t BAGlobalForKF;
+
+    uint64_t observationBegin;
+
+    uint8_t descriptor[32];
+    float pos[3];
+    float normal[3];
+    float minDistance, maxDistance;
+
+    int32_t nObs;
+    int32_t visible;
+    int32_t found;
+    uint32_t refKeyFrame;
+    uint32_t nObservations;
+
+    uint8_t bad;
+    uint8_t reserved[3];
+};
+
+struct MapFileObservation
+{
+    uint32_t keyFrame;
+    uint32_t index;
+};
+
+struct MapFileBowInfo
+{
+    // VocabularyHash of the vocabulary the BoW was computed with
+    uint64_t vocabularyHash;
+    uint32_t vocabularySize;
+    // Levels up from the leaves of the FeatureVector nodes
+    uint32_t levelsUp;
+};
+
+struct MapFileBowRange
+{
+    uint64_t wordBegin;
+    uint64_t nodeBegin;
+    uint64_t indexBegin;
+    uint32_t nWords;
+    uint32_t nNodes;
+};
+
+struct MapFileBowWord
+{
+    uint32_t word;
+    uint32_t reserved;
+    double value;
+};
+
+struct MapFileFeatureNode
+{
+    uint32_t node;
+    uint32_t nIndices;
+};
+
+struct MapFileInvertedWord
+{
+    uint32_t word;
+    uint32_t nKeyFrames;
+};
+
+// Read-only mapping of a map file with its section table
+class MapFileView
+{
+public:
+    MapFileView(): mpData(NULL), mnSize(0), mpSections(NULL), mnSections(0) {}
+    ~MapFileView();
+
+    // Maps the file and checks the header and the section table
+    bool Open(const std::string &filename);
+    bool VerifyChecksums() const;
+
+    template<class T>
+    bool Get(uint32_t id, const T* &pElems, uint64_t &count) const
+    {
+        for(uint32_t i=0; i<mnSections; i++)
+        {
+            const MapFileSection &s = mpSections[i];
+            if(s.id!=id)
+                continue;
+            if(s.elemSize!=sizeof(T))
+                return false;
+            pElems = reinterpret_cast<const T*>(static_cast<const char*>(mpData) + s.offset);
+            count = s.count;
+            return true;
+        }
+        return false;
+    }
+
+protected:
+    void* mpData;
+    size_t mnSize;
+    const MapFileSection* mpSections;
+    uint32_t mnSections;
+};
+
+// The sections of a map file, every range and index checked (MapFile::ReadContents). The
+// pointers are into the MapFileView.
+struct MapFileContents
+{
+    const MapFileInfo* pInfo; uint64_t nInfo;
+    const MapFileKeyFrame* pKFRecords; uint64_t nKFs;
+    const uint32_t* pOrigins; uint64_t nOrigins;
+    const MapFileScaleLevel* pLevels; uint64_t nLevels;
+    const MapFileKeyPoint* pKeys; uint64_t nKeys;
+    const MapFileKeyPoint* pKeysUn; uint64_t nKeysUn;
+    const MapFileStereo* pStereo; uint64_t nStereo;
+    const ORBDescriptor* pDescriptors; uint64_t nDescriptors;
+    const uint32_t* pMatches; uint64_t nMatches;
+    const uint32_t* pGridOffsets; uint64_t nGridOffsets;
+    const uint32_t* pGridIndices; uint64_t nGridIndices;
+    const MapFileConnection* pConnections; uint64_t nConnections;
+    const MapFileConnection* pOrdered; uint64_t nOrdered;
+    const uint32_t* pTree; uint64_t nTree;
+    const unsigned char* pImages; uint64_t nImageBytes;
+    const MapFileMapPoint* pMPRecords; uint64_t nMPs;
+    const MapFileObservation* pObservations; uint64_t nObservations;
+
+    // The BoW sections are only used if bBow is set
+    bool bBow;
+    const MapFileBowInfo* pBowInfo; uint64_t nBowInfo;
+    const MapFileBowRange* pBowRanges; uint64_t nBowRanges;
+    const MapFileBowWord* pBowWords; uint64_t nBowWords;
+    const MapFileFeatureNode* pFeatureNodes; uint64_t nFeatureNodes;
+    const uint32_t* pFeatureIndices; uint64_t nFeatureIndices;
+    const MapFileInvertedWord* pInvertedWords; uint64_t nInvertedWords;
+    const uint32_t* pInvertedKFs; uint64_t nInvertedKFs;
+};
+
+// What MapFile::Capture takes of a map: the state that changes while the map runs (poses, flags,
+// positions, graph, observations and map point matches) as file records. Keypoints, descriptors,
+// feature grids, scale levels, BoW vectors and images do not change once a keyframe is in the map,
+// MapFile::Write reads them from the keyframes, which must stay alive until then (Map::mMutexSave).
+struct MapFileCapture
+{
+    std::vector<KeyFrame*> vpKFs;
+    // The grid size and section offsets of the records are set by Write
+    std::vector<MapFileKeyFrame> vKFRecords;
+    std::vector<MapFileConnection> vConnections;
+    std::vector<MapFileConnection> vOrdered;
+    std::vector<uint32_t> vTree;
+    std::vector<uint32_t> vOrigins;
+    // Map point index of every keypoint of every keyframe, MAP_FILE_NONE if it has none
+    std::vector<uint32_t> vMatches;
+    std::vector<MapFileMapPoint> vMPRecords;
+    std::vector<MapFileObservation> vObservations;
+    // Images written to the map file, empty for those in the image store. They share the buffers
+    // of the keyframes.
+    std::vector<cv::Mat> vImages;
+    MapFileInfo info;
+    // The BoW sections are written only if every keyframe had its BoW
+    bool bBow;
+    MapFileBowInfo bowInfo;
+    std::vector<MapFileInvertedWord> vInvertedWords;
+    std::vector<uint32_t> vInvertedKFs;
+};
+
+class MapFile
+{
+public:
+    // Writes the keyframes and map points of the map. Local mapping and loop closing must not
+    // modify the map meanwhile (as for the boost archive). With pKFDB the BoW of the keyframes and
+    // the inverted file are written too, if every keyframe has its BoW computed.
+    // Returns false if a write failed.
+    static bool Save(Map* pMap, const std::string &filename, KeyFrameDatabase* pKFDB = NULL);
+
+    // Save in two steps, for a map that keeps running: Capture copies the changing state while
+    // nothing modifies the map (MapExporter holds Map::mMutexMapUpdate with local mapping paused),
+    // Write streams the file afterwards without any map lock. progress gets the fraction written.
+    static void Capture(Map* pMap, KeyFrameDatabase* pKFDB, MapFileCapture &c);
+    static bool Write(MapFileCapture &c, KeyFrameImageStore* pImageStore, const std::string &filename,
+                      const std::function<void(float)> &progress = nullptr);
+
+    // Returns a new map with the keyframes and map points fully linked (map point matches,
+    // observations, covisibility graph, spanning tree and loop edges), or NULL if the file is
+    // not a valid map file. If pKFDB is given and the file has the BoW of its vocabulary, the BoW
+    // vectors of the keyframes and the inverted file of pKFDB are restored and *pbBowLoaded is
+    // set. Otherwise the caller computes them.
+    static Map* Load(const std::string &filename, KeyFrameDatabase* pKFDB = NULL, bool* pbBowLoaded = NULL,
+                     bool bVerifyChecksums = true);
+
+    // True if the file starts with the map file magic (false for boost archive maps)
+    static bool IsMapFile(const std::string &filename);
+
+    // Hash of the header and section table, which hold the checksum of every section. Identifies
+    // the content of a map file without reading it all. 0 if it is not a map file.
+    static uint64_t Fingerprint(const std::string &filename);
+
+    // One keyframe in the layout of the per keyframe sections: MapFileKeyFrame, scale levels,
+    // keypoints, undistorted keypoints, stereo, descriptors, grid offsets and grid indices. The
+    // record offsets are unused except gridIndexBegin, which holds the number of grid indices.
+    // Map point matches, graph and image are not included (the map journal stores them by id).
+    static void AppendKeyFrame(KeyFrame* pKF, std::vector<char> &buffer);
+    // New keyframe from AppendKeyFrame bytes, NULL if they are inconsistent
+    static KeyFrame* ReadKeyFrame(const char* pData, uint64_t size);
+
+    // A map point record without its reference keyframe and observations
+    static void WriteMapPointRecord(MapPoint* pMP, MapFileMapPoint &r);
+    static void ReadMapPointRecord(const MapFileMapPoint &r, MapPoint* pMP);
+
+    // Gets and checks the sections of an open file. The BoW sections are taken (c.bBow) only if
+    // they are consistent and of pVoc. Returns false if the map itself is inconsistent.
+    static bool ReadContents(const MapFileView &view, const ORBVocabulary* pVoc, MapFileContents &c);
+
+    // New keyframe i of the file with its keypoints, descriptors, grid and image, without map
+    // point matches and graph. With c.bBow its BowVector and FeatureVector are set too.
+    static KeyFrame* ReadKeyFrame(const MapFileContents &c, uint64_t i);
+
+protected:
+    // The fixed part of a keyframe record (no section offsets, grid size, graph or image) and back.
+    // The arrays start at the keyframe's first element.
+    static void WriteKeyFrameRecord(KeyFrame* pKF, MapFileKeyFrame &r);
+    static void ReadKeyFrameRecord(const MapFileKeyFrame &r, const MapFileScaleLevel* pLevels, const MapFileKeyPoint* pKeys,
+                                   const MapFileKeyPoint* pKeysUn, const MapFileStereo* pStereo, const ORBDescriptor* pDescriptors,
+                                   const uint32_t* pGridOffsets, const uint32_t* pGridIndices, KeyFrame* pKF);
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPFILE_H
@@ -0,0 +1,92 @@
+#ifndef MAPFILELOADER_H
+#define MAPFILELOADER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+#include "MapFile.h"
+#include "ORBVocabulary.h"
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrame;
+class MapPoint;
+class KeyFrameDatabase;
+
+// Progressive loading of a native map file into a live map. Keyframes are inserted in batches,
+// nearest to a prior camera pose first (most recent first without a prior), each with the map
+// points it observes, its BoW in the keyframe database and its links to the keyframes already
+// loaded. A batch is inserted under the map update mutex, so tracking and relocalization can run
+// on the part of the map already loaded while the rest streams in.
+//
+// Until every keyframe is loaded, map points only have their observations from loaded keyframes
+// and the reference keyframe of a map point may be a stand-in. Loaded keyframes and map points the
+// mapping has set bad meanwhile are not linked to. Without a keyframe database the keyframes are not
+// indexed, without a vocabulary their BoW is only the one stored in the file.
+class MapFileLoader
+{
+public:
+    MapFileLoader(Map* pMap, KeyFrameDatabase* pKFDB, ORBVocabulary* pVoc);
+    ~MapFileLoader();
+
+    // Maps and checks the file and sets the load order. Twc is the prior camera pose (4x4), empty
+    // for none. Returns false if the file is not a valid map file.
+    bool Open(const std::string &filename, const cv::Mat &Twc = cv::Mat(), bool bVerifyChecksums = true);
+
+    // Loads the next n keyframes of the order on the calling thread. Returns how many were loaded.
+    size_t LoadNext(size_t n);
+
+    // Loads the rest of the map on a background thread, nBatch keyframes at a time
+    void LoadRemaining(size_t nBatch);
+
+    // Stops the background loading and drops the pointers to the loaded keyframes and map points.
+    // Must be called before the map or the keyframe database is cleared (Tracking::Reset), nothing
+    // is loaded afterwards.
+    void Abort();
+
+    // True once every keyframe is loaded or the loading was aborted
+    bool isFinished();
+
+    // Fraction of the keyframes loaded, in [0,1]
+    float GetProgress();
+
+    // Waits until the background loading is done
+    void Join();
+
+protected:
+    void Run(size_t nBatch);
+
+    Map* mpMap;
+    KeyFrameDatabase* mpKeyFrameDB;
+    ORBVocabulary* mpVocabulary;
+    std::string mFilename;
+
+    MapFileView mView;
+    MapFileContents mContents;
+
+    // Keyframe indices of the file in load order, the first mnLoaded are in the map
+    std::vector<uint32_t> mvOrder;
+    // By index in the file, NULL until loaded
+    std::vector<KeyFrame*> mvpKFs;
+    std::vector<MapPoint*> mvpMPs;
+    std::vector<bool> mvbOrigin;
+
+    // Serializes LoadNext
+    std::mutex mMutexLoad;
+
+    std::mutex mMutexProgress;
+    size_t mnLoaded;
+    bool mbAborted;
+
+    std::thread* mptLoader;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPFILELOADER_H
@@ -0,0 +1,32 @@
+#ifndef MAPIDINDEX_H
+#define MAPIDINDEX_H
+
+#include <vector>
+#include <unordered_map>
+
+namespace ORB_SLAM2
+{
+
+class KeyFrame;
+class MapPoint;
+
+// Id to pointer lookup of a loaded map. Keyframes and map points reference each other by id in the
+// map file, the index lets every reference be resolved in constant time when relinking them.
+// If two objects share an id the first one is kept, as the linear search it replaces did.
+class MapIdIndex
+{
+public:
+    MapIdIndex(const std::vector<KeyFrame*> &vpKeyFrames, const std::vector<MapPoint*> &vpMapPoints);
+
+    // NULL if there is no object with that id
+    KeyFrame* GetKeyFrame(long unsigned int id) const;
+    MapPoint* GetMapPoint(long unsigned int id) const;
+
+protected:
+    std::unordered_map<long unsigned int, KeyFrame*> mmKeyFrames;
+    std::unordered_map<long unsigned int, MapPoint*> mmMapPoints;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPIDINDEX_H
@@ -0,0 +1,173 @@
+#ifndef MAPJOURNAL_H
+#define MAPJOURNAL_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdint.h>
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrame;
+class MapPoint;
+
+// Append-only log of the changes of a map since its last snapshot. The snapshot is a native map
+// file (filename), the journal is filename + ".journal". Keyframes and map points mark themselves
+// as changed, a background thread writes the current state of the changed objects every interval,
+// so a checkpoint only costs what changed since the previous one. When the journal outgrows
+// nCompactBytes it is compacted: a new snapshot is written and the journal starts over.
+//
+// Layout (host byte order): MapJournalHeader, then MapJournalRecord + payload, payloads padded to
+// 8 bytes. Records hold full object states keyed by id, so replaying one twice is harmless. Every
+// batch ends with a MAP_JOURNAL_COMMIT record, replay stops at the last complete commit.
+static const uint32_t MAP_JOURNAL_VERSION = 1;
+static const uint64_t MAP_JOURNAL_NONE = 0xFFFFFFFFFFFFFFFFULL;
+
+enum eMapJournalRecord
+{
+    MAP_JOURNAL_KEYFRAME = 1,        // MapFile::AppendKeyFrame bytes, written once per keyframe
+    MAP_JOURNAL_KEYFRAME_STATE = 2,  // MapJournalKeyFrameState, then uint64_t loop edge ids
+    MAP_JOURNAL_MAPPOINT = 3,        // MapFileMapPoint, MapJournalMapPointLinks, MapJournalObservation[]
+    MAP_JOURNAL_ERASE_KEYFRAME = 4,  // uint64_t id
+    MAP_JOURNAL_ERASE_MAPPOINT = 5,  // uint64_t id
+    MAP_JOURNAL_CLEAR = 6,           // no payload, the map was reset
+    MAP_JOURNAL_COMMIT = 7           // MapJournalCommit, then uint64_t keyframe origin ids
+};
+
+struct MapJournalHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    // MapFile::Fingerprint of the snapshot the journal applies to
+    uint64_t snapshot;
+};
+
+struct MapJournalRecord
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t size;
+    // 64 bit FNV-1a of the payload
+    uint64_t checksum;
+};
+
+struct MapJournalKeyFrameState
+{
+    uint64_t id;
+    uint64_t parent;
+    float Tcw[16];
+    float Tcp[16];
+    uint32_t nLoopEdges;
+    uint8_t hasTcp;
+    uint8_t notErase;
+    uint8_t toBeErased;
+    uint8_t bad;
+};
+
+struct MapJournalMapPointLinks
+{
+    uint64_t refKeyFrame;
+    uint64_t nObservations;
+};
+
+struct MapJournalObservation
+{
+    uint64_t keyFrame;
+    uint64_t index;
+};
+
+struct MapJournalCommit
+{
+    uint64_t nextKeyFrameId;
+    uint64_t nextMapPointId;
+    uint64_t nOrigins;
+};
+
+class MapJournal
+{
+public:
+    // saveSnapshot writes the whole map to the given file (see MapExporter::SaveBinary), it is
+    // called from the journal thread. The first snapshot is written when the thread starts. It may
+    // run while the map changes: what changes after the marks are taken goes to the new journal.
+    MapJournal(Map* pMap, const std::string &filename, int nIntervalMs, uint64_t nCompactBytes,
+               const std::function<bool(const std::string&)> &saveSnapshot);
+    ~MapJournal();
+
+    // Called by the map, keyframes and map points after they changed. Only records the pointer.
+    void MarkKeyFrame(KeyFrame* pKF);
+    void MarkMapPoint(MapPoint* pMP);
+    void EraseKeyFrame(KeyFrame* pKF);
+    void EraseMapPoint(MapPoint* pMP);
+
+    // Called by Map::clear before the objects are deleted. The journal thread does not read the
+    // map until the returned lock is released.
+    std::unique_lock<std::mutex> Clear();
+
+    // Writes the pending changes now and waits until they are on disk. Returns false if the
+    // journal could not be written.
+    bool Checkpoint();
+
+    // Writes the pending changes and stops the journal thread
+    void Finish();
+
+    const std::string &GetSnapshotFilename() const { return mSnapshotFilename; }
+
+    static std::string JournalFilename(const std::string &filename);
+
+    // Applies the journal of filename, if there is one for that snapshot, to the map loaded from
+    // it. Returns the number of records applied. The covisibility graph, spanning tree and map
+    // point matches are rebuilt if anything changed.
+    static size_t Replay(Map* pMap, const std::string &filename);
+
+protected:
+    void Run();
+
+    // Write the changes marked so far, or a new snapshot and an empty journal. mMutexWrite must
+    // be held.
+    bool WriteBatch();
+    bool WriteSnapshot();
+
+    Map* mpMap;
+    std::string mSnapshotFilename;
+    std::string mJournalFilename;
+    int mnIntervalMs;
+    uint64_t mnCompactBytes;
+    std::function<bool(const std::string&)> mSaveSnapshot;
+
+    // Marks since the last batch, guarded by mMutexJournal
+    std::mutex mMutexJournal;
+    std::condition_variable mCondJournal;
+    std::unordered_set<KeyFrame*> msChangedKFs;
+    std::unordered_set<MapPoint*> msChangedMPs;
+    std::vector<long unsigned int> mvErasedKFs;
+    std::vector<long unsigned int> mvErasedMPs;
+    bool mbCleared;
+    bool mbFinish;
+    // Checkpoints are numbered, a caller waits until the batch that took its request is synced
+    uint64_t mnCheckpointRequested;
+    uint64_t mnCheckpointDone;
+    bool mbCheckpointOk;
+
+    // Held while a batch or snapshot reads the map, so that Clear does not delete objects meanwhile.
+    // Only the journal thread writes the file.
+    std::mutex mMutexWrite;
+    int mFd;
+    uint64_t mnJournalSize;
+    // Keyframes whose MAP_JOURNAL_KEYFRAME record is in the snapshot or the journal
+    std::set<KeyFrame*> mspWrittenKFs;
+    std::vector<char> mvBuffer;
+
+    std::thread* mptJournal;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPJOURNAL_H
@@ -24,6 +24,7 @@
 #include"KeyFrame.h"
 #include"Frame.h"
 #include"Map.h"
+#include"Descriptor.h"
 
 #include <boost/serialization/serialization.hpp>
 #include <boost/archive/binary_oarchive.hpp>
@@ -46,6 +47,7 @@ namespace ORB_SLAM2
 class KeyFrame;
 class Map;
 class Frame;
+class MapIdIndex;
 
 
 class MapPoint
@@ -85,15 +87,20 @@ public:
 
     void ComputeDistinctiveDescriptors();
 
-    cv::Mat GetDescriptor();
+    ORBDescriptor GetDescriptor();
 
     void UpdateNormalAndDepth();
 
     float GetMinDistanceInvariance();
     float GetMaxDistanceInvariance();
     int PredictScale(const float &currentDist, const float &logScaleFactor);
+
+    // Position, normal and scale invariance distances (not scaled) under one lock, for the
+    // batch frustum test of the tracking (MapPointBatch)
+    void GetViewingData(float *pos, float *normal, float &minDistance, float &maxDistance);
 	void SetMap(Map* map);
-	void SetObservations(std::vector<KeyFrame*>);
+	// Resolves the keyframe ids read by load
+	void SetObservations(const MapIdIndex &index);
 	
 
 public:
@@ -139,7 +146,7 @@ protected:
      cv::Mat mNormalVector;
 
      // Best descriptor to fast matching
-     cv::Mat mDescriptor;
+     ORBDescriptor mDescriptor;
 
      // Reference KeyFrame
      KeyFrame* mpRefKF;
@@ -165,6 +172,9 @@ protected:
      std::mutex mMutexFeatures;
 
 
+	 friend class MapFile;
+	 friend class MapJournal;
+	 friend class MapFileLoader;
 	 friend class boost::serialization::access;
  template<class Archive>
     void serialize(Archive & ar, const unsigned int version)
@@ -0,0 +1,44 @@
+#ifndef MAPPOINTBATCH_H
+#define MAPPOINTBATCH_H
+
+#include <vector>
+
+namespace ORB_SLAM2
+{
+
+class MapPoint;
+class Frame;
+
+// Local map points in structure of arrays form. Positions, normals and distance bounds are read
+// once per frame (one lock per point) so that the frustum test of Frame::isInFrustum can run on
+// all of them at once with SIMD instead of cv::Mat arithmetic per point.
+class MapPointBatch
+{
+public:
+    void Clear();
+    void Add(MapPoint* pMP);
+    size_t size() const { return mvpMapPoints.size(); }
+
+    // Same test and tracking data as Frame::isInFrustum for every point of the batch.
+    // mbTrackInView is set on all of them. Returns the number of points in view.
+    int IsInFrustum(const Frame &F, float viewingCosLimit);
+
+    bool InView(size_t i) const { return mvbInView[i]; }
+    MapPoint* GetMapPoint(size_t i) const { return mvpMapPoints[i]; }
+
+protected:
+    std::vector<MapPoint*> mvpMapPoints;
+
+    // Input: world position, normal, scale invariance distances
+    std::vector<float> mvX, mvY, mvZ;
+    std::vector<float> mvNx, mvNy, mvNz;
+    std::vector<float> mvMinDistance, mvMaxDistance;
+
+    // Output: projection, inverse depth, distance to the camera, viewing cosine
+    std::vector<float> mvU, mvV, mvInvZ, mvDist, mvViewCos;
+    std::vector<unsigned char> mvbInView;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPPOINTBATCH_H
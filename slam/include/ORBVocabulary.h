@@ -25,12 +25,49 @@
 #include"../Thirdparty/DBoW2/DBoW2/FORB.h"
 #include"../Thirdparty/DBoW2/DBoW2/TemplatedVocabulary.h"
 
+#include <stdint.h>
+
 namespace ORB_SLAM2
 {
 
 typedef DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB>
   ORBVocabulary;
 
+// Fingerprint of a vocabulary: its shape, weighting, scoring, word weights and a sample of the word
+// descriptors. Stored with the BoW of map files and localization packages, which are only valid for
+// the vocabulary they were computed with. Inline so that the localizer needs no map code to check it.
+inline uint64_t VocabularyHash(const ORBVocabulary &voc)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    auto fnv1a = [&hash](const void* pData, size_t size)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(pData);
+        for(size_t i=0; i<size; i++)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    const int32_t shape[5] = {(int32_t)voc.size(), voc.getBranchingFactor(), voc.getDepthLevels(),
+                              (int32_t)voc.getWeightingType(), (int32_t)voc.getScoringType()};
+    fnv1a(shape, sizeof(shape));
+    for(unsigned int w=0; w<voc.size(); w++)
+    {
+        const double weight = voc.getWordWeight(w);
+        fnv1a(&weight, sizeof(weight));
+    }
+    // Descriptors of every 64th word, copying all of them would take longer than the BoW it saves
+    for(unsigned int w=0; w<voc.size(); w+=64)
+    {
+        const cv::Mat descriptor = voc.getWord(w);
+        for(int r=0; r<descriptor.rows; r++)
+            fnv1a(descriptor.ptr(r), descriptor.cols*descriptor.elemSize());
+    }
+    return hash;
+}
+
 } //namespace ORB_SLAM
 
 #endif // ORBVOCABULARY_H
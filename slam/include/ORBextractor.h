@@ -22,26 +22,44 @@
 #define ORBEXTRACTOR_H
 
 #include <vector>
-#include <list>
 #include <opencv/cv.h>
 
+#include "TaskPool.h"
+
 
 namespace ORB_SLAM2
 {
 
+// Quadtree node of DistributeOctTree. Nodes live in a flat array and own the range
+// [iniKey,endKey) of a shared buffer of keypoint indices instead of a copy of their keypoints.
 class ExtractorNode
 {
 public:
-    ExtractorNode():bNoMore(false){}
+    ExtractorNode():iniKey(0),endKey(0),prev(-1),next(-1),bNoMore(false){}
+
+    // Splits the keypoint range in the four childs, keeping the keypoint order inside each child
+    void DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4,
+                    const std::vector<cv::KeyPoint> &vKeys, std::vector<int> &vKeyIdx, std::vector<int> &vKeyIdxTmp);
 
-    void DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4);
+    int Size() const { return endKey-iniKey; }
 
-    std::vector<cv::KeyPoint> vKeys;
     cv::Point2i UL, UR, BL, BR;
-    std::list<ExtractorNode>::iterator lit;
+    int iniKey, endKey;
+    // Neighbours in the list of leaves
+    int prev, next;
     bool bNoMore;
 };
 
+// Scratch space of DistributeOctTree, kept per level so that levels can be distributed in parallel
+struct ExtractorNodeArena
+{
+    std::vector<ExtractorNode> vNodes;
+    std::vector<int> vKeyIdx;
+    std::vector<int> vKeyIdxTmp;
+    std::vector<std::pair<int,int> > vSizeAndNode;
+    std::vector<std::pair<int,int> > vPrevSizeAndNode;
+};
+
 class ORBextractor
 {
 public:
@@ -82,14 +100,28 @@ public:
         return mvInvLevelSigma2;
     }
 
+    // Share a task pool to process the pyramid levels (and row bands of level 0) concurrently.
+    // The output is identical to the serial path. Pass NULL to go back to a single thread.
+    void inline SetTaskPool(TaskPool* pTaskPool){
+        mpTaskPool = pTaskPool;
+    }
+
     std::vector<cv::Mat> mvImagePyramid;
 
 protected:
 
     void ComputePyramid(cv::Mat image);
     void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);    
-    std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
-                                           const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
+    // FAST on the cell rows [iniRow,endRow) of a level, coordinates relative to the level borders.
+    // vRowCorners and vCellCorners are scratch space of the calling task.
+    void ComputeFASTInRows(const int level, const int iniRow, const int endRow, std::vector<cv::KeyPoint>& vKeys,
+                           std::vector<int>& vRowCorners, std::vector<std::vector<cv::Point> >& vCellCorners);
+    int GetCellRows(const int level);
+    // Octree distribution, borders, scale and orientation of the keypoints of one level
+    void DistributeLevel(const int level, const std::vector<cv::KeyPoint>& vToDistributeKeys, std::vector<cv::KeyPoint>& keypoints);
+    void DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
+                           const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level,
+                           std::vector<cv::KeyPoint>& vResultKeys);
 
     void ComputeKeyPointsOld(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);
     std::vector<cv::Point> pattern;
@@ -108,6 +140,22 @@ protected:
     std::vector<float> mvInvScaleFactor;    
     std::vector<float> mvLevelSigma2;
     std::vector<float> mvInvLevelSigma2;
+
+    TaskPool* mpTaskPool;
+
+    // Buffers reused across frames, they are only reallocated when the image size changes.
+    // mvImagePyramid holds views into the bordered mvPyramidBuffers.
+    cv::Size mImageSize;
+    std::vector<cv::Mat> mvPyramidBuffers;
+    std::vector<cv::Mat> mvBlurredPyramid;
+    std::vector<std::vector<cv::KeyPoint> > mvAllKeypoints;
+    std::vector<std::vector<cv::KeyPoint> > mvToDistributeKeys;
+    std::vector<std::vector<cv::KeyPoint> > mvBandKeys;
+    std::vector<cv::Mat> mvFASTScores;
+    std::vector<std::vector<int> > mvRowCorners;
+    std::vector<std::vector<std::vector<cv::Point> > > mvCellCorners;
+    std::vector<int> mvLevelOffsets;
+    std::vector<ExtractorNodeArena> mvNodeArenas;
 };
 
 } //namespace ORB_SLAM
@@ -29,6 +29,7 @@
 #include"MapPoint.h"
 #include"KeyFrame.h"
 #include"Frame.h"
+#include"HammingDistance.h"
 
 
 namespace ORB_SLAM2
@@ -43,6 +44,9 @@ public:
     // Computes the Hamming distance between two ORB descriptors
     static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
 
+    // Batch distances (default) or one DescriptorDistance per candidate, as before. For benchmarks.
+    static void SetBatchDistances(bool bBatch);
+
     // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
     // Used to track the local map (Tracking)
     int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const float th=3);
@@ -97,8 +101,38 @@ protected:
 
     void ComputeThreeMaxima(std::vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3);
 
+    // Distances from descriptor d to the descriptors vIndices in one batch (HammingDistance.h).
+    // The result is overwritten by the next call.
+    template<typename T>
+    const std::vector<int>& ComputeDistances(const ORBDescriptor &d, const DescriptorArray &descriptors, const std::vector<T> &vIndices)
+    {
+        const int n = vIndices.size();
+        if(!mbBatchDistances)
+        {
+            mvDistances.resize(n);
+            const cv::Mat a(1,32,CV_8U,const_cast<unsigned char*>(d.data));
+            for(int i=0; i<n; i++)
+                mvDistances[i] = DescriptorDistance(a,cv::Mat(1,32,CV_8U,const_cast<unsigned char*>(descriptors.ptr(vIndices[i]))));
+            return mvDistances;
+        }
+        mvpCandidates.resize(n);
+        for(int i=0; i<n; i++)
+            mvpCandidates[i] = descriptors.ptr(vIndices[i]);
+        mvDistances.resize(n);
+        if(n>0)
+            DescriptorDistances(d.data, &mvpCandidates[0], n, &mvDistances[0]);
+        return mvDistances;
+    }
+
     float mfNNratio;
     bool mbCheckOrientation;
+
+    // Scratch buffers reused by the searches: keypoints in the search window and their distances
+    std::vector<size_t> mvIndices;
+    std::vector<const unsigned char*> mvpCandidates;
+    std::vector<int> mvDistances;
+
+    static bool mbBatchDistances;
 };
 
 }// namespace ORB_SLAM
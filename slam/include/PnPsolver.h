@@ -51,25 +51,35 @@
 #ifndef PNPSOLVER_H
 #define PNPSOLVER_H
 
+#include <vector>
 #include <opencv2/core/core.hpp>
-#include "MapPoint.h"
-#include "Frame.h"
+#include <opencv2/core/core_c.h>
 
 namespace ORB_SLAM2
 {
 
+class Frame;
+class MapPoint;
+
 class PnPsolver {
  public:
-  PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches);
+  // Matches of the frame keypoints, defined in PnPsolverFrame.cc so that the solver builds without the map.
+  // The inlier flags are indexed by keypoint.
+  PnPsolver(const Frame &F, const std::vector<MapPoint*> &vpMapPointMatches);
+
+  // Plain 2D-3D correspondences: undistorted keypoints with the sigma^2 of their octave, world points
+  // and the calibration. The inlier flags are indexed by correspondence.
+  PnPsolver(const std::vector<cv::Point2f> &vP2D, const std::vector<float> &vSigma2, const std::vector<cv::Point3f> &vP3Dw,
+            float fx, float fy, float cx, float cy);
 
   ~PnPsolver();
 
   void SetRansacParameters(double probability = 0.99, int minInliers = 8 , int maxIterations = 300, int minSet = 4, float epsilon = 0.4,
                            float th2 = 5.991);
 
-  cv::Mat find(vector<bool> &vbInliers, int &nInliers);
+  cv::Mat find(std::vector<bool> &vbInliers, int &nInliers);
 
-  cv::Mat iterate(int nIterations, bool &bNoMore, vector<bool> &vbInliers, int &nInliers);
+  cv::Mat iterate(int nIterations, bool &bNoMore, std::vector<bool> &vbInliers, int &nInliers);
 
  private:
 
@@ -134,41 +144,42 @@ class PnPsolver {
   double cws[4][3], ccs[4][3];
   double cws_determinant;
 
-  vector<MapPoint*> mvpMapPointMatches;
+  // Number of input matches, the size of the inlier flags
+  size_t mnMatches;
 
   // 2D Points
-  vector<cv::Point2f> mvP2D;
-  vector<float> mvSigma2;
+  std::vector<cv::Point2f> mvP2D;
+  std::vector<float> mvSigma2;
 
   // 3D Points
-  vector<cv::Point3f> mvP3Dw;
+  std::vector<cv::Point3f> mvP3Dw;
 
   // Index in Frame
-  vector<size_t> mvKeyPointIndices;
+  std::vector<size_t> mvKeyPointIndices;
 
   // Current Estimation
   double mRi[3][3];
   double mti[3];
   cv::Mat mTcwi;
-  vector<bool> mvbInliersi;
+  std::vector<bool> mvbInliersi;
   int mnInliersi;
 
   // Current Ransac State
   int mnIterations;
-  vector<bool> mvbBestInliers;
+  std::vector<bool> mvbBestInliers;
   int mnBestInliers;
   cv::Mat mBestTcw;
 
   // Refined
   cv::Mat mRefinedTcw;
-  vector<bool> mvbRefinedInliers;
+  std::vector<bool> mvbRefinedInliers;
   int mnRefinedInliers;
 
   // Number of Correspondences
   int N;
 
   // Indices for random selection [0 .. N-1]
-  vector<size_t> mvAllIndices;
+  std::vector<size_t> mvAllIndices;
 
   // RANSAC probability
   double mRansacProb;
@@ -189,7 +200,7 @@ class PnPsolver {
   int mRansacMinSet;
 
   // Max square error associated with scale level. Max error = th*th*sigma(level)*sigma(level)
-  vector<float> mvMaxError;
+  std::vector<float> mvMaxError;
 
 };
 
@@ -0,0 +1,60 @@
+#ifndef RASPBERRYMAPFILE_H
+#define RASPBERRYMAPFILE_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "RaspberryMapView.h"
+#include "ORBVocabulary.h"
+#include "Descriptor.h"
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrame;
+
+// What RaspberryMapFile::Capture takes of the keyframes, see MapFileCapture: their poses, the map
+// point of each matched keypoint and the positions and descriptors of those map points. Keypoints
+// and BoW vectors are read from the keyframes by Write.
+struct RaspberryMapCapture
+{
+    std::vector<KeyFrame*> vpKFs;
+    std::vector<cv::Mat> vTcw;
+    // (keypoint, map point index) of the good map points of every keyframe
+    std::vector<std::vector<std::pair<uint32_t,uint32_t> > > vvObs;
+    // Map points in id order
+    std::vector<long unsigned int> vMPIds;
+    std::vector<cv::Mat> vPos;
+    std::vector<ORBDescriptor> vDescriptors;
+    // Whether the keyframe had its BowVector, Write computes the others
+    std::vector<bool> vbBow;
+};
+
+// Writer of the Raspberry map files (RaspberryMapView.h for the format). Replaces the boost text
+// archive of KeyFrame::rpi_save. With a vocabulary the file is a localization package: it also holds
+// the BoW vectors of the keyframes and their inverted index, so the device relocalizes against it
+// without the keyframe database.
+class RaspberryMapFile
+{
+public:
+    // Writes the good keyframes of the map and the map points they observe. Local mapping and loop
+    // closing must not modify the map meanwhile. Returns false if the file cannot be written.
+    // Without pVoc the BoW sections are left empty.
+    static bool Save(Map* pMap, const std::string &filename, const ORBVocabulary* pVoc = NULL);
+
+    // Writes the given keyframes and the map points they observe. Keyframes without a BowVector
+    // get one computed with pVoc.
+    static bool Save(const std::vector<KeyFrame*> &vpKFs, const std::string &filename,
+                     const ORBVocabulary* pVoc = NULL);
+
+    // Save of the given keyframes in two steps, as MapFile::Capture and MapFile::Write
+    static void Capture(const std::vector<KeyFrame*> &vpKFs, RaspberryMapCapture &c);
+    static bool Write(const RaspberryMapCapture &c, const std::string &filename, const ORBVocabulary* pVoc = NULL);
+};
+
+} //namespace ORB_SLAM
+
+#endif // RASPBERRYMAPFILE_H
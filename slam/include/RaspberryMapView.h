@@ -0,0 +1,305 @@
+#ifndef RASPBERRYMAPVIEW_H
+#define RASPBERRYMAPVIEW_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace ORB_SLAM2
+{
+
+// Compact map export for the Raspberry Pi (RaspberryMapFile). Only what localization against the
+// map needs is kept: the pose and calibration of the keyframes, their keypoints that observe a map
+// point, the position and descriptor of every map point, stored once however many keyframes observe
+// it, and optionally the BoW vectors of the keyframes with their inverted index. Covisibility,
+// spanning tree and optimizer state are left out.
+//
+// Coordinates are fixed-point int16 with a per-map scale: keypoints in pixels (x = keyPointScale*q,
+// undistorted keypoints can be negative) and map points around the center of the map
+// (p = pointOrigin + pointScale*q). The scales are the resolution: the largest keypoint coordinate
+// over 32767 and half the largest extent of the map over 32767. The extent leaves out the farthest
+// 0.1% of the map points on every axis (with a margin), those outliers are clamped to its border.
+//
+// Layout (host byte order), every array 32 byte aligned so the device reads it in place
+// (RaspberryMapView):
+//   RaspberryMapHeader
+//   RaspberryMapKeyFrame[nKeyFrames]       in id order
+//   RaspberryMapObservation[nObservations] of keyframe k at observationBegin of k
+//   int16_t[3*nMapPoints]                  map point positions, in id order
+//   uint8_t[32*nMapPoints]                 map point descriptors
+//   RaspberryMapBowWord[nBowWords]         BowVector of keyframe k at bowBegin of k
+//   RaspberryMapInvertedWord[nInvertedWords]  the words of any keyframe, increasing
+//   uint32_t[nInvertedKeyFrames]           keyframe indices of each inverted word
+//   ids                                    keyframe then map point mnIds, delta coded varints
+// The BoW sections are empty if vocabularyHash is 0, they are only valid for the vocabulary of
+// that VocabularyHash (ORBVocabulary.h). The ids are only needed to trace an element back to the
+// map that was exported.
+static const uint32_t RASPBERRY_MAP_VERSION = 2;
+static const uint64_t RASPBERRY_MAP_ALIGNMENT = 32;
+static const char RASPBERRY_MAP_MAGIC[8] = {'O','R','B','R','P','M','A','P'};
+
+struct RaspberryMapHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nKeyFrames;
+    uint32_t nObservations;
+    uint32_t nMapPoints;
+    float pointOrigin[3];
+    float pointScale;
+    float keyPointScale;
+    uint32_t idBytes;
+    uint32_t nBowWords;
+    uint32_t nInvertedWords;
+    uint32_t nInvertedKeyFrames;
+    uint32_t reserved;
+    uint64_t vocabularyHash;
+    uint64_t keyFramesOffset;
+    uint64_t observationsOffset;
+    uint64_t pointsOffset;
+    uint64_t descriptorsOffset;
+    uint64_t bowWordsOffset;
+    uint64_t invertedWordsOffset;
+    uint64_t invertedKeyFramesOffset;
+    uint64_t idsOffset;
+    uint64_t fileSize;
+    // 64 bit FNV-1a of the bytes after the header
+    uint64_t checksum;
+};
+
+struct RaspberryMapKeyFrame
+{
+    // Tcw, row major rotation then translation
+    float R[9];
+    float t[3];
+    float fx, fy, cx, cy;
+    uint32_t observationBegin;
+    uint32_t nObservations;
+    uint32_t bowBegin;
+    uint32_t nBowWords;
+};
+
+struct RaspberryMapObservation
+{
+    int16_t x, y;       // mvKeys
+    int16_t ux, uy;     // mvKeysUn
+    uint32_t mapPoint;
+    uint8_t octave;
+    uint8_t reserved[3];
+};
+
+struct RaspberryMapBowWord
+{
+    uint32_t word;
+    float weight;
+};
+
+struct RaspberryMapInvertedWord
+{
+    uint32_t word;
+    uint32_t keyFrameBegin;
+    uint32_t nKeyFrames;
+    uint32_t reserved;
+};
+
+inline uint64_t RaspberryMapChecksum(const void* pData, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char* p = static_cast<const unsigned char*>(pData);
+    for(size_t i=0; i<size; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Read-only mapping of a Raspberry map file. Header only, with no dependency on the rest of
+// ORB_SLAM2, so that the device builds it alone. The arrays are used in place: opening the file
+// checks the header and the checksum and does not copy anything.
+class RaspberryMapView
+{
+public:
+    RaspberryMapView(): mpData(NULL), mnSize(0) {}
+    ~RaspberryMapView() { Close(); }
+
+    bool Open(const std::string &filename)
+    {
+        Close();
+        const int fd = open(filename.c_str(), O_RDONLY);
+        if(fd<0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st)==0 && st.st_size>=(off_t)sizeof(RaspberryMapHeader))
+        {
+            mnSize = st.st_size;
+            mpData = mmap(NULL, mnSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mpData==MAP_FAILED)
+                mpData = NULL;
+        }
+        close(fd);
+        if(mpData && IsValid())
+            return true;
+        Close();
+        return false;
+    }
+
+    void Close()
+    {
+        if(mpData)
+            munmap(mpData, mnSize);
+        mpData = NULL;
+        mnSize = 0;
+    }
+
+    const RaspberryMapHeader& Header() const { return *static_cast<const RaspberryMapHeader*>(mpData); }
+
+    const RaspberryMapKeyFrame* KeyFrames() const { return At<RaspberryMapKeyFrame>(Header().keyFramesOffset); }
+    const RaspberryMapObservation* Observations() const { return At<RaspberryMapObservation>(Header().observationsOffset); }
+    const int16_t* Points() const { return At<int16_t>(Header().pointsOffset); }
+    const uint8_t* Descriptor(uint32_t iMP) const { return At<uint8_t>(Header().descriptorsOffset) + 32*(uint64_t)iMP; }
+    const RaspberryMapBowWord* BowWords() const { return At<RaspberryMapBowWord>(Header().bowWordsOffset); }
+    const RaspberryMapInvertedWord* InvertedWords() const { return At<RaspberryMapInvertedWord>(Header().invertedWordsOffset); }
+    const uint32_t* InvertedKeyFrames() const { return At<uint32_t>(Header().invertedKeyFramesOffset); }
+
+    bool HasBow() const { return Header().vocabularyHash!=0; }
+
+    // Entry of a word in the inverted index, NULL if no keyframe has it
+    const RaspberryMapInvertedWord* FindWord(uint32_t word) const
+    {
+        const RaspberryMapInvertedWord* pBegin = InvertedWords();
+        const RaspberryMapInvertedWord* pEnd = pBegin + Header().nInvertedWords;
+        while(pBegin<pEnd)
+        {
+            const RaspberryMapInvertedWord* pMid = pBegin + (pEnd-pBegin)/2;
+            if(pMid->word<word)
+                pBegin = pMid+1;
+            else
+                pEnd = pMid;
+        }
+        return pBegin<InvertedWords()+Header().nInvertedWords && pBegin->word==word ? pBegin : NULL;
+    }
+
+    void Position(uint32_t iMP, float* pos) const
+    {
+        const RaspberryMapHeader &h = Header();
+        const int16_t* q = Points() + 3*(uint64_t)iMP;
+        for(int j=0; j<3; j++)
+            pos[j] = h.pointOrigin[j] + h.pointScale*q[j];
+    }
+
+    void KeyPoint(const RaspberryMapObservation &obs, float &x, float &y) const
+    {
+        x = Header().keyPointScale*obs.x;
+        y = Header().keyPointScale*obs.y;
+    }
+
+    void KeyPointUn(const RaspberryMapObservation &obs, float &x, float &y) const
+    {
+        x = Header().keyPointScale*obs.ux;
+        y = Header().keyPointScale*obs.uy;
+    }
+
+    // Decodes the mnIds of the keyframes and map points. False if they are truncated.
+    bool ReadIds(std::vector<uint64_t> &vKFIds, std::vector<uint64_t> &vMPIds) const
+    {
+        const RaspberryMapHeader &h = Header();
+        const uint8_t* p = At<uint8_t>(h.idsOffset);
+        const uint8_t* pEnd = p + h.idBytes;
+        return ReadDeltas(p, pEnd, h.nKeyFrames, vKFIds) && ReadDeltas(p, pEnd, h.nMapPoints, vMPIds);
+    }
+
+protected:
+    template<class T>
+    const T* At(uint64_t offset) const
+    {
+        return reinterpret_cast<const T*>(static_cast<const char*>(mpData) + offset);
+    }
+
+    // Every array inside the file and aligned, every observation of its keyframe and map point
+    bool IsValid() const
+    {
+        const RaspberryMapHeader &h = Header();
+        if(memcmp(h.magic, RASPBERRY_MAP_MAGIC, sizeof(h.magic))!=0 || h.version!=RASPBERRY_MAP_VERSION ||
+           h.fileSize!=mnSize)
+            return false;
+        const uint64_t vOffsets[8] = {h.keyFramesOffset, h.observationsOffset, h.pointsOffset, h.descriptorsOffset,
+                                      h.bowWordsOffset, h.invertedWordsOffset, h.invertedKeyFramesOffset, h.idsOffset};
+        const uint64_t vSizes[8] = {(uint64_t)h.nKeyFrames*sizeof(RaspberryMapKeyFrame),
+                                    (uint64_t)h.nObservations*sizeof(RaspberryMapObservation),
+                                    (uint64_t)h.nMapPoints*3*sizeof(int16_t), (uint64_t)h.nMapPoints*32,
+                                    (uint64_t)h.nBowWords*sizeof(RaspberryMapBowWord),
+                                    (uint64_t)h.nInvertedWords*sizeof(RaspberryMapInvertedWord),
+                                    (uint64_t)h.nInvertedKeyFrames*sizeof(uint32_t), h.idBytes};
+        for(int i=0; i<8; i++)
+        {
+            if(vOffsets[i]%RASPBERRY_MAP_ALIGNMENT!=0 || vOffsets[i]<sizeof(h) || vOffsets[i]>mnSize ||
+               vSizes[i]>mnSize-vOffsets[i])
+                return false;
+        }
+        if(h.checksum!=RaspberryMapChecksum(At<char>(sizeof(h)), mnSize-sizeof(h)))
+            return false;
+
+        const RaspberryMapKeyFrame* pKFs = KeyFrames();
+        for(uint32_t i=0; i<h.nKeyFrames; i++)
+        {
+            if(pKFs[i].observationBegin>h.nObservations || pKFs[i].nObservations>h.nObservations-pKFs[i].observationBegin ||
+               pKFs[i].bowBegin>h.nBowWords || pKFs[i].nBowWords>h.nBowWords-pKFs[i].bowBegin)
+                return false;
+        }
+        const RaspberryMapObservation* pObs = Observations();
+        for(uint32_t i=0; i<h.nObservations; i++)
+        {
+            if(pObs[i].mapPoint>=h.nMapPoints)
+                return false;
+        }
+        const RaspberryMapInvertedWord* pWords = InvertedWords();
+        for(uint32_t i=0; i<h.nInvertedWords; i++)
+        {
+            if((i>0 && pWords[i].word<=pWords[i-1].word) || pWords[i].keyFrameBegin>h.nInvertedKeyFrames ||
+               pWords[i].nKeyFrames>h.nInvertedKeyFrames-pWords[i].keyFrameBegin)
+                return false;
+        }
+        const uint32_t* pInvertedKFs = InvertedKeyFrames();
+        for(uint32_t i=0; i<h.nInvertedKeyFrames; i++)
+        {
+            if(pInvertedKFs[i]>=h.nKeyFrames)
+                return false;
+        }
+        return true;
+    }
+
+    static bool ReadDeltas(const uint8_t* &p, const uint8_t* pEnd, uint32_t n, std::vector<uint64_t> &v)
+    {
+        v.resize(n);
+        uint64_t last = 0;
+        for(uint32_t i=0; i<n; i++)
+        {
+            uint64_t delta = 0;
+            for(int shift=0; ; shift+=7)
+            {
+                if(p==pEnd || shift>63)
+                    return false;
+                const uint8_t byte = *p++;
+                delta |= (uint64_t)(byte & 0x7f) << shift;
+                if(!(byte & 0x80))
+                    break;
+            }
+            last += delta;
+            v[i] = last;
+        }
+        return true;
+    }
+
+    void* mpData;
+    size_t mnSize;
+};
+
+} //namespace ORB_SLAM
+
+#endif // RASPBERRYMAPVIEW_H
@@ -42,6 +42,7 @@
 #include "KeyFrameDatabase.h"
 #include "ORBVocabulary.h"
 #include "Viewer.h"
+#include "MapExporter.h"
 
 namespace ORB_SLAM2 {
 
@@ -57,6 +58,14 @@ namespace ORB_SLAM2 {
 
     class LoopClosing;
 
+    class KeyFrameImageStore;
+
+    class KeyFramePayloadStore;
+
+    class MapJournal;
+
+    class MapFileLoader;
+
     class System {
     public:
         // Input sensor
@@ -102,6 +111,16 @@ namespace ORB_SLAM2 {
         cv::Mat
         TrackMonocular(const cv::Mat &descriptors, std::vector<cv::KeyPoint> &keyPoints, const double &timestamp);
 
+        // Pipelined TrackMonocular: ORB extraction of this image runs on a background thread while the
+        // previous image is tracked. Returns the pose of the previous image and its timestamp in
+        // trackedTimestamp (empty pose and -1 on the first call). Poses are the same as with TrackMonocular.
+        // The queue size is ORBextractor.pipelineQueueSize in the settings (default 2).
+        cv::Mat TrackMonocularPipelined(const cv::Mat &im, const double &timestamp, double &trackedTimestamp);
+
+        // Tracks the images left in the pipeline after the last TrackMonocularPipelined.
+        // Returns their timestamps and poses in order.
+        std::vector<std::pair<double, cv::Mat> > FlushMonocularPipeline();
+
         // This stops local mapping thread (map building) and performs only camera tracking.
         void ActivateLocalizationMode();
 
@@ -127,6 +146,14 @@ namespace ORB_SLAM2 {
 
         Tracking *GetTracker();
 
+        inline ORBVocabulary *GetVocabulary() {
+            return mpVocabulary;
+        }
+
+        inline KeyFrameDatabase *GetKeyFrameDatabase() {
+            return mpKeyFrameDatabase;
+        }
+
         // All threads will be requested to finish.
         // It waits until all threads have finished.
         // This function must be called before saving the trajectory.
@@ -135,7 +162,36 @@ namespace ORB_SLAM2 {
         // Save / Load the current map for Mono Execution
         void SaveMap(const string &filename);
 
-        void LoadMap(const string &filename);
+        // Native map files (MapFile) and boost archives are both read, the links of the map and the
+        // keyframe database are restored either way. The relinking of archives and the BoW of maps
+        // saved without it run on the pool if one is given.
+        void LoadMap(const string &filename, TaskPool* pPool = NULL);
+
+        // Loads the nInitial keyframes of a native map file nearest to the camera pose Twc (the most
+        // recent ones if Twc is empty) and returns, the rest is loaded nBatch keyframes at a time on a
+        // background thread (see GetMapLoader()).
+        void LoadMapProgressive(const string &filename, const cv::Mat &Twc, int nInitial, int nBatch);
+
+        // NULL unless the map was loaded progressively
+        inline MapFileLoader *GetMapLoader() {
+            return mpMapLoader;
+        }
+
+        // Writes the cloud csv and/or the binary map on a background thread, an empty filename skips it.
+        // Returns false if the previous export has not finished yet. Progress is read from GetMapExporter().
+        bool SaveMapInBackground(const string &csvFilename, const string &binFilename);
+
+        inline MapExporter *GetMapExporter() {
+            return mpMapExporter;
+        }
+
+        // Makes the map changes so far durable in the journal (Journal.file). Only writes what changed
+        // since the previous checkpoint. Returns false if there is no journal or it could not be written.
+        bool CheckpointMap();
+
+        inline MapJournal *GetMapJournal() {
+            return mpJournal;
+        }
 
         // Get map with tracked frames and points.
         // Call first Shutdown()
@@ -163,6 +219,12 @@ namespace ORB_SLAM2 {
 
     private:
 
+        // Applies the localization mode changes and reset requested since the last frame
+        void CheckModeAndReset();
+
+        // Boost archive maps of older versions: deserialization and relinking
+        void LoadArchive(const string &filename, TaskPool* pPool);
+
         // Input sensor
         eSensor mSensor;
 
@@ -193,6 +255,21 @@ namespace ORB_SLAM2 {
         FrameDrawer *mpFrameDrawer;
         MapDrawer *mpMapDrawer;
 
+        // Background map export (snapshot csv and binary map).
+        MapExporter *mpMapExporter;
+
+        // Compressed keyframe images outside the map, NULL unless ImageStore.file is set.
+        KeyFrameImageStore *mpImageStore;
+
+        // Keyframe payloads paged out under a memory budget, NULL unless PayloadStore.file is set.
+        KeyFramePayloadStore *mpPayloadStore;
+
+        // Snapshot and append-only journal of the map, NULL unless Journal.file is set.
+        MapJournal *mpJournal;
+
+        // Progressive loading of the map, NULL if it was loaded at once.
+        MapFileLoader *mpMapLoader;
+
         // System threads: Local Mapping, Loop Closing, Viewer.
         // The Tracking thread "lives" in the main execution thread that creates the System object.
         std::thread *mptLocalMapping;
@@ -0,0 +1,66 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ORB_SLAM2
+{
+
+// Fixed set of worker threads shared by several users (e.g. the ORB extractors of Tracking).
+// ParallelFor can be called from any number of threads at once, the caller works on its own
+// batch too, so nested or concurrent calls cannot deadlock.
+class TaskPool
+{
+public:
+    // nThreads counts the calling thread, so nThreads-1 workers are started
+    TaskPool(int nThreads);
+    ~TaskPool();
+
+    // Runs f(0) ... f(n-1) and returns when all of them finished. Indices are handed out in order,
+    // results must be written to per-index slots to keep the output deterministic. f is called
+    // through a pointer, a call does not allocate.
+    template<class F>
+    void ParallelFor(int n, const F &f)
+    {
+        Dispatch(n, [](const void* pFunc, int i){ (*static_cast<const F*>(pFunc))(i); }, &f);
+    }
+
+    int GetNumThreads() const { return mvThreads.size()+1; }
+
+protected:
+    typedef void (*CallFunc)(const void* pFunc, int i);
+
+    // Lives on the stack of ParallelFor, queued in an intrusive list
+    struct Batch
+    {
+        CallFunc call;
+        const void* pFunc;
+        int n;
+        int nNext;
+        int nDone;
+        Batch* pNext;
+    };
+
+    void Dispatch(int n, CallFunc call, const void* pFunc);
+
+    // mMutex must be held
+    void RemoveBatch(Batch* pBatch);
+
+    void Run();
+
+    std::vector<std::thread> mvThreads;
+    // Batches with indices left to hand out, oldest first
+    Batch* mpFirstBatch;
+    Batch* mpLastBatch;
+    std::mutex mMutex;
+    std::condition_variable mCondWork;
+    std::condition_variable mCondDone;
+    bool mbFinish;
+};
+
+} //namespace ORB_SLAM
+
+#endif // TASKPOOL_H
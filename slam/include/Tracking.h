@@ -37,6 +37,8 @@
 #include"ORBextractor.h"
 #include "Initializer.h"
 #include "MapDrawer.h"
+#include "MapPointBatch.h"
+#include "FramePipeline.h"
 #include "System.h"
 
 #include <mutex>
@@ -63,6 +65,16 @@ public:
     cv::Mat GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp);
     cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp);
     cv::Mat GrabImageMonocular(const cv::Mat &descriptors, vector<cv::KeyPoint> &keyPoints, const float cols, const float rows, const double &timestamp);
+
+    // Pipelined monocular input: the image is queued for ORB extraction on the FramePipeline thread and
+    // the oldest image is tracked meanwhile, once ORBextractor.pipelineQueueSize images are queued.
+    // Returns the pose of the tracked image and its timestamp (empty pose and timestamp -1 while the
+    // pipeline fills). Tracking results are the same as with GrabImageMonocular, queue size-1 images later.
+    cv::Mat GrabImageMonocularPipelined(const cv::Mat &im, const double &timestamp, double &trackedTimestamp);
+    // Tracks the oldest image of the pipeline. Returns false if there is none.
+    bool TrackPipelinedImage(cv::Mat &Tcw, double &timestamp);
+    // Stops the extraction thread, images not tracked yet are dropped
+    void StopPipeline();
     void SetLocalMapper(LocalMapping* pLocalMapper);
     void SetLoopClosing(LoopClosing* pLoopClosing);
     void SetViewer(Viewer* pViewer);
@@ -158,6 +170,11 @@ protected:
     //ORB
     ORBextractor* mpORBextractorLeft, *mpORBextractorRight;
     ORBextractor* mpIniORBextractor;
+    TaskPool* mpORBextractorPool;
+
+    // Pipelined monocular extraction, created on the first GrabImageMonocularPipelined
+    FramePipeline* mpFramePipeline;
+    int mnPipelineQueueSize;
 
     //BoW
     ORBVocabulary* mpORBVocabulary;
@@ -170,6 +187,8 @@ protected:
     KeyFrame* mpReferenceKF;
     std::vector<KeyFrame*> mvpLocalKeyFrames;
     std::vector<MapPoint*> mvpLocalMapPoints;
+    // Local map points tested for visibility in SearchLocalPoints, reused across frames
+    MapPointBatch mLocalPointsBatch;
     
     // System
     System* mpSystem;
@@ -0,0 +1,159 @@
+#include "FASTDetector.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace ORB_SLAM2
+{
+
+// Bresenham circle of radius 3 (same order as OpenCV), the first 9 offsets are repeated
+// at the end so that every arc of 9 contiguous pixels is a plain range.
+static void MakeCircle(const int step, int pixel[25])
+{
+    static const int offsets[16][2] =
+    {
+        {0, 3}, { 1, 3}, { 2, 2}, { 3, 1}, { 3, 0}, { 3, -1}, { 2, -2}, { 1, -3},
+        {0, -3}, {-1, -3}, {-2, -2}, {-3, -1}, {-3, 0}, {-3, 1}, {-2, 2}, {-1, 3}
+    };
+
+    for(int k=0; k<16; k++)
+        pixel[k] = offsets[k][0] + offsets[k][1]*step;
+    for(int k=16; k<25; k++)
+        pixel[k] = pixel[k-16];
+}
+
+// Largest threshold for which ptr is a corner: max over the 9 pixel arcs of the smallest
+// difference with the centre, minus one since the test is strict.
+static int CornerScore(const unsigned char* ptr, const int pixel[25])
+{
+    const int v = ptr[0];
+    int d[25];
+    for(int k=0; k<25; k++)
+        d[k] = v - ptr[pixel[k]];
+
+    int best = 0;
+    for(int k=0; k<16; k++)
+    {
+        int minDarker = d[k];
+        int minBrighter = -d[k];
+        for(int l=k+1; l<k+9; l++)
+        {
+            minDarker = std::min(minDarker, d[l]);
+            minBrighter = std::min(minBrighter, -d[l]);
+        }
+        best = std::max(best, std::max(minDarker, minBrighter));
+    }
+
+    return best-1;
+}
+
+// A 9 pixel arc always covers two neighbouring compass pixels, reject before scoring
+static bool PassesCompassTest(const unsigned char* ptr, const int pixel[25], const int threshold)
+{
+    const int v = ptr[0];
+    const int vb = v+threshold;
+    const int vd = v-threshold;
+    int brighter = 0, darker = 0;
+    for(int k=0; k<4; k++)
+    {
+        const int x = ptr[pixel[k*4]];
+        brighter |= (x>vb) << k;
+        darker |= (x<vd) << k;
+    }
+    // Rotate by one compass position and check for two consecutive hits
+    const int brighterNext = ((brighter >> 1) | (brighter << 3)) & 15;
+    const int darkerNext = ((darker >> 1) | (darker << 3)) & 15;
+    return (brighter & brighterNext) || (darker & darkerNext);
+}
+
+int FASTScoreRow(const unsigned char* pRow, const int step, const int x0, const int x1, int threshold,
+                 unsigned char* scores, int* corners)
+{
+    threshold = std::min(std::max(threshold, 0), 255);
+
+    int pixel[25];
+    MakeCircle(step, pixel);
+
+    if(x1>x0)
+        memset(scores+x0, 0, x1-x0);
+
+    int nCorners = 0;
+    int x = x0;
+
+#if CV_SIMD
+    {
+        const int nlanes = cv::v_uint8::nlanes;
+        const cv::v_uint8 delta = cv::vx_setall_u8(0x80);
+        const cv::v_uint8 t = cv::vx_setall_u8((unsigned char)threshold);
+        const cv::v_int8 K = cv::vx_setall_s8(8);
+
+        for(; x<=x1-nlanes; x+=nlanes)
+        {
+            const unsigned char* ptr = pRow + x;
+
+            // Signed bounds, saturation keeps them exact at 0 and 255
+            const cv::v_uint8 v = cv::vx_load(ptr);
+            const cv::v_int8 vb = cv::v_reinterpret_as_s8((v + t) ^ delta);
+            const cv::v_int8 vd = cv::v_reinterpret_as_s8((v - t) ^ delta);
+
+            const cv::v_int8 c0 = cv::v_reinterpret_as_s8(cv::vx_load(ptr + pixel[0]) ^ delta);
+            const cv::v_int8 c1 = cv::v_reinterpret_as_s8(cv::vx_load(ptr + pixel[4]) ^ delta);
+            const cv::v_int8 c2 = cv::v_reinterpret_as_s8(cv::vx_load(ptr + pixel[8]) ^ delta);
+            const cv::v_int8 c3 = cv::v_reinterpret_as_s8(cv::vx_load(ptr + pixel[12]) ^ delta);
+
+            cv::v_int8 m0 = ((vb < c0) & (vb < c1)) | ((vb < c1) & (vb < c2)) |
+                            ((vb < c2) & (vb < c3)) | ((vb < c3) & (vb < c0));
+            cv::v_int8 m1 = ((c0 < vd) & (c1 < vd)) | ((c1 < vd) & (c2 < vd)) |
+                            ((c2 < vd) & (c3 < vd)) | ((c3 < vd) & (c0 < vd));
+            if(cv::v_signmask(m0 | m1)==0)
+                continue;
+
+            // Length of the current run of brighter/darker pixels, 25 steps close every arc
+            cv::v_int8 run0 = cv::vx_setzero_s8(), run1 = run0, max0 = run0, max1 = run0;
+            for(int k=0; k<25; k++)
+            {
+                const cv::v_int8 c = cv::v_reinterpret_as_s8(cv::vx_load(ptr + pixel[k]) ^ delta);
+                m0 = vb < c;
+                m1 = c < vd;
+                run0 = cv::v_sub_wrap(run0, m0) & m0;
+                run1 = cv::v_sub_wrap(run1, m1) & m1;
+                max0 = cv::v_max(max0, run0);
+                max1 = cv::v_max(max1, run1);
+            }
+
+            // One bit per lane, 64 lanes with AVX-512. Narrower signmasks are ints, drop their sign extension.
+            uint64_t mask = (uint64_t)cv::v_signmask(K < cv::v_max(max0, max1));
+            if(nlanes<64)
+                mask &= (uint64_t(1) << nlanes) - 1;
+            for(int k=0; mask; k++, mask >>= 1)
+            {
+                if(mask & 1)
+                {
+                    scores[x+k] = (unsigned char)CornerScore(ptr+k, pixel);
+                    corners[nCorners++] = x+k;
+                }
+            }
+        }
+    }
+#endif
+
+    for(; x<x1; x++)
+    {
+        const unsigned char* ptr = pRow + x;
+        if(!PassesCompassTest(ptr, pixel, threshold))
+            continue;
+
+        const int score = CornerScore(ptr, pixel);
+        if(score>=threshold)
+        {
+            scores[x] = (unsigned char)score;
+            corners[nCorners++] = x;
+        }
+    }
+
+    return nCorners;
+}
+
+} //namespace ORB_SLAM
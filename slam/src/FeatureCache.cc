@@ -0,0 +1,209 @@
+#include "FeatureCache.h"
+
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+static const char FEATURE_CACHE_MAGIC[8] = {'O','R','B','F','E','A','T','S'};
+static const uint32_t FEATURE_CACHE_VERSION = 1;
+static const uint64_t FEATURE_CACHE_ALIGNMENT = 32;
+
+static uint64_t DescriptorOffset(const FeatureCacheFrame &frame)
+{
+    const uint64_t offset = frame.offset + (uint64_t)frame.nKeys*sizeof(CachedKeyPoint);
+    return offset + (FEATURE_CACHE_ALIGNMENT - offset%FEATURE_CACHE_ALIGNMENT)%FEATURE_CACHE_ALIGNMENT;
+}
+
+FeatureCacheWriter::FeatureCacheWriter(): mnOffset(0)
+{
+}
+
+FeatureCacheWriter::~FeatureCacheWriter()
+{
+    if(mFile.is_open())
+        Close();
+}
+
+bool FeatureCacheWriter::Open(const string &filename, float cols, float rows)
+{
+    mFile.open(filename.c_str(), ios::binary | ios::trunc);
+    if(!mFile.is_open())
+    {
+        cerr << "Failed to open feature cache for writing: " << filename << endl;
+        return false;
+    }
+
+    memset(&mHeader, 0, sizeof(mHeader));
+    memcpy(mHeader.magic, FEATURE_CACHE_MAGIC, sizeof(mHeader.magic));
+    mHeader.version = FEATURE_CACHE_VERSION;
+    mHeader.cols = cols;
+    mHeader.rows = rows;
+    mHeader.descriptorSize = 32;
+    mvFrames.clear();
+
+    // Patched in Close
+    mFile.write(reinterpret_cast<const char*>(&mHeader), sizeof(mHeader));
+    mnOffset = sizeof(mHeader);
+    return true;
+}
+
+void FeatureCacheWriter::Pad()
+{
+    static const char zeros[FEATURE_CACHE_ALIGNMENT] = {0};
+    const uint64_t padding = (FEATURE_CACHE_ALIGNMENT - mnOffset%FEATURE_CACHE_ALIGNMENT)%FEATURE_CACHE_ALIGNMENT;
+    mFile.write(zeros, padding);
+    mnOffset += padding;
+}
+
+void FeatureCacheWriter::AddFrame(double timestamp, const vector<cv::KeyPoint> &vKeys, const cv::Mat &descriptors)
+{
+    Pad();
+
+    FeatureCacheFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.timestamp = timestamp;
+    frame.offset = mnOffset;
+    frame.nKeys = vKeys.size();
+    mvFrames.push_back(frame);
+
+    vector<CachedKeyPoint> vCached(vKeys.size());
+    for(size_t i=0; i<vKeys.size(); i++)
+    {
+        const cv::KeyPoint &kp = vKeys[i];
+        vCached[i].x = kp.pt.x;
+        vCached[i].y = kp.pt.y;
+        vCached[i].size = kp.size;
+        vCached[i].angle = kp.angle;
+        vCached[i].response = kp.response;
+        vCached[i].octave = kp.octave;
+    }
+    mFile.write(reinterpret_cast<const char*>(vCached.data()), vCached.size()*sizeof(CachedKeyPoint));
+    mnOffset += vCached.size()*sizeof(CachedKeyPoint);
+
+    Pad();
+
+    for(int i=0; i<descriptors.rows; i++)
+        mFile.write(reinterpret_cast<const char*>(descriptors.ptr<unsigned char>(i)), 32);
+    mnOffset += descriptors.rows*32;
+}
+
+bool FeatureCacheWriter::Close()
+{
+    Pad();
+    mHeader.nFrames = mvFrames.size();
+    mHeader.indexOffset = mnOffset;
+    mFile.write(reinterpret_cast<const char*>(mvFrames.data()), mvFrames.size()*sizeof(FeatureCacheFrame));
+
+    mFile.seekp(0);
+    mFile.write(reinterpret_cast<const char*>(&mHeader), sizeof(mHeader));
+
+    const bool bOk = mFile.good();
+    mFile.close();
+    return bOk;
+}
+
+FeatureCache::FeatureCache(): mpData(NULL), mnSize(0), mpHeader(NULL), mpFrames(NULL), mnFrames(0)
+{
+}
+
+FeatureCache::~FeatureCache()
+{
+    Close();
+}
+
+bool FeatureCache::Open(const string &filename)
+{
+    Close();
+
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if(fd<0)
+    {
+        cerr << "Failed to open feature cache: " << filename << endl;
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st)!=0 || st.st_size<(off_t)sizeof(FeatureCacheHeader))
+    {
+        cerr << "Feature cache is too small: " << filename << endl;
+        close(fd);
+        return false;
+    }
+
+    void* pData = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(pData==MAP_FAILED)
+    {
+        cerr << "Failed to map feature cache: " << filename << endl;
+        return false;
+    }
+    mpData = pData;
+    mnSize = st.st_size;
+
+    mpHeader = static_cast<const FeatureCacheHeader*>(mpData);
+    if(memcmp(mpHeader->magic, FEATURE_CACHE_MAGIC, sizeof(mpHeader->magic))!=0 ||
+       mpHeader->version!=FEATURE_CACHE_VERSION || mpHeader->descriptorSize!=32 ||
+       mpHeader->indexOffset + (uint64_t)mpHeader->nFrames*sizeof(FeatureCacheFrame) > mnSize)
+    {
+        cerr << "Not a valid feature cache (or unsupported version): " << filename << endl;
+        Close();
+        return false;
+    }
+
+    mpFrames = reinterpret_cast<const FeatureCacheFrame*>(static_cast<const char*>(mpData) + mpHeader->indexOffset);
+    for(uint32_t i=0; i<mpHeader->nFrames; i++)
+    {
+        if(mpFrames[i].offset%FEATURE_CACHE_ALIGNMENT!=0 ||
+           DescriptorOffset(mpFrames[i]) + (uint64_t)mpFrames[i].nKeys*32 > mpHeader->indexOffset)
+        {
+            cerr << "Feature cache frame " << i << " is out of the file: " << filename << endl;
+            Close();
+            return false;
+        }
+    }
+    mnFrames = mpHeader->nFrames;
+
+    // Sequential replay
+    madvise(mpData, mnSize, MADV_SEQUENTIAL);
+    return true;
+}
+
+void FeatureCache::Close()
+{
+    if(mpData)
+        munmap(mpData, mnSize);
+    mpData = NULL;
+    mnSize = 0;
+    mpHeader = NULL;
+    mpFrames = NULL;
+    mnFrames = 0;
+}
+
+void FeatureCache::GetFrame(size_t i, vector<cv::KeyPoint> &vKeys, cv::Mat &descriptors) const
+{
+    const FeatureCacheFrame &frame = mpFrames[i];
+    const char* pFrame = static_cast<const char*>(mpData) + frame.offset;
+    const CachedKeyPoint* pKeys = reinterpret_cast<const CachedKeyPoint*>(pFrame);
+
+    vKeys.resize(frame.nKeys);
+    for(uint32_t k=0; k<frame.nKeys; k++)
+    {
+        const CachedKeyPoint &kp = pKeys[k];
+        vKeys[k] = cv::KeyPoint(kp.x, kp.y, kp.size, kp.angle, kp.response, kp.octave);
+    }
+
+    if(frame.nKeys==0)
+        descriptors = cv::Mat();
+    else
+        descriptors = cv::Mat(frame.nKeys, 32, CV_8U, static_cast<char*>(mpData) + DescriptorOffset(frame));
+}
+
+} //namespace ORB_SLAM
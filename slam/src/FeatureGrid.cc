@@ -0,0 +1,86 @@
+#include "FeatureGrid.h"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+FeatureGrid::FeatureGrid(): mnCols(0), mnRows(0), mvOffsets(1,0), mvIndices(1,0)
+{
+}
+
+void FeatureGrid::Build(int nCols, int nRows, const vector<int> &vCells)
+{
+    mnCols = nCols;
+    mnRows = nRows;
+    const int nCells = nCols*nRows;
+
+    // First pass: cell sizes, shifted by one so that the prefix sum gives the offsets
+    mvOffsets.assign(nCells+1,0);
+    for(size_t i=0; i<vCells.size(); i++)
+    {
+        if(vCells[i]>=0)
+            mvOffsets[vCells[i]+1]++;
+    }
+    for(int c=0; c<nCells; c++)
+        mvOffsets[c+1] += mvOffsets[c];
+
+    // Second pass: scatter the indices. The last slot stays valid for CellBegin of empty grids.
+    mvIndices.resize(mvOffsets[nCells]+1);
+    vector<unsigned int> vNext(mvOffsets.begin(),mvOffsets.end()-1);
+    for(size_t i=0; i<vCells.size(); i++)
+    {
+        if(vCells[i]>=0)
+            mvIndices[vNext[vCells[i]]++] = i;
+    }
+}
+
+void FeatureGrid::FromNested(const vector< vector< vector<size_t> > > &vGrid)
+{
+    mnCols = vGrid.size();
+    mnRows = mnCols>0 ? vGrid[0].size() : 0;
+
+    mvOffsets.assign(1,0);
+    mvOffsets.reserve(mnCols*mnRows+1);
+    mvIndices.clear();
+    for(int x=0; x<mnCols; x++)
+    {
+        for(int y=0; y<mnRows; y++)
+        {
+            mvIndices.insert(mvIndices.end(),vGrid[x][y].begin(),vGrid[x][y].end());
+            mvOffsets.push_back(mvIndices.size());
+        }
+    }
+    mvIndices.push_back(0);
+}
+
+void FeatureGrid::Assign(int nCols, int nRows, const unsigned int* pOffsets, const unsigned int* pIndices)
+{
+    mnCols = nCols;
+    mnRows = nRows;
+    const int nCells = nCols*nRows;
+    mvOffsets.assign(pOffsets,pOffsets+nCells+1);
+    mvIndices.assign(pIndices,pIndices+mvOffsets[nCells]);
+    mvIndices.push_back(0);
+}
+
+void FeatureGrid::Release()
+{
+    mnCols = 0;
+    mnRows = 0;
+    vector<unsigned int>(1,0).swap(mvOffsets);
+    vector<unsigned int>(1,0).swap(mvIndices);
+}
+
+vector< vector< vector<size_t> > > FeatureGrid::ToNested() const
+{
+    vector< vector< vector<size_t> > > vGrid(mnCols, vector< vector<size_t> >(mnRows));
+    for(int x=0; x<mnCols; x++)
+    {
+        for(int y=0; y<mnRows; y++)
+            vGrid[x][y].assign(CellBegin(x,y),CellEnd(x,y));
+    }
+    return vGrid;
+}
+
+} //namespace ORB_SLAM
@@ -42,16 +42,13 @@ namespace ORB_SLAM2 {
               mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mvKeys(frame.mvKeys),
               mvKeysRight(frame.mvKeysRight), mvKeysUn(frame.mvKeysUn), mvuRight(frame.mvuRight),
               mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec),
-              mDescriptors(frame.mDescriptors.clone()), mDescriptorsRight(frame.mDescriptorsRight.clone()),
-              mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mnId(frame.mnId),
+              mDescriptors(frame.mDescriptors), mDescriptorsRight(frame.mDescriptorsRight),
+              mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mGrid(frame.mGrid),
+              mnId(frame.mnId),
               mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
               mfScaleFactor(frame.mfScaleFactor), mfLogScaleFactor(frame.mfLogScaleFactor),
               mvScaleFactors(frame.mvScaleFactors), mvInvScaleFactors(frame.mvInvScaleFactors),
               mvLevelSigma2(frame.mvLevelSigma2), mvInvLevelSigma2(frame.mvInvLevelSigma2) {
-        for (int i = 0; i < FRAME_GRID_COLS; i++)
-            for (int j = 0; j < FRAME_GRID_ROWS; j++)
-                mGrid[i][j] = frame.mGrid[i][j];
-
         if (!frame.mTcw.empty())
             SetPose(frame.mTcw);
     }
@@ -74,7 +71,7 @@ namespace ORB_SLAM2 {
         mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
         // ORB extraction
-        mDescriptors = descriptors.clone();
+        mDescriptors.Assign(descriptors);
         mvKeys = std::vector<cv::KeyPoint>(keyPoints.begin(),keyPoints.end());
         if (mvKeys.empty())
             return;
@@ -249,6 +246,37 @@ namespace ORB_SLAM2 {
         // ORB extraction
         ExtractORB(0, imGray);
 
+        InitMonocular(imGray);
+    }
+
+    Frame::Frame(const cv::Mat &imGray, const vector<cv::KeyPoint> &vKeys, const cv::Mat &descriptors,
+                 const double &timeStamp, ORBextractor *extractor, ORBVocabulary *voc, cv::Mat &K, cv::Mat &distCoef,
+                 const float &bf, const float &thDepth)
+            : mpORBvocabulary(voc), mpORBextractorLeft(extractor),
+              mpORBextractorRight(static_cast<ORBextractor *>(NULL)),
+              mTimeStamp(timeStamp), mK(K.clone()), mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth) {
+        image = imGray;
+
+        // Frame ID
+        mnId = nNextId++;
+
+        // Scale Level Info
+        mnScaleLevels = mpORBextractorLeft->GetLevels();
+        mfScaleFactor = mpORBextractorLeft->GetScaleFactor();
+        mfLogScaleFactor = log(mfScaleFactor);
+        mvScaleFactors = mpORBextractorLeft->GetScaleFactors();
+        mvInvScaleFactors = mpORBextractorLeft->GetInverseScaleFactors();
+        mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
+        mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
+
+        // ORB features, already extracted by extractor on imGray
+        mvKeys = vKeys;
+        mDescriptors.Assign(descriptors);
+
+        InitMonocular(imGray);
+    }
+
+    void Frame::InitMonocular(const cv::Mat &imGray) {
         N = mvKeys.size();
 
         if (mvKeys.empty())
@@ -270,10 +298,10 @@ namespace ORB_SLAM2 {
             mfGridElementWidthInv = static_cast<float>(FRAME_GRID_COLS) / static_cast<float>(mnMaxX - mnMinX);
             mfGridElementHeightInv = static_cast<float>(FRAME_GRID_ROWS) / static_cast<float>(mnMaxY - mnMinY);
 
-            fx = K.at<float>(0, 0);
-            fy = K.at<float>(1, 1);
-            cx = K.at<float>(0, 2);
-            cy = K.at<float>(1, 2);
+            fx = mK.at<float>(0, 0);
+            fy = mK.at<float>(1, 1);
+            cx = mK.at<float>(0, 2);
+            cy = mK.at<float>(1, 2);
             invfx = 1.0f / fx;
             invfy = 1.0f / fy;
 
@@ -286,18 +314,16 @@ namespace ORB_SLAM2 {
     }
 
     void Frame::AssignFeaturesToGrid() {
-        int nReserve = 0.5f * N / (FRAME_GRID_COLS * FRAME_GRID_ROWS);
-        for (unsigned int i = 0; i < FRAME_GRID_COLS; i++)
-            for (unsigned int j = 0; j < FRAME_GRID_ROWS; j++)
-                mGrid[i][j].reserve(nReserve);
-
+        vector<int> vCells(N, -1);
         for (int i = 0; i < N; i++) {
             const cv::KeyPoint &kp = mvKeysUn[i];
 
             int nGridPosX, nGridPosY;
             if (PosInGrid(kp, nGridPosX, nGridPosY))
-                mGrid[nGridPosX][nGridPosY].push_back(i);
+                vCells[i] = nGridPosX * FRAME_GRID_ROWS + nGridPosY;
         }
+
+        mGrid.Build(FRAME_GRID_COLS, FRAME_GRID_ROWS, vCells);
     }
 
     std::chrono::steady_clock::time_point get_time() {
@@ -310,13 +336,16 @@ namespace ORB_SLAM2 {
 
     void Frame::ExtractORB(int flag, const cv::Mat &im) {
         //line auto start ... line auto end .. printing get_time_diff should be logged accordingly
-        this->orb = cv::ORB::create(1000, 1.2, 8);
         // auto start = get_time();
-        if (flag == 0)
-            (*mpORBextractorLeft)(im, cv::Mat(), mvKeys, mDescriptors);
-            // orb->detectAndCompute(im, cv::Mat(), mvKeys, mDescriptors);
-        else
-            (*mpORBextractorRight)(im, cv::Mat(), mvKeysRight, mDescriptorsRight);
+        cv::Mat descriptors;
+        if (flag == 0) {
+            (*mpORBextractorLeft)(im, cv::Mat(), mvKeys, descriptors);
+            // orb->detectAndCompute(im, cv::Mat(), mvKeys, descriptors);
+            mDescriptors.Assign(descriptors);
+        } else {
+            (*mpORBextractorRight)(im, cv::Mat(), mvKeysRight, descriptors);
+            mDescriptorsRight.Assign(descriptors);
+        }
         // auto end = get_time();
 
         //std::cout << "Time: " << get_time_diff(start, end) << " Size: " << mvKeys.size() << "\n";
@@ -395,54 +424,16 @@ namespace ORB_SLAM2 {
     vector<size_t> Frame::GetFeaturesInArea(const float &x, const float &y, const float &r, const int minLevel,
                                             const int maxLevel) const {
         vector<size_t> vIndices;
-        vIndices.reserve(N);
-
-        const int nMinCellX = max(0, (int) floor((x - mnMinX - r) * mfGridElementWidthInv));
-        if (nMinCellX >= FRAME_GRID_COLS)
-            return vIndices;
-
-        const int nMaxCellX = min((int) FRAME_GRID_COLS - 1, (int) ceil((x - mnMinX + r) * mfGridElementWidthInv));
-        if (nMaxCellX < 0)
-            return vIndices;
-
-        const int nMinCellY = max(0, (int) floor((y - mnMinY - r) * mfGridElementHeightInv));
-        if (nMinCellY >= FRAME_GRID_ROWS)
-            return vIndices;
-
-        const int nMaxCellY = min((int) FRAME_GRID_ROWS - 1, (int) ceil((y - mnMinY + r) * mfGridElementHeightInv));
-        if (nMaxCellY < 0)
-            return vIndices;
-
-        const bool bCheckLevels = (minLevel > 0) || (maxLevel >= 0);
-
-        for (int ix = nMinCellX; ix <= nMaxCellX; ix++) {
-            for (int iy = nMinCellY; iy <= nMaxCellY; iy++) {
-                const vector<size_t> vCell = mGrid[ix][iy];
-                if (vCell.empty())
-                    continue;
-
-                for (size_t j = 0, jend = vCell.size(); j < jend; j++) {
-                    const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-                    if (bCheckLevels) {
-                        if (kpUn.octave < minLevel)
-                            continue;
-                        if (maxLevel >= 0)
-                            if (kpUn.octave > maxLevel)
-                                continue;
-                    }
-
-                    const float distx = kpUn.pt.x - x;
-                    const float disty = kpUn.pt.y - y;
-
-                    if (fabs(distx) < r && fabs(disty) < r)
-                        vIndices.push_back(vCell[j]);
-                }
-            }
-        }
-
+        GetFeaturesInArea(x, y, r, minLevel, maxLevel, vIndices);
         return vIndices;
     }
 
+    void Frame::GetFeaturesInArea(const float &x, const float &y, const float &r, const int minLevel,
+                                  const int maxLevel, vector<size_t> &vIndices) const {
+        vIndices.clear();
+        ForEachFeatureInArea(x, y, r, minLevel, maxLevel, [&vIndices](size_t idx) { vIndices.push_back(idx); });
+    }
+
     bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY) {
         posX = round((kp.pt.x - mnMinX) * mfGridElementWidthInv);
         posY = round((kp.pt.y - mnMinY) * mfGridElementHeightInv);
@@ -457,7 +448,7 @@ namespace ORB_SLAM2 {
 
     void Frame::ComputeBoW() {
         if (mBowVec.empty()) {
-            vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
+            vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors.AsMat());
             mpORBvocabulary->transform(vCurrentDesc, mBowVec, mFeatVec, 4);
         }
     }
@@ -632,6 +623,11 @@ namespace ORB_SLAM2 {
         vector<pair<int, int> > vDistIdx;
         vDistIdx.reserve(N);
 
+        // Candidates of the current left keypoint, compared in one batch
+        vector<size_t> vCandidatesR;
+        vector<const unsigned char *> vpCandidateDescriptors;
+        vector<int> vCandidateDistances;
+
         for (int iL = 0; iL < N; iL++) {
             const cv::KeyPoint &kpL = mvKeys[iL];
             const int &levelL = kpL.octave;
@@ -652,9 +648,9 @@ namespace ORB_SLAM2 {
             int bestDist = ORBmatcher::TH_HIGH;
             size_t bestIdxR = 0;
 
-            const cv::Mat &dL = mDescriptors.row(iL);
-
-            // Compare descriptor to right keypoints
+            // Right keypoints in the scale and disparity range
+            vCandidatesR.clear();
+            vpCandidateDescriptors.clear();
             for (size_t iC = 0; iC < vCandidates.size(); iC++) {
                 const size_t iR = vCandidates[iC];
                 const cv::KeyPoint &kpR = mvKeysRight[iR];
@@ -665,13 +661,24 @@ namespace ORB_SLAM2 {
                 const float &uR = kpR.pt.x;
 
                 if (uR >= minU && uR <= maxU) {
-                    const cv::Mat &dR = mDescriptorsRight.row(iR);
-                    const int dist = ORBmatcher::DescriptorDistance(dL, dR);
+                    vCandidatesR.push_back(iR);
+                    vpCandidateDescriptors.push_back(mDescriptorsRight.ptr(iR));
+                }
+            }
 
-                    if (dist < bestDist) {
-                        bestDist = dist;
-                        bestIdxR = iR;
-                    }
+            // Compare descriptor to right keypoints
+            const int nCandidatesR = vCandidatesR.size();
+            vCandidateDistances.resize(nCandidatesR);
+            if (nCandidatesR > 0)
+                DescriptorDistances(mDescriptors.ptr(iL), &vpCandidateDescriptors[0], nCandidatesR,
+                                    &vCandidateDistances[0]);
+
+            for (int iC = 0; iC < nCandidatesR; iC++) {
+                const int dist = vCandidateDistances[iC];
+
+                if (dist < bestDist) {
+                    bestDist = dist;
+                    bestIdxR = vCandidatesR[iC];
                 }
             }
 
@@ -0,0 +1,136 @@
+#include "FramePipeline.h"
+#include "ORBextractor.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+FramePipeline::FramePipeline(ORBextractor* pIniExtractor, ORBextractor* pExtractor, bool bRGB, int nQueueSize):
+    mpIniExtractor(pIniExtractor), mpExtractor(pExtractor), mbRGB(bRGB), mnQueueSize(max(nQueueSize,2)),
+    mnExtracted(0), mbUseIniExtractor(true), mbFinish(false)
+{
+    mptExtraction = new thread(&FramePipeline::Run, this);
+}
+
+FramePipeline::~FramePipeline()
+{
+    Finish();
+}
+
+void FramePipeline::Push(const cv::Mat &im, const double &timestamp)
+{
+    // The caller may reuse its buffer for the next image (e.g. cv::VideoCapture)
+    Item item;
+    item.im = im.clone();
+    item.timestamp = timestamp;
+    item.pExtractor = NULL;
+
+    unique_lock<mutex> lock(mMutexQueue);
+    while(mqItems.size()>=mnQueueSize && !mbFinish)
+        mCondQueue.wait(lock);
+    if(mbFinish)
+        return;
+
+    mqItems.push_back(std::move(item));
+    mCondQueue.notify_all();
+}
+
+bool FramePipeline::Pop(Item &item)
+{
+    unique_lock<mutex> lock(mMutexQueue);
+    if(mqItems.empty())
+        return false;
+    while(mnExtracted==0 && !mbFinish)
+        mCondQueue.wait(lock);
+    if(mnExtracted==0)
+        return false;
+
+    item = std::move(mqItems.front());
+    mqItems.pop_front();
+    mnExtracted--;
+    mCondQueue.notify_all();
+    return true;
+}
+
+size_t FramePipeline::size()
+{
+    unique_lock<mutex> lock(mMutexQueue);
+    return mqItems.size();
+}
+
+void FramePipeline::SetUseIniExtractor(bool bUseIni)
+{
+    unique_lock<mutex> lock(mMutexQueue);
+    mbUseIniExtractor = bUseIni;
+}
+
+void FramePipeline::Extract(ORBextractor* pExtractor, Item &item)
+{
+    unique_lock<mutex> lock(mMutexExtractor);
+    (*pExtractor)(item.im,cv::Mat(),item.vKeys,item.descriptors);
+    item.pExtractor = pExtractor;
+}
+
+void FramePipeline::Finish()
+{
+    {
+        unique_lock<mutex> lock(mMutexQueue);
+        mbFinish = true;
+        mCondQueue.notify_all();
+    }
+
+    if(mptExtraction)
+    {
+        mptExtraction->join();
+        delete mptExtraction;
+        mptExtraction = NULL;
+    }
+}
+
+void FramePipeline::Run()
+{
+    while(1)
+    {
+        Item* pItem;
+        ORBextractor* pExtractor;
+        {
+            unique_lock<mutex> lock(mMutexQueue);
+            while(mnExtracted==mqItems.size() && !mbFinish)
+                mCondQueue.wait(lock);
+            if(mbFinish)
+                return;
+
+            // Only this thread touches the items past mnExtracted, and deque elements do not move
+            // when others are added at the back or removed from the front
+            pItem = &mqItems[mnExtracted];
+            pExtractor = mbUseIniExtractor ? mpIniExtractor : mpExtractor;
+        }
+
+        cv::Mat &im = pItem->im;
+        if(im.channels()==3)
+        {
+            if(mbRGB)
+                cvtColor(im,im,cv::COLOR_RGB2GRAY);
+            else
+                cvtColor(im,im,cv::COLOR_BGR2GRAY);
+        }
+        else if(im.channels()==4)
+        {
+            if(mbRGB)
+                cvtColor(im,im,cv::COLOR_RGBA2GRAY);
+            else
+                cvtColor(im,im,cv::COLOR_BGRA2GRAY);
+        }
+
+        Extract(pExtractor,*pItem);
+
+        unique_lock<mutex> lock(mMutexQueue);
+        mnExtracted++;
+        mCondQueue.notify_all();
+    }
+}
+
+} //namespace ORB_SLAM
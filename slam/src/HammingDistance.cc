@@ -0,0 +1,270 @@
+#include "HammingDistance.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAMMING_X86
+#endif
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+static inline uint64_t Load64(const unsigned char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Portable kernel, 64 bit version of the bit count of ORBmatcher::DescriptorDistance
+static inline int BitCount64(uint64_t v)
+{
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    return (((v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL) * 0x0101010101010101ULL) >> 56;
+}
+
+static int DistancePortable(const unsigned char* a, const unsigned char* b)
+{
+    int dist = 0;
+    for(int i=0; i<32; i+=8)
+        dist += BitCount64(Load64(a+i) ^ Load64(b+i));
+    return dist;
+}
+
+static void DistancesPortable(const unsigned char* a, const unsigned char* const* pB, int n, int* dist)
+{
+    for(int i=0; i<n; i++)
+        dist[i] = DistancePortable(a, pB[i]);
+}
+
+static void MatrixPortable(const unsigned char* const* pA, int nA, const unsigned char* const* pB, int nB, int* dist)
+{
+    for(int i=0; i<nA; i++)
+        DistancesPortable(pA[i], pB, nB, dist+i*nB);
+}
+
+#ifdef HAMMING_X86
+
+__attribute__((target("popcnt")))
+static inline int DistancePopcnt(const unsigned char* a, const unsigned char* b)
+{
+    return __builtin_popcountll(Load64(a) ^ Load64(b)) + __builtin_popcountll(Load64(a+8) ^ Load64(b+8)) +
+           __builtin_popcountll(Load64(a+16) ^ Load64(b+16)) + __builtin_popcountll(Load64(a+24) ^ Load64(b+24));
+}
+
+__attribute__((target("popcnt")))
+static void DistancesPopcnt(const unsigned char* a, const unsigned char* const* pB, int n, int* dist)
+{
+    for(int i=0; i<n; i++)
+        dist[i] = DistancePopcnt(a, pB[i]);
+}
+
+__attribute__((target("popcnt")))
+static void MatrixPopcnt(const unsigned char* const* pA, int nA, const unsigned char* const* pB, int nB, int* dist)
+{
+    for(int i=0; i<nA; i++)
+        DistancesPopcnt(pA[i], pB, nB, dist+i*nB);
+}
+
+// AVX2: nibble lookup table popcount of the 32 xor'ed bytes, summed with sad
+__attribute__((target("avx2")))
+static inline __m256i PopcountBytesAVX2(__m256i v)
+{
+    const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                         0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low));
+    const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static inline int HorizontalSum64(__m256i v)
+{
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return _mm_cvtsi128_si32(_mm_add_epi64(s, _mm_unpackhi_epi64(s, s)));
+}
+
+__attribute__((target("avx2")))
+static void DistancesAVX2(const unsigned char* a, const unsigned char* const* pB, int n, int* dist)
+{
+    const __m256i va = _mm256_loadu_si256((const __m256i*)a);
+    for(int i=0; i<n; i++)
+    {
+        const __m256i vb = _mm256_loadu_si256((const __m256i*)pB[i]);
+        dist[i] = HorizontalSum64(PopcountBytesAVX2(_mm256_xor_si256(va, vb)));
+    }
+}
+
+__attribute__((target("avx2")))
+static int DistanceAVX2(const unsigned char* a, const unsigned char* b)
+{
+    int dist;
+    DistancesAVX2(a, &b, 1, &dist);
+    return dist;
+}
+
+// Two rows of A per pass, every B descriptor is loaded once for both
+__attribute__((target("avx2")))
+static void MatrixAVX2(const unsigned char* const* pA, int nA, const unsigned char* const* pB, int nB, int* dist)
+{
+    int i=0;
+    for(; i+1<nA; i+=2)
+    {
+        const __m256i va0 = _mm256_loadu_si256((const __m256i*)pA[i]);
+        const __m256i va1 = _mm256_loadu_si256((const __m256i*)pA[i+1]);
+        int* dist0 = dist+i*nB;
+        int* dist1 = dist0+nB;
+        for(int j=0; j<nB; j++)
+        {
+            const __m256i vb = _mm256_loadu_si256((const __m256i*)pB[j]);
+            dist0[j] = HorizontalSum64(PopcountBytesAVX2(_mm256_xor_si256(va0, vb)));
+            dist1[j] = HorizontalSum64(PopcountBytesAVX2(_mm256_xor_si256(va1, vb)));
+        }
+    }
+    if(i<nA)
+        DistancesAVX2(pA[i], pB, nB, dist+i*nB);
+}
+
+// AVX-512 VPOPCNTDQ on 256 bit registers (needs VL)
+__attribute__((target("avx2,avx512f,avx512vl,avx512vpopcntdq")))
+static void DistancesAVX512(const unsigned char* a, const unsigned char* const* pB, int n, int* dist)
+{
+    const __m256i va = _mm256_loadu_si256((const __m256i*)a);
+    for(int i=0; i<n; i++)
+    {
+        const __m256i vb = _mm256_loadu_si256((const __m256i*)pB[i]);
+        dist[i] = HorizontalSum64(_mm256_popcnt_epi64(_mm256_xor_si256(va, vb)));
+    }
+}
+
+__attribute__((target("avx2,avx512f,avx512vl,avx512vpopcntdq")))
+static int DistanceAVX512(const unsigned char* a, const unsigned char* b)
+{
+    int dist;
+    DistancesAVX512(a, &b, 1, &dist);
+    return dist;
+}
+
+__attribute__((target("avx2,avx512f,avx512vl,avx512vpopcntdq")))
+static void MatrixAVX512(const unsigned char* const* pA, int nA, const unsigned char* const* pB, int nB, int* dist)
+{
+    int i=0;
+    for(; i+1<nA; i+=2)
+    {
+        const __m256i va0 = _mm256_loadu_si256((const __m256i*)pA[i]);
+        const __m256i va1 = _mm256_loadu_si256((const __m256i*)pA[i+1]);
+        int* dist0 = dist+i*nB;
+        int* dist1 = dist0+nB;
+        for(int j=0; j<nB; j++)
+        {
+            const __m256i vb = _mm256_loadu_si256((const __m256i*)pB[j]);
+            dist0[j] = HorizontalSum64(_mm256_popcnt_epi64(_mm256_xor_si256(va0, vb)));
+            dist1[j] = HorizontalSum64(_mm256_popcnt_epi64(_mm256_xor_si256(va1, vb)));
+        }
+    }
+    if(i<nA)
+        DistancesAVX512(pA[i], pB, nB, dist+i*nB);
+}
+
+#endif // HAMMING_X86
+
+struct HammingKernel
+{
+    const char* name;
+    int (*distance)(const unsigned char*, const unsigned char*);
+    void (*distances)(const unsigned char*, const unsigned char* const*, int, int*);
+    void (*matrix)(const unsigned char* const*, int, const unsigned char* const*, int, int*);
+    bool (*supported)();
+};
+
+static bool AlwaysSupported() { return true; }
+
+#ifdef HAMMING_X86
+static bool SupportsPopcnt() { return __builtin_cpu_supports("popcnt"); }
+static bool SupportsAVX2() { return __builtin_cpu_supports("avx2"); }
+static bool SupportsAVX512()
+{
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+           __builtin_cpu_supports("avx512vpopcntdq");
+}
+#endif
+
+// Best first
+static const HammingKernel gKernels[] =
+{
+#ifdef HAMMING_X86
+    {"avx512-vpopcntdq", DistanceAVX512, DistancesAVX512, MatrixAVX512, SupportsAVX512},
+    {"avx2", DistanceAVX2, DistancesAVX2, MatrixAVX2, SupportsAVX2},
+    {"popcnt", DistancePopcnt, DistancesPopcnt, MatrixPopcnt, SupportsPopcnt},
+#endif
+    {"portable", DistancePortable, DistancesPortable, MatrixPortable, AlwaysSupported}
+};
+static const int gnKernels = sizeof(gKernels)/sizeof(gKernels[0]);
+
+static const HammingKernel* SelectBestKernel()
+{
+    for(int i=0; i<gnKernels; i++)
+    {
+        if(gKernels[i].supported())
+            return &gKernels[i];
+    }
+    return &gKernels[gnKernels-1];
+}
+
+static const HammingKernel* &CurrentKernel()
+{
+    static const HammingKernel* pKernel = SelectBestKernel();
+    return pKernel;
+}
+
+int DescriptorDistance(const unsigned char* a, const unsigned char* b)
+{
+    return CurrentKernel()->distance(a, b);
+}
+
+void DescriptorDistances(const unsigned char* a, const unsigned char* const* pB, int n, int* dist)
+{
+    CurrentKernel()->distances(a, pB, n, dist);
+}
+
+void DescriptorDistanceMatrix(const unsigned char* const* pA, int nA, const unsigned char* const* pB, int nB, int* dist)
+{
+    CurrentKernel()->matrix(pA, nA, pB, nB, dist);
+}
+
+string GetHammingKernel()
+{
+    return CurrentKernel()->name;
+}
+
+vector<string> GetAvailableHammingKernels()
+{
+    vector<string> vNames;
+    for(int i=0; i<gnKernels; i++)
+    {
+        if(gKernels[i].supported())
+            vNames.push_back(gKernels[i].name);
+    }
+    return vNames;
+}
+
+bool SetHammingKernel(const string &name)
+{
+    for(int i=0; i<gnKernels; i++)
+    {
+        if(name==gKernels[i].name && gKernels[i].supported())
+        {
+            CurrentKernel() = &gKernels[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+} //namespace ORB_SLAM
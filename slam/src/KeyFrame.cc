@@ -21,10 +21,12 @@
 #include "KeyFrame.h"
 #include "Converter.h"
 #include "ORBmatcher.h"
-#include "RaspberryKeyFrame.h"
+#include "RaspberryMapFile.h"
+#include "MapIdIndex.h"
+#include "KeyFrameImageStore.h"
+#include "KeyFramePayloadStore.h"
 #include<mutex>
 
-#include <boost/archive/text_oarchive.hpp>
 // #include <boost/archive/binary_iarchive.hpp>
 
 
@@ -46,7 +48,7 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mnLoopQuery(0), mnLoopWords(0), mnRelocQuery(0), mnRelocWords(0), mnBAGlobalForKF(0),
     fx(F.fx), fy(F.fy), cx(F.cx), cy(F.cy), invfx(F.invfx), invfy(F.invfy),
     mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mvKeys(F.mvKeys), mvKeysUn(F.mvKeysUn),
-    mvuRight(F.mvuRight), mvDepth(F.mvDepth), mDescriptors(F.mDescriptors.clone()),
+    mvuRight(F.mvuRight), mvDepth(F.mvDepth), mDescriptors(F.mDescriptors),
     mBowVec(F.mBowVec), mFeatVec(F.mFeatVec), mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
     mfLogScaleFactor(F.mfLogScaleFactor), mvScaleFactors(F.mvScaleFactors), mvLevelSigma2(F.mvLevelSigma2),
     mvInvLevelSigma2(F.mvInvLevelSigma2), mnMinX(F.mnMinX), mnMinY(F.mnMinY), mnMaxX(F.mnMaxX),
@@ -59,13 +61,12 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     
     mnId=nNextId++;
 
-    mGrid.resize(mnGridCols);
-    for(int i=0; i<mnGridCols;i++)
-    {
-        mGrid[i].resize(mnGridRows);
-        for(int j=0; j<mnGridRows; j++)
-            mGrid[i][j] = F.mGrid[i][j];
-    }
+    // The image store keeps the image from now on, unless keyframes are set to retain theirs
+    KeyFrameImageStore* pImageStore = pMap ? pMap->GetImageStore() : static_cast<KeyFrameImageStore*>(NULL);
+    if(pImageStore && pImageStore->Add(mnId,image) && !pImageStore->RetainsImages())
+        image.release();
+
+    mGrid = F.mGrid;
 
     SetPose(F.mTcw);    
 }
@@ -80,7 +81,7 @@ KeyFrame::KeyFrame():
     mbf(0.0), mb(0.0), mThDepth(0.0), N(0), mnScaleLevels(0), mfScaleFactor(0),
     mfLogScaleFactor(0.0),
     mnMinX(0), mnMinY(0), mnMaxX(0),
-    mnMaxY(0)
+    mnMaxY(0), mpMap(static_cast<Map*>(NULL))
 {
 #if 0
     mnId=nNextId++;
@@ -101,6 +102,7 @@ KeyFrame::KeyFrame():
 template<class Archive>
     void KeyFrame::save(Archive & ar, const unsigned int version) const
     {
+        KeyFramePayloadPin pin(const_cast<KeyFrame*>(this));
         ar & const_cast<cv::Mat &> (image);
 
         int nItems;bool is_id;bool has_parent = false;
@@ -147,7 +149,8 @@ template<class Archive>
         ar & const_cast<std::vector<cv::KeyPoint> &> (mvKeysUn);
         ar & const_cast<std::vector<float> &> (mvuRight);
         ar & const_cast<std::vector<float> &> (mvDepth);
-        ar & const_cast<cv::Mat &> (mDescriptors);
+        cv::Mat descriptors = mDescriptors.AsMat();
+        ar & descriptors;
         ar & const_cast<cv::Mat &> (mTcp);
         ar & const_cast<int &> (mnScaleLevels);
         ar & const_cast<float &> (mfScaleFactor);
@@ -192,7 +195,8 @@ template<class Archive>
         }
 
         // Grid
-        ar & const_cast<std::vector< std::vector <std::vector<size_t> > > &> (mGrid);
+        std::vector< std::vector <std::vector<size_t> > > vGrid = mGrid.ToNested();
+        ar & vGrid;
          nItems = mConnectedKeyFrameWeights.size();
          ar & nItems;
 
@@ -370,7 +374,9 @@ template<class Archive>
         ar & const_cast<std::vector<cv::KeyPoint> &> (mvKeysUn);
         ar & const_cast<std::vector<float> &> (mvuRight);
         ar & const_cast<std::vector<float> &> (mvDepth);
-        ar & const_cast<cv::Mat &> (mDescriptors);
+        cv::Mat descriptors;
+        ar & descriptors;
+        mDescriptors.Assign(descriptors);
         ar & const_cast<cv::Mat &> (mTcp);
         ar & const_cast<int &> (mnScaleLevels);
         ar & const_cast<float &> (mfScaleFactor);
@@ -414,7 +420,9 @@ template<class Archive>
         
         //cout << "KF " << mnId <<" valid points = " << j << "invalid points = " << (nItems - j) << endl;
         // Grid
-        ar & const_cast<std::vector< std::vector <std::vector<size_t> > > &> (mGrid);
+        std::vector< std::vector <std::vector<size_t> > > vGrid;
+        ar & vGrid;
+        mGrid.FromNested(vGrid);
 
         ar & nItems;
         //mConnectedKeyFrameWeights_nId.resize(nItems);
@@ -544,242 +552,86 @@ template void KeyFrame::load<boost::archive::binary_iarchive>(
     const unsigned int);
 #endif
 
-void KeyFrame::SetMapPoints(std::vector<MapPoint*> spMapPoints)
+void KeyFrame::SetMapPoints(const MapIdIndex &index)
 {
-    // We assume the mvpMapPoints_nId list has been initialized and contains the Map point IDS
-    // With nid, Search the KetFrame List and populate mvpMapPoints
-    long unsigned int id;
-    bool is_valid = false;
-    bool mapp_found = false;
-
-    int j = 0, ctr = 0;
+    // We assume the mmMapPoints_nId list has been initialized and contains the Map point IDS
+    // With nid, look up the map points and populate mvpMapPoints
+    int j = 0;
     for (std::map<long unsigned int,id_map>::iterator it = mmMapPoints_nId.begin(); 
             it != mmMapPoints_nId.end(); 
             j++,++it) 
     {
-        is_valid = it->second.is_valid; 
-        if (!is_valid)  
-        {
-            //j--; 
-            //continue;
+        if (!it->second.is_valid)
             mvpMapPoints[j] = static_cast<MapPoint*>(NULL);
-        }
         else
-        {
-            id = it->second.id;  
-            //cout << "pushing a map point to mvp mappoint" << endl;
-            mapp_found = false;
-            for(std::vector<MapPoint*>::iterator mit=spMapPoints.begin(); mit !=spMapPoints.end(); mit++)
-            {
-                MapPoint* pMp = *mit;
-               
-                if(id == pMp->mnId)
-                {    
-                    ctr ++;
-                    mvpMapPoints[j] = pMp;
-                    mapp_found = true;
-                    break;
-                }
-            }
-            if (mapp_found == false)
-            {
-                //cout << " map point [" << id <<"] not found in KF " << mnId << endl;
-                mvpMapPoints[j] = static_cast<MapPoint*>(NULL);
-            }
-
-        }
-
+            mvpMapPoints[j] = index.GetMapPoint(it->second.id);
     }
 }
 
-void KeyFrame::SetSpanningTree(std::vector<KeyFrame*> vpKeyFrames)
+void KeyFrame::SetSpanningTree(const MapIdIndex &index)
 {
-    // We assume the mvpMapPoints_nId list has been initialized and contains the Map point IDS
-    // With nid, Search the KetFrame List and populate mvpMapPoints
-    long unsigned int id;
-    bool is_valid = false;
-    bool kf_found = false;
-
-    int j = 0, ctr = 0;
     // Search Parent
     if (mparent_KfId_map.is_valid)
     {        
-        for(std::vector<KeyFrame*>::iterator mit=vpKeyFrames.begin(); mit !=vpKeyFrames.end(); mit++)
-        {
-            KeyFrame* pKf = *mit;
-            id = pKf->mnId;
-            //if (mnId == 10 && 964 == id)
-                 //cout << "[" << pMp->mnId <<"]";
-            if(id == mparent_KfId_map.id)
-            {    
-                ctr ++;
-                mpParent = pKf;
-                kf_found = true;
-                break;
-            }
-        }
-        if (kf_found == false)
-        {
+        mpParent = index.GetKeyFrame(mparent_KfId_map.id);
+        if (!mpParent)
             cout << endl << "Parent KF [" << mparent_KfId_map.id <<"] not found for KF " << mnId << endl;
-            //mpParent = new KeyFrame();
-            //mpParent->mbBad = true;     
-            mpParent = static_cast<KeyFrame*>(NULL);             
-        }
     }
+
     // Search Child
-    kf_found = false;
-    j = 0; ctr = 0;
-    is_valid = false;
     for (std::map<long unsigned int,id_map>::iterator it = mmChildrens_nId.begin(); 
             it != mmChildrens_nId.end(); 
-            j++,++it) 
+            ++it) 
     {
-        is_valid = it->second.is_valid;  
-        if (!is_valid) 
-        {
-            //j--;
+        if (!it->second.is_valid) 
             continue;
-            //mspChildrens.insert(NULL);            
-        }  
 
+        KeyFrame* pKf = index.GetKeyFrame(it->second.id);
+        if (pKf)
+            mspChildrens.insert(pKf);
         else
-        {
-            id = it->second.id;  
-            
-            kf_found = false;
-            for(std::vector<KeyFrame*>::iterator mit=vpKeyFrames.begin(); mit !=vpKeyFrames.end(); mit++)
-            {
-                KeyFrame* pKf = *mit;
-                //if (mnId == 10 && 964 == id)
-                     //cout << "[" << pMp->mnId <<"]";
-                if(id == pKf->mnId)
-                {    
-                    ctr ++;
-                    mspChildrens.insert(pKf);
-                    kf_found = true;
-                    break;
-                }
-            }
-            if (kf_found == false)
-                cout << endl << "Child [" << id <<"] not found for KF " << mnId << endl;
-
-        }
-
+            cout << endl << "Child [" << it->second.id <<"] not found for KF " << mnId << endl;
     }
 
     // Search Loop Edges
-    kf_found = false;
-    j = 0; ctr = 0;
-    is_valid = false;
     for (std::map<long unsigned int,id_map>::iterator it = mmLoopEdges_nId.begin(); 
             it != mmLoopEdges_nId.end(); 
-            j++,++it) 
+            ++it) 
     {
-        is_valid = it->second.is_valid;  
-
-
-        if (!is_valid) 
-        {
-            //j--;
+        if (!it->second.is_valid) 
             continue;
-            //mspLoopEdges.insert(NULL);
-        }  
-            
-        else
-        {
-            id = it->second.id;  
-            
-            kf_found = false;
-            for(std::vector<KeyFrame*>::iterator mit=vpKeyFrames.begin(); mit !=vpKeyFrames.end(); mit++)
-            {
-                KeyFrame* pKf = *mit;
-              
-                if(id == pKf->mnId)
-                {    
-                    ctr ++;                    
-                    mspLoopEdges.insert(pKf);
-                    kf_found = true;
-                    break;
-                }
-            }
-            if (kf_found == false)
-                cout << endl << "Loop Edge [" << id <<"] not found for KF " << mnId << endl;
-
-        }
 
+        KeyFrame* pKf = index.GetKeyFrame(it->second.id);
+        if (pKf)
+            mspLoopEdges.insert(pKf);
+        else
+            cout << endl << "Loop Edge [" << it->second.id <<"] not found for KF " << mnId << endl;
     }
-
 }
-void KeyFrame::SetGridParams(std::vector<KeyFrame*> vpKeyFrames)
-{
-    long unsigned int id; int weight;  
-    bool Kf_found = false;  
-    //cout << "KF" << mnId <<" valid indexes-" << endl;
-    int j = 0; 
-    int ctr = 0;
-    bool is_valid = false;
 
-    
+void KeyFrame::SetGridParams(const MapIdIndex &index)
+{
     // Set up mConnectedKeyFrameWeights
     for (map<long unsigned int, int>::iterator it = mConnectedKeyFrameWeights_nId.begin(); 
             it != mConnectedKeyFrameWeights_nId.end(); 
-            j++,++it) 
+            ++it) 
     {
-        id = it->first;
-        weight = it->second;        
-        {
-            
-            for(std::vector<KeyFrame*>::iterator mit=vpKeyFrames.begin(); mit !=vpKeyFrames.end(); mit++)
-            {
-                KeyFrame* pKf = *mit;
-               
-                if(id == pKf->mnId)
-                {   
-                    mConnectedKeyFrameWeights[pKf] = weight;
-                    break;
-                }
-            }
-            
-        }
+        KeyFrame* pKf = index.GetKeyFrame(it->first);
+        if (pKf)
+            mConnectedKeyFrameWeights[pKf] = it->second;
     }
 
     // Set up mvpOrderedConnectedKeyFrames
-    j = 0;
     for (std::map<long unsigned int,id_map>::iterator it = mvpOrderedConnectedKeyFrames_nId.begin(); 
             it != mvpOrderedConnectedKeyFrames_nId.end(); 
             ++it) 
     {
-        is_valid = it->second.is_valid; 
-        if (!is_valid)  
-        {   
+        if (!it->second.is_valid)  
             continue; 
-            ;//mvpOrderedConnectedKeyFrames[j] = NULL;
-        }
-        else
-        {
-            id = it->second.id;  
-            
-            Kf_found = false;
-            for(std::vector<KeyFrame*>::iterator mit=vpKeyFrames.begin(); mit !=vpKeyFrames.end(); mit++)
-            {
-                KeyFrame* pKf = *mit;
-
-                if(id == pKf->mnId)
-                {    
-                    ctr ++;
-                    mvpOrderedConnectedKeyFrames.push_back(pKf);
-                    Kf_found = true;
-                    break;
-                }
-            }
-            if (Kf_found == false)
-            {
-                //cout << "[" << id <<"] not found in KF " << mnId << endl;
-                
-            }
-
-        }
 
+        KeyFrame* pKf = index.GetKeyFrame(it->second.id);
+        if (pKf)
+            mvpOrderedConnectedKeyFrames.push_back(pKf);
     }
 }
 
@@ -802,7 +654,8 @@ void KeyFrame::ComputeBoW()
 {
     if(mBowVec.empty() || mFeatVec.empty())
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
+        KeyFramePayloadPin pin(this);
+        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors.AsMat());
         // Feature vector associate features with nodes in the 4th level (from leaves up)
         // We assume the vocabulary tree has 6 levels, change the 4 otherwise
         mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
@@ -811,18 +664,23 @@ void KeyFrame::ComputeBoW()
 
 void KeyFrame::SetPose(const cv::Mat &Tcw_)
 {
-    unique_lock<mutex> lock(mMutexPose);
-    Tcw_.copyTo(Tcw);
-    cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
-    cv::Mat tcw = Tcw.rowRange(0,3).col(3);
-    cv::Mat Rwc = Rcw.t();
-    Ow = -Rwc*tcw;
-
-    Twc = cv::Mat::eye(4,4,Tcw.type());
-    Rwc.copyTo(Twc.rowRange(0,3).colRange(0,3));
-    Ow.copyTo(Twc.rowRange(0,3).col(3));
-    cv::Mat center = (cv::Mat_<float>(4,1) << mHalfBaseline, 0 , 0, 1);
-    Cw = Twc*center;
+    {
+        unique_lock<mutex> lock(mMutexPose);
+        Tcw_.copyTo(Tcw);
+        cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
+        cv::Mat tcw = Tcw.rowRange(0,3).col(3);
+        cv::Mat Rwc = Rcw.t();
+        Ow = -Rwc*tcw;
+
+        Twc = cv::Mat::eye(4,4,Tcw.type());
+        Rwc.copyTo(Twc.rowRange(0,3).colRange(0,3));
+        Ow.copyTo(Twc.rowRange(0,3).col(3));
+        cv::Mat center = (cv::Mat_<float>(4,1) << mHalfBaseline, 0 , 0, 1);
+        Cw = Twc*center;
+    }
+
+    if(mpMap)
+        mpMap->MarkChanged(this);
 }
 
 cv::Mat KeyFrame::GetPose()
@@ -1028,6 +886,11 @@ MapPoint* KeyFrame::GetMapPoint(const size_t &idx)
 }
 
 void KeyFrame::UpdateConnections()
+{
+    UpdateConnections(CountCovisibles());
+}
+
+map<KeyFrame*,int> KeyFrame::CountCovisibles()
 {
     map<KeyFrame*,int> KFcounter;
 
@@ -1060,6 +923,11 @@ void KeyFrame::UpdateConnections()
         }
     }
 
+    return KFcounter;
+}
+
+void KeyFrame::UpdateConnections(const map<KeyFrame*,int> &KFcounter)
+{
     // This should not happen
     if(KFcounter.empty())
         return;
@@ -1072,7 +940,7 @@ void KeyFrame::UpdateConnections()
 
     vector<pair<int,KeyFrame*> > vPairs;
     vPairs.reserve(KFcounter.size());
-    for(map<KeyFrame*,int>::iterator mit=KFcounter.begin(), mend=KFcounter.end(); mit!=mend; mit++)
+    for(map<KeyFrame*,int>::const_iterator mit=KFcounter.begin(), mend=KFcounter.end(); mit!=mend; mit++)
     {
         if(mit->second>nmax)
         {
@@ -1133,9 +1001,14 @@ void KeyFrame::EraseChild(KeyFrame *pKF)
 
 void KeyFrame::ChangeParent(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
-    mpParent = pKF;
-    pKF->AddChild(this);
+    {
+        unique_lock<mutex> lockCon(mMutexConnections);
+        mpParent = pKF;
+        pKF->AddChild(this);
+    }
+
+    if(mpMap)
+        mpMap->MarkChanged(this);
 }
 
 set<KeyFrame*> KeyFrame::GetChilds()
@@ -1158,9 +1031,14 @@ bool KeyFrame::hasChild(KeyFrame *pKF)
 
 void KeyFrame::AddLoopEdge(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
-    mbNotErase = true;
-    mspLoopEdges.insert(pKF);
+    {
+        unique_lock<mutex> lockCon(mMutexConnections);
+        mbNotErase = true;
+        mspLoopEdges.insert(pKF);
+    }
+
+    if(mpMap)
+        mpMap->MarkChanged(this);
 }
 
 set<KeyFrame*> KeyFrame::GetLoopEdges()
@@ -1331,44 +1209,16 @@ void KeyFrame::EraseConnection(KeyFrame* pKF)
 vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r) const
 {
     vector<size_t> vIndices;
-    vIndices.reserve(N);
-
-    const int nMinCellX = max(0,(int)floor((x-mnMinX-r)*mfGridElementWidthInv));
-    if(nMinCellX>=mnGridCols)
-        return vIndices;
-
-    const int nMaxCellX = min((int)mnGridCols-1,(int)ceil((x-mnMinX+r)*mfGridElementWidthInv));
-    if(nMaxCellX<0)
-        return vIndices;
-
-    const int nMinCellY = max(0,(int)floor((y-mnMinY-r)*mfGridElementHeightInv));
-    if(nMinCellY>=mnGridRows)
-        return vIndices;
-
-    const int nMaxCellY = min((int)mnGridRows-1,(int)ceil((y-mnMinY+r)*mfGridElementHeightInv));
-    if(nMaxCellY<0)
-        return vIndices;
-
-    for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
-    {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
-        {
-            const vector<size_t> vCell = mGrid[ix][iy];
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
-            {
-                const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-                const float distx = kpUn.pt.x-x;
-                const float disty = kpUn.pt.y-y;
-
-                if(fabs(distx)<r && fabs(disty)<r)
-                    vIndices.push_back(vCell[j]);
-            }
-        }
-    }
-
+    GetFeaturesInArea(x,y,r,vIndices);
     return vIndices;
 }
 
+void KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r, vector<size_t> &vIndices) const
+{
+    vIndices.clear();
+    ForEachFeatureInArea(x,y,r,[&vIndices](size_t idx){ vIndices.push_back(idx); });
+}
+
 bool KeyFrame::IsInImage(const float &x, const float &y) const
 {
     return (x>=mnMinX && x<mnMaxX && y>=mnMinY && y<mnMaxY);
@@ -1379,6 +1229,7 @@ cv::Mat KeyFrame::UnprojectStereo(int i)
     const float z = mvDepth[i];
     if(z>0)
     {
+        KeyFramePayloadPin pin(this);
         const float u = mvKeys[i].pt.x;
         const float v = mvKeys[i].pt.y;
         const float x = (u-cx)*z*invfx;
@@ -1424,17 +1275,40 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
     return vDepths[(vDepths.size()-1)/q];
 }
 
-void KeyFrame::rpi_save(const std::string& file_name)
+cv::Mat KeyFrame::GetImage()
 {
-    RaspberryKeyFrame* rpi_kf = new RaspberryKeyFrame(*this);
-    {
-    std::ofstream os(file_name);
-    boost::archive::text_oarchive oa(os);
-    //oa << mpKeyFrameDatabase;
-    oa << rpi_kf;
-    }
+    if(!image.empty())
+        return image;
+    KeyFrameImageStore* pImageStore = mpMap ? mpMap->GetImageStore() : static_cast<KeyFrameImageStore*>(NULL);
+    return pImageStore ? pImageStore->Get(mnId) : cv::Mat();
+}
+
+bool KeyFrame::HasImage()
+{
+    if(!image.empty())
+        return true;
+    KeyFrameImageStore* pImageStore = mpMap ? mpMap->GetImageStore() : static_cast<KeyFrameImageStore*>(NULL);
+    return pImageStore && pImageStore->Has(mnId);
+}
 
-    delete rpi_kf;
+void KeyFrame::PinPayload()
+{
+    KeyFramePayloadStore* pPayloadStore = mpMap ? mpMap->GetPayloadStore() : static_cast<KeyFramePayloadStore*>(NULL);
+    if(pPayloadStore)
+        pPayloadStore->Pin(this);
+}
+
+void KeyFrame::UnpinPayload()
+{
+    KeyFramePayloadStore* pPayloadStore = mpMap ? mpMap->GetPayloadStore() : static_cast<KeyFramePayloadStore*>(NULL);
+    if(pPayloadStore)
+        pPayloadStore->Unpin(this);
+}
+
+void KeyFrame::rpi_save(const std::string& file_name)
+{
+    if(!RaspberryMapFile::Save(vector<KeyFrame*>(1, this), file_name))
+        cerr << "Failed to save keyframe " << mnId << " to " << file_name << endl;
 }
 
 void KeyFrame::align(const cv::Mat& R_align, const cv::Mat& mu_align)
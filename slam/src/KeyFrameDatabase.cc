@@ -24,6 +24,8 @@
 #include "../Thirdparty/DBoW2/DBoW2/BowVector.h"
 
 #include<mutex>
+#include<map>
+#include<algorithm>
 
 using namespace std;
 
@@ -392,4 +394,57 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F)
     return vpRelocCandidates;
 }
 
+vector<pair<float,KeyFrame*> > KeyFrameDatabase::DetectBestCandidates(const DBoW2::BowVector &vBowVec, int nMaxCandidates)
+{
+    map<KeyFrame*,int> mKFsSharingWords;
+
+    // Count the words shared with every keyframe in the inverted file
+    {
+        unique_lock<mutex> lock(mMutex);
+
+        for(DBoW2::BowVector::const_iterator vit=vBowVec.begin(), vend=vBowVec.end(); vit != vend; vit++)
+        {
+            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+
+            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+                mKFsSharingWords[*lit]++;
+        }
+    }
+
+    if(mKFsSharingWords.empty())
+        return vector<pair<float,KeyFrame*> >();
+
+    // Only compare against those keyframes that share enough words
+    int maxCommonWords=0;
+    for(map<KeyFrame*,int>::iterator mit=mKFsSharingWords.begin(), mend=mKFsSharingWords.end(); mit!=mend; mit++)
+    {
+        if(mit->second>maxCommonWords)
+            maxCommonWords=mit->second;
+    }
+
+    int minCommonWords = maxCommonWords*0.8f;
+
+    vector<pair<float,KeyFrame*> > vScoreAndMatch;
+    vScoreAndMatch.reserve(mKFsSharingWords.size());
+    for(map<KeyFrame*,int>::iterator mit=mKFsSharingWords.begin(), mend=mKFsSharingWords.end(); mit!=mend; mit++)
+    {
+        KeyFrame* pKFi = mit->first;
+        if(mit->second<minCommonWords || pKFi->isBad())
+            continue;
+
+        vScoreAndMatch.push_back(make_pair(mpVoc->score(vBowVec,pKFi->mBowVec),pKFi));
+    }
+
+    // Ties are broken by keyframe id so the ranking does not depend on pointer order
+    const size_t nKeep = min(vScoreAndMatch.size(), (size_t)max(nMaxCandidates,0));
+    partial_sort(vScoreAndMatch.begin(), vScoreAndMatch.begin()+nKeep, vScoreAndMatch.end(),
+                 [](const pair<float,KeyFrame*> &a, const pair<float,KeyFrame*> &b)
+                 {
+                     return a.first>b.first || (a.first==b.first && a.second->mnId<b.second->mnId);
+                 });
+    vScoreAndMatch.resize(nKeep);
+
+    return vScoreAndMatch;
+}
+
 } //namespace ORB_SLAM
@@ -0,0 +1,240 @@
+#include "KeyFrameImageStore.h"
+
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <opencv2/highgui/highgui.hpp>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+static const char IMAGE_STORE_MAGIC[8] = {'K','F','I','M','A','G','E','S'};
+static const uint32_t IMAGE_STORE_VERSION = 1;
+
+static bool ReadAt(int fd, void* pData, size_t size, uint64_t offset)
+{
+    char* p = static_cast<char*>(pData);
+    while(size>0)
+    {
+        ssize_t n = pread(fd, p, size, offset);
+        if(n<=0)
+            return false;
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool WriteAt(int fd, const void* pData, size_t size, uint64_t offset)
+{
+    const char* p = static_cast<const char*>(pData);
+    while(size>0)
+    {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if(n<=0)
+            return false;
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+KeyFrameImageStore::KeyFrameImageStore(const string &filename, bool bRetain, int nCompression, bool bTruncate):
+    mbRetain(bRetain), mFd(-1), mnFileSize(0), mbFinish(false), mptWriter(static_cast<thread*>(NULL))
+{
+    mvEncodeParams.push_back(cv::IMWRITE_PNG_COMPRESSION);
+    mvEncodeParams.push_back(min(max(nCompression,0),9));
+
+    if(!Open(filename, bTruncate))
+    {
+        cerr << "Cannot open keyframe image store: " << filename << endl;
+        if(mFd>=0)
+            close(mFd);
+        mFd = -1;
+        return;
+    }
+    mptWriter = new thread(&KeyFrameImageStore::Run, this);
+}
+
+KeyFrameImageStore::~KeyFrameImageStore()
+{
+    Finish();
+    if(mFd>=0)
+        close(mFd);
+}
+
+bool KeyFrameImageStore::Open(const string &filename, bool bTruncate)
+{
+    mFd = open(filename.c_str(), O_RDWR | O_CREAT | (bTruncate ? O_TRUNC : 0), 0644);
+    if(mFd<0)
+        return false;
+    struct stat st;
+    if(fstat(mFd, &st)!=0)
+        return false;
+
+    KeyFrameImageHeader header;
+    if(st.st_size==0)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, IMAGE_STORE_MAGIC, sizeof(header.magic));
+        header.version = IMAGE_STORE_VERSION;
+        mnFileSize = sizeof(header);
+        return WriteAt(mFd, &header, sizeof(header), 0);
+    }
+
+    if(!ReadAt(mFd, &header, sizeof(header), 0) || memcmp(header.magic, IMAGE_STORE_MAGIC, sizeof(header.magic))!=0 ||
+       header.version!=IMAGE_STORE_VERSION)
+        return false;
+
+    // Index of the images written by previous runs
+    const uint64_t fileSize = st.st_size;
+    uint64_t offset = sizeof(header);
+    KeyFrameImageRecord record;
+    while(offset+sizeof(record)<=fileSize && ReadAt(mFd, &record, sizeof(record), offset) &&
+          record.size<=fileSize-offset-sizeof(record))
+    {
+        Location location;
+        location.offset = offset+sizeof(record);
+        location.size = record.size;
+        mmLocations[record.id] = location;
+        offset = location.offset+location.size;
+    }
+    if(offset<fileSize)
+    {
+        cerr << "Keyframe image store " << filename << ": dropping " << fileSize-offset << " bytes of an incomplete image" << endl;
+        if(ftruncate(mFd, offset)!=0)
+            return false;
+    }
+    mnFileSize = offset;
+    return true;
+}
+
+bool KeyFrameImageStore::Add(long unsigned int id, const cv::Mat &image)
+{
+    if(mFd<0 || image.empty())
+        return false;
+
+    unique_lock<mutex> lock(mMutexStore);
+    if(mbFinish)
+        return false;
+    mqPending.push_back(make_pair(id,image));
+    mCondStore.notify_all();
+    return true;
+}
+
+bool KeyFrameImageStore::Has(long unsigned int id)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    for(size_t i=0; i<mqPending.size(); i++)
+    {
+        if(mqPending[i].first==id)
+            return true;
+    }
+    return mmLocations.count(id)>0;
+}
+
+cv::Mat KeyFrameImageStore::Get(long unsigned int id)
+{
+    Location location;
+    {
+        unique_lock<mutex> lock(mMutexStore);
+        // The newest image of the id, in case it was queued twice
+        for(deque<pair<long unsigned int,cv::Mat> >::reverse_iterator rit=mqPending.rbegin(); rit!=mqPending.rend(); rit++)
+        {
+            if(rit->first==id)
+                return rit->second;
+        }
+        map<long unsigned int,Location>::const_iterator it = mmLocations.find(id);
+        if(it==mmLocations.end())
+            return cv::Mat();
+        location = it->second;
+    }
+
+    // Written regions of the file are never modified, no lock needed to read them
+    vector<uchar> buffer(location.size);
+    if(!ReadAt(mFd, buffer.data(), buffer.size(), location.offset))
+    {
+        cerr << "Cannot read the image of keyframe " << id << endl;
+        return cv::Mat();
+    }
+    return cv::imdecode(buffer, cv::IMREAD_UNCHANGED);
+}
+
+void KeyFrameImageStore::Flush()
+{
+    unique_lock<mutex> lock(mMutexStore);
+    while(!mqPending.empty())
+        mCondStore.wait(lock);
+}
+
+void KeyFrameImageStore::Finish()
+{
+    {
+        unique_lock<mutex> lock(mMutexStore);
+        mbFinish = true;
+        mCondStore.notify_all();
+    }
+    if(mptWriter)
+    {
+        mptWriter->join();
+        delete mptWriter;
+        mptWriter = static_cast<thread*>(NULL);
+    }
+}
+
+void KeyFrameImageStore::Run()
+{
+    vector<uchar> buffer;
+    while(true)
+    {
+        pair<long unsigned int,cv::Mat> item;
+        {
+            unique_lock<mutex> lock(mMutexStore);
+            while(mqPending.empty() && !mbFinish)
+                mCondStore.wait(lock);
+            // Queued images are still written when finishing
+            if(mqPending.empty())
+                break;
+            item = mqPending.front();
+        }
+
+        // Only this thread appends, mnFileSize needs no lock
+        KeyFrameImageRecord record;
+        record.id = item.first;
+        record.size = 0;
+        bool bWritten = false;
+        if(cv::imencode(".png", item.second, buffer, mvEncodeParams))
+        {
+            record.size = buffer.size();
+            bWritten = WriteAt(mFd, &record, sizeof(record), mnFileSize) &&
+                       WriteAt(mFd, buffer.data(), buffer.size(), mnFileSize+sizeof(record));
+        }
+        if(!bWritten)
+        {
+            cerr << "Cannot write the image of keyframe " << item.first << endl;
+            // Drop a partial record, the file stays readable up to the last image
+            if(ftruncate(mFd, mnFileSize)!=0)
+                cerr << "Cannot truncate the keyframe image store" << endl;
+        }
+
+        unique_lock<mutex> lock(mMutexStore);
+        if(bWritten)
+        {
+            Location location;
+            location.offset = mnFileSize+sizeof(record);
+            location.size = record.size;
+            mmLocations[record.id] = location;
+            mnFileSize = location.offset+location.size;
+        }
+        mqPending.pop_front();
+        mCondStore.notify_all();
+    }
+}
+
+} //namespace ORB_SLAM
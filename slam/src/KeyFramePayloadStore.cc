@@ -0,0 +1,314 @@
+#include "KeyFramePayloadStore.h"
+#include "KeyFrame.h"
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+static bool ReadAt(int fd, void* pData, size_t size, uint64_t offset)
+{
+    char* p = static_cast<char*>(pData);
+    while(size>0)
+    {
+        ssize_t n = pread(fd, p, size, offset);
+        if(n<=0)
+            return false;
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool WriteAt(int fd, const void* pData, size_t size, uint64_t offset)
+{
+    const char* p = static_cast<const char*>(pData);
+    while(size>0)
+    {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if(n<=0)
+            return false;
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+KeyFramePayloadStore::KeyFramePayloadStore(const string &filename, uint64_t nBudgetBytes):
+    mnBudgetBytes(nBudgetBytes), mFd(-1), mnFileSize(0), mnResidentBytes(0), mnPagedOut(0), mnInTransit(0),
+    mbFinish(false), mptEvictor(static_cast<thread*>(NULL))
+{
+    mFd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(mFd<0)
+    {
+        cerr << "Cannot open keyframe payload store: " << filename << endl;
+        return;
+    }
+    mptEvictor = new thread(&KeyFramePayloadStore::Run, this);
+}
+
+KeyFramePayloadStore::~KeyFramePayloadStore()
+{
+    Finish();
+    if(mFd>=0)
+        close(mFd);
+}
+
+uint64_t KeyFramePayloadStore::PayloadBytes(KeyFrame* pKF)
+{
+    return pKF->mvKeys.size()*sizeof(cv::KeyPoint) + pKF->mDescriptors.size()*sizeof(ORBDescriptor) +
+           (pKF->mGrid.Offsets().size()+pKF->mGrid.Indices().size())*sizeof(unsigned int);
+}
+
+void KeyFramePayloadStore::Add(KeyFrame* pKF)
+{
+    if(mFd<0)
+        return;
+    unique_lock<mutex> lock(mMutexStore);
+    if(mmEntries.count(pKF))
+        return;
+    Entry &entry = mmEntries[pKF];
+    mlLRU.push_front(pKF);
+    entry.itLRU = mlLRU.begin();
+    entry.nBytes = PayloadBytes(pKF);
+    entry.nPins = 0;
+    entry.bResident = true;
+    entry.bInTransit = false;
+    entry.bWritten = false;
+    entry.offset = 0;
+    entry.size = 0;
+    mnResidentBytes += entry.nBytes;
+    if(mnResidentBytes>mnBudgetBytes)
+        mCondStore.notify_one();
+}
+
+void KeyFramePayloadStore::Clear()
+{
+    unique_lock<mutex> lock(mMutexStore);
+    // The keyframes are deleted next, no eviction may still be writing one
+    while(mnInTransit>0)
+        mCondStore.wait(lock);
+    mmEntries.clear();
+    mlLRU.clear();
+    mnResidentBytes = 0;
+    mnPagedOut = 0;
+}
+
+void KeyFramePayloadStore::Pin(KeyFrame* pKF)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    unordered_map<KeyFrame*,Entry>::iterator it = mmEntries.find(pKF);
+    if(it==mmEntries.end())
+        return;
+    // Entries are nodes, the reference survives insertions while the lock is released
+    Entry &entry = it->second;
+    while(entry.bInTransit)
+        mCondStore.wait(lock);
+    entry.nPins++;
+    if(entry.bResident)
+    {
+        mlLRU.splice(mlLRU.begin(), mlLRU, entry.itLRU);
+        return;
+    }
+
+    // Read back without the lock, the pin keeps the evictor away and other pins wait for the transit
+    entry.bInTransit = true;
+    mnInTransit++;
+    const uint64_t offset = entry.offset;
+    const uint64_t size = entry.size;
+    lock.unlock();
+    const bool bRead = Read(pKF, offset, size);
+    lock.lock();
+
+    // Without its payload the keyframe cannot be matched any more, the map is unusable
+    if(!bRead)
+    {
+        cerr << "Cannot read the payload of keyframe " << pKF->mnId << " back from the payload store" << endl;
+        exit(-1);
+    }
+    entry.bInTransit = false;
+    mnInTransit--;
+    entry.bResident = true;
+    mlLRU.push_front(pKF);
+    entry.itLRU = mlLRU.begin();
+    mnResidentBytes += entry.nBytes;
+    mnPagedOut--;
+    mCondStore.notify_all();
+}
+
+void KeyFramePayloadStore::Unpin(KeyFrame* pKF)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    unordered_map<KeyFrame*,Entry>::iterator it = mmEntries.find(pKF);
+    if(it==mmEntries.end() || it->second.nPins==0)
+        return;
+    it->second.nPins--;
+    if(it->second.nPins==0 && mnResidentBytes>mnBudgetBytes)
+        mCondStore.notify_one();
+}
+
+uint64_t KeyFramePayloadStore::GetResidentBytes()
+{
+    unique_lock<mutex> lock(mMutexStore);
+    return mnResidentBytes;
+}
+
+size_t KeyFramePayloadStore::GetPagedOutCount()
+{
+    unique_lock<mutex> lock(mMutexStore);
+    return mnPagedOut;
+}
+
+void KeyFramePayloadStore::Finish()
+{
+    {
+        unique_lock<mutex> lock(mMutexStore);
+        mbFinish = true;
+        mCondStore.notify_all();
+    }
+    if(mptEvictor)
+    {
+        mptEvictor->join();
+        delete mptEvictor;
+        mptEvictor = static_cast<thread*>(NULL);
+    }
+}
+
+uint64_t KeyFramePayloadStore::Write(KeyFrame* pKF)
+{
+    KeyFramePayloadRecord record;
+    memset(&record, 0, sizeof(record));
+    record.id = pKF->mnId;
+    record.nKeys = pKF->mvKeys.size();
+    record.gridCols = pKF->mGrid.Cols();
+    record.gridRows = pKF->mGrid.Rows();
+    record.nGridIndices = pKF->mGrid.Offsets().back();
+    if(pKF->mDescriptors.size()!=record.nKeys ||
+       pKF->mGrid.Offsets().size()!=(size_t)record.gridCols*record.gridRows+1)
+        return 0;
+
+    vector<char> buffer;
+    auto Append = [&buffer](const void* pData, size_t size)
+    {
+        const char* p = static_cast<const char*>(pData);
+        buffer.insert(buffer.end(), p, p+size);
+    };
+    Append(&record, sizeof(record));
+    if(record.nKeys>0)
+    {
+        Append(&pKF->mvKeys[0], record.nKeys*sizeof(cv::KeyPoint));
+        Append(&pKF->mDescriptors[0], record.nKeys*sizeof(ORBDescriptor));
+    }
+    Append(pKF->mGrid.Offsets().data(), pKF->mGrid.Offsets().size()*sizeof(unsigned int));
+    Append(pKF->mGrid.Indices().data(), record.nGridIndices*sizeof(unsigned int));
+
+    if(!WriteAt(mFd, &buffer[0], buffer.size(), mnFileSize))
+        return 0;
+    return buffer.size();
+}
+
+bool KeyFramePayloadStore::Read(KeyFrame* pKF, uint64_t offset, uint64_t size)
+{
+    if(size<sizeof(KeyFramePayloadRecord))
+        return false;
+    vector<char> buffer(size);
+    if(!ReadAt(mFd, &buffer[0], buffer.size(), offset))
+        return false;
+    KeyFramePayloadRecord record;
+    memcpy(&record, &buffer[0], sizeof(record));
+    if(record.gridCols<0 || record.gridRows<0)
+        return false;
+    const uint64_t nOffsets = (uint64_t)record.gridCols*record.gridRows+1;
+    if(record.id!=pKF->mnId || record.nKeys!=(uint32_t)pKF->N ||
+       size!=sizeof(record) + record.nKeys*(sizeof(cv::KeyPoint)+sizeof(ORBDescriptor)) +
+                   (nOffsets+record.nGridIndices)*sizeof(unsigned int))
+        return false;
+
+    const char* p = &buffer[0] + sizeof(record);
+    vector<cv::KeyPoint> &vKeys = const_cast<vector<cv::KeyPoint> &>(pKF->mvKeys);
+    vKeys.resize(record.nKeys);
+    if(record.nKeys>0)
+        memcpy(&vKeys[0], p, record.nKeys*sizeof(cv::KeyPoint));
+    p += record.nKeys*sizeof(cv::KeyPoint);
+    pKF->mDescriptors.Assign(cv::Mat(record.nKeys, sizeof(ORBDescriptor), CV_8U, const_cast<char*>(p)));
+    p += record.nKeys*sizeof(ORBDescriptor);
+    const unsigned int* pOffsets = reinterpret_cast<const unsigned int*>(p);
+    if(pOffsets[nOffsets-1]!=record.nGridIndices)
+        return false;
+    pKF->mGrid.Assign(record.gridCols, record.gridRows, pOffsets, pOffsets+nOffsets);
+    return true;
+}
+
+void KeyFramePayloadStore::Evict(KeyFrame* pKF, Entry &entry)
+{
+    vector<cv::KeyPoint>().swap(const_cast<vector<cv::KeyPoint> &>(pKF->mvKeys));
+    pKF->mDescriptors.Release();
+    pKF->mGrid.Release();
+
+    mlLRU.erase(entry.itLRU);
+    entry.bResident = false;
+    mnResidentBytes -= entry.nBytes;
+    mnPagedOut++;
+}
+
+void KeyFramePayloadStore::Run()
+{
+    unique_lock<mutex> lock(mMutexStore);
+    while(!mbFinish)
+    {
+        // Least recently pinned first, pinned keyframes are skipped
+        KeyFrame* pVictim = static_cast<KeyFrame*>(NULL);
+        if(mnResidentBytes>mnBudgetBytes)
+        {
+            for(list<KeyFrame*>::reverse_iterator rit=mlLRU.rbegin(); rit!=mlLRU.rend(); rit++)
+            {
+                if(mmEntries[*rit].nPins==0)
+                {
+                    pVictim = *rit;
+                    break;
+                }
+            }
+        }
+        if(!pVictim)
+        {
+            mCondStore.wait(lock);
+            continue;
+        }
+
+        Entry &entry = mmEntries[pVictim];
+        if(!entry.bWritten)
+        {
+            // Written without the lock, pins of the victim wait for the transit. Only this thread
+            // appends, mnFileSize needs no lock.
+            entry.bInTransit = true;
+            mnInTransit++;
+            lock.unlock();
+            const uint64_t size = Write(pVictim);
+            lock.lock();
+            entry.bInTransit = false;
+            mnInTransit--;
+            mCondStore.notify_all();
+            if(size==0)
+            {
+                cerr << "Cannot write to the keyframe payload store, keyframes stay in memory" << endl;
+                mnBudgetBytes = UINT64_MAX;
+                continue;
+            }
+            entry.bWritten = true;
+            entry.offset = mnFileSize;
+            entry.size = size;
+            mnFileSize += size;
+        }
+        Evict(pVictim, entry);
+    }
+}
+
+} //namespace ORB_SLAM
@@ -19,12 +19,19 @@
 */
 
 #include "Map.h"
+#include "MapIdIndex.h"
+#include "TaskPool.h"
+#include "MapJournal.h"
+#include "KeyFramePayloadStore.h"
+#include "KeyFrameImageStore.h"
 #define TEST_DATA 0xdeadbeef
 #include<mutex>
+#include<algorithm>
 namespace ORB_SLAM2
 {
 
-Map::Map():mnMaxKFid(0)
+Map::Map():mnMaxKFid(0), mpImageStore(static_cast<KeyFrameImageStore*>(NULL)),
+    mpPayloadStore(static_cast<KeyFramePayloadStore*>(NULL)), mpJournal(static_cast<MapJournal*>(NULL))
 {
 }
 
@@ -130,22 +137,38 @@ template void Map::load<boost::archive::binary_iarchive>(
 
 void Map::AddKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspKeyFrames.insert(pKF);
-    if(pKF->mnId>mnMaxKFid)
-        mnMaxKFid=pKF->mnId;
+    KeyFramePayloadStore* pPayloadStore;
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        mspKeyFrames.insert(pKF);
+        if(pKF->mnId>mnMaxKFid)
+            mnMaxKFid=pKF->mnId;
+        pPayloadStore = mpPayloadStore;
+    }
+    if(pPayloadStore)
+        pPayloadStore->Add(pKF);
+    MarkChanged(pKF);
 }
 
 void Map::AddMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspMapPoints.insert(pMP);
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        mspMapPoints.insert(pMP);
+    }
+    MarkChanged(pMP);
 }
 
 void Map::EraseMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspMapPoints.erase(pMP);
+    MapJournal* pJournal;
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        mspMapPoints.erase(pMP);
+        pJournal = mpJournal;
+    }
+    if(pJournal)
+        pJournal->EraseMapPoint(pMP);
 
     // TODO: This only erase the pointer.
     // Delete the MapPoint
@@ -153,8 +176,14 @@ void Map::EraseMapPoint(MapPoint *pMP)
 
 void Map::EraseKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspKeyFrames.erase(pKF);
+    MapJournal* pJournal;
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        mspKeyFrames.erase(pKF);
+        pJournal = mpJournal;
+    }
+    if(pJournal)
+        pJournal->EraseKeyFrame(pKF);
 
     // TODO: This only erase the pointer.
     // Delete the MapPoint
@@ -202,8 +231,97 @@ long unsigned int Map::GetMaxKFid()
     return mnMaxKFid;
 }
 
+void Map::SetImageStore(KeyFrameImageStore* pImageStore)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    mpImageStore = pImageStore;
+    if(mpImageStore)
+    {
+        // Keyframes loaded from a map file hold their image in memory, the store takes them over
+        // as it does for new keyframes
+        for(set<KeyFrame*>::iterator sit=mspKeyFrames.begin(), send=mspKeyFrames.end(); sit!=send; sit++)
+        {
+            KeyFrame* pKF = *sit;
+            if(mpImageStore->Add(pKF->mnId,pKF->image) && !mpImageStore->RetainsImages())
+                pKF->image.release();
+        }
+    }
+}
+
+KeyFrameImageStore* Map::GetImageStore()
+{
+    unique_lock<mutex> lock(mMutexMap);
+    return mpImageStore;
+}
+
+void Map::SetPayloadStore(KeyFramePayloadStore* pPayloadStore)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    mpPayloadStore.store(pPayloadStore);
+    if(pPayloadStore)
+    {
+        for(set<KeyFrame*>::iterator sit=mspKeyFrames.begin(), send=mspKeyFrames.end(); sit!=send; sit++)
+            pPayloadStore->Add(*sit);
+    }
+}
+
+KeyFramePayloadStore* Map::GetPayloadStore()
+{
+    return mpPayloadStore.load();
+}
+
+void Map::SetJournal(MapJournal* pJournal)
+{
+    mpJournal.store(pJournal);
+}
+
+MapJournal* Map::GetJournal()
+{
+    return mpJournal.load();
+}
+
+void Map::MarkChanged(KeyFrame* pKF)
+{
+    MapJournal* pJournal = GetJournal();
+    if(pJournal)
+        pJournal->MarkKeyFrame(pKF);
+}
+
+void Map::MarkChanged(MapPoint* pMP)
+{
+    MapJournal* pJournal = GetJournal();
+    if(pJournal)
+        pJournal->MarkMapPoint(pMP);
+}
+
+bool Map::HasKeyFrame(KeyFrame* pKF)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    return mspKeyFrames.count(pKF)>0;
+}
+
+bool Map::HasMapPoint(MapPoint* pMP)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    return mspMapPoints.count(pMP)>0;
+}
+
 void Map::clear()
 {
+    // The journal does not read the objects until they are deleted
+    MapJournal* pJournal = GetJournal();
+    unique_lock<mutex> lockJournal;
+    if(pJournal)
+        lockJournal = pJournal->Clear();
+    // Savers read the keyframes and map points after they captured the map (MapExporter). Taken
+    // after the journal, which may be saving the map itself, and before the payloads are dropped.
+    unique_lock<mutex> lockSave(mMutexSave);
+    KeyFramePayloadStore* pPayloadStore = GetPayloadStore();
+    if(pPayloadStore)
+        pPayloadStore->Clear();
+
+    unique_lock<mutex> lockUpdate(mMutexMapUpdate);
+
     for(set<MapPoint*>::iterator sit=mspMapPoints.begin(), send=mspMapPoints.end(); sit!=send; sit++)
         delete *sit;
 
@@ -217,6 +335,135 @@ void Map::clear()
     mvpKeyFrameOrigins.clear();
 }
 
+// Runs f(i) for i in [0,n), in chunks on the pool if there is one. f may only write to object i.
+static void ForEachIndex(TaskPool* pPool, int n, const function<void(int)> &f)
+{
+    if(!pPool)
+    {
+        for(int i=0; i<n; i++)
+            f(i);
+        return;
+    }
+
+    const int chunk = 256;
+    pPool->ParallelFor((n+chunk-1)/chunk, [&](int c)
+    {
+        for(int i=c*chunk; i<min(n,(c+1)*chunk); i++)
+            f(i);
+    });
+}
+
+void Map::RestoreLinks(TaskPool* pPool)
+{
+    // Id order, so that the serial steps do not depend on where the objects were allocated
+    vector<KeyFrame*> vpKFs = GetAllKeyFrames();
+    sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
+    vector<MapPoint*> vpMPs = GetAllMapPoints();
+
+    // Built once, every id reference of the map is then resolved in constant time
+    MapIdIndex index(vpKFs, vpMPs);
+
+    // Each object only writes its own links
+    ForEachIndex(pPool, vpKFs.size(), [&](int i)
+    {
+        vpKFs[i]->SetMap(this);
+        vpKFs[i]->SetMapPoints(index);
+        vpKFs[i]->SetSpanningTree(index);
+        vpKFs[i]->SetGridParams(index);
+    });
+
+    // Reconstruct map points Observation
+    ForEachIndex(pPool, vpMPs.size(), [&](int i)
+    {
+        vpMPs[i]->SetMap(this);
+        vpMPs[i]->SetObservations(index);
+    });
+
+    // Covisibility: the shared map points are counted in parallel, the connections (which also
+    // touch the neighbours) are updated in id order as the serial UpdateConnections loop would
+    vector<map<KeyFrame*,int> > vCounters(vpKFs.size());
+    ForEachIndex(pPool, vpKFs.size(), [&](int i)
+    {
+        vCounters[i] = vpKFs[i]->CountCovisibles();
+    });
+    for(size_t i=0; i<vpKFs.size(); i++)
+        vpKFs[i]->UpdateConnections(vCounters[i]);
+}
+
+MapSnapshot Map::CreateSnapshot()
+{
+    MapSnapshot snapshot;
+
+    // The keyframes stay alive until their keypoints are looked up
+    unique_lock<mutex> lockSave(mMutexSave);
+
+    // (keyframe, keypoint) of the observations of every map point, in snapshot order
+    vector<vector<pair<KeyFrame*,size_t> > > vvObservations;
+    {
+        // Tracking, local BA and loop correction all take this lock, so the copy is consistent
+        unique_lock<mutex> lock(mMutexMapUpdate);
+
+        vector<KeyFrame*> vpKFs = GetAllKeyFrames();
+        vector<MapPoint*> vpMPs = GetAllMapPoints();
+
+        snapshot.mvKeyFrames.reserve(vpKFs.size());
+        for(vector<KeyFrame*>::iterator vit=vpKFs.begin(), vend=vpKFs.end(); vit!=vend; vit++)
+        {
+            KeyFrame* pKF = *vit;
+            if(pKF->isBad())
+                continue;
+
+            KeyFrameSnapshot kfSnapshot;
+            kfSnapshot.mnId = pKF->mnId;
+            kfSnapshot.mTcw = pKF->GetPose();
+            kfSnapshot.mbHasImage = pKF->HasImage();
+            kfSnapshot.mnMapPoints = pKF->GetMapPoints().size();
+            snapshot.mvKeyFrames.push_back(kfSnapshot);
+        }
+
+        snapshot.mvMapPoints.reserve(vpMPs.size());
+        vvObservations.reserve(vpMPs.size());
+        for(vector<MapPoint*>::iterator vit=vpMPs.begin(), vend=vpMPs.end(); vit!=vend; vit++)
+        {
+            MapPoint* pMP = *vit;
+            if(pMP->isBad())
+                continue;
+
+            snapshot.mvMapPoints.push_back(MapPointSnapshot());
+            MapPointSnapshot &mpSnapshot = snapshot.mvMapPoints.back();
+            mpSnapshot.mnId = pMP->mnId;
+            mpSnapshot.mWorldPos = pMP->GetWorldPos();
+            mpSnapshot.mNormal = pMP->GetNormal();
+            mpSnapshot.mfMinDistance = pMP->GetMinDistanceInvariance();
+            mpSnapshot.mfMaxDistance = pMP->GetMaxDistanceInvariance();
+
+            map<KeyFrame*,size_t> observations = pMP->GetObservations();
+            vvObservations.push_back(vector<pair<KeyFrame*,size_t> >(observations.begin(), observations.end()));
+        }
+    }
+
+    // Keypoints do not change, they are read without blocking tracking (pinned, they may be paged out)
+    map<KeyFrame*,vector<pair<size_t,size_t> > > mKeyFrameObservations;
+    for(size_t i=0; i<vvObservations.size(); i++)
+    {
+        snapshot.mvMapPoints[i].mvObservations.resize(vvObservations[i].size());
+        for(size_t j=0; j<vvObservations[i].size(); j++)
+            mKeyFrameObservations[vvObservations[i][j].first].push_back(make_pair(i, j));
+    }
+    for(map<KeyFrame*,vector<pair<size_t,size_t> > >::iterator mit=mKeyFrameObservations.begin(); mit!=mKeyFrameObservations.end(); mit++)
+    {
+        KeyFrame* pKF = mit->first;
+        KeyFramePayloadPin pin(pKF);
+        for(size_t k=0; k<mit->second.size(); k++)
+        {
+            const size_t i = mit->second[k].first, j = mit->second[k].second;
+            snapshot.mvMapPoints[i].mvObservations[j] = make_pair(pKF->mnId, pKF->mvKeysUn[vvObservations[i][j].second].pt);
+        }
+    }
+
+    return snapshot;
+}
+
 
 cv::Mat points3d_to_mat(const std::vector<cv::Point3f>& points3d)
 {
@@ -0,0 +1,214 @@
+#include "MapExporter.h"
+#include "LocalMapping.h"
+#include "LoopClosing.h"
+#include "MapFile.h"
+#include "RaspberryMapFile.h"
+#include "KeyFrame.h"
+
+#include <fstream>
+#include <unordered_set>
+#include <unistd.h>
+
+namespace ORB_SLAM2
+{
+
+MapExporter::MapExporter(Map* pMap, KeyFrameDatabase* pKFDB, LocalMapping* pLocalMapper, LoopClosing* pLoopCloser):
+    mpMap(pMap), mpKeyFrameDB(pKFDB), mpLocalMapper(pLocalMapper), mpLoopCloser(pLoopCloser), mptExport(nullptr),
+    meState(IDLE), mfProgress(0), mbRunning(false)
+{
+}
+
+MapExporter::~MapExporter()
+{
+    Join();
+}
+
+bool MapExporter::RequestExport(const string &csvFilename, const string &binFilename)
+{
+    {
+        unique_lock<mutex> lock(mMutexState);
+        if(mbRunning)
+            return false;
+        mbRunning = true;
+    }
+
+    // The previous thread already finished, only reclaim it
+    if(mptExport)
+    {
+        mptExport->join();
+        delete mptExport;
+        mptExport = nullptr;
+    }
+
+    MapSnapshot snapshot;
+    if(!csvFilename.empty())
+        snapshot = mpMap->CreateSnapshot();
+
+    mptExport = new thread(&MapExporter::Run, this, std::move(snapshot), csvFilename, binFilename);
+    return true;
+}
+
+bool MapExporter::isRunning()
+{
+    unique_lock<mutex> lock(mMutexState);
+    return mbRunning;
+}
+
+MapExporter::eExportState MapExporter::GetState()
+{
+    unique_lock<mutex> lock(mMutexState);
+    return meState;
+}
+
+float MapExporter::GetProgress()
+{
+    unique_lock<mutex> lock(mMutexState);
+    return mfProgress;
+}
+
+void MapExporter::Join()
+{
+    if(mptExport)
+    {
+        mptExport->join();
+        delete mptExport;
+        mptExport = nullptr;
+    }
+}
+
+void MapExporter::SetState(eExportState state, float progress)
+{
+    unique_lock<mutex> lock(mMutexState);
+    meState = state;
+    mfProgress = progress;
+}
+
+void MapExporter::Run(MapSnapshot snapshot, string csvFilename, string binFilename)
+{
+    auto progress = [this](float progress)
+    {
+        unique_lock<mutex> lock(mMutexState);
+        mfProgress = progress;
+    };
+
+    if(!csvFilename.empty())
+    {
+        SetState(WRITING_CSV, 0);
+        SaveCloudCsv(snapshot, csvFilename, progress);
+        cout << "Map cloud saved to " << csvFilename << endl;
+    }
+
+    if(!binFilename.empty())
+    {
+        SetState(WRITING_BINARY, 0);
+        if(SaveBinary(binFilename, progress))
+            cout << "Map saved to " << binFilename << endl;
+    }
+
+    unique_lock<mutex> lock(mMutexState);
+    meState = DONE;
+    mfProgress = 1;
+    mbRunning = false;
+}
+
+bool MapExporter::SaveBinary(const string &filename, const function<void(float)> &progress)
+{
+    MapFileCapture capture;
+    return SaveCaptured([this, &capture](){ MapFile::Capture(mpMap, mpKeyFrameDB, capture); },
+                        [this, &capture, &filename, &progress]()
+                        {
+                            return MapFile::Write(capture, mpMap->GetImageStore(), filename, progress);
+                        });
+}
+
+bool MapExporter::SaveRaspberry(const string &filename, const ORBVocabulary* pVoc)
+{
+    RaspberryMapCapture capture;
+    return SaveCaptured([this, &capture]()
+                        {
+                            vector<KeyFrame*> vpKFs;
+                            const vector<KeyFrame*> vpAllKFs = mpMap->GetAllKeyFrames();
+                            for(size_t i=0; i<vpAllKFs.size(); i++)
+                            {
+                                if(!vpAllKFs[i]->isBad())
+                                    vpKFs.push_back(vpAllKFs[i]);
+                            }
+                            RaspberryMapFile::Capture(vpKFs, capture);
+                        },
+                        [&capture, &filename, pVoc](){ return RaspberryMapFile::Write(capture, filename, pVoc); });
+}
+
+bool MapExporter::SaveCaptured(const function<void()> &capture, const function<bool()> &write)
+{
+    // The exporter and the map journal both save, only one pauses local mapping at a time
+    unique_lock<mutex> lockSave(mMutexSave);
+    // A reset waits for the write before it deletes the keyframes and map points
+    unique_lock<mutex> lockMapSave(mpMap->mMutexSave);
+
+    // A loop correction moves the whole map, let it finish first
+    while(mpLoopCloser->isRunningGBA())
+        usleep(5000);
+
+    // If local mapping is already stopped (localization mode) leave it that way
+    bool bStoppedHere = !mpLocalMapper->isStopped();
+    if(bStoppedHere)
+    {
+        mpLocalMapper->RequestStop();
+        while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
+            usleep(1000);
+    }
+
+    {
+        // Tracking and loop closing also change the keyframes and map points, they wait for the
+        // capture only
+        unique_lock<mutex> lockMap(mpMap->mMutexMapUpdate);
+        capture();
+    }
+
+    if(bStoppedHere)
+        mpLocalMapper->Release();
+    return write();
+}
+
+void MapExporter::SaveCloudCsv(const MapSnapshot &snapshot, const string &filename,
+                               const std::function<void(float)> &progress)
+{
+    std::unordered_set<long unsigned int> sKFsWithImage;
+    for(const KeyFrameSnapshot &kf : snapshot.mvKeyFrames)
+    {
+        if(kf.mbHasImage)
+            sKFsWithImage.insert(kf.mnId);
+    }
+
+    ofstream pointData(filename);
+    if(!pointData.is_open())
+    {
+        cerr << "Cannot open file: " << filename << endl;
+        return;
+    }
+
+    const size_t nPoints = snapshot.mvMapPoints.size();
+    for(size_t i=0; i<nPoints; i++)
+    {
+        const MapPointSnapshot &mp = snapshot.mvMapPoints[i];
+        cv::Mat worldPos, normal;
+        mp.mWorldPos.convertTo(worldPos, CV_64F);
+        mp.mNormal.convertTo(normal, CV_64F);
+
+        pointData << worldPos.at<double>(0) << "," << worldPos.at<double>(1) << "," << worldPos.at<double>(2);
+        pointData << "," << mp.mfMinDistance << "," << mp.mfMaxDistance << ","
+                  << normal.at<double>(0) << "," << normal.at<double>(1) << "," << normal.at<double>(2);
+        for(const auto &obs : mp.mvObservations)
+        {
+            if(sKFsWithImage.count(obs.first))
+                pointData << "," << obs.first << "," << obs.second.x << "," << obs.second.y;
+        }
+        pointData << endl;
+
+        if(progress && (i & 1023) == 0)
+            progress((float)i/nPoints);
+    }
+    pointData.close();
+}
+
+} //namespace ORB_SLAM
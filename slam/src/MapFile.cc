@@ -0,0 +1,1231 @@
+#include "MapFile.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "KeyFrameImageStore.h"
+#include "KeyFrameDatabase.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+static const char MAP_FILE_MAGIC[8] = {'O','R','B','S','L','M','A','P'};
+static const uint64_t MAP_FILE_ALIGNMENT = 64;
+static const uint32_t MAP_FILE_SECTIONS = 24;
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+// FeatureVector level of KeyFrame::ComputeBoW
+static const uint32_t MAP_FILE_BOW_LEVELS_UP = 4;
+
+static uint64_t Fnv1a(uint64_t hash, const void* pData, size_t size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(pData);
+    for(size_t i=0; i<size; i++)
+    {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static void MatToArray(const cv::Mat &M, float* p, int n)
+{
+    cv::Mat M32;
+    M.convertTo(M32,CV_32F);
+    for(int i=0; i<n; i++)
+        p[i] = M32.at<float>(i/M32.cols, i%M32.cols);
+}
+
+static void ToKeyPoint(const MapFileKeyPoint &kp, cv::KeyPoint &out)
+{
+    out = cv::KeyPoint(kp.x, kp.y, kp.size, kp.angle, kp.response, kp.octave, kp.classId);
+}
+
+static MapFileKeyPoint FromKeyPoint(const cv::KeyPoint &kp)
+{
+    MapFileKeyPoint out;
+    out.x = kp.pt.x;
+    out.y = kp.pt.y;
+    out.size = kp.size;
+    out.angle = kp.angle;
+    out.response = kp.response;
+    out.octave = kp.octave;
+    out.classId = kp.class_id;
+    return out;
+}
+
+// Streams the sections one after the other. The header and section table are written last.
+class MapFileWriter
+{
+public:
+    bool Open(const string &filename)
+    {
+        mFile.open(filename.c_str(), ios::binary | ios::trunc);
+        if(!mFile.is_open())
+            return false;
+        mvSections.clear();
+        mnOffset = sizeof(MapFileHeader) + MAP_FILE_SECTIONS*sizeof(MapFileSection);
+        mnReported = mnOffset;
+        vector<char> placeholder(mnOffset, 0);
+        mFile.write(&placeholder[0], placeholder.size());
+        return true;
+    }
+
+    // progress gets the fraction of nBytes written, about every megabyte
+    void SetProgress(uint64_t nBytes, const function<void(float)> &progress)
+    {
+        mnProgressBytes = nBytes;
+        mProgress = progress;
+    }
+
+    void Begin(uint32_t id, uint32_t elemSize)
+    {
+        static const char zeros[MAP_FILE_ALIGNMENT] = {0};
+        const uint64_t padding = (MAP_FILE_ALIGNMENT - mnOffset%MAP_FILE_ALIGNMENT)%MAP_FILE_ALIGNMENT;
+        mFile.write(zeros, padding);
+        mnOffset += padding;
+
+        MapFileSection section;
+        section.id = id;
+        section.elemSize = elemSize;
+        section.offset = mnOffset;
+        section.count = 0;
+        section.checksum = FNV_OFFSET;
+        mvSections.push_back(section);
+    }
+
+    void Write(const void* pData, size_t size)
+    {
+        if(size==0)
+            return;
+        MapFileSection &section = mvSections.back();
+        mFile.write(static_cast<const char*>(pData), size);
+        section.checksum = Fnv1a(section.checksum, pData, size);
+        mnOffset += size;
+        if(mProgress && mnOffset-mnReported>=(1<<20))
+        {
+            mnReported = mnOffset;
+            mProgress(min(1.0f, (float)mnOffset/mnProgressBytes));
+        }
+    }
+
+    template<class T>
+    void WriteArray(const vector<T> &v)
+    {
+        if(!v.empty())
+            Write(&v[0], v.size()*sizeof(T));
+    }
+
+    void End()
+    {
+        MapFileSection &section = mvSections.back();
+        section.count = (mnOffset - section.offset)/section.elemSize;
+    }
+
+    bool Close()
+    {
+        MapFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MAP_FILE_MAGIC, sizeof(header.magic));
+        header.version = MAP_FILE_VERSION;
+        header.nSections = mvSections.size();
+        header.fileSize = mnOffset;
+
+        mFile.seekp(0);
+        mFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        mFile.write(reinterpret_cast<const char*>(&mvSections[0]), mvSections.size()*sizeof(MapFileSection));
+        const bool bOk = mFile.good();
+        mFile.close();
+        return bOk;
+    }
+
+protected:
+    ofstream mFile;
+    vector<MapFileSection> mvSections;
+    uint64_t mnOffset;
+
+    function<void(float)> mProgress;
+    uint64_t mnProgressBytes;
+    uint64_t mnReported;
+};
+
+void MapFile::WriteKeyFrameRecord(KeyFrame* pKF, MapFileKeyFrame &r)
+{
+    memset(&r, 0, sizeof(r));
+
+    r.id = pKF->mnId;
+    r.frameId = pKF->mnFrameId;
+    r.timestamp = pKF->mTimeStamp;
+    r.trackReferenceForFrame = pKF->mnTrackReferenceForFrame;
+    r.fuseTargetForKF = pKF->mnFuseTargetForKF;
+    r.BALocalForKF = pKF->mnBALocalForKF;
+    r.BAFixedForKF = pKF->mnBAFixedForKF;
+    r.loopQuery = pKF->mnLoopQuery;
+    r.relocQuery = pKF->mnRelocQuery;
+    r.BAGlobalForKF = pKF->mnBAGlobalForKF;
+
+    MatToArray(pKF->GetPose(), r.Tcw, 16);
+    r.hasTcp = !pKF->mTcp.empty();
+    if(r.hasTcp)
+        MatToArray(pKF->mTcp, r.Tcp, 16);
+
+    r.fx = pKF->fx; r.fy = pKF->fy; r.cx = pKF->cx; r.cy = pKF->cy;
+    r.invfx = pKF->invfx; r.invfy = pKF->invfy;
+    r.bf = pKF->mbf; r.b = pKF->mb; r.thDepth = pKF->mThDepth; r.halfBaseline = pKF->mHalfBaseline;
+    r.gridElementWidthInv = pKF->mfGridElementWidthInv;
+    r.gridElementHeightInv = pKF->mfGridElementHeightInv;
+    r.scaleFactor = pKF->mfScaleFactor;
+    r.logScaleFactor = pKF->mfLogScaleFactor;
+    r.loopScore = pKF->mLoopScore;
+    r.relocScore = pKF->mRelocScore;
+    r.minX = pKF->mnMinX; r.minY = pKF->mnMinY; r.maxX = pKF->mnMaxX; r.maxY = pKF->mnMaxY;
+    r.scaleLevels = pKF->mvScaleFactors.size();
+    r.loopWords = pKF->mnLoopWords;
+    r.relocWords = pKF->mnRelocWords;
+    r.N = pKF->N;
+    {
+        unique_lock<mutex> lock(pKF->mMutexConnections);
+        r.firstConnection = pKF->mbFirstConnection;
+        r.notErase = pKF->mbNotErase;
+        r.toBeErased = pKF->mbToBeErased;
+        r.bad = pKF->mbBad;
+    }
+}
+
+void MapFile::ReadKeyFrameRecord(const MapFileKeyFrame &r, const MapFileScaleLevel* pLevels, const MapFileKeyPoint* pKeys,
+                                 const MapFileKeyPoint* pKeysUn, const MapFileStereo* pStereo, const ORBDescriptor* pDescriptors,
+                                 const uint32_t* pGridOffsets, const uint32_t* pGridIndices, KeyFrame* pKF)
+{
+    pKF->mnId = r.id;
+    const_cast<long unsigned int &>(pKF->mnFrameId) = r.frameId;
+    const_cast<double &>(pKF->mTimeStamp) = r.timestamp;
+    pKF->mnTrackReferenceForFrame = r.trackReferenceForFrame;
+    pKF->mnFuseTargetForKF = r.fuseTargetForKF;
+    pKF->mnBALocalForKF = r.BALocalForKF;
+    pKF->mnBAFixedForKF = r.BAFixedForKF;
+    pKF->mnLoopQuery = r.loopQuery;
+    pKF->mnLoopWords = r.loopWords;
+    pKF->mLoopScore = r.loopScore;
+    pKF->mnRelocQuery = r.relocQuery;
+    pKF->mnRelocWords = r.relocWords;
+    pKF->mRelocScore = r.relocScore;
+    pKF->mnBAGlobalForKF = r.BAGlobalForKF;
+
+    const_cast<int &>(pKF->mnGridCols) = r.gridCols;
+    const_cast<int &>(pKF->mnGridRows) = r.gridRows;
+    const_cast<float &>(pKF->mfGridElementWidthInv) = r.gridElementWidthInv;
+    const_cast<float &>(pKF->mfGridElementHeightInv) = r.gridElementHeightInv;
+    const_cast<float &>(pKF->fx) = r.fx;
+    const_cast<float &>(pKF->fy) = r.fy;
+    const_cast<float &>(pKF->cx) = r.cx;
+    const_cast<float &>(pKF->cy) = r.cy;
+    const_cast<float &>(pKF->invfx) = r.invfx;
+    const_cast<float &>(pKF->invfy) = r.invfy;
+    const_cast<float &>(pKF->mbf) = r.bf;
+    const_cast<float &>(pKF->mb) = r.b;
+    const_cast<float &>(pKF->mThDepth) = r.thDepth;
+    const_cast<int &>(pKF->mnMinX) = r.minX;
+    const_cast<int &>(pKF->mnMinY) = r.minY;
+    const_cast<int &>(pKF->mnMaxX) = r.maxX;
+    const_cast<int &>(pKF->mnMaxY) = r.maxY;
+    cv::Mat K = cv::Mat::eye(3,3,CV_32F);
+    K.at<float>(0,0) = r.fx;
+    K.at<float>(1,1) = r.fy;
+    K.at<float>(0,2) = r.cx;
+    K.at<float>(1,2) = r.cy;
+    const_cast<cv::Mat &>(pKF->mK) = K;
+
+    const_cast<int &>(pKF->mnScaleLevels) = r.scaleLevels;
+    const_cast<float &>(pKF->mfScaleFactor) = r.scaleFactor;
+    const_cast<float &>(pKF->mfLogScaleFactor) = r.logScaleFactor;
+    vector<float> &vScaleFactors = const_cast<vector<float> &>(pKF->mvScaleFactors);
+    vector<float> &vLevelSigma2 = const_cast<vector<float> &>(pKF->mvLevelSigma2);
+    vector<float> &vInvLevelSigma2 = const_cast<vector<float> &>(pKF->mvInvLevelSigma2);
+    vScaleFactors.resize(r.scaleLevels);
+    vLevelSigma2.resize(r.scaleLevels);
+    vInvLevelSigma2.resize(r.scaleLevels);
+    for(int l=0; l<r.scaleLevels; l++)
+    {
+        vScaleFactors[l] = pLevels[l].scaleFactor;
+        vLevelSigma2[l] = pLevels[l].levelSigma2;
+        vInvLevelSigma2[l] = pLevels[l].invLevelSigma2;
+    }
+
+    // Keypoints
+    const_cast<int &>(pKF->N) = r.N;
+    vector<cv::KeyPoint> &vKeys = const_cast<vector<cv::KeyPoint> &>(pKF->mvKeys);
+    vector<cv::KeyPoint> &vKeysUn = const_cast<vector<cv::KeyPoint> &>(pKF->mvKeysUn);
+    vector<float> &vuRight = const_cast<vector<float> &>(pKF->mvuRight);
+    vector<float> &vDepth = const_cast<vector<float> &>(pKF->mvDepth);
+    vKeys.resize(r.N);
+    vKeysUn.resize(r.N);
+    vuRight.resize(r.N);
+    vDepth.resize(r.N);
+    pKF->mvpMapPoints.assign(r.N, static_cast<MapPoint*>(NULL));
+    for(int k=0; k<r.N; k++)
+    {
+        ToKeyPoint(pKeys[k], vKeys[k]);
+        ToKeyPoint(pKeysUn[k], vKeysUn[k]);
+        vuRight[k] = pStereo[k].uRight;
+        vDepth[k] = pStereo[k].depth;
+    }
+    if(r.N>0)
+        pKF->mDescriptors.Assign(cv::Mat(r.N, 32, CV_8U, const_cast<ORBDescriptor*>(pDescriptors)));
+    pKF->mGrid.Assign(r.gridCols, r.gridRows, pGridOffsets, pGridIndices);
+
+    // Pose (Cw depends on the half baseline)
+    pKF->mHalfBaseline = r.halfBaseline;
+    pKF->SetPose(cv::Mat(4, 4, CV_32F, const_cast<float*>(r.Tcw)));
+    if(r.hasTcp)
+        pKF->mTcp = cv::Mat(4, 4, CV_32F, const_cast<float*>(r.Tcp)).clone();
+
+    pKF->mbFirstConnection = r.firstConnection;
+    pKF->mparent_KfId_map.is_valid = false;
+    pKF->mparent_KfId_map.id = 0;
+    pKF->mbNotErase = r.notErase;
+    pKF->mbToBeErased = r.toBeErased;
+    pKF->mbBad = r.bad;
+    pKF->mpKeyFrameDB = static_cast<KeyFrameDatabase*>(NULL);
+    pKF->mpORBvocabulary = static_cast<ORBVocabulary*>(NULL);
+}
+
+void MapFile::WriteMapPointRecord(MapPoint* pMP, MapFileMapPoint &r)
+{
+    memset(&r, 0, sizeof(r));
+
+    r.id = pMP->mnId;
+    r.firstKFid = pMP->mnFirstKFid;
+    r.firstFrame = pMP->mnFirstFrame;
+    r.trackReferenceForFrame = pMP->mnTrackReferenceForFrame;
+    r.lastFrameSeen = pMP->mnLastFrameSeen;
+    r.BALocalForKF = pMP->mnBALocalForKF;
+    r.fuseCandidateForKF = pMP->mnFuseCandidateForKF;
+    r.loopPointForKF = pMP->mnLoopPointForKF;
+    r.correctedByKF = pMP->mnCorrectedByKF;
+    r.correctedReference = pMP->mnCorrectedReference;
+    r.BAGlobalForKF = pMP->mnBAGlobalForKF;
+
+    {
+        unique_lock<mutex> lock(pMP->mMutexPos);
+        MatToArray(pMP->mWorldPos, r.pos, 3);
+        if(!pMP->mNormalVector.empty())
+            MatToArray(pMP->mNormalVector, r.normal, 3);
+        r.minDistance = pMP->mfMinDistance;
+        r.maxDistance = pMP->mfMaxDistance;
+    }
+    {
+        unique_lock<mutex> lock(pMP->mMutexFeatures);
+        memcpy(r.descriptor, pMP->mDescriptor.data, sizeof(r.descriptor));
+        r.nObs = pMP->nObs;
+        r.visible = pMP->mnVisible;
+        r.found = pMP->mnFound;
+        r.bad = pMP->mbBad;
+    }
+}
+
+void MapFile::ReadMapPointRecord(const MapFileMapPoint &r, MapPoint* pMP)
+{
+    pMP->mnId = r.id;
+    pMP->mnFirstKFid = r.firstKFid;
+    pMP->mnFirstFrame = r.firstFrame;
+    pMP->nObs = r.nObs;
+    pMP->mnTrackReferenceForFrame = r.trackReferenceForFrame;
+    pMP->mnLastFrameSeen = r.lastFrameSeen;
+    pMP->mnBALocalForKF = r.BALocalForKF;
+    pMP->mnFuseCandidateForKF = r.fuseCandidateForKF;
+    pMP->mnLoopPointForKF = r.loopPointForKF;
+    pMP->mnCorrectedByKF = r.correctedByKF;
+    pMP->mnCorrectedReference = r.correctedReference;
+    pMP->mnBAGlobalForKF = r.BAGlobalForKF;
+
+    pMP->mWorldPos = cv::Mat(3, 1, CV_32F, const_cast<float*>(r.pos)).clone();
+    pMP->mNormalVector = cv::Mat(3, 1, CV_32F, const_cast<float*>(r.normal)).clone();
+    memcpy(pMP->mDescriptor.data, r.descriptor, sizeof(r.descriptor));
+    pMP->mfMinDistance = r.minDistance;
+    pMP->mfMaxDistance = r.maxDistance;
+    pMP->mnVisible = r.visible;
+    pMP->mnFound = r.found;
+    pMP->mbBad = r.bad;
+    pMP->mpReplaced = static_cast<MapPoint*>(NULL);
+}
+
+bool MapFile::Save(Map* pMap, const string &filename, KeyFrameDatabase* pKFDB)
+{
+    MapFileCapture capture;
+    Capture(pMap, pKFDB, capture);
+    return Write(capture, pMap->GetImageStore(), filename);
+}
+
+void MapFile::Capture(Map* pMap, KeyFrameDatabase* pKFDB, MapFileCapture &c)
+{
+    vector<KeyFrame*> &vpKFs = c.vpKFs;
+    vpKFs = pMap->GetAllKeyFrames();
+    sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
+    vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+    sort(vpMPs.begin(),vpMPs.end(),[](MapPoint* p1, MapPoint* p2){ return p1->mnId<p2->mnId; });
+
+    // References to objects that are not in the map (erased) are dropped, as the boost archive
+    // relinking does
+    unordered_map<KeyFrame*,uint32_t> mKFIndices;
+    for(size_t i=0; i<vpKFs.size(); i++)
+        mKFIndices[vpKFs[i]] = i;
+    unordered_map<MapPoint*,uint32_t> mMPIndices;
+    for(size_t i=0; i<vpMPs.size(); i++)
+        mMPIndices[vpMPs[i]] = i;
+    auto KFIndex = [&](KeyFrame* pKF) -> uint32_t
+    {
+        unordered_map<KeyFrame*,uint32_t>::const_iterator it = mKFIndices.find(pKF);
+        return it==mKFIndices.end() ? MAP_FILE_NONE : it->second;
+    };
+    auto MPIndex = [&](MapPoint* pMP) -> uint32_t
+    {
+        unordered_map<MapPoint*,uint32_t>::const_iterator it = mMPIndices.find(pMP);
+        return it==mMPIndices.end() ? MAP_FILE_NONE : it->second;
+    };
+
+    // With an image store the images stay out of the map file. Images the store does not have
+    // (keyframes streamed in from a map file after the store was set) are written to the map file.
+    // The Mats share the keyframe buffers, a keyframe releasing its image does not free them.
+    KeyFrameImageStore* pImageStore = pMap->GetImageStore();
+    c.vImages.assign(vpKFs.size(), cv::Mat());
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        if(!pImageStore || !pImageStore->Has(vpKFs[i]->mnId))
+            c.vImages[i] = vpKFs[i]->image;
+    }
+
+    // Keyframe records and graph tables. The payloads are not pinned: the grid size and the
+    // section offsets of the records are set by Write.
+    c.vKFRecords.resize(vpKFs.size());
+    c.vConnections.clear();
+    c.vOrdered.clear();
+    c.vTree.clear();
+    c.vMatches.clear();
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        MapFileKeyFrame &r = c.vKFRecords[i];
+        WriteKeyFrameRecord(pKF, r);
+
+        const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
+        for(int k=0; k<pKF->N; k++)
+            c.vMatches.push_back(k<(int)vpMapPoints.size() && vpMapPoints[k] ? MPIndex(vpMapPoints[k]) : MAP_FILE_NONE);
+
+        // The covisibility graph and the spanning tree of the keyframe are read in one critical section,
+        // local mapping and loop closing update them concurrently
+        unique_lock<mutex> lockConnections(pKF->mMutexConnections);
+        r.connectionBegin = c.vConnections.size();
+        for(map<KeyFrame*,int>::const_iterator it=pKF->mConnectedKeyFrameWeights.begin(); it!=pKF->mConnectedKeyFrameWeights.end(); it++)
+        {
+            MapFileConnection connection;
+            connection.keyFrame = KFIndex(it->first);
+            connection.weight = it->second;
+            if(connection.keyFrame!=MAP_FILE_NONE)
+                c.vConnections.push_back(connection);
+        }
+        r.nConnections = c.vConnections.size()-r.connectionBegin;
+
+        r.orderedBegin = c.vOrdered.size();
+        for(size_t k=0; k<pKF->mvpOrderedConnectedKeyFrames.size(); k++)
+        {
+            MapFileConnection connection;
+            connection.keyFrame = KFIndex(pKF->mvpOrderedConnectedKeyFrames[k]);
+            connection.weight = k<pKF->mvOrderedWeights.size() ? pKF->mvOrderedWeights[k] : 0;
+            if(connection.keyFrame!=MAP_FILE_NONE)
+                c.vOrdered.push_back(connection);
+        }
+        r.nOrdered = c.vOrdered.size()-r.orderedBegin;
+
+        r.parent = pKF->mpParent ? KFIndex(pKF->mpParent) : MAP_FILE_NONE;
+        r.treeBegin = c.vTree.size();
+        for(set<KeyFrame*>::const_iterator it=pKF->mspChildrens.begin(); it!=pKF->mspChildrens.end(); it++)
+        {
+            if(KFIndex(*it)!=MAP_FILE_NONE)
+                c.vTree.push_back(KFIndex(*it));
+        }
+        r.nChildren = c.vTree.size()-r.treeBegin;
+        for(set<KeyFrame*>::const_iterator it=pKF->mspLoopEdges.begin(); it!=pKF->mspLoopEdges.end(); it++)
+        {
+            if(KFIndex(*it)!=MAP_FILE_NONE)
+                c.vTree.push_back(KFIndex(*it));
+        }
+        r.nLoopEdges = c.vTree.size()-r.treeBegin-r.nChildren;
+    }
+
+    // Map point records and observations
+    c.vMPRecords.resize(vpMPs.size());
+    c.vObservations.clear();
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPoint* pMP = vpMPs[i];
+        MapFileMapPoint &r = c.vMPRecords[i];
+        WriteMapPointRecord(pMP, r);
+        KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+        r.refKeyFrame = pRefKF ? KFIndex(pRefKF) : MAP_FILE_NONE;
+
+        const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+        r.observationBegin = c.vObservations.size();
+        for(map<KeyFrame*,size_t>::const_iterator it=observations.begin(); it!=observations.end(); it++)
+        {
+            MapFileObservation o;
+            o.keyFrame = KFIndex(it->first);
+            o.index = it->second;
+            if(o.keyFrame!=MAP_FILE_NONE)
+                c.vObservations.push_back(o);
+        }
+        r.nObservations = c.vObservations.size()-r.observationBegin;
+    }
+
+    c.info.nextKeyFrameId = KeyFrame::nNextId;
+    c.info.nextMapPointId = MapPoint::nNextId;
+    c.info.maxKeyFrameId = pMap->GetMaxKFid();
+
+    c.vOrigins.clear();
+    for(size_t i=0; i<pMap->mvpKeyFrameOrigins.size(); i++)
+    {
+        if(KFIndex(pMap->mvpKeyFrameOrigins[i])!=MAP_FILE_NONE)
+            c.vOrigins.push_back(KFIndex(pMap->mvpKeyFrameOrigins[i]));
+    }
+
+    // BoW sections, only if no keyframe is waiting for its BoW (local mapping computes it). Once
+    // computed the BoW of a keyframe does not change, Write reads it from the keyframe.
+    c.bBow = pKFDB && pKFDB->mpVoc;
+    for(size_t i=0; i<vpKFs.size() && c.bBow; i++)
+        c.bBow = vpKFs[i]->N==0 || (!vpKFs[i]->mBowVec.empty() && !vpKFs[i]->mFeatVec.empty());
+    c.vInvertedWords.clear();
+    c.vInvertedKFs.clear();
+    if(c.bBow)
+    {
+        c.bowInfo.vocabularyHash = VocabularyHash(*pKFDB->mpVoc);
+        c.bowInfo.vocabularySize = pKFDB->mpVoc->size();
+        c.bowInfo.levelsUp = MAP_FILE_BOW_LEVELS_UP;
+
+        // Inverted file in its current order, which decides the order of the candidates
+        unique_lock<mutex> lock(pKFDB->mMutex);
+        for(size_t w=0; w<pKFDB->mvInvertedFile.size(); w++)
+        {
+            const list<KeyFrame*> &lKFs = pKFDB->mvInvertedFile[w];
+            MapFileInvertedWord word;
+            word.word = w;
+            word.nKeyFrames = 0;
+            for(list<KeyFrame*>::const_iterator it=lKFs.begin(); it!=lKFs.end(); it++)
+            {
+                if(KFIndex(*it)==MAP_FILE_NONE)
+                    continue;
+                c.vInvertedKFs.push_back(KFIndex(*it));
+                word.nKeyFrames++;
+            }
+            if(word.nKeyFrames>0)
+                c.vInvertedWords.push_back(word);
+        }
+    }
+}
+
+bool MapFile::Write(MapFileCapture &c, KeyFrameImageStore* pImageStore, const string &filename,
+                    const function<void(float)> &progress)
+{
+    const vector<KeyFrame*> &vpKFs = c.vpKFs;
+
+    // The image store must have every image the map file leaves out
+    if(pImageStore)
+        pImageStore->Flush();
+
+    // Section offsets of the keyframe records, with the grid of each keyframe (it may be paged out)
+    uint64_t nKeys = 0, nLevels = 0, nGridOffsets = 0, nGridIndices = 0, nImageBytes = 0;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        KeyFramePayloadPin pin(pKF);
+        MapFileKeyFrame &r = c.vKFRecords[i];
+        r.gridCols = pKF->mGrid.Cols();
+        r.gridRows = pKF->mGrid.Rows();
+
+        r.keyBegin = nKeys;
+        nKeys += r.N;
+        r.levelBegin = nLevels;
+        nLevels += r.scaleLevels;
+        r.gridOffsetBegin = nGridOffsets;
+        nGridOffsets += r.gridCols*r.gridRows+1;
+        r.gridIndexBegin = nGridIndices;
+        nGridIndices += pKF->mGrid.Offsets().back();
+
+        const cv::Mat &image = c.vImages[i];
+        r.imageOffset = nImageBytes;
+        r.imageRows = image.rows;
+        r.imageCols = image.cols;
+        r.imageType = image.type();
+        nImageBytes += image.total()*image.elemSize();
+    }
+
+    MapFileWriter writer;
+    if(!writer.Open(filename))
+    {
+        cerr << "Failed to open map file for writing: " << filename << endl;
+        return false;
+    }
+    if(progress)
+    {
+        const uint64_t nBytes = vpKFs.size()*sizeof(MapFileKeyFrame) + nLevels*sizeof(MapFileScaleLevel) +
+                                nKeys*(2*sizeof(MapFileKeyPoint)+sizeof(MapFileStereo)+sizeof(ORBDescriptor)+sizeof(uint32_t)) +
+                                (nGridOffsets+nGridIndices)*sizeof(uint32_t) + c.vMPRecords.size()*sizeof(MapFileMapPoint) +
+                                c.vObservations.size()*sizeof(MapFileObservation) + nImageBytes;
+        writer.SetProgress(nBytes, progress);
+    }
+
+    writer.Begin(MAP_FILE_INFO, sizeof(MapFileInfo));
+    writer.Write(&c.info, sizeof(c.info));
+    writer.End();
+
+    writer.Begin(MAP_FILE_KEYFRAMES, sizeof(MapFileKeyFrame));
+    writer.WriteArray(c.vKFRecords);
+    writer.End();
+
+    writer.Begin(MAP_FILE_KEYFRAME_ORIGINS, sizeof(uint32_t));
+    writer.WriteArray(c.vOrigins);
+    writer.End();
+
+    writer.Begin(MAP_FILE_SCALE_LEVELS, sizeof(MapFileScaleLevel));
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        for(size_t l=0; l<pKF->mvScaleFactors.size(); l++)
+        {
+            MapFileScaleLevel level;
+            level.scaleFactor = pKF->mvScaleFactors[l];
+            level.levelSigma2 = l<pKF->mvLevelSigma2.size() ? pKF->mvLevelSigma2[l] : 0;
+            level.invLevelSigma2 = l<pKF->mvInvLevelSigma2.size() ? pKF->mvInvLevelSigma2[l] : 0;
+            writer.Write(&level, sizeof(level));
+        }
+    }
+    writer.End();
+
+    // Per keypoint sections, one keyframe at a time
+    vector<MapFileKeyPoint> vKeys;
+    writer.Begin(MAP_FILE_KEYPOINTS, sizeof(MapFileKeyPoint));
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFramePayloadPin pin(vpKFs[i]);
+        vKeys.resize(vpKFs[i]->mvKeys.size());
+        for(size_t k=0; k<vKeys.size(); k++)
+            vKeys[k] = FromKeyPoint(vpKFs[i]->mvKeys[k]);
+        writer.WriteArray(vKeys);
+    }
+    writer.End();
+
+    // mvKeysUn has the size of mvKeys (it is empty only when there are no keypoints)
+    writer.Begin(MAP_FILE_KEYPOINTS_UN, sizeof(MapFileKeyPoint));
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFramePayloadPin pin(vpKFs[i]);
+        const vector<cv::KeyPoint> &vKeysUn = vpKFs[i]->mvKeysUn.size()==vpKFs[i]->mvKeys.size() ? vpKFs[i]->mvKeysUn : vpKFs[i]->mvKeys;
+        vKeys.resize(vKeysUn.size());
+        for(size_t k=0; k<vKeys.size(); k++)
+            vKeys[k] = FromKeyPoint(vKeysUn[k]);
+        writer.WriteArray(vKeys);
+    }
+    writer.End();
+
+    vector<MapFileStereo> vStereo;
+    writer.Begin(MAP_FILE_STEREO, sizeof(MapFileStereo));
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        vStereo.resize(pKF->N);
+        for(size_t k=0; k<vStereo.size(); k++)
+        {
+            vStereo[k].uRight = k<pKF->mvuRight.size() ? pKF->mvuRight[k] : -1;
+            vStereo[k].depth = k<pKF->mvDepth.size() ? pKF->mvDepth[k] : -1;
+        }
+        writer.WriteArray(vStereo);
+    }
+    writer.End();
+
+    const ORBDescriptor emptyDescriptor = ORBDescriptor();
+    writer.Begin(MAP_FILE_DESCRIPTORS, sizeof(ORBDescriptor));
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        KeyFramePayloadPin pin(pKF);
+        for(size_t k=0; k<pKF->mvKeys.size(); k++)
+            writer.Write(k<pKF->mDescriptors.size() ? &pKF->mDescriptors[k] : &emptyDescriptor, sizeof(ORBDescriptor));
+    }
+    writer.End();
+
+    writer.Begin(MAP_FILE_MATCHES, sizeof(uint32_t));
+    writer.WriteArray(c.vMatches);
+    writer.End();
+
+    writer.Begin(MAP_FILE_GRID_OFFSETS, sizeof(uint32_t));
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFramePayloadPin pin(vpKFs[i]);
+        writer.WriteArray(vpKFs[i]->mGrid.Offsets());
+    }
+    writer.End();
+
+    writer.Begin(MAP_FILE_GRID_INDICES, sizeof(uint32_t));
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFramePayloadPin pin(vpKFs[i]);
+        const FeatureGrid &grid = vpKFs[i]->mGrid;
+        writer.Write(grid.Indices().data(), grid.Offsets().back()*sizeof(uint32_t));
+    }
+    writer.End();
+
+    writer.Begin(MAP_FILE_CONNECTIONS, sizeof(MapFileConnection));
+    writer.WriteArray(c.vConnections);
+    writer.End();
+
+    writer.Begin(MAP_FILE_ORDERED, sizeof(MapFileConnection));
+    writer.WriteArray(c.vOrdered);
+    writer.End();
+
+    writer.Begin(MAP_FILE_TREE, sizeof(uint32_t));
+    writer.WriteArray(c.vTree);
+    writer.End();
+
+    writer.Begin(MAP_FILE_MAPPOINTS, sizeof(MapFileMapPoint));
+    writer.WriteArray(c.vMPRecords);
+    writer.End();
+
+    writer.Begin(MAP_FILE_OBSERVATIONS, sizeof(MapFileObservation));
+    writer.WriteArray(c.vObservations);
+    writer.End();
+
+    if(c.bBow)
+    {
+        writer.Begin(MAP_FILE_BOW_INFO, sizeof(MapFileBowInfo));
+        writer.Write(&c.bowInfo, sizeof(c.bowInfo));
+        writer.End();
+
+        vector<MapFileBowRange> vRanges(vpKFs.size());
+        uint64_t nWords = 0, nNodes = 0, nIndices = 0;
+        for(size_t i=0; i<vpKFs.size(); i++)
+        {
+            KeyFrame* pKF = vpKFs[i];
+            vRanges[i].wordBegin = nWords;
+            vRanges[i].nodeBegin = nNodes;
+            vRanges[i].indexBegin = nIndices;
+            vRanges[i].nWords = pKF->mBowVec.size();
+            vRanges[i].nNodes = pKF->mFeatVec.size();
+            nWords += pKF->mBowVec.size();
+            nNodes += pKF->mFeatVec.size();
+            for(DBoW2::FeatureVector::const_iterator it=pKF->mFeatVec.begin(); it!=pKF->mFeatVec.end(); it++)
+                nIndices += it->second.size();
+        }
+        writer.Begin(MAP_FILE_BOW_RANGES, sizeof(MapFileBowRange));
+        writer.WriteArray(vRanges);
+        writer.End();
+
+        writer.Begin(MAP_FILE_BOW_WORDS, sizeof(MapFileBowWord));
+        for(size_t i=0; i<vpKFs.size(); i++)
+        {
+            for(DBoW2::BowVector::const_iterator it=vpKFs[i]->mBowVec.begin(); it!=vpKFs[i]->mBowVec.end(); it++)
+            {
+                MapFileBowWord word;
+                word.word = it->first;
+                word.reserved = 0;
+                word.value = it->second;
+                writer.Write(&word, sizeof(word));
+            }
+        }
+        writer.End();
+
+        writer.Begin(MAP_FILE_FEATURE_NODES, sizeof(MapFileFeatureNode));
+        for(size_t i=0; i<vpKFs.size(); i++)
+        {
+            for(DBoW2::FeatureVector::const_iterator it=vpKFs[i]->mFeatVec.begin(); it!=vpKFs[i]->mFeatVec.end(); it++)
+            {
+                MapFileFeatureNode node;
+                node.node = it->first;
+                node.nIndices = it->second.size();
+                writer.Write(&node, sizeof(node));
+            }
+        }
+        writer.End();
+
+        writer.Begin(MAP_FILE_FEATURE_INDICES, sizeof(uint32_t));
+        vector<uint32_t> vIndices;
+        for(size_t i=0; i<vpKFs.size(); i++)
+        {
+            for(DBoW2::FeatureVector::const_iterator it=vpKFs[i]->mFeatVec.begin(); it!=vpKFs[i]->mFeatVec.end(); it++)
+            {
+                vIndices.assign(it->second.begin(), it->second.end());
+                writer.WriteArray(vIndices);
+            }
+        }
+        writer.End();
+
+        writer.Begin(MAP_FILE_INVERTED_WORDS, sizeof(MapFileInvertedWord));
+        writer.WriteArray(c.vInvertedWords);
+        writer.End();
+
+        writer.Begin(MAP_FILE_INVERTED_KEYFRAMES, sizeof(uint32_t));
+        writer.WriteArray(c.vInvertedKFs);
+        writer.End();
+    }
+
+    // Largest section last
+    writer.Begin(MAP_FILE_IMAGES, 1);
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        const cv::Mat &image = c.vImages[i];
+        if(image.empty())
+            continue;
+        if(image.isContinuous())
+            writer.Write(image.data, image.total()*image.elemSize());
+        else
+        {
+            for(int y=0; y<image.rows; y++)
+                writer.Write(image.ptr(y), image.cols*image.elemSize());
+        }
+    }
+    writer.End();
+
+    if(!writer.Close())
+    {
+        cerr << "Failed to write map file: " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+MapFileView::~MapFileView()
+{
+    if(mpData)
+        munmap(mpData, mnSize);
+}
+
+bool MapFileView::Open(const string &filename)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if(fd<0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st)!=0 || st.st_size<(off_t)sizeof(MapFileHeader))
+    {
+        close(fd);
+        return false;
+    }
+    void* pData = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(pData==MAP_FAILED)
+        return false;
+    mpData = pData;
+    mnSize = st.st_size;
+    // The whole file is read once, front to back
+    madvise(mpData, mnSize, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    const MapFileHeader* pHeader = static_cast<const MapFileHeader*>(mpData);
+    if(memcmp(pHeader->magic, MAP_FILE_MAGIC, sizeof(pHeader->magic))!=0 || pHeader->version!=MAP_FILE_VERSION ||
+       pHeader->fileSize!=mnSize || sizeof(MapFileHeader) + (uint64_t)pHeader->nSections*sizeof(MapFileSection) > mnSize)
+        return false;
+    mpSections = reinterpret_cast<const MapFileSection*>(static_cast<const char*>(mpData) + sizeof(MapFileHeader));
+    mnSections = pHeader->nSections;
+
+    for(uint32_t i=0; i<mnSections; i++)
+    {
+        const MapFileSection &s = mpSections[i];
+        if(s.elemSize==0 || s.offset%MAP_FILE_ALIGNMENT!=0 || s.offset>mnSize || s.count>(mnSize-s.offset)/s.elemSize)
+            return false;
+    }
+    return true;
+}
+
+bool MapFileView::VerifyChecksums() const
+{
+    for(uint32_t i=0; i<mnSections; i++)
+    {
+        const MapFileSection &s = mpSections[i];
+        if(Fnv1a(FNV_OFFSET, static_cast<const char*>(mpData) + s.offset, s.count*s.elemSize)!=s.checksum)
+        {
+            cerr << "Map file section " << s.id << " is corrupted" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MapFile::IsMapFile(const string &filename)
+{
+    ifstream file(filename.c_str(), ios::binary);
+    char magic[8];
+    if(!file.read(magic, sizeof(magic)))
+        return false;
+    return memcmp(magic, MAP_FILE_MAGIC, sizeof(magic))==0;
+}
+
+uint64_t MapFile::Fingerprint(const string &filename)
+{
+    ifstream file(filename.c_str(), ios::binary);
+    MapFileHeader header;
+    if(!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+       memcmp(header.magic, MAP_FILE_MAGIC, sizeof(header.magic))!=0 || header.nSections>MAP_FILE_SECTIONS)
+        return 0;
+    vector<MapFileSection> vSections(header.nSections);
+    if(!vSections.empty() && !file.read(reinterpret_cast<char*>(&vSections[0]), vSections.size()*sizeof(MapFileSection)))
+        return 0;
+
+    // The section table holds the checksum of every section
+    uint64_t hash = Fnv1a(FNV_OFFSET, &header, sizeof(header));
+    if(!vSections.empty())
+        hash = Fnv1a(hash, &vSections[0], vSections.size()*sizeof(MapFileSection));
+    return hash;
+}
+
+template<class T>
+static void Append(vector<char> &buffer, const T* pElems, size_t n)
+{
+    const char* p = reinterpret_cast<const char*>(pElems);
+    buffer.insert(buffer.end(), p, p+n*sizeof(T));
+}
+
+template<class T>
+static const T* Take(const char* &pData, uint64_t &size, uint64_t n)
+{
+    if(n>size/sizeof(T))
+        return static_cast<const T*>(NULL);
+    const T* pElems = reinterpret_cast<const T*>(pData);
+    pData += n*sizeof(T);
+    size -= n*sizeof(T);
+    return pElems;
+}
+
+void MapFile::AppendKeyFrame(KeyFrame* pKF, vector<char> &buffer)
+{
+    KeyFramePayloadPin pin(pKF);
+    MapFileKeyFrame r;
+    WriteKeyFrameRecord(pKF, r);
+    r.gridCols = pKF->mGrid.Cols();
+    r.gridRows = pKF->mGrid.Rows();
+    r.gridIndexBegin = pKF->mGrid.Offsets().back();
+    Append(buffer, &r, 1);
+
+    for(int l=0; l<r.scaleLevels; l++)
+    {
+        MapFileScaleLevel level;
+        level.scaleFactor = pKF->mvScaleFactors[l];
+        level.levelSigma2 = l<(int)pKF->mvLevelSigma2.size() ? pKF->mvLevelSigma2[l] : 0;
+        level.invLevelSigma2 = l<(int)pKF->mvInvLevelSigma2.size() ? pKF->mvInvLevelSigma2[l] : 0;
+        Append(buffer, &level, 1);
+    }
+
+    const vector<cv::KeyPoint> &vKeysUn = pKF->mvKeysUn.size()==pKF->mvKeys.size() ? pKF->mvKeysUn : pKF->mvKeys;
+    vector<MapFileKeyPoint> vKeys(r.N);
+    for(int k=0; k<r.N; k++)
+        vKeys[k] = FromKeyPoint(pKF->mvKeys[k]);
+    Append(buffer, vKeys.data(), vKeys.size());
+    for(int k=0; k<r.N; k++)
+        vKeys[k] = FromKeyPoint(vKeysUn[k]);
+    Append(buffer, vKeys.data(), vKeys.size());
+
+    vector<MapFileStereo> vStereo(r.N);
+    for(int k=0; k<r.N; k++)
+    {
+        vStereo[k].uRight = k<(int)pKF->mvuRight.size() ? pKF->mvuRight[k] : -1;
+        vStereo[k].depth = k<(int)pKF->mvDepth.size() ? pKF->mvDepth[k] : -1;
+    }
+    Append(buffer, vStereo.data(), vStereo.size());
+
+    const ORBDescriptor emptyDescriptor = ORBDescriptor();
+    for(int k=0; k<r.N; k++)
+        Append(buffer, k<(int)pKF->mDescriptors.size() ? &pKF->mDescriptors[k] : &emptyDescriptor, 1);
+
+    Append(buffer, pKF->mGrid.Offsets().data(), pKF->mGrid.Offsets().size());
+    Append(buffer, pKF->mGrid.Indices().data(), r.gridIndexBegin);
+}
+
+KeyFrame* MapFile::ReadKeyFrame(const char* pData, uint64_t size)
+{
+    const MapFileKeyFrame* pRecord = Take<MapFileKeyFrame>(pData, size, 1);
+    if(!pRecord || pRecord->N<0 || pRecord->scaleLevels<0 || pRecord->gridCols<0 || pRecord->gridRows<0)
+        return static_cast<KeyFrame*>(NULL);
+    const MapFileKeyFrame &r = *pRecord;
+    const uint64_t nCells = (uint64_t)r.gridCols*r.gridRows;
+
+    const MapFileScaleLevel* pLevels = Take<MapFileScaleLevel>(pData, size, r.scaleLevels);
+    const MapFileKeyPoint* pKeys = Take<MapFileKeyPoint>(pData, size, r.N);
+    const MapFileKeyPoint* pKeysUn = Take<MapFileKeyPoint>(pData, size, r.N);
+    const MapFileStereo* pStereo = Take<MapFileStereo>(pData, size, r.N);
+    const ORBDescriptor* pDescriptors = Take<ORBDescriptor>(pData, size, r.N);
+    const uint32_t* pGridOffsets = Take<uint32_t>(pData, size, nCells+1);
+    const uint32_t* pGridIndices = Take<uint32_t>(pData, size, r.gridIndexBegin);
+    bool bValid = pLevels && pKeys && pKeysUn && pStereo && pDescriptors && pGridOffsets && pGridIndices && size==0 &&
+                  pGridOffsets[0]==0 && pGridOffsets[nCells]==r.gridIndexBegin;
+    for(uint64_t c=0; bValid && c<nCells; c++)
+        bValid = pGridOffsets[c]<=pGridOffsets[c+1];
+    for(uint64_t k=0; bValid && k<r.gridIndexBegin; k++)
+        bValid = pGridIndices[k]<(uint32_t)r.N;
+    if(!bValid)
+        return static_cast<KeyFrame*>(NULL);
+
+    KeyFrame* pKF = new KeyFrame();
+    ReadKeyFrameRecord(r, pLevels, pKeys, pKeysUn, pStereo, pDescriptors, pGridOffsets, pGridIndices, pKF);
+    return pKF;
+}
+
+bool MapFile::ReadContents(const MapFileView &view, const ORBVocabulary* pVoc, MapFileContents &c)
+{
+    memset(&c, 0, sizeof(c));
+    bool bValid = view.Get(MAP_FILE_INFO, c.pInfo, c.nInfo) && c.nInfo==1 &&
+                  view.Get(MAP_FILE_KEYFRAMES, c.pKFRecords, c.nKFs) &&
+                  view.Get(MAP_FILE_KEYFRAME_ORIGINS, c.pOrigins, c.nOrigins) &&
+                  view.Get(MAP_FILE_SCALE_LEVELS, c.pLevels, c.nLevels) &&
+                  view.Get(MAP_FILE_KEYPOINTS, c.pKeys, c.nKeys) &&
+                  view.Get(MAP_FILE_KEYPOINTS_UN, c.pKeysUn, c.nKeysUn) && c.nKeysUn==c.nKeys &&
+                  view.Get(MAP_FILE_STEREO, c.pStereo, c.nStereo) && c.nStereo==c.nKeys &&
+                  view.Get(MAP_FILE_DESCRIPTORS, c.pDescriptors, c.nDescriptors) && c.nDescriptors==c.nKeys &&
+                  view.Get(MAP_FILE_MATCHES, c.pMatches, c.nMatches) && c.nMatches==c.nKeys &&
+                  view.Get(MAP_FILE_GRID_OFFSETS, c.pGridOffsets, c.nGridOffsets) &&
+                  view.Get(MAP_FILE_GRID_INDICES, c.pGridIndices, c.nGridIndices) &&
+                  view.Get(MAP_FILE_CONNECTIONS, c.pConnections, c.nConnections) &&
+                  view.Get(MAP_FILE_ORDERED, c.pOrdered, c.nOrdered) &&
+                  view.Get(MAP_FILE_TREE, c.pTree, c.nTree) &&
+                  view.Get(MAP_FILE_IMAGES, c.pImages, c.nImageBytes) &&
+                  view.Get(MAP_FILE_MAPPOINTS, c.pMPRecords, c.nMPs) &&
+                  view.Get(MAP_FILE_OBSERVATIONS, c.pObservations, c.nObservations) &&
+                  c.nKFs<MAP_FILE_NONE && c.nMPs<MAP_FILE_NONE;
+
+    // Every range and index is checked before any object is built
+    const uint64_t nKFs = c.nKFs;
+    for(uint64_t i=0; bValid && i<nKFs; i++)
+    {
+        const MapFileKeyFrame &r = c.pKFRecords[i];
+        const uint64_t nCells = (uint64_t)r.gridCols*r.gridRows;
+        bValid = r.N>=0 && r.keyBegin+r.N<=c.nKeys && r.scaleLevels>=0 && r.levelBegin+r.scaleLevels<=c.nLevels &&
+                 r.gridCols>=0 && r.gridRows>=0 && r.gridOffsetBegin+nCells+1<=c.nGridOffsets &&
+                 r.connectionBegin+r.nConnections<=c.nConnections && r.orderedBegin+r.nOrdered<=c.nOrdered &&
+                 r.treeBegin+r.nChildren+r.nLoopEdges<=c.nTree && (r.parent<nKFs || r.parent==MAP_FILE_NONE) &&
+                 r.imageRows>=0 && r.imageCols>=0;
+        if(!bValid)
+            break;
+
+        const uint32_t* pOffsets = c.pGridOffsets + r.gridOffsetBegin;
+        bValid = pOffsets[0]==0 && r.gridIndexBegin+pOffsets[nCells]<=c.nGridIndices;
+        for(uint64_t k=0; bValid && k<nCells; k++)
+            bValid = pOffsets[k]<=pOffsets[k+1];
+        for(uint64_t k=0; bValid && k<pOffsets[nCells]; k++)
+            bValid = c.pGridIndices[r.gridIndexBegin+k]<(uint32_t)r.N;
+        for(int32_t k=0; bValid && k<r.N; k++)
+            bValid = c.pMatches[r.keyBegin+k]<c.nMPs || c.pMatches[r.keyBegin+k]==MAP_FILE_NONE;
+        for(uint32_t k=0; bValid && k<r.nConnections; k++)
+            bValid = c.pConnections[r.connectionBegin+k].keyFrame<nKFs;
+        for(uint32_t k=0; bValid && k<r.nOrdered; k++)
+            bValid = c.pOrdered[r.orderedBegin+k].keyFrame<nKFs;
+        for(uint32_t k=0; bValid && k<r.nChildren+r.nLoopEdges; k++)
+            bValid = c.pTree[r.treeBegin+k]<nKFs;
+
+        if(bValid && (uint64_t)r.imageRows*r.imageCols>0)
+        {
+            const uint64_t elemSize = CV_ELEM_SIZE(r.imageType);
+            bValid = elemSize>0 && r.imageOffset+(uint64_t)r.imageRows*r.imageCols*elemSize<=c.nImageBytes;
+        }
+    }
+    for(uint64_t i=0; bValid && i<c.nOrigins; i++)
+        bValid = c.pOrigins[i]<nKFs;
+    for(uint64_t i=0; bValid && i<c.nMPs; i++)
+    {
+        const MapFileMapPoint &r = c.pMPRecords[i];
+        bValid = r.observationBegin+r.nObservations<=c.nObservations &&
+                 (r.refKeyFrame<nKFs || r.refKeyFrame==MAP_FILE_NONE);
+        for(uint32_t k=0; bValid && k<r.nObservations; k++)
+        {
+            const MapFileObservation &o = c.pObservations[r.observationBegin+k];
+            bValid = o.keyFrame<nKFs && o.index<(uint32_t)c.pKFRecords[o.keyFrame].N;
+        }
+    }
+    if(!bValid)
+        return false;
+
+    // BoW sections: used only if they were computed with the given vocabulary. Without them the
+    // map is still complete, the caller computes the BoW.
+    c.bBow = pVoc &&
+             view.Get(MAP_FILE_BOW_INFO, c.pBowInfo, c.nBowInfo) && c.nBowInfo==1 &&
+             view.Get(MAP_FILE_BOW_RANGES, c.pBowRanges, c.nBowRanges) && c.nBowRanges==nKFs &&
+             view.Get(MAP_FILE_BOW_WORDS, c.pBowWords, c.nBowWords) &&
+             view.Get(MAP_FILE_FEATURE_NODES, c.pFeatureNodes, c.nFeatureNodes) &&
+             view.Get(MAP_FILE_FEATURE_INDICES, c.pFeatureIndices, c.nFeatureIndices) &&
+             view.Get(MAP_FILE_INVERTED_WORDS, c.pInvertedWords, c.nInvertedWords) &&
+             view.Get(MAP_FILE_INVERTED_KEYFRAMES, c.pInvertedKFs, c.nInvertedKFs);
+    if(c.bBow && (c.pBowInfo->vocabularySize!=pVoc->size() || c.pBowInfo->levelsUp!=MAP_FILE_BOW_LEVELS_UP ||
+                  c.pBowInfo->vocabularyHash!=VocabularyHash(*pVoc)))
+    {
+        cout << "The BoW of the map file is of another vocabulary, it is computed again" << endl;
+        c.bBow = false;
+    }
+    bool bBowValid = true;
+    const uint32_t vocabularySize = c.bBow ? c.pBowInfo->vocabularySize : 0;
+    for(uint64_t i=0; c.bBow && bBowValid && i<nKFs; i++)
+    {
+        const MapFileBowRange &r = c.pBowRanges[i];
+        bBowValid = r.wordBegin+r.nWords<=c.nBowWords && r.nodeBegin+r.nNodes<=c.nFeatureNodes;
+        for(uint32_t k=0; bBowValid && k<r.nWords; k++)
+            bBowValid = c.pBowWords[r.wordBegin+k].word<vocabularySize;
+        uint64_t nIndices = 0;
+        for(uint32_t k=0; bBowValid && k<r.nNodes; k++)
+            nIndices += c.pFeatureNodes[r.nodeBegin+k].nIndices;
+        bBowValid = bBowValid && r.indexBegin+nIndices<=c.nFeatureIndices;
+        for(uint64_t k=0; bBowValid && k<nIndices; k++)
+            bBowValid = c.pFeatureIndices[r.indexBegin+k]<(uint32_t)c.pKFRecords[i].N;
+    }
+    uint64_t nInvertedTotal = 0;
+    for(uint64_t i=0; c.bBow && bBowValid && i<c.nInvertedWords; i++)
+    {
+        bBowValid = c.pInvertedWords[i].word<vocabularySize;
+        nInvertedTotal += c.pInvertedWords[i].nKeyFrames;
+    }
+    bBowValid = bBowValid && nInvertedTotal<=c.nInvertedKFs;
+    for(uint64_t i=0; c.bBow && bBowValid && i<nInvertedTotal; i++)
+        bBowValid = c.pInvertedKFs[i]<nKFs;
+    if(c.bBow && !bBowValid)
+    {
+        cerr << "The BoW of the map file is inconsistent, it is computed again" << endl;
+        c.bBow = false;
+    }
+    return true;
+}
+
+KeyFrame* MapFile::ReadKeyFrame(const MapFileContents &c, uint64_t i)
+{
+    const MapFileKeyFrame &r = c.pKFRecords[i];
+    KeyFrame* pKF = new KeyFrame();
+    ReadKeyFrameRecord(r, c.pLevels+r.levelBegin, c.pKeys+r.keyBegin, c.pKeysUn+r.keyBegin, c.pStereo+r.keyBegin,
+                       c.pDescriptors+r.keyBegin, c.pGridOffsets+r.gridOffsetBegin, c.pGridIndices+r.gridIndexBegin, pKF);
+    if((uint64_t)r.imageRows*r.imageCols>0)
+        pKF->image = cv::Mat(r.imageRows, r.imageCols, r.imageType, const_cast<unsigned char*>(c.pImages+r.imageOffset)).clone();
+
+    if(c.bBow)
+    {
+        const MapFileBowRange &range = c.pBowRanges[i];
+        // Entries were written in map order, so every insert goes at the end
+        for(uint32_t k=0; k<range.nWords; k++)
+            pKF->mBowVec.insert(pKF->mBowVec.end(), make_pair(c.pBowWords[range.wordBegin+k].word, c.pBowWords[range.wordBegin+k].value));
+        const uint32_t* pIndices = c.pFeatureIndices+range.indexBegin;
+        for(uint32_t k=0; k<range.nNodes; k++)
+        {
+            const MapFileFeatureNode &node = c.pFeatureNodes[range.nodeBegin+k];
+            pKF->mFeatVec.insert(pKF->mFeatVec.end(), make_pair(node.node, vector<unsigned int>(pIndices, pIndices+node.nIndices)));
+            pIndices += node.nIndices;
+        }
+    }
+    return pKF;
+}
+
+Map* MapFile::Load(const string &filename, KeyFrameDatabase* pKFDB, bool* pbBowLoaded, bool bVerifyChecksums)
+{
+    if(pbBowLoaded)
+        *pbBowLoaded = false;
+
+    MapFileView view;
+    if(!view.Open(filename))
+    {
+        cerr << "Not a valid map file (or unsupported version): " << filename << endl;
+        return static_cast<Map*>(NULL);
+    }
+    if(bVerifyChecksums && !view.VerifyChecksums())
+        return static_cast<Map*>(NULL);
+
+    MapFileContents c;
+    if(!ReadContents(view, pKFDB ? pKFDB->mpVoc : static_cast<const ORBVocabulary*>(NULL), c))
+    {
+        cerr << "Map file is inconsistent: " << filename << endl;
+        return static_cast<Map*>(NULL);
+    }
+    const uint64_t nKFs = c.nKFs;
+    const uint64_t nMPs = c.nMPs;
+
+    Map* pMap = new Map();
+    vector<KeyFrame*> vpKFs(nKFs);
+    for(uint64_t i=0; i<nKFs; i++)
+        vpKFs[i] = ReadKeyFrame(c, i);
+    vector<MapPoint*> vpMPs(nMPs);
+    for(uint64_t i=0; i<nMPs; i++)
+        vpMPs[i] = new MapPoint();
+    auto GetKF = [&](uint32_t index){ return index==MAP_FILE_NONE ? static_cast<KeyFrame*>(NULL) : vpKFs[index]; };
+    auto GetMP = [&](uint32_t index){ return index==MAP_FILE_NONE ? static_cast<MapPoint*>(NULL) : vpMPs[index]; };
+
+    for(uint64_t i=0; i<nKFs; i++)
+    {
+        const MapFileKeyFrame &r = c.pKFRecords[i];
+        KeyFrame* pKF = vpKFs[i];
+
+        for(int k=0; k<r.N; k++)
+            pKF->mvpMapPoints[k] = GetMP(c.pMatches[r.keyBegin+k]);
+
+        // Covisibility graph, spanning tree and loop edges
+        for(uint32_t k=0; k<r.nConnections; k++)
+            pKF->mConnectedKeyFrameWeights[vpKFs[c.pConnections[r.connectionBegin+k].keyFrame]] = c.pConnections[r.connectionBegin+k].weight;
+        pKF->mvpOrderedConnectedKeyFrames.resize(r.nOrdered);
+        pKF->mvOrderedWeights.resize(r.nOrdered);
+        for(uint32_t k=0; k<r.nOrdered; k++)
+        {
+            pKF->mvpOrderedConnectedKeyFrames[k] = vpKFs[c.pOrdered[r.orderedBegin+k].keyFrame];
+            pKF->mvOrderedWeights[k] = c.pOrdered[r.orderedBegin+k].weight;
+        }
+        pKF->mpParent = GetKF(r.parent);
+        for(uint32_t k=0; k<r.nChildren; k++)
+            pKF->mspChildrens.insert(vpKFs[c.pTree[r.treeBegin+k]]);
+        for(uint32_t k=0; k<r.nLoopEdges; k++)
+            pKF->mspLoopEdges.insert(vpKFs[c.pTree[r.treeBegin+r.nChildren+k]]);
+
+        pKF->mpMap = pMap;
+
+        pMap->AddKeyFrame(pKF);
+    }
+
+    for(uint64_t i=0; i<nMPs; i++)
+    {
+        const MapFileMapPoint &r = c.pMPRecords[i];
+        MapPoint* pMP = vpMPs[i];
+
+        ReadMapPointRecord(r, pMP);
+        pMP->mpRefKF = GetKF(r.refKeyFrame);
+        pMP->mpMap = pMap;
+
+        for(uint32_t k=0; k<r.nObservations; k++)
+        {
+            const MapFileObservation &o = c.pObservations[r.observationBegin+k];
+            pMP->mObservations[vpKFs[o.keyFrame]] = o.index;
+        }
+
+        pMap->AddMapPoint(pMP);
+    }
+
+    for(uint64_t i=0; i<c.nOrigins; i++)
+        pMap->mvpKeyFrameOrigins.push_back(vpKFs[c.pOrigins[i]]);
+
+    if(c.bBow)
+    {
+        unique_lock<mutex> lock(pKFDB->mMutex);
+        pKFDB->mvInvertedFile.assign(c.pBowInfo->vocabularySize, list<KeyFrame*>());
+        const uint32_t* pKFIndices = c.pInvertedKFs;
+        for(uint64_t i=0; i<c.nInvertedWords; i++)
+        {
+            list<KeyFrame*> &lKFs = pKFDB->mvInvertedFile[c.pInvertedWords[i].word];
+            for(uint32_t k=0; k<c.pInvertedWords[i].nKeyFrames; k++)
+                lKFs.push_back(vpKFs[*pKFIndices++]);
+        }
+        if(pbBowLoaded)
+            *pbBowLoaded = true;
+    }
+
+    KeyFrame::nNextId = c.pInfo->nextKeyFrameId;
+    MapPoint::nNextId = c.pInfo->nextMapPointId;
+
+    cout << "Map loaded from " << filename << ": " << nKFs << " keyframes, " << nMPs << " map points" << endl;
+    return pMap;
+}
+
+} //namespace ORB_SLAM
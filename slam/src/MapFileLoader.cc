@@ -0,0 +1,278 @@
+#include "MapFileLoader.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "KeyFrameDatabase.h"
+
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+// Camera center of a keyframe record, -R^T t of its Tcw (row major)
+static void CameraCenter(const MapFileKeyFrame &r, float* Ow)
+{
+    for(int j=0; j<3; j++)
+        Ow[j] = -(r.Tcw[j]*r.Tcw[3] + r.Tcw[4+j]*r.Tcw[7] + r.Tcw[8+j]*r.Tcw[11]);
+}
+
+MapFileLoader::MapFileLoader(Map* pMap, KeyFrameDatabase* pKFDB, ORBVocabulary* pVoc):
+    mpMap(pMap), mpKeyFrameDB(pKFDB), mpVocabulary(pVoc), mnLoaded(0), mbAborted(false),
+    mptLoader(static_cast<thread*>(NULL))
+{
+}
+
+MapFileLoader::~MapFileLoader()
+{
+    Join();
+}
+
+bool MapFileLoader::Open(const string &filename, const cv::Mat &Twc, bool bVerifyChecksums)
+{
+    mFilename = filename;
+    if(!mView.Open(filename))
+    {
+        cerr << "Not a valid map file (or unsupported version): " << filename << endl;
+        return false;
+    }
+    if(bVerifyChecksums && !mView.VerifyChecksums())
+        return false;
+    if(!MapFile::ReadContents(mView, mpVocabulary, mContents))
+    {
+        cerr << "Map file is inconsistent: " << filename << endl;
+        return false;
+    }
+
+    const uint64_t nKFs = mContents.nKFs;
+    mvpKFs.assign(nKFs, static_cast<KeyFrame*>(NULL));
+    mvpMPs.assign(mContents.nMPs, static_cast<MapPoint*>(NULL));
+    mvbOrigin.assign(nKFs, false);
+    for(uint64_t i=0; i<mContents.nOrigins; i++)
+        mvbOrigin[mContents.pOrigins[i]] = true;
+
+    // Nearest camera center to the prior first, otherwise the most recent keyframes
+    vector<pair<float,uint32_t> > vKeys(nKFs);
+    cv::Mat prior;
+    if(!Twc.empty())
+        Twc.convertTo(prior, CV_32F);
+    for(uint64_t i=0; i<nKFs; i++)
+    {
+        const MapFileKeyFrame &r = mContents.pKFRecords[i];
+        float key = -(float)r.id;
+        if(!prior.empty())
+        {
+            float Ow[3];
+            CameraCenter(r, Ow);
+            key = 0;
+            for(int j=0; j<3; j++)
+                key += (Ow[j]-prior.at<float>(j,3))*(Ow[j]-prior.at<float>(j,3));
+        }
+        vKeys[i] = make_pair(key, (uint32_t)i);
+    }
+    sort(vKeys.begin(), vKeys.end());
+    mvOrder.resize(nKFs);
+    for(uint64_t i=0; i<nKFs; i++)
+        mvOrder[i] = vKeys[i].second;
+
+    // Keyframes and map points created while the rest is loading must not reuse the file ids
+    KeyFrame::nNextId = mContents.pInfo->nextKeyFrameId;
+    MapPoint::nNextId = mContents.pInfo->nextMapPointId;
+
+    cout << "Loading map " << filename << " progressively: " << nKFs << " keyframes, " << mContents.nMPs
+         << " map points" << endl;
+    return true;
+}
+
+size_t MapFileLoader::LoadNext(size_t n)
+{
+    unique_lock<mutex> lockLoad(mMutexLoad);
+    size_t nBegin;
+    {
+        unique_lock<mutex> lock(mMutexProgress);
+        if(mbAborted)
+            return 0;
+        nBegin = mnLoaded;
+    }
+    const size_t nEnd = min(nBegin+n, mvOrder.size());
+    if(nBegin>=nEnd)
+        return 0;
+    const MapFileContents &c = mContents;
+
+    // Keyframes, their BoW and the map points seen first in this batch are built before taking
+    // the map, nothing else can reach them yet
+    vector<KeyFrame*> vpNewKFs;
+    vector<MapPoint*> vpNewMPs;
+    vpNewKFs.reserve(nEnd-nBegin);
+    for(size_t o=nBegin; o<nEnd; o++)
+    {
+        const uint32_t i = mvOrder[o];
+        const MapFileKeyFrame &r = c.pKFRecords[i];
+        KeyFrame* pKF = MapFile::ReadKeyFrame(c, i);
+        pKF->SetKeyFrameDatabase(mpKeyFrameDB);
+        pKF->SetORBvocabulary(mpVocabulary);
+        if(!c.bBow && mpVocabulary)
+            pKF->ComputeBoW();
+        vpNewKFs.push_back(pKF);
+
+        for(int k=0; k<r.N; k++)
+        {
+            const uint32_t m = c.pMatches[r.keyBegin+k];
+            if(m==MAP_FILE_NONE || mvpMPs[m])
+                continue;
+            MapPoint* pMP = new MapPoint();
+            MapFile::ReadMapPointRecord(c.pMPRecords[m], pMP);
+            // Observations are added as their keyframes come in
+            pMP->nObs = 0;
+            pMP->mpRefKF = static_cast<KeyFrame*>(NULL);
+            pMP->SetMap(mpMap);
+            mvpMPs[m] = pMP;
+            vpNewMPs.push_back(pMP);
+        }
+    }
+
+    {
+        unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+
+        for(size_t b=0; b<vpNewKFs.size(); b++)
+            mvpKFs[mvOrder[nBegin+b]] = vpNewKFs[b];
+
+        // Keyframes of earlier batches may have been culled and map points fused since, the links
+        // towards them are left out. A culled parent is replaced by its nearest good ancestor.
+        auto GoodKF = [&](uint32_t i) -> KeyFrame*
+        {
+            KeyFrame* pKF = mvpKFs[i];
+            return pKF && !pKF->isBad() ? pKF : static_cast<KeyFrame*>(NULL);
+        };
+
+        for(size_t b=0; b<vpNewKFs.size(); b++)
+        {
+            const uint32_t i = mvOrder[nBegin+b];
+            const MapFileKeyFrame &r = c.pKFRecords[i];
+            KeyFrame* pKF = vpNewKFs[b];
+            pKF->SetMap(mpMap);
+
+            for(int k=0; k<r.N; k++)
+            {
+                const uint32_t m = c.pMatches[r.keyBegin+k];
+                if(m==MAP_FILE_NONE)
+                    continue;
+                MapPoint* pMP = mvpMPs[m];
+                if(pMP->isBad())
+                    continue;
+                pKF->AddMapPoint(pMP, k);
+                pMP->AddObservation(pKF, k);
+
+                // The reference keyframe of the file once it is loaded, a loaded observer meanwhile
+                KeyFrame* pRefKF = c.pMPRecords[m].refKeyFrame==MAP_FILE_NONE ? static_cast<KeyFrame*>(NULL) :
+                                   GoodKF(c.pMPRecords[m].refKeyFrame);
+                unique_lock<mutex> lockFeatures(pMP->mMutexFeatures);
+                if(pRefKF)
+                    pMP->mpRefKF = pRefKF;
+                else if(!pMP->mpRefKF)
+                    pMP->mpRefKF = pKF;
+            }
+
+            // Covisibility, spanning tree and loop edges towards the loaded keyframes
+            for(uint32_t k=0; k<r.nConnections; k++)
+            {
+                KeyFrame* pConnected = GoodKF(c.pConnections[r.connectionBegin+k].keyFrame);
+                if(!pConnected)
+                    continue;
+                const int weight = c.pConnections[r.connectionBegin+k].weight;
+                pKF->AddConnection(pConnected, weight);
+                pConnected->AddConnection(pKF, weight);
+            }
+            KeyFrame* pParent = r.parent==MAP_FILE_NONE ? static_cast<KeyFrame*>(NULL) : mvpKFs[r.parent];
+            while(pParent && pParent->isBad())
+                pParent = pParent->GetParent();
+            if(pParent)
+                pKF->ChangeParent(pParent);
+            for(uint32_t k=0; k<r.nChildren; k++)
+            {
+                KeyFrame* pChild = GoodKF(c.pTree[r.treeBegin+k]);
+                if(pChild)
+                    pChild->ChangeParent(pKF);
+            }
+            for(uint32_t k=0; k<r.nLoopEdges; k++)
+            {
+                KeyFrame* pLoop = GoodKF(c.pTree[r.treeBegin+r.nChildren+k]);
+                if(!pLoop)
+                    continue;
+                pKF->AddLoopEdge(pLoop);
+                pLoop->AddLoopEdge(pKF);
+            }
+
+            if(mvbOrigin[i])
+                mpMap->mvpKeyFrameOrigins.push_back(pKF);
+        }
+
+        for(size_t b=0; b<vpNewMPs.size(); b++)
+            mpMap->AddMapPoint(vpNewMPs[b]);
+        for(size_t b=0; b<vpNewKFs.size(); b++)
+        {
+            mpMap->AddKeyFrame(vpNewKFs[b]);
+            if(mpKeyFrameDB)
+                mpKeyFrameDB->add(vpNewKFs[b]);
+        }
+    }
+
+    unique_lock<mutex> lock(mMutexProgress);
+    mnLoaded = nEnd;
+    if(mnLoaded==mvOrder.size())
+        cout << "Map " << mFilename << " loaded: " << mvOrder.size() << " keyframes, " << mvpMPs.size() << " map points" << endl;
+    return nEnd-nBegin;
+}
+
+void MapFileLoader::LoadRemaining(size_t nBatch)
+{
+    if(!mptLoader)
+        mptLoader = new thread(&MapFileLoader::Run, this, max(nBatch, (size_t)1));
+}
+
+void MapFileLoader::Run(size_t nBatch)
+{
+    while(LoadNext(nBatch)>0)
+    {
+    }
+}
+
+void MapFileLoader::Abort()
+{
+    {
+        unique_lock<mutex> lock(mMutexProgress);
+        mbAborted = true;
+    }
+    // The background thread stops after its current batch
+    Join();
+
+    unique_lock<mutex> lockLoad(mMutexLoad);
+    mvpKFs.assign(mvpKFs.size(), static_cast<KeyFrame*>(NULL));
+    mvpMPs.assign(mvpMPs.size(), static_cast<MapPoint*>(NULL));
+}
+
+bool MapFileLoader::isFinished()
+{
+    unique_lock<mutex> lock(mMutexProgress);
+    return mbAborted || mnLoaded==mvOrder.size();
+}
+
+float MapFileLoader::GetProgress()
+{
+    unique_lock<mutex> lock(mMutexProgress);
+    return mvOrder.empty() ? 1.0f : (float)mnLoaded/mvOrder.size();
+}
+
+void MapFileLoader::Join()
+{
+    if(mptLoader)
+    {
+        mptLoader->join();
+        delete mptLoader;
+        mptLoader = static_cast<thread*>(NULL);
+    }
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,33 @@
+#include "MapIdIndex.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+MapIdIndex::MapIdIndex(const vector<KeyFrame*> &vpKeyFrames, const vector<MapPoint*> &vpMapPoints)
+{
+    mmKeyFrames.reserve(vpKeyFrames.size());
+    for(size_t i=0; i<vpKeyFrames.size(); i++)
+        mmKeyFrames.insert(make_pair(vpKeyFrames[i]->mnId, vpKeyFrames[i]));
+
+    mmMapPoints.reserve(vpMapPoints.size());
+    for(size_t i=0; i<vpMapPoints.size(); i++)
+        mmMapPoints.insert(make_pair(vpMapPoints[i]->mnId, vpMapPoints[i]));
+}
+
+KeyFrame* MapIdIndex::GetKeyFrame(long unsigned int id) const
+{
+    unordered_map<long unsigned int, KeyFrame*>::const_iterator it = mmKeyFrames.find(id);
+    return it==mmKeyFrames.end() ? static_cast<KeyFrame*>(NULL) : it->second;
+}
+
+MapPoint* MapIdIndex::GetMapPoint(long unsigned int id) const
+{
+    unordered_map<long unsigned int, MapPoint*>::const_iterator it = mmMapPoints.find(id);
+    return it==mmMapPoints.end() ? static_cast<MapPoint*>(NULL) : it->second;
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,686 @@
+#include "MapJournal.h"
+#include "MapFile.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+
+#include <iostream>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+static const char MAP_JOURNAL_MAGIC[8] = {'O','R','B','J','R','N','A','L'};
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static uint64_t Fnv1a(const void* pData, size_t size)
+{
+    uint64_t hash = FNV_OFFSET;
+    const unsigned char* p = static_cast<const unsigned char*>(pData);
+    for(size_t i=0; i<size; i++)
+    {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool WriteAt(int fd, const void* pData, size_t size, uint64_t offset)
+{
+    const char* p = static_cast<const char*>(pData);
+    while(size>0)
+    {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if(n<=0)
+            return false;
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static uint64_t Padded(uint64_t size)
+{
+    return (size+7)/8*8;
+}
+
+static void AppendRecord(vector<char> &buffer, uint32_t type, const vector<char> &payload)
+{
+    MapJournalRecord record;
+    record.type = type;
+    record.reserved = 0;
+    record.size = payload.size();
+    record.checksum = Fnv1a(payload.data(), payload.size());
+    const char* p = reinterpret_cast<const char*>(&record);
+    buffer.insert(buffer.end(), p, p+sizeof(record));
+    buffer.insert(buffer.end(), payload.begin(), payload.end());
+    buffer.resize(buffer.size()+Padded(payload.size())-payload.size(), 0);
+}
+
+template<class T>
+static void Append(vector<char> &buffer, const T &value)
+{
+    const char* p = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), p, p+sizeof(T));
+}
+
+MapJournal::MapJournal(Map* pMap, const string &filename, int nIntervalMs, uint64_t nCompactBytes,
+                       const function<bool(const string&)> &saveSnapshot):
+    mpMap(pMap), mSnapshotFilename(filename), mJournalFilename(JournalFilename(filename)),
+    mnIntervalMs(max(nIntervalMs,1)), mnCompactBytes(nCompactBytes), mSaveSnapshot(saveSnapshot),
+    mbCleared(false), mbFinish(false), mnCheckpointRequested(0), mnCheckpointDone(0), mbCheckpointOk(true),
+    mFd(-1), mnJournalSize(0)
+{
+    mptJournal = new thread(&MapJournal::Run, this);
+}
+
+MapJournal::~MapJournal()
+{
+    Finish();
+}
+
+string MapJournal::JournalFilename(const string &filename)
+{
+    return filename + ".journal";
+}
+
+void MapJournal::MarkKeyFrame(KeyFrame* pKF)
+{
+    unique_lock<mutex> lock(mMutexJournal);
+    msChangedKFs.insert(pKF);
+}
+
+void MapJournal::MarkMapPoint(MapPoint* pMP)
+{
+    unique_lock<mutex> lock(mMutexJournal);
+    msChangedMPs.insert(pMP);
+}
+
+void MapJournal::EraseKeyFrame(KeyFrame* pKF)
+{
+    unique_lock<mutex> lock(mMutexJournal);
+    msChangedKFs.erase(pKF);
+    mvErasedKFs.push_back(pKF->mnId);
+}
+
+void MapJournal::EraseMapPoint(MapPoint* pMP)
+{
+    unique_lock<mutex> lock(mMutexJournal);
+    msChangedMPs.erase(pMP);
+    mvErasedMPs.push_back(pMP->mnId);
+}
+
+unique_lock<mutex> MapJournal::Clear()
+{
+    unique_lock<mutex> lockWrite(mMutexWrite);
+    mspWrittenKFs.clear();
+
+    unique_lock<mutex> lock(mMutexJournal);
+    msChangedKFs.clear();
+    msChangedMPs.clear();
+    mvErasedKFs.clear();
+    mvErasedMPs.clear();
+    mbCleared = true;
+    return lockWrite;
+}
+
+bool MapJournal::Checkpoint()
+{
+    unique_lock<mutex> lock(mMutexJournal);
+    if(mbFinish)
+        return false;
+    const uint64_t nCheckpoint = ++mnCheckpointRequested;
+    mCondJournal.notify_all();
+    while(mnCheckpointDone<nCheckpoint && !mbFinish)
+        mCondJournal.wait(lock);
+    return mnCheckpointDone>=nCheckpoint && mbCheckpointOk;
+}
+
+void MapJournal::Finish()
+{
+    {
+        unique_lock<mutex> lock(mMutexJournal);
+        mbFinish = true;
+        mCondJournal.notify_all();
+    }
+    if(mptJournal)
+    {
+        mptJournal->join();
+        delete mptJournal;
+        mptJournal = static_cast<thread*>(NULL);
+    }
+    if(mFd>=0)
+    {
+        close(mFd);
+        mFd = -1;
+    }
+}
+
+void MapJournal::Run()
+{
+    bool bSnapshot = true;
+    while(true)
+    {
+        uint64_t nCheckpoint;
+        bool bFinish;
+        {
+            unique_lock<mutex> lock(mMutexJournal);
+            if(!bSnapshot)
+            {
+                mCondJournal.wait_for(lock, chrono::milliseconds(mnIntervalMs),
+                                      [this]{ return mnCheckpointRequested>mnCheckpointDone || mbFinish; });
+            }
+            nCheckpoint = mnCheckpointRequested;
+            bFinish = mbFinish;
+        }
+
+        bool bOk;
+        {
+            unique_lock<mutex> lock(mMutexWrite);
+            // The first snapshot is written when the journal starts, later ones once the journal
+            // grew too large. Until a snapshot exists the changes stay marked.
+            if(bSnapshot && !bFinish)
+                bSnapshot = !WriteSnapshot();
+            bOk = mFd>=0 && WriteBatch();
+            if(bOk && (nCheckpoint>mnCheckpointDone || bFinish))
+                bOk = fdatasync(mFd)==0;
+            if(bOk && !bFinish && mnJournalSize>mnCompactBytes)
+                bSnapshot = true;
+        }
+
+        {
+            unique_lock<mutex> lock(mMutexJournal);
+            if(nCheckpoint>mnCheckpointDone)
+            {
+                mnCheckpointDone = nCheckpoint;
+                mbCheckpointOk = bOk;
+            }
+            mCondJournal.notify_all();
+        }
+
+        if(bFinish)
+            break;
+    }
+}
+
+bool MapJournal::WriteSnapshot()
+{
+    // The snapshot covers every change marked so far. They are put back if it fails.
+    unordered_set<KeyFrame*> sChangedKFs;
+    unordered_set<MapPoint*> sChangedMPs;
+    vector<long unsigned int> vErasedKFs, vErasedMPs;
+    bool bCleared;
+    {
+        unique_lock<mutex> lock(mMutexJournal);
+        sChangedKFs.swap(msChangedKFs);
+        sChangedMPs.swap(msChangedMPs);
+        vErasedKFs.swap(mvErasedKFs);
+        vErasedMPs.swap(mvErasedMPs);
+        bCleared = mbCleared;
+        mbCleared = false;
+    }
+    // Taken before the snapshot captures the map, which keeps running meanwhile. A keyframe added
+    // in between is in the snapshot and written again to the journal, replay skips it.
+    vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
+
+    // Both files are written aside and renamed, snapshot first. A crash in between leaves the new
+    // snapshot with the previous journal, which is then ignored (its fingerprint does not match).
+    const string snapshotTmp = mSnapshotFilename + ".tmp";
+    const string journalTmp = mJournalFilename + ".tmp";
+    bool bOk = mSaveSnapshot(snapshotTmp);
+    int fd = -1;
+    MapJournalHeader header;
+    if(bOk)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MAP_JOURNAL_MAGIC, sizeof(header.magic));
+        header.version = MAP_JOURNAL_VERSION;
+        header.snapshot = MapFile::Fingerprint(snapshotTmp);
+
+        const int fdSnapshot = open(snapshotTmp.c_str(), O_RDONLY);
+        bOk = header.snapshot!=0 && fdSnapshot>=0 && fsync(fdSnapshot)==0;
+        if(fdSnapshot>=0)
+            close(fdSnapshot);
+    }
+    if(bOk)
+    {
+        fd = open(journalTmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        bOk = fd>=0 && WriteAt(fd, &header, sizeof(header), 0) && fdatasync(fd)==0 &&
+              rename(snapshotTmp.c_str(), mSnapshotFilename.c_str())==0 &&
+              rename(journalTmp.c_str(), mJournalFilename.c_str())==0;
+    }
+
+    if(!bOk)
+    {
+        cerr << "Failed to write the map snapshot " << mSnapshotFilename << endl;
+        if(fd>=0)
+            close(fd);
+        unique_lock<mutex> lock(mMutexJournal);
+        msChangedKFs.insert(sChangedKFs.begin(), sChangedKFs.end());
+        msChangedMPs.insert(sChangedMPs.begin(), sChangedMPs.end());
+        mvErasedKFs.insert(mvErasedKFs.begin(), vErasedKFs.begin(), vErasedKFs.end());
+        mvErasedMPs.insert(mvErasedMPs.begin(), vErasedMPs.begin(), vErasedMPs.end());
+        mbCleared = mbCleared || bCleared;
+        return false;
+    }
+
+    if(mFd>=0)
+        close(mFd);
+    mFd = fd;
+    mnJournalSize = sizeof(header);
+    mspWrittenKFs = set<KeyFrame*>(vpKFs.begin(), vpKFs.end());
+    cout << "Map snapshot written to " << mSnapshotFilename << ", journal in " << mJournalFilename << endl;
+    return true;
+}
+
+bool MapJournal::WriteBatch()
+{
+    unordered_set<KeyFrame*> sChangedKFs;
+    unordered_set<MapPoint*> sChangedMPs;
+    vector<long unsigned int> vErasedKFs, vErasedMPs;
+    bool bCleared;
+    {
+        unique_lock<mutex> lock(mMutexJournal);
+        sChangedKFs.swap(msChangedKFs);
+        sChangedMPs.swap(msChangedMPs);
+        vErasedKFs.swap(mvErasedKFs);
+        vErasedMPs.swap(mvErasedMPs);
+        bCleared = mbCleared;
+        mbCleared = false;
+    }
+    if(!bCleared && sChangedKFs.empty() && sChangedMPs.empty() && vErasedKFs.empty() && vErasedMPs.empty())
+        return true;
+
+    mvBuffer.clear();
+    vector<char> payload;
+    if(bCleared)
+        AppendRecord(mvBuffer, MAP_JOURNAL_CLEAR, payload);
+
+    for(size_t i=0; i<vErasedKFs.size(); i++)
+    {
+        payload.clear();
+        Append(payload, (uint64_t)vErasedKFs[i]);
+        AppendRecord(mvBuffer, MAP_JOURNAL_ERASE_KEYFRAME, payload);
+    }
+    for(size_t i=0; i<vErasedMPs.size(); i++)
+    {
+        payload.clear();
+        Append(payload, (uint64_t)vErasedMPs[i]);
+        AppendRecord(mvBuffer, MAP_JOURNAL_ERASE_MAPPOINT, payload);
+    }
+
+    // Marks of objects not (or no longer) in the map are dropped, those pointers are not read.
+    // Keyframes go in id order, so that replay adds them as they were created.
+    vector<KeyFrame*> vpKFs;
+    for(unordered_set<KeyFrame*>::const_iterator it=sChangedKFs.begin(); it!=sChangedKFs.end(); it++)
+    {
+        if(mpMap->HasKeyFrame(*it))
+            vpKFs.push_back(*it);
+    }
+    sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        if(!mspWrittenKFs.count(pKF))
+        {
+            payload.clear();
+            MapFile::AppendKeyFrame(pKF, payload);
+            AppendRecord(mvBuffer, MAP_JOURNAL_KEYFRAME, payload);
+            mspWrittenKFs.insert(pKF);
+        }
+
+        MapJournalKeyFrameState state;
+        memset(&state, 0, sizeof(state));
+        state.id = pKF->mnId;
+        KeyFrame* pParent = pKF->GetParent();
+        state.parent = pParent ? pParent->mnId : MAP_JOURNAL_NONE;
+        cv::Mat Tcw(4, 4, CV_32F, state.Tcw);
+        pKF->GetPose().convertTo(Tcw, CV_32F);
+        const set<KeyFrame*> sLoopEdges = pKF->GetLoopEdges();
+        state.nLoopEdges = sLoopEdges.size();
+        {
+            unique_lock<mutex> lock(pKF->mMutexConnections);
+            state.hasTcp = !pKF->mTcp.empty();
+            if(state.hasTcp)
+            {
+                cv::Mat Tcp(4, 4, CV_32F, state.Tcp);
+                pKF->mTcp.convertTo(Tcp, CV_32F);
+            }
+            state.notErase = pKF->mbNotErase;
+            state.toBeErased = pKF->mbToBeErased;
+            state.bad = pKF->mbBad;
+        }
+        payload.clear();
+        Append(payload, state);
+        for(set<KeyFrame*>::const_iterator it=sLoopEdges.begin(); it!=sLoopEdges.end(); it++)
+            Append(payload, (uint64_t)(*it)->mnId);
+        AppendRecord(mvBuffer, MAP_JOURNAL_KEYFRAME_STATE, payload);
+    }
+
+    for(unordered_set<MapPoint*>::const_iterator it=sChangedMPs.begin(); it!=sChangedMPs.end(); it++)
+    {
+        MapPoint* pMP = *it;
+        if(!mpMap->HasMapPoint(pMP))
+            continue;
+
+        MapFileMapPoint record;
+        MapFile::WriteMapPointRecord(pMP, record);
+        MapJournalMapPointLinks links;
+        KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+        links.refKeyFrame = pRefKF ? pRefKF->mnId : MAP_JOURNAL_NONE;
+        const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+        links.nObservations = observations.size();
+
+        payload.clear();
+        Append(payload, record);
+        Append(payload, links);
+        for(map<KeyFrame*,size_t>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+        {
+            MapJournalObservation observation;
+            observation.keyFrame = mit->first->mnId;
+            observation.index = mit->second;
+            Append(payload, observation);
+        }
+        AppendRecord(mvBuffer, MAP_JOURNAL_MAPPOINT, payload);
+    }
+
+    MapJournalCommit commit;
+    commit.nextKeyFrameId = KeyFrame::nNextId;
+    commit.nextMapPointId = MapPoint::nNextId;
+    commit.nOrigins = mpMap->mvpKeyFrameOrigins.size();
+    payload.clear();
+    Append(payload, commit);
+    for(size_t i=0; i<commit.nOrigins; i++)
+        Append(payload, (uint64_t)mpMap->mvpKeyFrameOrigins[i]->mnId);
+    AppendRecord(mvBuffer, MAP_JOURNAL_COMMIT, payload);
+
+    if(!WriteAt(mFd, mvBuffer.data(), mvBuffer.size(), mnJournalSize))
+    {
+        cerr << "Failed to append to the map journal " << mJournalFilename << endl;
+        // Drop the partial batch, the journal stays valid up to the previous commit
+        if(ftruncate(mFd, mnJournalSize)!=0)
+            cerr << "Cannot truncate the map journal" << endl;
+        return false;
+    }
+    mnJournalSize += mvBuffer.size();
+    return true;
+}
+
+size_t MapJournal::Replay(Map* pMap, const string &filename)
+{
+    const string journalFilename = JournalFilename(filename);
+    ifstream file(journalFilename.c_str(), ios::binary);
+    if(!file.is_open())
+        return 0;
+    vector<char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    MapJournalHeader header;
+    if(data.size()<sizeof(header))
+        return 0;
+    memcpy(&header, data.data(), sizeof(header));
+    if(memcmp(header.magic, MAP_JOURNAL_MAGIC, sizeof(header.magic))!=0 || header.version!=MAP_JOURNAL_VERSION)
+    {
+        cerr << "Not a valid map journal (or unsupported version): " << journalFilename << endl;
+        return 0;
+    }
+    if(header.snapshot!=MapFile::Fingerprint(filename))
+    {
+        cout << "The map journal " << journalFilename << " belongs to another snapshot, it is ignored" << endl;
+        return 0;
+    }
+
+    // Only whole batches are applied, up to the last commit with valid records before it
+    uint64_t offset = sizeof(header);
+    uint64_t end = offset;
+    while(data.size()-offset>=sizeof(MapJournalRecord))
+    {
+        MapJournalRecord record;
+        memcpy(&record, &data[offset], sizeof(record));
+        const uint64_t available = data.size()-offset-sizeof(record);
+        if(record.size>available || Padded(record.size)>available ||
+           Fnv1a(&data[offset+sizeof(record)], record.size)!=record.checksum)
+            break;
+        offset += sizeof(record)+Padded(record.size);
+        if(record.type==MAP_JOURNAL_COMMIT)
+            end = offset;
+    }
+    if(end<data.size())
+        cerr << "Map journal " << journalFilename << ": ignoring " << data.size()-end << " bytes after the last commit" << endl;
+
+    unordered_map<uint64_t,KeyFrame*> mKFs;
+    unordered_map<uint64_t,MapPoint*> mMPs;
+    {
+        const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+        for(size_t i=0; i<vpKFs.size(); i++)
+            mKFs[vpKFs[i]->mnId] = vpKFs[i];
+        const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+        for(size_t i=0; i<vpMPs.size(); i++)
+            mMPs[vpMPs[i]->mnId] = vpMPs[i];
+    }
+    // References by id, resolved once every record is applied
+    unordered_map<KeyFrame*,pair<uint64_t,vector<uint64_t> > > mKFLinks;
+    unordered_map<MapPoint*,pair<uint64_t,vector<MapJournalObservation> > > mMPLinks;
+
+    size_t nApplied = 0;
+    offset = sizeof(header);
+    while(offset<end)
+    {
+        MapJournalRecord record;
+        memcpy(&record, &data[offset], sizeof(record));
+        const char* pPayload = &data[offset+sizeof(record)];
+        const uint64_t size = record.size;
+        offset += sizeof(record)+Padded(record.size);
+        nApplied++;
+
+        if(record.type==MAP_JOURNAL_KEYFRAME)
+        {
+            MapFileKeyFrame r;
+            if(size<sizeof(r))
+                break;
+            memcpy(&r, pPayload, sizeof(r));
+            if(mKFs.count(r.id))
+                continue;
+            KeyFrame* pKF = MapFile::ReadKeyFrame(pPayload, size);
+            if(!pKF)
+                break;
+            // The spanning tree comes with the keyframe state
+            pKF->mbFirstConnection = false;
+            pKF->mpMap = pMap;
+            pMap->AddKeyFrame(pKF);
+            mKFs[pKF->mnId] = pKF;
+        }
+        else if(record.type==MAP_JOURNAL_KEYFRAME_STATE)
+        {
+            MapJournalKeyFrameState state;
+            if(size<sizeof(state))
+                break;
+            memcpy(&state, pPayload, sizeof(state));
+            if(size!=sizeof(state)+state.nLoopEdges*sizeof(uint64_t))
+                break;
+            unordered_map<uint64_t,KeyFrame*>::iterator it = mKFs.find(state.id);
+            if(it==mKFs.end())
+                continue;
+            KeyFrame* pKF = it->second;
+            pKF->SetPose(cv::Mat(4, 4, CV_32F, state.Tcw));
+            pKF->mTcp = state.hasTcp ? cv::Mat(4, 4, CV_32F, state.Tcp).clone() : cv::Mat();
+            pKF->mbNotErase = state.notErase;
+            pKF->mbToBeErased = state.toBeErased;
+            pKF->mbBad = state.bad;
+            pair<uint64_t,vector<uint64_t> > &links = mKFLinks[pKF];
+            links.first = state.parent;
+            links.second.resize(state.nLoopEdges);
+            if(state.nLoopEdges>0)
+                memcpy(&links.second[0], pPayload+sizeof(state), state.nLoopEdges*sizeof(uint64_t));
+        }
+        else if(record.type==MAP_JOURNAL_MAPPOINT)
+        {
+            MapFileMapPoint r;
+            MapJournalMapPointLinks links;
+            if(size<sizeof(r)+sizeof(links))
+                break;
+            memcpy(&r, pPayload, sizeof(r));
+            memcpy(&links, pPayload+sizeof(r), sizeof(links));
+            if(links.nObservations>(size-sizeof(r)-sizeof(links))/sizeof(MapJournalObservation) ||
+               size!=sizeof(r)+sizeof(links)+links.nObservations*sizeof(MapJournalObservation))
+                break;
+
+            MapPoint* pMP;
+            unordered_map<uint64_t,MapPoint*>::iterator it = mMPs.find(r.id);
+            if(it==mMPs.end())
+            {
+                pMP = new MapPoint();
+                pMP->mpMap = pMap;
+                mMPs[r.id] = pMP;
+                pMap->AddMapPoint(pMP);
+            }
+            else
+                pMP = it->second;
+            MapFile::ReadMapPointRecord(r, pMP);
+
+            pair<uint64_t,vector<MapJournalObservation> > &mpLinks = mMPLinks[pMP];
+            mpLinks.first = links.refKeyFrame;
+            mpLinks.second.resize(links.nObservations);
+            if(links.nObservations>0)
+                memcpy(&mpLinks.second[0], pPayload+sizeof(r)+sizeof(links), links.nObservations*sizeof(MapJournalObservation));
+        }
+        else if(record.type==MAP_JOURNAL_ERASE_KEYFRAME || record.type==MAP_JOURNAL_ERASE_MAPPOINT)
+        {
+            uint64_t id;
+            if(size!=sizeof(id))
+                break;
+            memcpy(&id, pPayload, sizeof(id));
+            // Erased objects are not deleted, as in the live map other objects may still point to them
+            if(record.type==MAP_JOURNAL_ERASE_KEYFRAME && mKFs.count(id))
+            {
+                KeyFrame* pKF = mKFs[id];
+                pKF->mbBad = true;
+                pMap->EraseKeyFrame(pKF);
+                mKFs.erase(id);
+                mKFLinks.erase(pKF);
+            }
+            else if(record.type==MAP_JOURNAL_ERASE_MAPPOINT && mMPs.count(id))
+            {
+                MapPoint* pMP = mMPs[id];
+                pMP->mbBad = true;
+                pMap->EraseMapPoint(pMP);
+                mMPs.erase(id);
+                mMPLinks.erase(pMP);
+            }
+        }
+        else if(record.type==MAP_JOURNAL_CLEAR)
+        {
+            pMap->clear();
+            mKFs.clear();
+            mMPs.clear();
+            mKFLinks.clear();
+            mMPLinks.clear();
+        }
+        else if(record.type==MAP_JOURNAL_COMMIT)
+        {
+            MapJournalCommit commit;
+            if(size<sizeof(commit))
+                break;
+            memcpy(&commit, pPayload, sizeof(commit));
+            if(commit.nOrigins!=(size-sizeof(commit))/sizeof(uint64_t))
+                break;
+            KeyFrame::nNextId = commit.nextKeyFrameId;
+            MapPoint::nNextId = commit.nextMapPointId;
+            pMap->mvpKeyFrameOrigins.clear();
+            for(uint64_t i=0; i<commit.nOrigins; i++)
+            {
+                uint64_t id;
+                memcpy(&id, pPayload+sizeof(commit)+i*sizeof(id), sizeof(id));
+                if(mKFs.count(id))
+                    pMap->mvpKeyFrameOrigins.push_back(mKFs[id]);
+            }
+        }
+    }
+    if(offset<end)
+        cerr << "Map journal " << journalFilename << " has an inconsistent record, replay stopped there" << endl;
+    if(nApplied==0)
+        return 0;
+
+    auto FindKF = [&](uint64_t id)
+    {
+        unordered_map<uint64_t,KeyFrame*>::const_iterator it = mKFs.find(id);
+        return it==mKFs.end() ? static_cast<KeyFrame*>(NULL) : it->second;
+    };
+
+    for(unordered_map<KeyFrame*,pair<uint64_t,vector<uint64_t> > >::iterator it=mKFLinks.begin(); it!=mKFLinks.end(); it++)
+    {
+        KeyFrame* pKF = it->first;
+        pKF->mpParent = FindKF(it->second.first);
+        pKF->mspLoopEdges.clear();
+        for(size_t i=0; i<it->second.second.size(); i++)
+        {
+            if(FindKF(it->second.second[i]))
+                pKF->mspLoopEdges.insert(FindKF(it->second.second[i]));
+        }
+    }
+    for(unordered_map<MapPoint*,pair<uint64_t,vector<MapJournalObservation> > >::iterator it=mMPLinks.begin(); it!=mMPLinks.end(); it++)
+    {
+        MapPoint* pMP = it->first;
+        pMP->mpRefKF = FindKF(it->second.first);
+        pMP->mObservations.clear();
+        pMP->nObs = 0;
+        for(size_t i=0; i<it->second.second.size(); i++)
+        {
+            const MapJournalObservation &o = it->second.second[i];
+            KeyFrame* pKF = FindKF(o.keyFrame);
+            if(pKF && o.index<(uint64_t)pKF->N)
+            {
+                pMP->mObservations[pKF] = o.index;
+                pMP->nObs += pKF->mvuRight[o.index]>=0 ? 2 : 1;
+            }
+        }
+    }
+
+    // Map point matches, spanning tree children and covisibility follow from the links above
+    vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+    sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
+    const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        pKF->mvpMapPoints.assign(pKF->N, static_cast<MapPoint*>(NULL));
+        pKF->mspChildrens.clear();
+        pKF->mConnectedKeyFrameWeights.clear();
+        pKF->mvpOrderedConnectedKeyFrames.clear();
+        pKF->mvOrderedWeights.clear();
+    }
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        for(map<KeyFrame*,size_t>::const_iterator mit=vpMPs[i]->mObservations.begin(); mit!=vpMPs[i]->mObservations.end(); mit++)
+        {
+            if(FindKF(mit->first->mnId)==mit->first && mit->second<(size_t)mit->first->N)
+                mit->first->mvpMapPoints[mit->second] = vpMPs[i];
+        }
+    }
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        if(pKF->mpParent && FindKF(pKF->mpParent->mnId)!=pKF->mpParent)
+            pKF->mpParent = static_cast<KeyFrame*>(NULL);
+        if(pKF->mpParent)
+            pKF->mpParent->mspChildrens.insert(pKF);
+    }
+    for(size_t i=0; i<vpKFs.size(); i++)
+        vpKFs[i]->UpdateConnections(vpKFs[i]->CountCovisibles());
+
+    cout << "Map journal " << journalFilename << ": " << nApplied << " records replayed, " << vpKFs.size()
+         << " keyframes, " << vpMPs.size() << " map points" << endl;
+    return nApplied;
+}
+
+} //namespace ORB_SLAM
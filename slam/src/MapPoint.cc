@@ -20,6 +20,7 @@
 
 #include "MapPoint.h"
 #include "ORBmatcher.h"
+#include "MapIdIndex.h"
 
 #include<mutex>
 
@@ -32,7 +33,7 @@ MapPoint::MapPoint():
     nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0),mnVisible(1), mnFound(1), mbBad(false),
-    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0)
+    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(static_cast<Map*>(NULL))
  { 
     //mNormalVector = cv::Mat::zeros(3,1,CV_32F);
     //unique_lock<recursive_mutex> lock(mpMap->mMutexPointCreation);
@@ -116,7 +117,8 @@ template<class Archive>
         
 
         ar & const_cast<cv::Mat &> (mNormalVector);
-        ar & const_cast<cv::Mat &> (mDescriptor);
+        cv::Mat descriptor(1, sizeof(ORBDescriptor), CV_8U, const_cast<unsigned char*>(mDescriptor.data));
+        ar & descriptor;
         if (mpRefKF) {
             is_valid = true;
             ar & is_valid;
@@ -189,7 +191,10 @@ template<class Archive>
         }
         
         ar & const_cast<cv::Mat &> (mNormalVector);
-        ar & const_cast<cv::Mat &> (mDescriptor);
+        cv::Mat descriptor;
+        ar & descriptor;
+        if(descriptor.rows>0)
+            memcpy(mDescriptor.data, descriptor.ptr<unsigned char>(), sizeof(ORBDescriptor));
 
         //mpRefKF = new KeyFrame();
         //Reference Keyframe
@@ -230,56 +235,19 @@ void MapPoint::SetMap(Map* map)
     mpMap = map;   
 }
 
-void MapPoint::SetObservations(std::vector<KeyFrame*> spKeyFrames)
+void MapPoint::SetObservations(const MapIdIndex &index)
 {
-    
-    long unsigned int id, kfRef_id; size_t size;    
-    //cout << "KF" << mnId <<" valid indexes-" << endl;
-    int j = 0; 
-    bool found_reference = false;
-    kfRef_id = mref_KfId_pair.first;
-    bool is_ref_valid = mref_KfId_pair.second;
-
-
-    for (map<long unsigned int, size_t>::iterator it = mObservations_nId.begin(); it != mObservations_nId.end(); j++,++it) {
-        id = it->first;
-        size = it->second;        
-        {
-            for(std::vector<KeyFrame*>::iterator mit=spKeyFrames.begin(); mit !=spKeyFrames.end(); mit++)
-            {
-                KeyFrame* pKf = *mit;
-                //cout << "[" << pKf->mnId << "]";               
-                if(id == pKf->mnId)
-                {                    
-                    //cout << "[" << id <<"]";                    
-                    mObservations[pKf] = size;
-                    //id = -1;
-                    break;
-                }
-            }
-            
-        }
-
+    for (map<long unsigned int, size_t>::iterator it = mObservations_nId.begin(); it != mObservations_nId.end(); ++it) {
+        KeyFrame* pKf = index.GetKeyFrame(it->first);
+        if (pKf)
+            mObservations[pKf] = it->second;
     }
 
-    for(std::vector<KeyFrame*>::iterator mit=spKeyFrames.begin(); mit !=spKeyFrames.end(); mit++)
-    {
-       KeyFrame* pKf = *mit;
-       if (is_ref_valid && kfRef_id == pKf->mnId )
-       {
-            // Set the refernce Keyframe
-            mpRefKF = pKf;
-            found_reference = true;
-       }
-   }
-
-    if (!found_reference)
-    {
-            mpRefKF = static_cast<KeyFrame*>(NULL);
-            //cout << "refernce KF - " << kfRef_id << "is not found for mappoint " << mnId << endl;  
-            // Dummy KF
-            //mpRefKF = new KeyFrame();  
-    }
+    // Set the refernce Keyframe
+    if (mref_KfId_pair.second)
+        mpRefKF = index.GetKeyFrame(mref_KfId_pair.first);
+    else
+        mpRefKF = static_cast<KeyFrame*>(NULL);
 }
 
 MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF):
@@ -302,7 +270,7 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
     mfMaxDistance = dist*levelScaleFactor;
     mfMinDistance = mfMaxDistance/pFrame->mvScaleFactors[nLevels-1];
 
-    pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
+    mDescriptor = pFrame->mDescriptors[idxF];
 
     // MapPoints can be created from Tracking and Local Mapping. This recursive_mutex avoid conflicts with id.
     unique_lock<mutex> lock(mpMap->mMutexPointCreation);
@@ -311,9 +279,14 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
 
 void MapPoint::SetWorldPos(const cv::Mat &Pos)
 {
-    unique_lock<mutex> lock2(mGlobalMutex);
-    unique_lock<mutex> lock(mMutexPos);
-    Pos.copyTo(mWorldPos);
+    {
+        unique_lock<mutex> lock2(mGlobalMutex);
+        unique_lock<mutex> lock(mMutexPos);
+        Pos.copyTo(mWorldPos);
+    }
+
+    if(mpMap)
+        mpMap->MarkChanged(this);
 }
 
 cv::Mat MapPoint::GetWorldPos()
@@ -336,20 +309,26 @@ KeyFrame* MapPoint::GetReferenceKeyFrame()
 
 void MapPoint::AddObservation(KeyFrame* pKF, size_t idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    if(mObservations.count(pKF))
-        return;
-    mObservations[pKF]=idx;
+    {
+        unique_lock<mutex> lock(mMutexFeatures);
+        if(mObservations.count(pKF))
+            return;
+        mObservations[pKF]=idx;
 
-    if(pKF->mvuRight[idx]>=0)
-        nObs+=2;
-    else
-        nObs++;
+        if(pKF->mvuRight[idx]>=0)
+            nObs+=2;
+        else
+            nObs++;
+    }
+
+    if(mpMap)
+        mpMap->MarkChanged(this);
 }
 
 void MapPoint::EraseObservation(KeyFrame* pKF)
 {
     bool bBad=false;
+    bool bErased=false;
     {
         unique_lock<mutex> lock(mMutexFeatures);
         if(mObservations.count(pKF))
@@ -361,6 +340,7 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
                 nObs--;
 
             mObservations.erase(pKF);
+            bErased=true;
 
             if(mpRefKF==pKF)
                 mpRefKF=mObservations.begin()->first;
@@ -373,6 +353,8 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
 
     if(bBad)
         SetBadFlag();
+    else if(bErased && mpMap)
+        mpMap->MarkChanged(this);
 }
 
 map<KeyFrame*, size_t> MapPoint::GetObservations()
@@ -480,8 +462,9 @@ float MapPoint::GetFoundRatio()
 
 void MapPoint::ComputeDistinctiveDescriptors()
 {
-    // Retrieve all observed descriptors
-    vector<cv::Mat> vDescriptors;
+    // Retrieve all observed descriptors. They are copied, the keyframe payloads may be paged out
+    // once unpinned.
+    vector<ORBDescriptor> vDescriptors;
 
     map<KeyFrame*,size_t> observations;
 
@@ -502,7 +485,10 @@ void MapPoint::ComputeDistinctiveDescriptors()
         KeyFrame* pKF = mit->first;
 
         if(!pKF->isBad())
-            vDescriptors.push_back(pKF->mDescriptors.row(mit->second));
+        {
+            KeyFramePayloadPin pin(pKF);
+            vDescriptors.push_back(pKF->mDescriptors[mit->second]);
+        }
     }
 
     if(vDescriptors.empty())
@@ -510,25 +496,19 @@ void MapPoint::ComputeDistinctiveDescriptors()
 
     // Compute distances between them
     const size_t N = vDescriptors.size();
-
-    float Distances[N][N];
+    vector<const unsigned char*> vpDescriptors(N);
     for(size_t i=0;i<N;i++)
-    {
-        Distances[i][i]=0;
-        for(size_t j=i+1;j<N;j++)
-        {
-            int distij = ORBmatcher::DescriptorDistance(vDescriptors[i],vDescriptors[j]);
-            Distances[i][j]=distij;
-            Distances[j][i]=distij;
-        }
-    }
+        vpDescriptors[i] = vDescriptors[i].data;
+
+    vector<int> vDistances(N*N);
+    DescriptorDistanceMatrix(&vpDescriptors[0],N,&vpDescriptors[0],N,&vDistances[0]);
 
     // Take the descriptor with least median distance to the rest
     int BestMedian = INT_MAX;
     int BestIdx = 0;
     for(size_t i=0;i<N;i++)
     {
-        vector<int> vDists(Distances[i],Distances[i]+N);
+        vector<int> vDists(vDistances.begin()+i*N,vDistances.begin()+(i+1)*N);
         sort(vDists.begin(),vDists.end());
         int median = vDists[0.5*(N-1)];
 
@@ -541,14 +521,17 @@ void MapPoint::ComputeDistinctiveDescriptors()
 
     {
         unique_lock<mutex> lock(mMutexFeatures);
-        mDescriptor = vDescriptors[BestIdx].clone();       
+        memcpy(mDescriptor.data, vpDescriptors[BestIdx], sizeof(ORBDescriptor));
     }
+
+    if(mpMap)
+        mpMap->MarkChanged(this);
 }
 
-cv::Mat MapPoint::GetDescriptor()
+ORBDescriptor MapPoint::GetDescriptor()
 {
     unique_lock<mutex> lock(mMutexFeatures);
-    return mDescriptor.clone();
+    return mDescriptor;
 }
 
 int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
@@ -614,6 +597,9 @@ void MapPoint::UpdateNormalAndDepth()
         mfMinDistance = mfMaxDistance/pRefKF->mvScaleFactors[nLevels-1];
         mNormalVector = normal/n;
     }
+
+    if(mpMap)
+        mpMap->MarkChanged(this);
 }
 
 float MapPoint::GetMinDistanceInvariance()
@@ -628,6 +614,18 @@ float MapPoint::GetMaxDistanceInvariance()
     return 1.2f*mfMaxDistance;
 }
 
+void MapPoint::GetViewingData(float *pos, float *normal, float &minDistance, float &maxDistance)
+{
+    unique_lock<mutex> lock(mMutexPos);
+    for(int i=0; i<3; i++)
+    {
+        pos[i] = mWorldPos.at<float>(i);
+        normal[i] = mNormalVector.at<float>(i);
+    }
+    minDistance = mfMinDistance;
+    maxDistance = mfMaxDistance;
+}
+
 int MapPoint::PredictScale(const float &currentDist, const float &logScaleFactor)
 {
     float ratio;
@@ -0,0 +1,162 @@
+#include "MapPointBatch.h"
+#include "MapPoint.h"
+#include "Frame.h"
+
+#include <cmath>
+#include <opencv2/core/hal/intrin.hpp>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+void MapPointBatch::Clear()
+{
+    mvpMapPoints.clear();
+    mvX.clear(); mvY.clear(); mvZ.clear();
+    mvNx.clear(); mvNy.clear(); mvNz.clear();
+    mvMinDistance.clear(); mvMaxDistance.clear();
+}
+
+void MapPointBatch::Add(MapPoint* pMP)
+{
+    float pos[3], normal[3], minDistance, maxDistance;
+    pMP->GetViewingData(pos, normal, minDistance, maxDistance);
+
+    mvpMapPoints.push_back(pMP);
+    mvX.push_back(pos[0]); mvY.push_back(pos[1]); mvZ.push_back(pos[2]);
+    mvNx.push_back(normal[0]); mvNy.push_back(normal[1]); mvNz.push_back(normal[2]);
+    mvMinDistance.push_back(minDistance);
+    mvMaxDistance.push_back(maxDistance);
+}
+
+// Camera pose and image bounds shared by the vector and scalar paths
+struct FrustumParams
+{
+    float R[9], t[3], Ow[3];
+    float fx, fy, cx, cy;
+    float minX, maxX, minY, maxY;
+    float viewingCosLimit;
+};
+
+// Test of one point, for the tail of the batch and builds without SIMD
+static void FrustumTestScalar(const FrustumParams &p, const float X, const float Y, const float Z,
+                              const float Nx, const float Ny, const float Nz, const float minDistance,
+                              const float maxDistance, float &u, float &v, float &invz, float &dist,
+                              float &viewCos, unsigned char &bInView)
+{
+    const float PcX = p.R[0]*X + p.R[1]*Y + p.R[2]*Z + p.t[0];
+    const float PcY = p.R[3]*X + p.R[4]*Y + p.R[5]*Z + p.t[1];
+    const float PcZ = p.R[6]*X + p.R[7]*Y + p.R[8]*Z + p.t[2];
+
+    invz = 1.0f/PcZ;
+    u = p.fx*PcX*invz + p.cx;
+    v = p.fy*PcY*invz + p.cy;
+
+    const float POx = X-p.Ow[0];
+    const float POy = Y-p.Ow[1];
+    const float POz = Z-p.Ow[2];
+    dist = sqrt(POx*POx + POy*POy + POz*POz);
+    viewCos = (POx*Nx + POy*Ny + POz*Nz)/dist;
+
+    bInView = PcZ>=0.0f && u>=p.minX && u<=p.maxX && v>=p.minY && v<=p.maxY &&
+              dist>=0.8f*minDistance && dist<=1.2f*maxDistance && viewCos>=p.viewingCosLimit;
+}
+
+int MapPointBatch::IsInFrustum(const Frame &F, float viewingCosLimit)
+{
+    const int N = mvpMapPoints.size();
+    mvU.resize(N); mvV.resize(N); mvInvZ.resize(N); mvDist.resize(N); mvViewCos.resize(N);
+    mvbInView.resize(N);
+
+    FrustumParams p;
+    const cv::Mat Rcw = F.mTcw.rowRange(0,3).colRange(0,3);
+    const cv::Mat tcw = F.mTcw.rowRange(0,3).col(3);
+    const cv::Mat Ow = -Rcw.t()*tcw;
+    for(int r=0; r<3; r++)
+    {
+        for(int c=0; c<3; c++)
+            p.R[r*3+c] = Rcw.at<float>(r,c);
+        p.t[r] = tcw.at<float>(r);
+        p.Ow[r] = Ow.at<float>(r);
+    }
+    p.fx = F.fx; p.fy = F.fy; p.cx = F.cx; p.cy = F.cy;
+    p.minX = Frame::mnMinX; p.maxX = Frame::mnMaxX; p.minY = Frame::mnMinY; p.maxY = Frame::mnMaxY;
+    p.viewingCosLimit = viewingCosLimit;
+
+    int i=0;
+#if CV_SIMD
+    {
+        const int nLanes = cv::v_float32::nlanes;
+        const cv::v_float32 r00 = cv::vx_setall_f32(p.R[0]), r01 = cv::vx_setall_f32(p.R[1]), r02 = cv::vx_setall_f32(p.R[2]);
+        const cv::v_float32 r10 = cv::vx_setall_f32(p.R[3]), r11 = cv::vx_setall_f32(p.R[4]), r12 = cv::vx_setall_f32(p.R[5]);
+        const cv::v_float32 r20 = cv::vx_setall_f32(p.R[6]), r21 = cv::vx_setall_f32(p.R[7]), r22 = cv::vx_setall_f32(p.R[8]);
+        const cv::v_float32 t0 = cv::vx_setall_f32(p.t[0]), t1 = cv::vx_setall_f32(p.t[1]), t2 = cv::vx_setall_f32(p.t[2]);
+        const cv::v_float32 ox = cv::vx_setall_f32(p.Ow[0]), oy = cv::vx_setall_f32(p.Ow[1]), oz = cv::vx_setall_f32(p.Ow[2]);
+        const cv::v_float32 fx = cv::vx_setall_f32(p.fx), fy = cv::vx_setall_f32(p.fy);
+        const cv::v_float32 cx = cv::vx_setall_f32(p.cx), cy = cv::vx_setall_f32(p.cy);
+        const cv::v_float32 minX = cv::vx_setall_f32(p.minX), maxX = cv::vx_setall_f32(p.maxX);
+        const cv::v_float32 minY = cv::vx_setall_f32(p.minY), maxY = cv::vx_setall_f32(p.maxY);
+        const cv::v_float32 cosLimit = cv::vx_setall_f32(p.viewingCosLimit);
+        const cv::v_float32 zero = cv::vx_setzero_f32(), one = cv::vx_setall_f32(1.0f);
+        const cv::v_float32 minScale = cv::vx_setall_f32(0.8f), maxScale = cv::vx_setall_f32(1.2f);
+
+        for(; i+nLanes<=N; i+=nLanes)
+        {
+            const cv::v_float32 X = cv::vx_load(&mvX[i]), Y = cv::vx_load(&mvY[i]), Z = cv::vx_load(&mvZ[i]);
+
+            const cv::v_float32 PcX = cv::v_fma(r00, X, cv::v_fma(r01, Y, cv::v_fma(r02, Z, t0)));
+            const cv::v_float32 PcY = cv::v_fma(r10, X, cv::v_fma(r11, Y, cv::v_fma(r12, Z, t1)));
+            const cv::v_float32 PcZ = cv::v_fma(r20, X, cv::v_fma(r21, Y, cv::v_fma(r22, Z, t2)));
+
+            const cv::v_float32 invz = one/PcZ;
+            const cv::v_float32 u = cv::v_fma(fx*PcX, invz, cx);
+            const cv::v_float32 v = cv::v_fma(fy*PcY, invz, cy);
+
+            const cv::v_float32 POx = X-ox, POy = Y-oy, POz = Z-oz;
+            const cv::v_float32 dist = cv::v_sqrt(cv::v_fma(POx, POx, cv::v_fma(POy, POy, POz*POz)));
+            const cv::v_float32 viewCos = cv::v_fma(POx, cv::vx_load(&mvNx[i]),
+                                          cv::v_fma(POy, cv::vx_load(&mvNy[i]), POz*cv::vx_load(&mvNz[i])))/dist;
+
+            const cv::v_float32 inView = (PcZ>=zero) & (u>=minX) & (u<=maxX) & (v>=minY) & (v<=maxY) &
+                                         (dist>=minScale*cv::vx_load(&mvMinDistance[i])) &
+                                         (dist<=maxScale*cv::vx_load(&mvMaxDistance[i])) & (viewCos>=cosLimit);
+
+            cv::v_store(&mvU[i], u);
+            cv::v_store(&mvV[i], v);
+            cv::v_store(&mvInvZ[i], invz);
+            cv::v_store(&mvDist[i], dist);
+            cv::v_store(&mvViewCos[i], viewCos);
+
+            const int mask = cv::v_signmask(inView);
+            for(int k=0; k<nLanes; k++)
+                mvbInView[i+k] = (mask>>k)&1;
+        }
+    }
+#endif
+    for(; i<N; i++)
+        FrustumTestScalar(p, mvX[i], mvY[i], mvZ[i], mvNx[i], mvNy[i], mvNz[i], mvMinDistance[i], mvMaxDistance[i],
+                          mvU[i], mvV[i], mvInvZ[i], mvDist[i], mvViewCos[i], mvbInView[i]);
+
+    // Data used by the tracking
+    int nInView = 0;
+    for(i=0; i<N; i++)
+    {
+        MapPoint* pMP = mvpMapPoints[i];
+        pMP->mbTrackInView = mvbInView[i];
+        if(!mvbInView[i])
+            continue;
+
+        pMP->mTrackProjX = mvU[i];
+        pMP->mTrackProjXR = mvU[i] - F.mbf*mvInvZ[i];
+        pMP->mTrackProjY = mvV[i];
+        // Predict scale in the image, as MapPoint::PredictScale
+        pMP->mnTrackScaleLevel = ceil(log(mvMaxDistance[i]/mvDist[i])/F.mfLogScaleFactor);
+        pMP->mTrackViewCos = mvViewCos[i];
+        nInView++;
+    }
+
+    return nInView;
+}
+
+} //namespace ORB_SLAM
@@ -60,6 +60,7 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <vector>
 #include "ORBextractor.h"
+#include "FASTDetector.h"
 
 
 using namespace cv;
@@ -422,7 +423,7 @@ static int bit_pattern_31_[256*4] =
 ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
          int _iniThFAST, int _minThFAST):
     nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels),
-    iniThFAST(_iniThFAST), minThFAST(_minThFAST)
+    iniThFAST(_iniThFAST), minThFAST(_minThFAST), mpTaskPool(NULL)
 {
     mvScaleFactor.resize(nlevels);
     mvLevelSigma2.resize(nlevels);
@@ -443,6 +444,15 @@ ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
     }
 
     mvImagePyramid.resize(nlevels);
+    mvPyramidBuffers.resize(nlevels);
+    mvBlurredPyramid.resize(nlevels);
+    mvFASTScores.resize(nlevels);
+    mvNodeArenas.resize(nlevels);
+    mvAllKeypoints.resize(nlevels);
+    mvToDistributeKeys.resize(nlevels);
+    mvLevelOffsets.resize(nlevels+1);
+    for(int level=0; level<nlevels; level++)
+        mvToDistributeKeys[level].reserve(nfeatures*10);
 
     mnFeaturesPerLevel.resize(nlevels);
     float factor = 1.0f / scaleFactor;
@@ -490,7 +500,8 @@ static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, co
     }
 }
 
-void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4)
+void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4,
+                               const vector<cv::KeyPoint> &vKeys, vector<int> &vKeyIdx, vector<int> &vKeyIdxTmp)
 {
     const int halfX = ceil(static_cast<float>(UR.x-UL.x)/2);
     const int halfY = ceil(static_cast<float>(BR.y-UL.y)/2);
@@ -500,67 +511,120 @@ void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNo
     n1.UR = cv::Point2i(UL.x+halfX,UL.y);
     n1.BL = cv::Point2i(UL.x,UL.y+halfY);
     n1.BR = cv::Point2i(UL.x+halfX,UL.y+halfY);
-    n1.vKeys.reserve(vKeys.size());
 
     n2.UL = n1.UR;
     n2.UR = UR;
     n2.BL = n1.BR;
     n2.BR = cv::Point2i(UR.x,UL.y+halfY);
-    n2.vKeys.reserve(vKeys.size());
 
     n3.UL = n1.BL;
     n3.UR = n1.BR;
     n3.BL = BL;
     n3.BR = cv::Point2i(n1.BR.x,BL.y);
-    n3.vKeys.reserve(vKeys.size());
 
     n4.UL = n3.UR;
     n4.UR = n2.BR;
     n4.BL = n3.BR;
     n4.BR = BR;
-    n4.vKeys.reserve(vKeys.size());
 
-    //Associate points to childs
-    for(size_t i=0;i<vKeys.size();i++)
+    //Associate points to childs: count, scatter to the scratch buffer and copy back,
+    //so every child gets a contiguous sub range in the original order
+    int nChildKeys[4] = {0,0,0,0};
+    for(int i=iniKey;i<endKey;i++)
     {
-        const cv::KeyPoint &kp = vKeys[i];
-        if(kp.pt.x<n1.UR.x)
-        {
-            if(kp.pt.y<n1.BR.y)
-                n1.vKeys.push_back(kp);
-            else
-                n3.vKeys.push_back(kp);
-        }
-        else if(kp.pt.y<n1.BR.y)
-            n2.vKeys.push_back(kp);
-        else
-            n4.vKeys.push_back(kp);
+        const cv::KeyPoint &kp = vKeys[vKeyIdx[i]];
+        nChildKeys[(kp.pt.x<n1.UR.x ? 0 : 1) + (kp.pt.y<n1.BR.y ? 0 : 2)]++;
     }
 
-    if(n1.vKeys.size()==1)
+    n1.iniKey = iniKey;
+    n2.iniKey = n1.endKey = n1.iniKey+nChildKeys[0];
+    n3.iniKey = n2.endKey = n2.iniKey+nChildKeys[1];
+    n4.iniKey = n3.endKey = n3.iniKey+nChildKeys[2];
+    n4.endKey = endKey;
+
+    int pos[4] = {n1.iniKey, n2.iniKey, n3.iniKey, n4.iniKey};
+    for(int i=iniKey;i<endKey;i++)
+    {
+        const cv::KeyPoint &kp = vKeys[vKeyIdx[i]];
+        vKeyIdxTmp[pos[(kp.pt.x<n1.UR.x ? 0 : 1) + (kp.pt.y<n1.BR.y ? 0 : 2)]++] = vKeyIdx[i];
+    }
+    copy(vKeyIdxTmp.begin()+iniKey, vKeyIdxTmp.begin()+endKey, vKeyIdx.begin()+iniKey);
+
+    if(n1.Size()==1)
         n1.bNoMore = true;
-    if(n2.vKeys.size()==1)
+    if(n2.Size()==1)
         n2.bNoMore = true;
-    if(n3.vKeys.size()==1)
+    if(n3.Size()==1)
         n3.bNoMore = true;
-    if(n4.vKeys.size()==1)
+    if(n4.Size()==1)
         n4.bNoMore = true;
 
 }
 
-vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
-                                       const int &maxX, const int &minY, const int &maxY, const int &N, const int &level)
+// Node list helpers for DistributeOctTree, the list is threaded through the arena by index
+static void PushFrontNode(vector<ExtractorNode> &vNodes, int &first, int &nNodes, const ExtractorNode &node)
 {
+    vNodes.push_back(node);
+    const int idx = vNodes.size()-1;
+    vNodes[idx].prev = -1;
+    vNodes[idx].next = first;
+    if(first>=0)
+        vNodes[first].prev = idx;
+    first = idx;
+    nNodes++;
+}
+
+static void EraseNode(vector<ExtractorNode> &vNodes, int &first, int &nNodes, const int idx)
+{
+    ExtractorNode &node = vNodes[idx];
+    if(node.prev>=0)
+        vNodes[node.prev].next = node.next;
+    else
+        first = node.next;
+    if(node.next>=0)
+        vNodes[node.next].prev = node.prev;
+    nNodes--;
+}
+
+// Divides a node, adds its non empty childs at the front of the list and removes it.
+// Childs that can still be divided are reported in vSizeAndNode. Returns how many were reported.
+static int ExpandNode(ExtractorNodeArena &arena, int &first, int &nNodes, const int idx, const vector<cv::KeyPoint> &vKeys)
+{
+    ExtractorNode n[4];
+    arena.vNodes[idx].DivideNode(n[0],n[1],n[2],n[3], vKeys, arena.vKeyIdx, arena.vKeyIdxTmp);
+
+    // Add childs if they contain points
+    int nToExpand = 0;
+    for(int c=0; c<4; c++)
+    {
+        if(n[c].Size()>0)
+        {
+            PushFrontNode(arena.vNodes, first, nNodes, n[c]);
+            if(n[c].Size()>1)
+            {
+                nToExpand++;
+                arena.vSizeAndNode.push_back(make_pair(n[c].Size(),first));
+            }
+        }
+    }
+
+    EraseNode(arena.vNodes, first, nNodes, idx);
+    return nToExpand;
+}
+
+void ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
+                                     const int &maxX, const int &minY, const int &maxY, const int &N, const int &level,
+                                     vector<cv::KeyPoint>& vResultKeys)
+{
+    ExtractorNodeArena &arena = mvNodeArenas[level];
+    vector<ExtractorNode> &vNodes = arena.vNodes;
+    vNodes.clear();
+
     // Compute how many initial nodes   
     const int nIni = round(static_cast<float>(maxX-minX)/(maxY-minY));
 
     const float hX = static_cast<float>(maxX-minX)/nIni;
 
-    list<ExtractorNode> lNodes;
-
-    vector<ExtractorNode*> vpIniNodes;
-    vpIniNodes.resize(nIni);
-
     for(int i=0; i<nIni; i++)
     {
         ExtractorNode ni;
@@ -568,182 +632,100 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
         ni.UR = cv::Point2i(hX*static_cast<float>(i+1),0);
         ni.BL = cv::Point2i(ni.UL.x,maxY-minY);
         ni.BR = cv::Point2i(ni.UR.x,maxY-minY);
-        ni.vKeys.reserve(vToDistributeKeys.size());
-
-        lNodes.push_back(ni);
-        vpIniNodes[i] = &lNodes.back();
+        vNodes.push_back(ni);
     }
 
-    //Associate points to childs
-    for(size_t i=0;i<vToDistributeKeys.size();i++)
+    //Associate points to childs, counting first to give every initial node a contiguous range
+    const int nKeys = vToDistributeKeys.size();
+    arena.vKeyIdx.resize(nKeys);
+    arena.vKeyIdxTmp.resize(nKeys);
+    for(int i=0;i<nKeys;i++)
+        vNodes[vToDistributeKeys[i].pt.x/hX].endKey++;
+    for(int i=0, nAccum=0; i<nIni; i++)
     {
-        const cv::KeyPoint &kp = vToDistributeKeys[i];
-        vpIniNodes[kp.pt.x/hX]->vKeys.push_back(kp);
+        vNodes[i].iniKey = nAccum;
+        nAccum += vNodes[i].endKey;
+        vNodes[i].endKey = vNodes[i].iniKey;
     }
+    for(int i=0;i<nKeys;i++)
+        arena.vKeyIdx[vNodes[vToDistributeKeys[i].pt.x/hX].endKey++] = i;
 
-    list<ExtractorNode>::iterator lit = lNodes.begin();
-
-    while(lit!=lNodes.end())
+    // Link the non empty initial nodes in order
+    int first = -1;
+    int nNodes = 0;
+    for(int i=nIni-1; i>=0; i--)
     {
-        if(lit->vKeys.size()==1)
-        {
-            lit->bNoMore=true;
-            lit++;
-        }
-        else if(lit->vKeys.empty())
-            lit = lNodes.erase(lit);
-        else
-            lit++;
+        if(vNodes[i].Size()==0)
+            continue;
+        if(vNodes[i].Size()==1)
+            vNodes[i].bNoMore=true;
+        vNodes[i].next = first;
+        if(first>=0)
+            vNodes[first].prev = i;
+        first = i;
+        nNodes++;
     }
 
     bool bFinish = false;
 
     int iteration = 0;
 
-    vector<pair<int,ExtractorNode*> > vSizeAndPointerToNode;
-    vSizeAndPointerToNode.reserve(lNodes.size()*4);
+    vector<pair<int,int> > &vSizeAndNode = arena.vSizeAndNode;
 
     while(!bFinish)
     {
         iteration++;
 
-        int prevSize = lNodes.size();
+        int prevSize = nNodes;
 
-        lit = lNodes.begin();
+        int idx = first;
 
         int nToExpand = 0;
 
-        vSizeAndPointerToNode.clear();
+        vSizeAndNode.clear();
 
-        while(lit!=lNodes.end())
+        while(idx>=0)
         {
-            if(lit->bNoMore)
-            {
-                // If node only contains one point do not subdivide and continue
-                lit++;
-                continue;
-            }
-            else
-            {
-                // If more than one point, subdivide
-                ExtractorNode n1,n2,n3,n4;
-                lit->DivideNode(n1,n2,n3,n4);
+            const int nextIdx = vNodes[idx].next;
 
-                // Add childs if they contain points
-                if(n1.vKeys.size()>0)
-                {
-                    lNodes.push_front(n1);                    
-                    if(n1.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n1.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-                if(n2.vKeys.size()>0)
-                {
-                    lNodes.push_front(n2);
-                    if(n2.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n2.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-                if(n3.vKeys.size()>0)
-                {
-                    lNodes.push_front(n3);
-                    if(n3.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n3.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-                if(n4.vKeys.size()>0)
-                {
-                    lNodes.push_front(n4);
-                    if(n4.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n4.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
+            // If node only contains one point do not subdivide and continue
+            // If more than one point, subdivide
+            if(!vNodes[idx].bNoMore)
+                nToExpand += ExpandNode(arena, first, nNodes, idx, vToDistributeKeys);
 
-                lit=lNodes.erase(lit);
-                continue;
-            }
+            idx = nextIdx;
         }       
 
         // Finish if there are more nodes than required features
         // or all nodes contain just one point
-        if((int)lNodes.size()>=N || (int)lNodes.size()==prevSize)
+        if(nNodes>=N || nNodes==prevSize)
         {
             bFinish = true;
         }
-        else if(((int)lNodes.size()+nToExpand*3)>N)
+        else if((nNodes+nToExpand*3)>N)
         {
 
             while(!bFinish)
             {
 
-                prevSize = lNodes.size();
+                prevSize = nNodes;
 
-                vector<pair<int,ExtractorNode*> > vPrevSizeAndPointerToNode = vSizeAndPointerToNode;
-                vSizeAndPointerToNode.clear();
+                vector<pair<int,int> > &vPrevSizeAndNode = arena.vPrevSizeAndNode;
+                vPrevSizeAndNode.swap(vSizeAndNode);
+                vSizeAndNode.clear();
 
-                sort(vPrevSizeAndPointerToNode.begin(),vPrevSizeAndPointerToNode.end());
-                for(int j=vPrevSizeAndPointerToNode.size()-1;j>=0;j--)
+                // Nodes of the same size are divided newest first. The former list version broke
+                // these ties by node address, which depended on the heap.
+                sort(vPrevSizeAndNode.begin(),vPrevSizeAndNode.end());
+                for(int j=vPrevSizeAndNode.size()-1;j>=0;j--)
                 {
-                    ExtractorNode n1,n2,n3,n4;
-                    vPrevSizeAndPointerToNode[j].second->DivideNode(n1,n2,n3,n4);
-
-                    // Add childs if they contain points
-                    if(n1.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n1);
-                        if(n1.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n1.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n2.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n2);
-                        if(n2.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n2.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n3.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n3);
-                        if(n3.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n3.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n4.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n4);
-                        if(n4.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n4.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-
-                    lNodes.erase(vPrevSizeAndPointerToNode[j].second->lit);
+                    ExpandNode(arena, first, nNodes, vPrevSizeAndNode[j].second, vToDistributeKeys);
 
-                    if((int)lNodes.size()>=N)
+                    if(nNodes>=N)
                         break;
                 }
 
-                if((int)lNodes.size()>=N || (int)lNodes.size()==prevSize)
+                if(nNodes>=N || nNodes==prevSize)
                     bFinish = true;
 
             }
@@ -751,119 +733,227 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
     }
 
     // Retain the best point in each node
-    vector<cv::KeyPoint> vResultKeys;
+    vResultKeys.clear();
     vResultKeys.reserve(nfeatures);
-    for(list<ExtractorNode>::iterator lit=lNodes.begin(); lit!=lNodes.end(); lit++)
+    for(int idx=first; idx>=0; idx=vNodes[idx].next)
     {
-        vector<cv::KeyPoint> &vNodeKeys = lit->vKeys;
-        cv::KeyPoint* pKP = &vNodeKeys[0];
+        const ExtractorNode &node = vNodes[idx];
+        const cv::KeyPoint* pKP = &vToDistributeKeys[arena.vKeyIdx[node.iniKey]];
         float maxResponse = pKP->response;
 
-        for(size_t k=1;k<vNodeKeys.size();k++)
+        for(int k=node.iniKey+1;k<node.endKey;k++)
         {
-            if(vNodeKeys[k].response>maxResponse)
+            const cv::KeyPoint &kp = vToDistributeKeys[arena.vKeyIdx[k]];
+            if(kp.response>maxResponse)
             {
-                pKP = &vNodeKeys[k];
-                maxResponse = vNodeKeys[k].response;
+                pKP = &kp;
+                maxResponse = kp.response;
             }
         }
 
         vResultKeys.push_back(*pKP);
     }
-
-    return vResultKeys;
 }
 
-void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
-{
-    allKeypoints.resize(nlevels);
+const float FAST_CELL_SIZE = 30;
 
-    const float W = 30;
+int ORBextractor::GetCellRows(const int level)
+{
+    const int minBorderY = EDGE_THRESHOLD-3;
+    const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+    return (maxBorderY-minBorderY)/FAST_CELL_SIZE;
+}
 
-    for (int level = 0; level < nlevels; ++level)
+// Keeps the corners of a cell that pass threshold and are strict maxima of their 3x3 neighbourhood.
+// Neighbours outside the cell window are ignored, as cv::FAST does when run on the window alone.
+static void AddCellMaxima(const Mat& scores, const vector<Point>& vCorners, const Rect& window, const int threshold,
+                          const Point& origin, vector<KeyPoint>& vKeys)
+{
+    for(vector<Point>::const_iterator vit=vCorners.begin(); vit!=vCorners.end(); vit++)
     {
-        const int minBorderX = EDGE_THRESHOLD-3;
-        const int minBorderY = minBorderX;
-        const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
-        const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+        const Point& p = *vit;
+        const int score = scores.at<uchar>(p.y, p.x);
+        if(score<threshold)
+            continue;
 
-        vector<cv::KeyPoint> vToDistributeKeys;
-        vToDistributeKeys.reserve(nfeatures*10);
+        bool bMax = true;
+        for(int y=max(p.y-1, window.y); y<=min(p.y+1, window.y+window.height-1) && bMax; y++)
+        {
+            const uchar* row = scores.ptr<uchar>(y);
+            for(int x=max(p.x-1, window.x); x<=min(p.x+1, window.x+window.width-1); x++)
+            {
+                if((x!=p.x || y!=p.y) && row[x]>=score)
+                {
+                    bMax = false;
+                    break;
+                }
+            }
+        }
 
-        const float width = (maxBorderX-minBorderX);
-        const float height = (maxBorderY-minBorderY);
+        if(bMax)
+            vKeys.push_back(KeyPoint((float)(p.x-origin.x), (float)(p.y-origin.y), 7.f, -1, (float)score));
+    }
+}
 
-        const int nCols = width/W;
-        const int nRows = height/W;
-        const int wCell = ceil(width/nCols);
-        const int hCell = ceil(height/nRows);
+void ORBextractor::ComputeFASTInRows(const int level, const int iniRow, const int endRow, vector<KeyPoint>& vKeys,
+                                     vector<int>& vRowCorners, vector<vector<Point> >& vCellCorners)
+{
+    const int minBorderX = EDGE_THRESHOLD-3;
+    const int minBorderY = minBorderX;
+    const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
+    const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+
+    const float width = (maxBorderX-minBorderX);
+    const float height = (maxBorderY-minBorderY);
+
+    const int nCols = width/FAST_CELL_SIZE;
+    const int nRows = height/FAST_CELL_SIZE;
+    const int wCell = ceil(width/nCols);
+    const int hCell = ceil(height/nRows);
 #ifndef _BAR_
-        for(int i=0; i<nRows; i++)
-        {
-            const float iniY =minBorderY+i*hCell;
-            float maxY = iniY+hCell+6;
+    // Each cell window (cell plus 3 pixels of FAST border) used to be passed to cv::FAST, which only
+    // reports corners 3 pixels inside the window. Those inner areas tile the level without overlap,
+    // so the rows are scanned once at the lowest threshold and the corners bucketed per cell.
+    // The iniThFAST/minThFAST fallback of a cell is then decided from the stored scores.
+    const Mat& image = mvImagePyramid[level];
+    Mat& scores = mvFASTScores[level];
+    const int scanThreshold = min(iniThFAST, minThFAST);
+    const int iniScanX = minBorderX+3;
+    const int endScanX = maxBorderX-3;
+    const Point origin(minBorderX, minBorderY);
+
+    vRowCorners.resize(image.cols);
+    if((int)vCellCorners.size()<nCols)
+        vCellCorners.resize(nCols);
+
+    for(int i=iniRow; i<endRow; i++)
+    {
+        const int iniY = minBorderY+i*hCell;
+        int maxY = iniY+hCell+6;
 
-            if(iniY>=maxBorderY-3)
-                continue;
-            if(maxY>maxBorderY)
-                maxY = maxBorderY;
+        if(iniY>=maxBorderY-3)
+            continue;
+        if(maxY>maxBorderY)
+            maxY = maxBorderY;
 
-            for(int j=0; j<nCols; j++)
+        for(int j=0; j<nCols; j++)
+            vCellCorners[j].clear();
+
+        for(int y=iniY+3; y<maxY-3; y++)
+        {
+            const int nCorners = FASTScoreRow(image.ptr<uchar>(y), (int)image.step, iniScanX, endScanX, scanThreshold,
+                                              scores.ptr<uchar>(y), &vRowCorners[0]);
+            for(int k=0; k<nCorners; k++)
             {
-                const float iniX =minBorderX+j*wCell;
-                float maxX = iniX+wCell+6;
-                if(iniX>=maxBorderX-6)
-                    continue;
-                if(maxX>maxBorderX)
-                    maxX = maxBorderX;
+                const int x = vRowCorners[k];
+                vCellCorners[(x-iniScanX)/wCell].push_back(Point(x,y));
+            }
+        }
 
-                vector<cv::KeyPoint> vKeysCell;
-                FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                     vKeysCell,iniThFAST,true);
+        for(int j=0; j<nCols; j++)
+        {
+            if(vCellCorners[j].empty())
+                continue;
 
-                if(vKeysCell.empty())
-                {
-                    FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                         vKeysCell,minThFAST,true);
-                }
+            const int iniX = minBorderX+j*wCell;
+            const int maxX = min(iniX+wCell+6, maxBorderX);
+            const Rect window(iniX+3, iniY+3, maxX-iniX-6, maxY-iniY-6);
 
-                if(!vKeysCell.empty())
-                {
-                    for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
-                    {
-                        (*vit).pt.x+=j*wCell;
-                        (*vit).pt.y+=i*hCell;
-                        vToDistributeKeys.push_back(*vit);
-                    }
-                }
+            const size_t nKeys = vKeys.size();
+            AddCellMaxima(scores, vCellCorners[j], window, iniThFAST, origin, vKeys);
 
-            }
+            if(vKeys.size()==nKeys)
+                AddCellMaxima(scores, vCellCorners[j], window, minThFAST, origin, vKeys);
         }
+    }
 #else
-        cv::FAST(mvImagePyramid[level].rowRange(minBorderY, maxBorderY).colRange(minBorderX, maxBorderX), vToDistributeKeys, minThFAST, true);
+    if(iniRow==0)
+        cv::FAST(mvImagePyramid[level].rowRange(minBorderY, maxBorderY).colRange(minBorderX, maxBorderX), vKeys, minThFAST, true);
 #endif
-        vector<KeyPoint> & keypoints = allKeypoints[level];
-        keypoints.reserve(nfeatures);
+}
 
-        keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
-                                      minBorderY, maxBorderY,mnFeaturesPerLevel[level], level);
+void ORBextractor::DistributeLevel(const int level, const vector<KeyPoint>& vToDistributeKeys, vector<KeyPoint>& keypoints)
+{
+    const int minBorderX = EDGE_THRESHOLD-3;
+    const int minBorderY = minBorderX;
+    const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
+    const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
 
-        const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+    keypoints.reserve(nfeatures);
 
-        // Add border to coordinates and scale information
-        const int nkps = keypoints.size();
-        for(int i=0; i<nkps ; i++)
-        {
-            keypoints[i].pt.x+=minBorderX;
-            keypoints[i].pt.y+=minBorderY;
-            keypoints[i].octave=level;
-            keypoints[i].size = scaledPatchSize;
-        }
+    DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
+                      minBorderY, maxBorderY,mnFeaturesPerLevel[level], level, keypoints);
+
+    const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+
+    // Add border to coordinates and scale information
+    const int nkps = keypoints.size();
+    for(int i=0; i<nkps ; i++)
+    {
+        keypoints[i].pt.x+=minBorderX;
+        keypoints[i].pt.y+=minBorderY;
+        keypoints[i].octave=level;
+        keypoints[i].size = scaledPatchSize;
     }
 
     // compute orientations
+    computeOrientation(mvImagePyramid[level], keypoints, umax);
+}
+
+void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
+{
+    allKeypoints.resize(nlevels);
+
     for (int level = 0; level < nlevels; ++level)
-        computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
+        mvToDistributeKeys[level].clear();
+
+    if(!mpTaskPool)
+    {
+        mvRowCorners.resize(1);
+        mvCellCorners.resize(1);
+        for (int level = 0; level < nlevels; ++level)
+        {
+            ComputeFASTInRows(level, 0, GetCellRows(level), mvToDistributeKeys[level], mvRowCorners[0], mvCellCorners[0]);
+            DistributeLevel(level, mvToDistributeKeys[level], allKeypoints[level]);
+        }
+        return;
+    }
+
+    // Level 0 holds about a third of the pixels, split it in row bands so it does not
+    // dominate. Bands are concatenated in row order, giving the serial keypoint order.
+    const int nLevel0Rows = GetCellRows(0);
+    const int nBands = max(1, min(mpTaskPool->GetNumThreads(), nLevel0Rows));
+    const int nTasks = nBands + nlevels - 1;
+    if((int)mvBandKeys.size() < nBands)
+        mvBandKeys.resize(nBands);
+    if((int)mvRowCorners.size() < nTasks)
+    {
+        mvRowCorners.resize(nTasks);
+        mvCellCorners.resize(nTasks);
+    }
+
+    mpTaskPool->ParallelFor(nTasks, [&](int task)
+    {
+        if(task < nBands)
+        {
+            mvBandKeys[task].clear();
+            ComputeFASTInRows(0, task*nLevel0Rows/nBands, (task+1)*nLevel0Rows/nBands, mvBandKeys[task],
+                              mvRowCorners[task], mvCellCorners[task]);
+        }
+        else
+        {
+            const int level = task - nBands + 1;
+            ComputeFASTInRows(level, 0, GetCellRows(level), mvToDistributeKeys[level], mvRowCorners[task], mvCellCorners[task]);
+        }
+    });
+
+    for(int b=0; b<nBands; b++)
+        mvToDistributeKeys[0].insert(mvToDistributeKeys[0].end(), mvBandKeys[b].begin(), mvBandKeys[b].end());
+
+    mpTaskPool->ParallelFor(nlevels, [&](int level)
+    {
+        DistributeLevel(level, mvToDistributeKeys[level], allKeypoints[level]);
+    });
 }
 
 void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allKeypoints)
@@ -1070,7 +1160,7 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
     //std::cout << "pyramid: " << get_time_diff2(start, end) << "\n";
 
 
-    vector < vector<KeyPoint> > allKeypoints;
+    vector < vector<KeyPoint> >& allKeypoints = mvAllKeypoints;
     start = get_time2();
     ComputeKeyPointsOctTree(allKeypoints);
     end = get_time2();
@@ -1093,35 +1183,29 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
     _keypoints.clear();
     _keypoints.reserve(nkeypoints);
 
-    int offset = 0;
-    uint total_t = 0;
-    uint total_desc = 0;
-    start = get_time2();
+    vector<int>& vLevelOffsets = mvLevelOffsets;
+    vLevelOffsets[0] = 0;
     for (int level = 0; level < nlevels; ++level)
+        vLevelOffsets[level+1] = vLevelOffsets[level] + (int)allKeypoints[level].size();
+
+    // Every level writes its own rows of the descriptor matrix
+    auto computeLevelDescriptors = [&](int level)
     {
         vector<KeyPoint>& keypoints = allKeypoints[level];
         int nkeypointsLevel = (int)keypoints.size();
 
         if(nkeypointsLevel==0)
-            continue;
+            return;
 
-        // preprocess the resized image
-        Mat workingMat = mvImagePyramid[level].clone();
-        auto start2 = get_time2();
-        GaussianBlur(workingMat, workingMat, Size(5, 5), 2, 2, BORDER_REFLECT_101);            
+        // preprocess the resized image. BORDER_ISOLATED keeps the pyramid border out of the
+        // filter, so this matches blurring a standalone copy of the level.
+        Mat &workingMat = mvBlurredPyramid[level];
+        GaussianBlur(mvImagePyramid[level], workingMat, Size(5, 5), 2, 2, BORDER_REFLECT_101+BORDER_ISOLATED);
         //boxFilter(workingMat, workingMat, workingMat.depth(), Size(5,5), Point(-1, -1), true, BORDER_REFLECT101);
-        auto end2 = get_time2();
-        total_t += get_time_diff2(start2, end2);
-        //std::cout << "curr total: " << total_t << "\n";
 
         // Compute the descriptors
-        Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-        start2 = get_time2();
+        Mat desc = descriptors.rowRange(vLevelOffsets[level], vLevelOffsets[level+1]);
         computeDescriptors(workingMat, keypoints, desc, pattern);
-        end2 = get_time2();
-        total_desc += get_time_diff2(start2, end2);
-
-        offset += nkeypointsLevel;
 
         // Scale keypoint coordinates
         if (level != 0)
@@ -1131,28 +1215,50 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
                  keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
                 keypoint->pt *= scale;
         }
-        // And add the keypoints to the output
-        _keypoints.insert(_keypoints.end(), keypoints.begin(), keypoints.end());
+    };
+
+    start = get_time2();
+    if(mpTaskPool)
+        mpTaskPool->ParallelFor(nlevels, computeLevelDescriptors);
+    else
+    {
+        for (int level = 0; level < nlevels; ++level)
+            computeLevelDescriptors(level);
     }
+
+    // And add the keypoints to the output
+    for (int level = 0; level < nlevels; ++level)
+        _keypoints.insert(_keypoints.end(), allKeypoints[level].begin(), allKeypoints[level].end());
     end = get_time2();
     //std::cout << "descriptors: " << get_time_diff2(start, end) << "\n";
-    //std::cout << "only descriptors: " << total_desc << "\n";
 }
 
 void ORBextractor::ComputePyramid(cv::Mat image)
 {
+    // Size the bordered level buffers once per image size
+    if(image.size()!=mImageSize)
+    {
+        mImageSize = image.size();
+        for (int level = 0; level < nlevels; ++level)
+        {
+            float scale = mvInvScaleFactor[level];
+            Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
+            Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
+            mvPyramidBuffers[level].create(wholeSize, image.type());
+            mvImagePyramid[level] = mvPyramidBuffers[level](Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
+            mvBlurredPyramid[level].create(sz, image.type());
+            mvFASTScores[level].create(sz, CV_8U);
+        }
+    }
+
     for (int level = 0; level < nlevels; ++level)
     {
-        float scale = mvInvScaleFactor[level];
-        Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
-        Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
-        Mat temp(wholeSize, image.type()), masktemp;
-        mvImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
+        Mat &temp = mvPyramidBuffers[level];
 
         // Compute the resized image
         if( level != 0 )
         {
-            resize(mvImagePyramid[level-1], mvImagePyramid[level], sz, 0, 0, INTER_LINEAR);
+            resize(mvImagePyramid[level-1], mvImagePyramid[level], mvImagePyramid[level].size(), 0, 0, INTER_LINEAR);
 
             copyMakeBorder(mvImagePyramid[level], temp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
                            BORDER_REFLECT_101+BORDER_ISOLATED);            
@@ -38,10 +38,17 @@ const int ORBmatcher::TH_HIGH = 100;
 const int ORBmatcher::TH_LOW = 50;
 const int ORBmatcher::HISTO_LENGTH = 30;
 
+bool ORBmatcher::mbBatchDistances = true;
+
 ORBmatcher::ORBmatcher(float nnratio, bool checkOri): mfNNratio(nnratio), mbCheckOrientation(checkOri)
 {
 }
 
+void ORBmatcher::SetBatchDistances(bool bBatch)
+{
+    mbBatchDistances = bBatch;
+}
+
 int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, const float th)
 {
     int nmatches=0;
@@ -65,13 +72,14 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
         if(bFactor)
             r*=th;
 
-        const vector<size_t> vIndices =
-                F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
+        F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel,mvIndices);
+        const vector<size_t> &vIndices = mvIndices;
 
         if(vIndices.empty())
             continue;
 
-        const cv::Mat MPdescriptor = pMP->GetDescriptor();
+        const ORBDescriptor MPdescriptor = pMP->GetDescriptor();
+        const vector<int> &vDistances = ComputeDistances(MPdescriptor,F.mDescriptors,vIndices);
 
         int bestDist=256;
         int bestLevel= -1;
@@ -95,9 +103,7 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
                     continue;
             }
 
-            const cv::Mat &d = F.mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(MPdescriptor,d);
+            const int dist = vDistances[vit-vIndices.begin()];
 
             if(dist<bestDist)
             {
@@ -158,6 +164,7 @@ bool ORBmatcher::CheckDistEpipolarLine(const cv::KeyPoint &kp1,const cv::KeyPoin
 
 int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPointMatches)
 {
+    KeyFramePayloadPin pin(pKF);
     const vector<MapPoint*> vpMapPointsKF = pKF->GetMapPointMatches();
 
     //cout << "SearchByBoW: ref KF points size = " << vpMapPointsKF.size();
@@ -184,8 +191,8 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
     {
         if(KFit->first == Fit->first)
         {
-            const vector<unsigned int> vIndicesKF = KFit->second;
-            const vector<unsigned int> vIndicesF = Fit->second;
+            const vector<unsigned int> &vIndicesKF = KFit->second;
+            const vector<unsigned int> &vIndicesF = Fit->second;
 
             for(size_t iKF=0; iKF<vIndicesKF.size(); iKF++)
             {
@@ -199,7 +206,8 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                 if(pMP->isBad())
                     continue;                
 
-                const cv::Mat &dKF= pKF->mDescriptors.row(realIdxKF);
+                const ORBDescriptor &dKF= pKF->mDescriptors[realIdxKF];
+                const vector<int> &vDistances = ComputeDistances(dKF,F.mDescriptors,vIndicesF);
 
                 int bestDist1=256;
                 int bestIdxF =-1 ;
@@ -212,9 +220,7 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                     if(vpMapPointMatches[realIdxF])
                         continue;
 
-                    const cv::Mat &dF = F.mDescriptors.row(realIdxF);
-
-                    const int dist =  DescriptorDistance(dKF,dF);
+                    const int dist = vDistances[iF];
 
                     if(dist<bestDist1)
                     {
@@ -292,6 +298,8 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
 
 int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapPoint*> &vpPoints, vector<MapPoint*> &vpMatched, int th)
 {
+    KeyFramePayloadPin pin(pKF);
+
     // Get Calibration Parameters for later projection
     const float &fx = pKF->fx;
     const float &fy = pKF->fy;
@@ -362,13 +370,15 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
         // Search in a radius
         const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF->GetFeaturesInArea(u,v,radius);
+        pKF->GetFeaturesInArea(u,v,radius,mvIndices);
+        const vector<size_t> &vIndices = mvIndices;
 
         if(vIndices.empty())
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor();
+        const vector<int> &vDistances = ComputeDistances(dMP,pKF->mDescriptors,vIndices);
 
         int bestDist = 256;
         int bestIdx = -1;
@@ -383,9 +393,7 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
+            const int dist = vDistances[vit-vIndices.begin()];
 
             if(dist<bestDist)
             {
@@ -425,24 +433,24 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
         if(level1>0)
             continue;
 
-        vector<size_t> vIndices2 = F2.GetFeaturesInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, windowSize,level1,level1);
+        F2.GetFeaturesInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, windowSize,level1,level1,mvIndices);
+        const vector<size_t> &vIndices2 = mvIndices;
 
         if(vIndices2.empty())
             continue;
 
-        cv::Mat d1 = F1.mDescriptors.row(i1);
+        const ORBDescriptor &d1 = F1.mDescriptors[i1];
+        const vector<int> &vDistances = ComputeDistances(d1,F2.mDescriptors,vIndices2);
 
         int bestDist = INT_MAX;
         int bestDist2 = INT_MAX;
         int bestIdx2 = -1;
 
-        for(vector<size_t>::iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
+        for(vector<size_t>::const_iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
         {
             size_t i2 = *vit;
 
-            cv::Mat d2 = F2.mDescriptors.row(i2);
-
-            int dist = DescriptorDistance(d1,d2);
+            int dist = vDistances[vit-vIndices2.begin()];
 
             if(vMatchedDistance[i2]<=dist)
                 continue;
@@ -524,15 +532,17 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
 
 int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &vpMatches12)
 {
+    KeyFramePayloadPin pin1(pKF1);
+    KeyFramePayloadPin pin2(pKF2);
     const vector<cv::KeyPoint> &vKeysUn1 = pKF1->mvKeysUn;
     const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
     const vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
-    const cv::Mat &Descriptors1 = pKF1->mDescriptors;
+    const DescriptorArray &Descriptors1 = pKF1->mDescriptors;
 
     const vector<cv::KeyPoint> &vKeysUn2 = pKF2->mvKeysUn;
     const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
     const vector<MapPoint*> vpMapPoints2 = pKF2->GetMapPointMatches();
-    const cv::Mat &Descriptors2 = pKF2->mDescriptors;
+    const DescriptorArray &Descriptors2 = pKF2->mDescriptors;
 
     vpMatches12 = vector<MapPoint*>(vpMapPoints1.size(),static_cast<MapPoint*>(NULL));
     vector<bool> vbMatched2(vpMapPoints2.size(),false);
@@ -564,7 +574,8 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
                 if(pMP1->isBad())
                     continue;
 
-                const cv::Mat &d1 = Descriptors1.row(idx1);
+                const ORBDescriptor &d1 = Descriptors1[idx1];
+                const vector<int> &vDistances = ComputeDistances(d1,Descriptors2,f2it->second);
 
                 int bestDist1=256;
                 int bestIdx2 =-1 ;
@@ -582,9 +593,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
                     if(pMP2->isBad())
                         continue;
 
-                    const cv::Mat &d2 = Descriptors2.row(idx2);
-
-                    int dist = DescriptorDistance(d1,d2);
+                    int dist = vDistances[i2];
 
                     if(dist<bestDist1)
                     {
@@ -660,6 +669,8 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
 int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F12,
                                        vector<pair<size_t, size_t> > &vMatchedPairs, const bool bOnlyStereo)
 {    
+    KeyFramePayloadPin pin1(pKF1);
+    KeyFramePayloadPin pin2(pKF2);
     const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
     const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
 
@@ -713,7 +724,8 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
                 
                 const cv::KeyPoint &kp1 = pKF1->mvKeysUn[idx1];
                 
-                const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
+                const ORBDescriptor &d1 = pKF1->mDescriptors[idx1];
+                const vector<int> &vDistances = ComputeDistances(d1,pKF2->mDescriptors,f2it->second);
                 
                 int bestDist = TH_LOW;
                 int bestIdx2 = -1;
@@ -734,9 +746,7 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
                         if(!bStereo2)
                             continue;
                     
-                    const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
-                    
-                    const int dist = DescriptorDistance(d1,d2);
+                    const int dist = vDistances[i2];
                     
                     if(dist>TH_LOW || dist>bestDist)
                         continue;
@@ -827,6 +837,8 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
 
 int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const float th)
 {
+    KeyFramePayloadPin pin(pKF);
+
     cv::Mat Rcw = pKF->GetRotation();
     cv::Mat tcw = pKF->GetTranslation();
 
@@ -892,14 +904,16 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
         // Search in a radius
         const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF->GetFeaturesInArea(u,v,radius);
+        pKF->GetFeaturesInArea(u,v,radius,mvIndices);
+        const vector<size_t> &vIndices = mvIndices;
 
         if(vIndices.empty())
             continue;
 
         // Match to the most similar keypoint in the radius
 
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor();
+        const vector<int> &vDistances = ComputeDistances(dMP,pKF->mDescriptors,vIndices);
 
         int bestDist = 256;
         int bestIdx = -1;
@@ -940,9 +954,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
                     continue;
             }
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
+            const int dist = vDistances[vit-vIndices.begin()];
 
             if(dist<bestDist)
             {
@@ -979,6 +991,8 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
 
 int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint)
 {
+    KeyFramePayloadPin pin(pKF);
+
     // Get Calibration Parameters for later projection
     const float &fx = pKF->fx;
     const float &fy = pKF->fy;
@@ -1051,14 +1065,16 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
         // Search in a radius
         const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF->GetFeaturesInArea(u,v,radius);
+        pKF->GetFeaturesInArea(u,v,radius,mvIndices);
+        const vector<size_t> &vIndices = mvIndices;
 
         if(vIndices.empty())
             continue;
 
         // Match to the most similar keypoint in the radius
 
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor();
+        const vector<int> &vDistances = ComputeDistances(dMP,pKF->mDescriptors,vIndices);
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
@@ -1070,9 +1086,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-            int dist = DescriptorDistance(dMP,dKF);
+            int dist = vDistances[vit-vIndices.begin()];
 
             if(dist<bestDist)
             {
@@ -1105,6 +1119,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
 int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &vpMatches12,
                              const float &s12, const cv::Mat &R12, const cv::Mat &t12, const float th)
 {
+    KeyFramePayloadPin pin1(pKF1);
+    KeyFramePayloadPin pin2(pKF2);
+
     const float &fx = pKF1->fx;
     const float &fy = pKF1->fy;
     const float &cx = pKF1->cx;
@@ -1191,13 +1208,15 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         // Search in a radius
         const float radius = th*pKF2->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF2->GetFeaturesInArea(u,v,radius);
+        pKF2->GetFeaturesInArea(u,v,radius,mvIndices);
+        const vector<size_t> &vIndices = mvIndices;
 
         if(vIndices.empty())
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor();
+        const vector<int> &vDistances = ComputeDistances(dMP,pKF2->mDescriptors,vIndices);
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
@@ -1210,9 +1229,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF2->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
+            const int dist = vDistances[vit-vIndices.begin()];
 
             if(dist<bestDist)
             {
@@ -1271,13 +1288,15 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         // Search in a radius of 2.5*sigma(ScaleLevel)
         const float radius = th*pKF1->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF1->GetFeaturesInArea(u,v,radius);
+        pKF1->GetFeaturesInArea(u,v,radius,mvIndices);
+        const vector<size_t> &vIndices = mvIndices;
 
         if(vIndices.empty())
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor();
+        const vector<int> &vDistances = ComputeDistances(dMP,pKF1->mDescriptors,vIndices);
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
@@ -1290,9 +1309,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF1->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
+            const int dist = vDistances[vit-vIndices.begin()];
 
             if(dist<bestDist)
             {
@@ -1383,19 +1400,19 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                 // Search in a window. Size depends on scale
                 float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
 
-                vector<size_t> vIndices2;
-
                 if(bForward)
-                    vIndices2 = CurrentFrame.GetFeaturesInArea(u,v, radius, nLastOctave);
+                    CurrentFrame.GetFeaturesInArea(u,v, radius, nLastOctave, -1, mvIndices);
                 else if(bBackward)
-                    vIndices2 = CurrentFrame.GetFeaturesInArea(u,v, radius, 0, nLastOctave);
+                    CurrentFrame.GetFeaturesInArea(u,v, radius, 0, nLastOctave, mvIndices);
                 else
-                    vIndices2 = CurrentFrame.GetFeaturesInArea(u,v, radius, nLastOctave-1, nLastOctave+1);
+                    CurrentFrame.GetFeaturesInArea(u,v, radius, nLastOctave-1, nLastOctave+1, mvIndices);
+                const vector<size_t> &vIndices2 = mvIndices;
 
                 if(vIndices2.empty())
                     continue;
 
-                const cv::Mat dMP = pMP->GetDescriptor();
+                const ORBDescriptor dMP = pMP->GetDescriptor();
+                const vector<int> &vDistances = ComputeDistances(dMP,CurrentFrame.mDescriptors,vIndices2);
 
                 int bestDist = 256;
                 int bestIdx2 = -1;
@@ -1415,9 +1432,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                             continue;
                     }
 
-                    const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                    const int dist = DescriptorDistance(dMP,d);
+                    const int dist = vDistances[vit-vIndices2.begin()];
 
                     if(dist<bestDist)
                     {
@@ -1528,12 +1543,14 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
                 // Search in a window
                 const float radius = th*CurrentFrame.mvScaleFactors[nPredictedLevel];
 
-                const vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel-1, nPredictedLevel+1);
+                CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel-1, nPredictedLevel+1, mvIndices);
+                const vector<size_t> &vIndices2 = mvIndices;
 
                 if(vIndices2.empty())
                     continue;
 
-                const cv::Mat dMP = pMP->GetDescriptor();
+                const ORBDescriptor dMP = pMP->GetDescriptor();
+                const vector<int> &vDistances = ComputeDistances(dMP,CurrentFrame.mDescriptors,vIndices2);
 
                 int bestDist = 256;
                 int bestIdx2 = -1;
@@ -1544,9 +1561,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
                     if(CurrentFrame.mvpMapPoints[i2])
                         continue;
 
-                    const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                    const int dist = DescriptorDistance(dMP,d);
+                    const int dist = vDistances[vit-vIndices2.begin()];
 
                     if(dist<bestDist)
                     {
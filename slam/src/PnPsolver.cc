@@ -64,47 +64,27 @@ namespace ORB_SLAM2
 {
 
 
-PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches):
+PnPsolver::PnPsolver(const vector<cv::Point2f> &vP2D, const vector<float> &vSigma2, const vector<cv::Point3f> &vP3Dw,
+                     float fx, float fy, float cx, float cy):
     pws(0), us(0), alphas(0), pcs(0), maximum_number_of_correspondences(0), number_of_correspondences(0), mnInliersi(0),
     mnIterations(0), mnBestInliers(0), N(0)
 {
-    mvpMapPointMatches = vpMapPointMatches;
-    mvP2D.reserve(F.mvpMapPoints.size());
-    mvSigma2.reserve(F.mvpMapPoints.size());
-    mvP3Dw.reserve(F.mvpMapPoints.size());
-    mvKeyPointIndices.reserve(F.mvpMapPoints.size());
-    mvAllIndices.reserve(F.mvpMapPoints.size());
-
-    int idx=0;
-    for(size_t i=0, iend=vpMapPointMatches.size(); i<iend; i++)
+    mnMatches = vP2D.size();
+    mvP2D = vP2D;
+    mvSigma2 = vSigma2;
+    mvP3Dw = vP3Dw;
+    mvKeyPointIndices.resize(mnMatches);
+    mvAllIndices.resize(mnMatches);
+    for(size_t i=0; i<mnMatches; i++)
     {
-        MapPoint* pMP = vpMapPointMatches[i];
-
-        if(pMP)
-        {
-            if(!pMP->isBad())
-            {
-                const cv::KeyPoint &kp = F.mvKeysUn[i];
-
-                mvP2D.push_back(kp.pt);
-                mvSigma2.push_back(F.mvLevelSigma2[kp.octave]);
-
-                cv::Mat Pos = pMP->GetWorldPos();
-                mvP3Dw.push_back(cv::Point3f(Pos.at<float>(0),Pos.at<float>(1), Pos.at<float>(2)));
-
-                mvKeyPointIndices.push_back(i);
-                mvAllIndices.push_back(idx);               
-
-                idx++;
-            }
-        }
+        mvKeyPointIndices[i] = i;
+        mvAllIndices[i] = i;
     }
 
-    // Set camera calibration parameters
-    fu = F.fx;
-    fv = F.fy;
-    uc = F.cx;
-    vc = F.cy;
+    fu = fx;
+    fv = fy;
+    uc = cx;
+    vc = cy;
 
     SetRansacParameters();
 }
@@ -228,7 +208,7 @@ cv::Mat PnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInlie
             if(Refine())
             {
                 nInliers = mnRefinedInliers;
-                vbInliers = vector<bool>(mvpMapPointMatches.size(),false);
+                vbInliers = vector<bool>(mnMatches,false);
                 for(int i=0; i<N; i++)
                 {
                     if(mvbRefinedInliers[i])
@@ -246,7 +226,7 @@ cv::Mat PnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInlie
         if(mnBestInliers>=mRansacMinInliers)
         {
             nInliers=mnBestInliers;
-            vbInliers = vector<bool>(mvpMapPointMatches.size(),false);
+            vbInliers = vector<bool>(mnMatches,false);
             for(int i=0; i<N; i++)
             {
                 if(mvbBestInliers[i])
@@ -0,0 +1,55 @@
+#include "PnPsolver.h"
+#include "MapPoint.h"
+#include "Frame.h"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches):
+    pws(0), us(0), alphas(0), pcs(0), maximum_number_of_correspondences(0), number_of_correspondences(0), mnInliersi(0),
+    mnIterations(0), mnBestInliers(0), N(0)
+{
+    mnMatches = vpMapPointMatches.size();
+    mvP2D.reserve(F.mvpMapPoints.size());
+    mvSigma2.reserve(F.mvpMapPoints.size());
+    mvP3Dw.reserve(F.mvpMapPoints.size());
+    mvKeyPointIndices.reserve(F.mvpMapPoints.size());
+    mvAllIndices.reserve(F.mvpMapPoints.size());
+
+    int idx=0;
+    for(size_t i=0, iend=vpMapPointMatches.size(); i<iend; i++)
+    {
+        MapPoint* pMP = vpMapPointMatches[i];
+
+        if(pMP)
+        {
+            if(!pMP->isBad())
+            {
+                const cv::KeyPoint &kp = F.mvKeysUn[i];
+
+                mvP2D.push_back(kp.pt);
+                mvSigma2.push_back(F.mvLevelSigma2[kp.octave]);
+
+                cv::Mat Pos = pMP->GetWorldPos();
+                mvP3Dw.push_back(cv::Point3f(Pos.at<float>(0),Pos.at<float>(1), Pos.at<float>(2)));
+
+                mvKeyPointIndices.push_back(i);
+                mvAllIndices.push_back(idx);               
+
+                idx++;
+            }
+        }
+    }
+
+    // Set camera calibration parameters
+    fu = F.fx;
+    fv = F.fy;
+    uc = F.cx;
+    vc = F.cy;
+
+    SetRansacParameters();
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,340 @@
+#include "RaspberryMapFile.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "MapFile.h"
+#include "Converter.h"
+
+#include <iostream>
+#include <fstream>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+static const float RASPBERRY_MAP_QMAX = 32767.0f;
+// Fraction of the map points left out at each end of every axis when choosing the position scale,
+// and margin added around the rest, as a fraction of its extent
+static const float RASPBERRY_MAP_CLIP = 0.001f;
+static const float RASPBERRY_MAP_MARGIN = 0.25f;
+
+static int16_t Quantize(float v, float scale)
+{
+    const float q = roundf(v/scale);
+    return (int16_t)max(-RASPBERRY_MAP_QMAX, min(RASPBERRY_MAP_QMAX, q));
+}
+
+static uint64_t Align(vector<char> &buffer)
+{
+    buffer.resize((buffer.size()+RASPBERRY_MAP_ALIGNMENT-1)/RASPBERRY_MAP_ALIGNMENT*RASPBERRY_MAP_ALIGNMENT, 0);
+    return buffer.size();
+}
+
+template<class T>
+static void Append(vector<char> &buffer, const T* pData, size_t n)
+{
+    const char* p = reinterpret_cast<const char*>(pData);
+    buffer.insert(buffer.end(), p, p+n*sizeof(T));
+}
+
+static void AppendVarint(vector<char> &buffer, uint64_t v)
+{
+    while(v>=0x80)
+    {
+        buffer.push_back((char)((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    buffer.push_back((char)v);
+}
+
+bool RaspberryMapFile::Save(Map* pMap, const string &filename, const ORBVocabulary* pVoc)
+{
+    vector<KeyFrame*> vpKFs;
+    const vector<KeyFrame*> vpAllKFs = pMap->GetAllKeyFrames();
+    for(size_t i=0; i<vpAllKFs.size(); i++)
+    {
+        if(!vpAllKFs[i]->isBad())
+            vpKFs.push_back(vpAllKFs[i]);
+    }
+    return Save(vpKFs, filename, pVoc);
+}
+
+bool RaspberryMapFile::Save(const vector<KeyFrame*> &vpKFs, const string &filename, const ORBVocabulary* pVoc)
+{
+    RaspberryMapCapture capture;
+    Capture(vpKFs, capture);
+    return Write(capture, filename, pVoc);
+}
+
+void RaspberryMapFile::Capture(const vector<KeyFrame*> &vpKFsIn, RaspberryMapCapture &c)
+{
+    vector<KeyFrame*> &vpKFs = c.vpKFs;
+    vpKFs = vpKFsIn;
+    sort(vpKFs.begin(), vpKFs.end(), KeyFrame::lId);
+
+    // Good map points matched by each keyframe
+    vector<vector<pair<uint32_t,MapPoint*> > > vvMatches(vpKFs.size());
+    vector<MapPoint*> vpMPs;
+    c.vTcw.resize(vpKFs.size());
+    c.vbBow.resize(vpKFs.size());
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        c.vTcw[i] = pKF->GetPose();
+        c.vbBow[i] = !pKF->mBowVec.empty();
+        const vector<MapPoint*> vpMatches = pKF->GetMapPointMatches();
+        for(size_t k=0; k<vpMatches.size() && k<(size_t)pKF->N; k++)
+        {
+            MapPoint* pMP = vpMatches[k];
+            if(!pMP || pMP->isBad())
+                continue;
+            vvMatches[i].push_back(make_pair((uint32_t)k, pMP));
+            vpMPs.push_back(pMP);
+        }
+    }
+
+    // Every map point once, in id order
+    sort(vpMPs.begin(), vpMPs.end(), [](MapPoint* pMP1, MapPoint* pMP2){ return pMP1->mnId<pMP2->mnId; });
+    vpMPs.erase(unique(vpMPs.begin(), vpMPs.end()), vpMPs.end());
+    unordered_map<MapPoint*,uint32_t> mMPIndices;
+    c.vMPIds.resize(vpMPs.size());
+    c.vPos.resize(vpMPs.size());
+    c.vDescriptors.resize(vpMPs.size());
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        mMPIndices[vpMPs[i]] = i;
+        c.vMPIds[i] = vpMPs[i]->mnId;
+        c.vPos[i] = vpMPs[i]->GetWorldPos();
+        c.vDescriptors[i] = vpMPs[i]->GetDescriptor();
+    }
+
+    c.vvObs.assign(vpKFs.size(), vector<pair<uint32_t,uint32_t> >());
+    for(size_t i=0; i<vvMatches.size(); i++)
+    {
+        c.vvObs[i].reserve(vvMatches[i].size());
+        for(size_t k=0; k<vvMatches[i].size(); k++)
+            c.vvObs[i].push_back(make_pair(vvMatches[i][k].first, mMPIndices[vvMatches[i][k].second]));
+    }
+}
+
+bool RaspberryMapFile::Write(const RaspberryMapCapture &c, const string &filename, const ORBVocabulary* pVoc)
+{
+    const vector<KeyFrame*> &vpKFs = c.vpKFs;
+
+    // Observations with the keypoints still in pixels
+    struct Observation
+    {
+        float x, y, ux, uy;
+        int octave;
+        uint32_t mapPoint;
+    };
+    vector<vector<Observation> > vvObs(vpKFs.size());
+    float maxKeyCoord = 0;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        KeyFramePayloadPin pin(pKF);
+        for(size_t k=0; k<c.vvObs[i].size(); k++)
+        {
+            const uint32_t idx = c.vvObs[i][k].first;
+            if(idx>=pKF->mvKeys.size())
+                continue;
+            const cv::KeyPoint &kp = pKF->mvKeys[idx];
+            const cv::KeyPoint &kpUn = idx<pKF->mvKeysUn.size() ? pKF->mvKeysUn[idx] : kp;
+            Observation obs = {kp.pt.x, kp.pt.y, kpUn.pt.x, kpUn.pt.y, kpUn.octave, c.vvObs[i][k].second};
+            vvObs[i].push_back(obs);
+            maxKeyCoord = max(maxKeyCoord, max(max(fabsf(obs.x), fabsf(obs.y)), max(fabsf(obs.ux), fabsf(obs.uy))));
+        }
+    }
+
+    // BowVectors of the keyframes, computed here for those that had none (e.g. a single keyframe
+    // saved before it was inserted), and the keyframes of every word. A BowVector does not change
+    // once computed.
+    vector<DBoW2::BowVector> vBowVecs(pVoc ? vpKFs.size() : 0);
+    map<uint32_t,vector<uint32_t> > mInvertedFile;
+    for(size_t i=0; i<vBowVecs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        if(c.vbBow[i])
+            vBowVecs[i] = pKF->mBowVec;
+        else
+        {
+            KeyFramePayloadPin pin(pKF);
+            DBoW2::FeatureVector featVec;
+            pVoc->transform(Converter::toDescriptorVector(pKF->mDescriptors.AsMat()), vBowVecs[i], featVec, 4);
+        }
+        for(DBoW2::BowVector::const_iterator vit=vBowVecs[i].begin(); vit!=vBowVecs[i].end(); vit++)
+            mInvertedFile[vit->first].push_back(i);
+    }
+
+    const vector<cv::Mat> &vPos = c.vPos;
+
+    // The position scale covers the map points between the RASPBERRY_MAP_CLIP quantiles of every
+    // axis with a margin, so that a few far outliers (points triangulated at a near infinite depth)
+    // do not set the resolution of the whole map. Points outside are clamped to the border.
+    float minPos[3] = {0, 0, 0}, maxPos[3] = {0, 0, 0};
+    vector<float> vAxis(vPos.size());
+    const size_t nClip = vAxis.empty() ? 0 : (size_t)(RASPBERRY_MAP_CLIP*(vAxis.size()-1));
+    for(int j=0; j<3 && !vAxis.empty(); j++)
+    {
+        for(size_t i=0; i<vPos.size(); i++)
+            vAxis[i] = vPos[i].at<float>(j);
+        const float minAll = *min_element(vAxis.begin(), vAxis.end());
+        const float maxAll = *max_element(vAxis.begin(), vAxis.end());
+        nth_element(vAxis.begin(), vAxis.begin()+nClip, vAxis.end());
+        const float lo = vAxis[nClip];
+        nth_element(vAxis.begin(), vAxis.end()-1-nClip, vAxis.end());
+        const float hi = vAxis[vAxis.size()-1-nClip];
+        const float margin = RASPBERRY_MAP_MARGIN*(hi-lo);
+        minPos[j] = max(minAll, lo-margin);
+        maxPos[j] = min(maxAll, hi+margin);
+    }
+
+    RaspberryMapHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RASPBERRY_MAP_MAGIC, sizeof(header.magic));
+    header.version = RASPBERRY_MAP_VERSION;
+    header.nKeyFrames = vpKFs.size();
+    header.nMapPoints = vPos.size();
+    float halfExtent = 0;
+    for(int j=0; j<3; j++)
+    {
+        header.pointOrigin[j] = 0.5f*(minPos[j]+maxPos[j]);
+        halfExtent = max(halfExtent, 0.5f*(maxPos[j]-minPos[j]));
+    }
+    header.pointScale = halfExtent>0 ? halfExtent/RASPBERRY_MAP_QMAX : 1.0f;
+    header.keyPointScale = maxKeyCoord>0 ? maxKeyCoord/RASPBERRY_MAP_QMAX : 1.0f;
+
+    size_t nClamped = 0;
+    for(size_t i=0; i<vPos.size(); i++)
+    {
+        bool bInside = true;
+        for(int j=0; j<3; j++)
+            bInside = bInside && fabsf(vPos[i].at<float>(j)-header.pointOrigin[j])<=halfExtent;
+        nClamped += !bInside;
+    }
+    cout << filename << ": position resolution " << header.pointScale << ", keypoint resolution "
+         << header.keyPointScale << " px, " << nClamped << " of " << vPos.size() << " map points clamped" << endl;
+    header.vocabularyHash = pVoc ? VocabularyHash(*pVoc) : 0;
+
+    // The arrays follow the header, offsets are from the start of the file
+    vector<char> body(sizeof(header), 0);
+
+    header.keyFramesOffset = Align(body);
+    uint32_t nObservations = 0, nBowWords = 0;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        RaspberryMapKeyFrame r;
+        memset(&r, 0, sizeof(r));
+        cv::Mat Tcw;
+        c.vTcw[i].convertTo(Tcw, CV_32F);
+        for(int j=0; j<9; j++)
+            r.R[j] = Tcw.at<float>(j/3, j%3);
+        for(int j=0; j<3; j++)
+            r.t[j] = Tcw.at<float>(j, 3);
+        r.fx = pKF->fx; r.fy = pKF->fy; r.cx = pKF->cx; r.cy = pKF->cy;
+        r.observationBegin = nObservations;
+        r.nObservations = vvObs[i].size();
+        nObservations += r.nObservations;
+        r.bowBegin = nBowWords;
+        r.nBowWords = i<vBowVecs.size() ? vBowVecs[i].size() : 0;
+        nBowWords += r.nBowWords;
+        Append(body, &r, 1);
+    }
+    header.nObservations = nObservations;
+    header.nBowWords = nBowWords;
+
+    header.observationsOffset = Align(body);
+    for(size_t i=0; i<vvObs.size(); i++)
+    {
+        for(size_t k=0; k<vvObs[i].size(); k++)
+        {
+            const Observation &obs = vvObs[i][k];
+            RaspberryMapObservation r;
+            memset(&r, 0, sizeof(r));
+            r.x = Quantize(obs.x, header.keyPointScale);
+            r.y = Quantize(obs.y, header.keyPointScale);
+            r.ux = Quantize(obs.ux, header.keyPointScale);
+            r.uy = Quantize(obs.uy, header.keyPointScale);
+            r.mapPoint = obs.mapPoint;
+            r.octave = (uint8_t)max(obs.octave, 0);
+            Append(body, &r, 1);
+        }
+    }
+
+    header.pointsOffset = Align(body);
+    for(size_t i=0; i<vPos.size(); i++)
+    {
+        int16_t q[3];
+        for(int j=0; j<3; j++)
+            q[j] = Quantize(vPos[i].at<float>(j)-header.pointOrigin[j], header.pointScale);
+        Append(body, q, 3);
+    }
+
+    header.descriptorsOffset = Align(body);
+    for(size_t i=0; i<c.vDescriptors.size(); i++)
+        Append(body, c.vDescriptors[i].data, sizeof(c.vDescriptors[i].data));
+
+    // BowVectors are ordered by word, the inverted file by word then keyframe index
+    header.bowWordsOffset = Align(body);
+    for(size_t i=0; i<vBowVecs.size(); i++)
+    {
+        for(DBoW2::BowVector::const_iterator vit=vBowVecs[i].begin(); vit!=vBowVecs[i].end(); vit++)
+        {
+            RaspberryMapBowWord r = {vit->first, (float)vit->second};
+            Append(body, &r, 1);
+        }
+    }
+
+    header.invertedWordsOffset = Align(body);
+    uint32_t nInvertedKFs = 0;
+    for(map<uint32_t,vector<uint32_t> >::const_iterator mit=mInvertedFile.begin(); mit!=mInvertedFile.end(); mit++)
+    {
+        RaspberryMapInvertedWord r = {mit->first, nInvertedKFs, (uint32_t)mit->second.size(), 0};
+        nInvertedKFs += r.nKeyFrames;
+        Append(body, &r, 1);
+    }
+    header.nInvertedWords = mInvertedFile.size();
+    header.nInvertedKeyFrames = nInvertedKFs;
+
+    header.invertedKeyFramesOffset = Align(body);
+    for(map<uint32_t,vector<uint32_t> >::const_iterator mit=mInvertedFile.begin(); mit!=mInvertedFile.end(); mit++)
+        Append(body, mit->second.data(), mit->second.size());
+
+    // Both id lists are increasing, the deltas are mostly a single byte
+    header.idsOffset = Align(body);
+    uint64_t lastId = 0;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        AppendVarint(body, vpKFs[i]->mnId-lastId);
+        lastId = vpKFs[i]->mnId;
+    }
+    lastId = 0;
+    for(size_t i=0; i<c.vMPIds.size(); i++)
+    {
+        AppendVarint(body, c.vMPIds[i]-lastId);
+        lastId = c.vMPIds[i];
+    }
+    header.idBytes = body.size()-header.idsOffset;
+
+    header.fileSize = body.size();
+    header.checksum = RaspberryMapChecksum(body.data()+sizeof(header), body.size()-sizeof(header));
+    memcpy(&body[0], &header, sizeof(header));
+
+    ofstream f(filename.c_str(), ios::binary | ios::trunc);
+    if(!f.is_open())
+    {
+        cerr << "Cannot open file: " << filename << endl;
+        return false;
+    }
+    f.write(&body[0], body.size());
+    return f.good();
+}
+
+} //namespace ORB_SLAM
@@ -22,6 +22,12 @@
 
 #include "System.h"
 #include "Converter.h"
+#include "TaskPool.h"
+#include "MapFile.h"
+#include "KeyFrameImageStore.h"
+#include "KeyFramePayloadStore.h"
+#include "MapJournal.h"
+#include "MapFileLoader.h"
 #include <thread>
 #include <pangolin/pangolin.h>
 #include <iomanip>
@@ -87,40 +93,68 @@ namespace ORB_SLAM2 {
             mpMap = new Map();
         }
 
-        if (bReuse) {
-            LoadMap(mapName);
-
-            //mpKeyFrameDatabase->set_vocab(mpVocabulary);
-
-            vector<ORB_SLAM2::KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
-            for (vector<ORB_SLAM2::KeyFrame *>::iterator it = vpKFs.begin(); it != vpKFs.end(); ++it) {
-                (*it)->SetKeyFrameDatabase(mpKeyFrameDatabase);
-                (*it)->SetORBvocabulary(mpVocabulary);
-                (*it)->SetMap(mpMap);
-                (*it)->ComputeBoW();
-                mpKeyFrameDatabase->add(*it);
-                (*it)->SetMapPoints(mpMap->GetAllMapPoints());
-                (*it)->SetSpanningTree(vpKFs);
-                (*it)->SetGridParams(vpKFs);
-
-                // Reconstruct map points Observation
-
+        // A native map file can be loaded progressively (MapLoader.progressive): the keyframes nearest to
+        // the prior camera position (MapLoader.priorX/Y/Z), or the most recent ones, are loaded before
+        // tracking starts and the rest streams in on a background thread. A journal needs the whole map.
+        mpMapLoader = static_cast<MapFileLoader *>(NULL);
+        cv::FileNode progressiveNode = fsSettings["MapLoader.progressive"];
+        string strJournalSetting = fsSettings["Journal.file"];
+        bool bProgressive = bReuse && !progressiveNode.empty() && (int) progressiveNode != 0 &&
+                            MapFile::IsMapFile(mapName) && strJournalSetting.empty() &&
+                            !ifstream(MapJournal::JournalFilename(mapName).c_str()).good();
+
+        if (bProgressive) {
+            cv::FileNode initialNode = fsSettings["MapLoader.initialKeyFrames"];
+            cv::FileNode batchNode = fsSettings["MapLoader.batch"];
+            cv::FileNode priorX = fsSettings["MapLoader.priorX"];
+            cv::FileNode priorY = fsSettings["MapLoader.priorY"];
+            cv::FileNode priorZ = fsSettings["MapLoader.priorZ"];
+            int nInitial = initialNode.empty() ? 100 : (int) initialNode;
+            int nBatch = batchNode.empty() ? 50 : (int) batchNode;
+            cv::Mat Twc;
+            if (!priorX.empty() && !priorY.empty() && !priorZ.empty()) {
+                Twc = cv::Mat::eye(4, 4, CV_32F);
+                Twc.at<float>(0, 3) = (float) priorX;
+                Twc.at<float>(1, 3) = (float) priorY;
+                Twc.at<float>(2, 3) = (float) priorZ;
             }
+            LoadMapProgressive(mapName, Twc, max(nInitial, 1), max(nBatch, 1));
+        } else if (bReuse) {
+            // Rebuilding the map is spread over all cores, the pool only lives while loading
+            TaskPool loadPool(max(thread::hardware_concurrency(), 1u));
 
-            vector<ORB_SLAM2::MapPoint *> vpMPs = mpMap->GetAllMapPoints();
-            for (vector<ORB_SLAM2::MapPoint *>::iterator mit = vpMPs.begin(); mit != vpMPs.end(); ++mit) {
-                (*mit)->SetMap(mpMap);
-                (*mit)->SetObservations(vpKFs);
-
-            }
-
-            for (vector<ORB_SLAM2::KeyFrame *>::iterator it = vpKFs.begin(); it != vpKFs.end(); ++it) {
-                (*it)->UpdateConnections();
-            }
+            // Keyframes, map points, the graphs between them and the keyframe database
+            LoadMap(mapName, &loadPool);
+        }
+        cout << endl << mpMap << " : is the created map address" << endl;
 
+        // Keyframe images can go to a compressed file of their own instead of memory and the map file.
+        // ImageStore.retain 0 drops them from memory once queued, ImageStore.compression is the PNG level.
+        string strImageStoreFile = fsSettings["ImageStore.file"];
+        mpImageStore = static_cast<KeyFrameImageStore *>(NULL);
+        if (!strImageStoreFile.empty()) {
+            cv::FileNode retainNode = fsSettings["ImageStore.retain"];
+            cv::FileNode compressionNode = fsSettings["ImageStore.compression"];
+            bool bRetainImages = retainNode.empty() || (int) retainNode != 0;
+            int nCompression = compressionNode.empty() ? 3 : (int) compressionNode;
+            // Keyframe ids start over without a map, the images of a previous run would be read for them
+            mpImageStore = new KeyFrameImageStore(strImageStoreFile, bRetainImages, nCompression, !bReuse);
+            if (mpImageStore->IsOpen())
+                mpMap->SetImageStore(mpImageStore);
+        }
 
+        // For maps larger than memory, the keypoints, descriptors and feature grid of the keyframes are
+        // paged out to PayloadStore.file once they take more than PayloadStore.budgetMB, least recently
+        // used first.
+        string strPayloadStoreFile = fsSettings["PayloadStore.file"];
+        mpPayloadStore = static_cast<KeyFramePayloadStore *>(NULL);
+        if (!strPayloadStoreFile.empty()) {
+            cv::FileNode budgetNode = fsSettings["PayloadStore.budgetMB"];
+            double budgetMB = budgetNode.empty() ? 512 : (double) budgetNode;
+            mpPayloadStore = new KeyFramePayloadStore(strPayloadStoreFile, (uint64_t) (max(budgetMB, 0.0) * (1 << 20)));
+            if (mpPayloadStore->IsOpen())
+                mpMap->SetPayloadStore(mpPayloadStore);
         }
-        cout << endl << mpMap << " : is the created map address" << endl;
 
         // BAR
         if (continue_mapping)
@@ -168,6 +202,26 @@ namespace ORB_SLAM2 {
 
         mpLoopCloser->SetTracker(mpTracker);
         mpLoopCloser->SetLocalMapper(mpLocalMapper);
+
+        mpMapExporter = new MapExporter(mpMap, mpKeyFrameDatabase, mpLocalMapper, mpLoopCloser);
+
+        // The map can be kept durable as a snapshot (native map file Journal.file) plus a journal of the
+        // changes, written every Journal.interval ms. The snapshot is rewritten once the journal grows
+        // past Journal.compactBytes.
+        string strJournalFile = fsSettings["Journal.file"];
+        mpJournal = static_cast<MapJournal *>(NULL);
+        if (!strJournalFile.empty()) {
+            cv::FileNode intervalNode = fsSettings["Journal.interval"];
+            cv::FileNode compactNode = fsSettings["Journal.compactBytes"];
+            int nIntervalMs = intervalNode.empty() ? 500 : (int) intervalNode;
+            uint64_t nCompactBytes = compactNode.empty() ? 64ULL << 20 : (uint64_t) (double) compactNode;
+            MapExporter *pExporter = mpMapExporter;
+            mpJournal = new MapJournal(mpMap, strJournalFile, nIntervalMs, nCompactBytes,
+                                       [pExporter](const string &filename) {
+                                           return pExporter->SaveBinary(filename);
+                                       });
+            mpMap->SetJournal(mpJournal);
+        }
     }
 
     cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp) {
@@ -176,35 +230,7 @@ namespace ORB_SLAM2 {
             exit(-1);
         }
 
-        // Check mode change
-        {
-            unique_lock<mutex> lock(mMutexMode);
-            if (mbActivateLocalizationMode) {
-                mpLocalMapper->RequestStop();
-
-                // Wait until Local Mapping has effectively stopped
-                while (!mpLocalMapper->isStopped()) {
-                    usleep(1000);
-                }
-
-                mpTracker->InformOnlyTracking(true);
-                mbActivateLocalizationMode = false;
-            }
-            if (mbDeactivateLocalizationMode) {
-                mpTracker->InformOnlyTracking(false);
-                mpLocalMapper->Release();
-                mbDeactivateLocalizationMode = false;
-            }
-        }
-
-        // Check reset
-        {
-            unique_lock<mutex> lock(mMutexReset);
-            if (mbReset) {
-                mpTracker->Reset();
-                mbReset = false;
-            }
-        }
+        CheckModeAndReset();
 
         return mpTracker->GrabImageStereo(imLeft, imRight, timestamp);
     }
@@ -215,35 +241,7 @@ namespace ORB_SLAM2 {
             exit(-1);
         }
 
-        // Check mode change
-        {
-            unique_lock<mutex> lock(mMutexMode);
-            if (mbActivateLocalizationMode) {
-                mpLocalMapper->RequestStop();
-
-                // Wait until Local Mapping has effectively stopped
-                while (!mpLocalMapper->isStopped()) {
-                    usleep(1000);
-                }
-
-                mpTracker->InformOnlyTracking(true);
-                mbActivateLocalizationMode = false;
-            }
-            if (mbDeactivateLocalizationMode) {
-                mpTracker->InformOnlyTracking(false);
-                mpLocalMapper->Release();
-                mbDeactivateLocalizationMode = false;
-            }
-        }
-
-        // Check reset
-        {
-            unique_lock<mutex> lock(mMutexReset);
-            if (mbReset) {
-                mpTracker->Reset();
-                mbReset = false;
-            }
-        }
+        CheckModeAndReset();
 
         return mpTracker->GrabImageRGBD(im, depthmap, timestamp);
     }
@@ -256,35 +254,7 @@ namespace ORB_SLAM2 {
             exit(-1);
         }
 
-        // Check mode change
-        {
-            unique_lock<mutex> lock(mMutexMode);
-            if (mbActivateLocalizationMode) {
-                mpLocalMapper->RequestStop();
-
-                // Wait until Local Mapping has effectively stopped
-                while (!mpLocalMapper->isStopped()) {
-                    usleep(1000);
-                }
-
-                mpTracker->InformOnlyTracking(true);
-                mbActivateLocalizationMode = false;
-            }
-            if (mbDeactivateLocalizationMode) {
-                mpTracker->InformOnlyTracking(false);
-                mpLocalMapper->Release();
-                mbDeactivateLocalizationMode = false;
-            }
-        }
-
-        // Check reset
-        {
-            unique_lock<mutex> lock(mMutexReset);
-            if (mbReset) {
-                mpTracker->Reset();
-                mbReset = false;
-            }
-        }
+        CheckModeAndReset();
 
         //return (mpTracker->GrabImageMonocular(im,timestamp)).clone();
         return (mpTracker->GrabImageMonocular(descriptors, keyPoints, mpViewer->GetImageWidth(),
@@ -299,6 +269,39 @@ namespace ORB_SLAM2 {
             exit(-1);
         }
 
+        CheckModeAndReset();
+
+        //return (mpTracker->GrabImageMonocular(im,timestamp)).clone();
+        return (mpTracker->GrabImageMonocular(im, timestamp));
+
+    }
+
+    cv::Mat System::TrackMonocularPipelined(const cv::Mat &im, const double &timestamp, double &trackedTimestamp) {
+        if (mSensor != MONOCULAR) {
+            cerr << "ERROR: you called TrackMonocularPipelined but input sensor was not set to Monocular." << endl;
+            exit(-1);
+        }
+
+        CheckModeAndReset();
+
+        return mpTracker->GrabImageMonocularPipelined(im, timestamp, trackedTimestamp);
+    }
+
+    std::vector<std::pair<double, cv::Mat> > System::FlushMonocularPipeline() {
+        std::vector<std::pair<double, cv::Mat> > vPoses;
+        cv::Mat Tcw;
+        double timestamp;
+
+        CheckModeAndReset();
+        while (mpTracker->TrackPipelinedImage(Tcw, timestamp)) {
+            vPoses.push_back(std::make_pair(timestamp, Tcw));
+            CheckModeAndReset();
+        }
+
+        return vPoses;
+    }
+
+    void System::CheckModeAndReset() {
         // Check mode change
         {
             unique_lock<mutex> lock(mMutexMode);
@@ -328,10 +331,6 @@ namespace ORB_SLAM2 {
                 mbReset = false;
             }
         }
-
-        //return (mpTracker->GrabImageMonocular(im,timestamp)).clone();
-        return (mpTracker->GrabImageMonocular(im, timestamp));
-
     }
 
     void System::ActivateLocalizationMode() {
@@ -358,6 +357,13 @@ namespace ORB_SLAM2 {
     }
 
     void System::Shutdown() {
+        mpTracker->StopPipeline();
+        mpMapExporter->Join();
+
+        // The map is saved whole, the rest of a progressive load comes in first
+        if (mpMapLoader)
+            mpMapLoader->Join();
+
         mpLocalMapper->RequestFinish();
         mpLoopCloser->RequestFinish();
         mpViewer->RequestFinish();
@@ -367,11 +373,75 @@ namespace ORB_SLAM2 {
                !mpViewer->isFinished() || mpLoopCloser->isRunningGBA()) {
             sleep(3);
         }
+
+        // Keyframe images still queued are written, they stay readable afterwards
+        if (mpImageStore)
+            mpImageStore->Flush();
+
+        // The last changes go to the journal, the map stays attached for the final state
+        if (mpJournal)
+            mpJournal->Finish();
+
+        // Payloads stay where they are, pinning still reads them back for saving the map
+        if (mpPayloadStore)
+            mpPayloadStore->Finish();
         //if(mpViewer)
         //   pangolin::BindToContext("ORB-SLAM2: Map Viewer");
     }
 
-    void System::LoadMap(const string &filename) {
+    void System::LoadMap(const string &filename, TaskPool* pPool) {
+        // Native map files are stored already linked, and with the inverted file if it was saved
+        // with the same vocabulary
+        bool bBowLoaded = false;
+        if (MapFile::IsMapFile(filename)) {
+            mpMap = MapFile::Load(filename, mpKeyFrameDatabase, &bBowLoaded);
+            if (!mpMap) {
+                cerr << "Failed to load map file: " << filename << endl;
+                exit(-1);
+            }
+            // Changes journaled after the snapshot was written; the inverted file is rebuilt then
+            if (MapJournal::Replay(mpMap, filename) > 0)
+                bBowLoaded = false;
+        } else {
+            LoadArchive(filename, pPool);
+        }
+
+        vector<ORB_SLAM2::KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
+        sort(vpKFs.begin(), vpKFs.end(), KeyFrame::lId);
+        for (vector<ORB_SLAM2::KeyFrame *>::iterator it = vpKFs.begin(); it != vpKFs.end(); ++it) {
+            (*it)->SetKeyFrameDatabase(mpKeyFrameDatabase);
+            (*it)->SetORBvocabulary(mpVocabulary);
+        }
+        if (bBowLoaded)
+            return;
+
+        // The vocabulary is only read by the BoW transforms. The inverted file is filled
+        // afterwards in id order, so its lists do not depend on which transform finished first.
+        mpKeyFrameDatabase->clear();
+        if (pPool) {
+            pPool->ParallelFor(vpKFs.size(), [&](int i) {
+                vpKFs[i]->ComputeBoW();
+            });
+        } else {
+            for (vector<ORB_SLAM2::KeyFrame *>::iterator it = vpKFs.begin(); it != vpKFs.end(); ++it)
+                (*it)->ComputeBoW();
+        }
+        for (vector<ORB_SLAM2::KeyFrame *>::iterator it = vpKFs.begin(); it != vpKFs.end(); ++it)
+            mpKeyFrameDatabase->add(*it);
+    }
+
+    void System::LoadMapProgressive(const string &filename, const cv::Mat &Twc, int nInitial, int nBatch) {
+        mpMap = new Map();
+        mpMapLoader = new MapFileLoader(mpMap, mpKeyFrameDatabase, mpVocabulary);
+        if (!mpMapLoader->Open(filename, Twc)) {
+            cerr << "Failed to load map file: " << filename << endl;
+            exit(-1);
+        }
+        mpMapLoader->LoadNext(nInitial);
+        mpMapLoader->LoadRemaining(nBatch);
+    }
+
+    void System::LoadArchive(const string &filename, TaskPool* pPool) {
         {
             std::ifstream is(filename);
 
@@ -395,19 +465,36 @@ namespace ORB_SLAM2 {
         copy_n(std::istream_iterator<char>(file), 5, std::back_inserter(my_str));
         cout << my_str << endl;
 
+        mpMap->RestoreLinks(pPool);
+
     }
 
     void System::SaveMap(const string &filename) {
-        std::ofstream os(filename);
-        {
-            ::boost::archive::binary_oarchive oa(os, ::boost::archive::no_header);
-            //oa << mpKeyFrameDatabase;
-            oa << mpMap;
-        }
+        if (mpMapLoader)
+            mpMapLoader->Join();
+        if (!MapFile::Save(mpMap, filename, mpKeyFrameDatabase))
+            return;
         cout << endl << "Map saved to " << filename << endl;
 
     }
 
+    bool System::SaveMapInBackground(const string &csvFilename, const string &binFilename) {
+        if (mpMapLoader && !mpMapLoader->isFinished()) {
+            cerr << "The map is still loading (" << int(mpMapLoader->GetProgress() * 100) << "%), not exported" << endl;
+            return false;
+        }
+        return mpMapExporter->RequestExport(csvFilename, binFilename);
+    }
+
+    bool System::CheckpointMap() {
+        if (!mpJournal)
+            return false;
+        if (!mpJournal->Checkpoint())
+            return false;
+        cout << "Map checkpoint written to " << MapJournal::JournalFilename(mpJournal->GetSnapshotFilename()) << endl;
+        return true;
+    }
+
 
     void System::SaveTrajectoryTUM(const string &filename) {
         cout << endl << "Saving camera trajectory to " << filename << " ..." << endl;
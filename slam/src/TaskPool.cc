@@ -0,0 +1,127 @@
+#include "TaskPool.h"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+TaskPool::TaskPool(int nThreads):mpFirstBatch(static_cast<Batch*>(NULL)), mpLastBatch(static_cast<Batch*>(NULL)),
+    mbFinish(false)
+{
+    for(int i=1; i<nThreads; i++)
+        mvThreads.emplace_back(&TaskPool::Run, this);
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        unique_lock<mutex> lock(mMutex);
+        mbFinish = true;
+    }
+    mCondWork.notify_all();
+    for(size_t i=0; i<mvThreads.size(); i++)
+        mvThreads[i].join();
+}
+
+void TaskPool::Dispatch(int n, CallFunc call, const void* pFunc)
+{
+    if(n<=0)
+        return;
+
+    if(mvThreads.empty() || n==1)
+    {
+        for(int i=0; i<n; i++)
+            call(pFunc, i);
+        return;
+    }
+
+    Batch batch;
+    batch.call = call;
+    batch.pFunc = pFunc;
+    batch.n = n;
+    batch.nNext = 0;
+    batch.nDone = 0;
+    batch.pNext = static_cast<Batch*>(NULL);
+
+    {
+        unique_lock<mutex> lock(mMutex);
+        if(mpLastBatch)
+            mpLastBatch->pNext = &batch;
+        else
+            mpFirstBatch = &batch;
+        mpLastBatch = &batch;
+    }
+    mCondWork.notify_all();
+
+    // Work on our own batch instead of waiting idle
+    while(true)
+    {
+        int i;
+        {
+            unique_lock<mutex> lock(mMutex);
+            if(batch.nNext>=n)
+                break;
+            i = batch.nNext++;
+            if(batch.nNext==n)
+                RemoveBatch(&batch);
+        }
+
+        call(pFunc, i);
+
+        unique_lock<mutex> lock(mMutex);
+        batch.nDone++;
+    }
+
+    unique_lock<mutex> lock(mMutex);
+    mCondDone.wait(lock, [&batch]{ return batch.nDone==batch.n; });
+}
+
+void TaskPool::RemoveBatch(Batch* pBatch)
+{
+    Batch* pPrev = static_cast<Batch*>(NULL);
+    for(Batch* p=mpFirstBatch; p; pPrev=p, p=p->pNext)
+    {
+        if(p!=pBatch)
+            continue;
+        if(pPrev)
+            pPrev->pNext = p->pNext;
+        else
+            mpFirstBatch = p->pNext;
+        if(mpLastBatch==p)
+            mpLastBatch = pPrev;
+        return;
+    }
+}
+
+void TaskPool::Run()
+{
+    while(true)
+    {
+        Batch* pBatch;
+        int i;
+        {
+            unique_lock<mutex> lock(mMutex);
+            mCondWork.wait(lock, [this]{ return mbFinish || mpFirstBatch; });
+            if(!mpFirstBatch)
+                return;
+
+            pBatch = mpFirstBatch;
+            i = pBatch->nNext++;
+            if(pBatch->nNext==pBatch->n)
+                RemoveBatch(pBatch);
+        }
+
+        pBatch->call(pBatch->pFunc, i);
+
+        bool bBatchDone;
+        {
+            unique_lock<mutex> lock(mMutex);
+            pBatch->nDone++;
+            bBatchDone = pBatch->nDone==pBatch->n;
+        }
+        if(bBatchDone)
+            mCondDone.notify_all();
+    }
+}
+
+} //namespace ORB_SLAM
@@ -32,6 +32,7 @@
 
 #include"Optimizer.h"
 #include"PnPsolver.h"
+#include"MapFileLoader.h"
 
 #include<iostream>
 
@@ -128,14 +129,28 @@ namespace ORB_SLAM2 {
         int nLevels = fSettings["ORBextractor.nLevels"];
         int fIniThFAST = fSettings["ORBextractor.iniThFAST"];
         int fMinThFAST = fSettings["ORBextractor.minThFAST"];
+        int nExtractorThreads = fSettings["ORBextractor.nThreads"];
+        int nPipelineQueueSize = fSettings["ORBextractor.pipelineQueueSize"];
+
+        // All extractors share one pool, stereo left/right extraction can run on it concurrently
+        mpORBextractorPool = nExtractorThreads > 1 ? new TaskPool(nExtractorThreads) : static_cast<TaskPool *>(NULL);
 
         mpORBextractorLeft = new ORBextractor(nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST);
+        mpORBextractorLeft->SetTaskPool(mpORBextractorPool);
 
-        if (sensor == System::STEREO)
+        if (sensor == System::STEREO) {
             mpORBextractorRight = new ORBextractor(nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST);
+            mpORBextractorRight->SetTaskPool(mpORBextractorPool);
+        }
 
-        if (sensor == System::MONOCULAR)
+        if (sensor == System::MONOCULAR) {
             mpIniORBextractor = new ORBextractor(2 * nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST);
+            mpIniORBextractor->SetTaskPool(mpORBextractorPool);
+        }
+
+        // Images waiting or in extraction in the pipelined monocular mode
+        mpFramePipeline = static_cast<FramePipeline *>(NULL);
+        mnPipelineQueueSize = nPipelineQueueSize > 0 ? nPipelineQueueSize : 2;
 
         cout << endl << "ORB Extractor Parameters: " << endl;
         cout << "- Number of Features: " << nFeatures << endl;
@@ -143,6 +158,7 @@ namespace ORB_SLAM2 {
         cout << "- Scale Factor: " << fScaleFactor << endl;
         cout << "- Initial Fast Threshold: " << fIniThFAST << endl;
         cout << "- Minimum Fast Threshold: " << fMinThFAST << endl;
+        cout << "- Extractor Threads: " << max(nExtractorThreads, 1) << endl;
         cout << "- Reuse Map ?: " << is_preloaded << endl;
         if (sensor == System::STEREO || sensor == System::RGBD) {
             mThDepth = mbf * (float) fSettings["ThDepth"] / fx;
@@ -288,6 +304,53 @@ namespace ORB_SLAM2 {
         return mCurrentFrame.mTcw.clone();
     }
 
+    cv::Mat Tracking::GrabImageMonocularPipelined(const cv::Mat &im, const double &timestamp, double &trackedTimestamp) {
+        if (!mpFramePipeline)
+            mpFramePipeline = new FramePipeline(mpIniORBextractor, mpORBextractorLeft, mbRGB, mnPipelineQueueSize);
+
+        mpFramePipeline->Push(im, timestamp);
+
+        // Keep up to ORBextractor.pipelineQueueSize-1 images in extraction while the oldest one is tracked
+        cv::Mat Tcw;
+        trackedTimestamp = -1;
+        if (mpFramePipeline->size() >= (size_t) mnPipelineQueueSize)
+            TrackPipelinedImage(Tcw, trackedTimestamp);
+        return Tcw;
+    }
+
+    bool Tracking::TrackPipelinedImage(cv::Mat &Tcw, double &timestamp) {
+        FramePipeline::Item item;
+        if (!mpFramePipeline || !mpFramePipeline->Pop(item))
+            return false;
+
+        // The extractor depends on the state left by the previous frame. Images extracted before it changed
+        // (initialization, reset) are extracted again so that the frame is the one GrabImageMonocular builds.
+        ORBextractor *pExtractor = (mState == NOT_INITIALIZED || mState == NO_IMAGES_YET) ? mpIniORBextractor
+                                                                                        : mpORBextractorLeft;
+        if (item.pExtractor != pExtractor)
+            mpFramePipeline->Extract(pExtractor, item);
+
+        mImGray = item.im;
+        mCurrentFrame = Frame(mImGray, item.vKeys, item.descriptors, item.timestamp, pExtractor, mpORBVocabulary, mK,
+                              mDistCoef, mbf, mThDepth);
+
+        Track();
+
+        mpFramePipeline->SetUseIniExtractor(mState == NOT_INITIALIZED || mState == NO_IMAGES_YET);
+
+        Tcw = mCurrentFrame.mTcw.clone();
+        timestamp = item.timestamp;
+        return true;
+    }
+
+    void Tracking::StopPipeline() {
+        if (mpFramePipeline) {
+            mpFramePipeline->Finish();
+            delete mpFramePipeline;
+            mpFramePipeline = static_cast<FramePipeline *>(NULL);
+        }
+    }
+
     void Tracking::Track() {
         if (mState == NO_IMAGES_YET) {
             mState = NOT_INITIALIZED;
@@ -1090,9 +1153,8 @@ namespace ORB_SLAM2 {
             }
         }
 
-        int nToMatch = 0;
-
-        // Project points in frame and check its visibility
+        // Gather the points to project, then check their visibility in one batch
+        mLocalPointsBatch.Clear();
         for (vector<MapPoint *>::iterator vit = mvpLocalMapPoints.begin(), vend = mvpLocalMapPoints.end();
              vit != vend; vit++) {
             MapPoint *pMP = *vit;
@@ -1100,11 +1162,14 @@ namespace ORB_SLAM2 {
                 continue;
             if (pMP->isBad())
                 continue;
-            // Project (this fills MapPoint variables for matching)
-            if (mCurrentFrame.isInFrustum(pMP, 0.5)) {
-                pMP->IncreaseVisible();
-                nToMatch++;
-            }
+            mLocalPointsBatch.Add(pMP);
+        }
+
+        // Project (this fills MapPoint variables for matching)
+        const int nToMatch = mLocalPointsBatch.IsInFrustum(mCurrentFrame, 0.5);
+        for (size_t i = 0; i < mLocalPointsBatch.size(); i++) {
+            if (mLocalPointsBatch.InView(i))
+                mLocalPointsBatch.GetMapPoint(i)->IncreaseVisible();
         }
 
         if (nToMatch > 0) {
@@ -1430,6 +1495,11 @@ namespace ORB_SLAM2 {
         while (!mpViewer->isStopped())
             usleep(3000);
 
+        // Stop a progressive map load, it links new keyframes to the ones about to be deleted
+        MapFileLoader *pMapLoader = mpSystem ? mpSystem->GetMapLoader() : static_cast<MapFileLoader *>(NULL);
+        if (pMapLoader)
+            pMapLoader->Abort();
+
         // Reset Local Mapping
         cout << "Reseting Local Mapper...";
         mpLocalMapper->RequestReset();
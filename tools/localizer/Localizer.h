@@ -0,0 +1,70 @@
+#ifndef ORB_SLAM2_LOCALIZER_H
+#define ORB_SLAM2_LOCALIZER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "ORBextractor.h"
+#include "ORBVocabulary.h"
+#include "RaspberryMapView.h"
+
+/**
+ *  @class Localizer
+ *  @brief Onboard relocalization against a localization package, without a running ORBSLAM2 system.
+ *
+ *  The package is a Raspberry map file written with a vocabulary (exe/export_localization_package or
+ *  MapExporter::SaveRaspberry): keyframe poses, their BoW vectors and inverted index, map point positions
+ *  and descriptors and the keypoint to map point associations. It is mapped read-only and used in place.
+ *
+ *  A query extracts ORB features from the image, finds the keyframes sharing the most words with it through
+ *  the inverted index, matches the descriptors of the map points they observe to the query keypoints and
+ *  solves the camera pose with the PnP RANSAC of the relocalization of ORBSLAM2. No map, keyframe database
+ *  or threads are created.
+ */
+class Localizer {
+public:
+    /**
+ * Loads the vocabulary, reads the camera and ORB extractor parameters and maps the package.
+ *
+ * @param vocPath: A string representing the path to the ORBSLAM2 vocabulary file (.txt or binary), the one the package was exported with.
+ *
+ * @param settingsPath: A string representing the path to the ORBSLAM2 configuration file of the camera, an example can be found in the "config" folder in the project.
+ *
+ * @param packagePath: A string representing the path to the localization package.
+ */
+    Localizer(std::string vocPath, std::string settingsPath, std::string packagePath);
+
+/**
+ * @return false if the vocabulary or the package could not be loaded, or the package was exported with another vocabulary
+ * */
+    bool isReady() { return ready; }
+
+/**
+ * @brief Estimates the pose of the camera that took the image. Not thread safe, use one Localizer per thread.
+ * @param image: the camera image, grayscale or color (channel order from Camera.RGB)
+ * @param Tcw: the world to camera transformation (4x4, CV_32F) if localized
+ * @param inliers: if not null, the number of PnP inliers of the pose
+ * @return whether the image was localized
+ */
+    bool localize(const cv::Mat &image, cv::Mat &Tcw, int *inliers = nullptr);
+
+private:
+    // Package keyframes sharing the most words with the query, best BoW score first
+    std::vector<uint32_t> detectCandidates(const DBoW2::BowVector &bowVec);
+
+    // Map point of the package for each query keypoint, -1 if none
+    int matchKeyFrame(uint32_t keyFrame, const cv::Mat &descriptors, std::vector<int> &matches);
+
+    ORB_SLAM2::ORBVocabulary vocabulary;
+    std::unique_ptr<ORB_SLAM2::ORBextractor> extractor;
+    ORB_SLAM2::RaspberryMapView package;
+
+    cv::Mat K;
+    cv::Mat distCoef;
+    bool rgb;
+    bool ready;
+};
+
+#endif //ORB_SLAM2_LOCALIZER_H
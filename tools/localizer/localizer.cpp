@@ -0,0 +1,245 @@
+#include <iostream>
+#include <algorithm>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include "Localizer.h"
+#include "PnPsolver.h"
+#include "HammingDistance.h"
+
+// Same thresholds as ORBmatcher and Tracking::Relocalization
+static const int TH_LOW = 50;
+static const float NN_RATIO = 0.75f;
+static const int MIN_MATCHES = 15;
+static const int MIN_INLIERS = 20;
+static const size_t MAX_CANDIDATES = 5;
+
+Localizer::Localizer(std::string vocPath, std::string settingsPath, std::string packagePath) : rgb(false),
+                                                                                                   ready(false) {
+    bool vocLoaded = vocPath.size() > 4 && vocPath.compare(vocPath.size() - 4, 4, ".txt") == 0 ?
+                     vocabulary.loadFromTextFile(vocPath) : vocabulary.loadFromBinaryFile(vocPath);
+    if (!vocLoaded) {
+        std::cerr << "Failed to open vocabulary " << vocPath << std::endl;
+        return;
+    }
+
+    cv::FileStorage fSettings(settingsPath, cv::FileStorage::READ);
+    if (!fSettings.isOpened()) {
+        std::cerr << "Failed to open settings file " << settingsPath << std::endl;
+        return;
+    }
+    float width = fSettings["Camera.width"];
+    float height = fSettings["Camera.height"];
+    float origWidth = fSettings["Camera.orig_width"];
+    float origHeight = fSettings["Camera.orig_height"];
+    // The calibration is for images of the size the camera runs at unless the settings give another one
+    if (origWidth <= 0)
+        origWidth = width;
+    if (origHeight <= 0)
+        origHeight = height;
+    if (width <= 0 || height <= 0) {
+        std::cerr << "Camera.width and Camera.height missing from " << settingsPath << std::endl;
+        return;
+    }
+    K = cv::Mat::eye(3, 3, CV_32F);
+    K.at<float>(0, 0) = (float) fSettings["Camera.fx"] * width / origWidth;
+    K.at<float>(1, 1) = (float) fSettings["Camera.fy"] * height / origHeight;
+    K.at<float>(0, 2) = (float) fSettings["Camera.cx"] * width / origWidth;
+    K.at<float>(1, 2) = (float) fSettings["Camera.cy"] * height / origHeight;
+
+    distCoef = cv::Mat(4, 1, CV_32F);
+    distCoef.at<float>(0) = fSettings["Camera.k1"];
+    distCoef.at<float>(1) = fSettings["Camera.k2"];
+    distCoef.at<float>(2) = fSettings["Camera.p1"];
+    distCoef.at<float>(3) = fSettings["Camera.p2"];
+    const float k3 = fSettings["Camera.k3"];
+    if (k3 != 0) {
+        distCoef.resize(5);
+        distCoef.at<float>(4) = k3;
+    }
+    int nRGB = fSettings["Camera.RGB"];
+    rgb = nRGB;
+
+    int nFeatures = fSettings["ORBextractor.nFeatures"];
+    float scaleFactor = fSettings["ORBextractor.scaleFactor"];
+    int nLevels = fSettings["ORBextractor.nLevels"];
+    int iniThFAST = fSettings["ORBextractor.iniThFAST"];
+    int minThFAST = fSettings["ORBextractor.minThFAST"];
+    extractor = std::make_unique<ORB_SLAM2::ORBextractor>(nFeatures, scaleFactor, nLevels, iniThFAST, minThFAST);
+
+    if (!package.Open(packagePath)) {
+        std::cerr << "Failed to open localization package " << packagePath << std::endl;
+        return;
+    }
+    if (!package.HasBow() || package.Header().vocabularyHash != ORB_SLAM2::VocabularyHash(vocabulary)) {
+        std::cerr << packagePath << " was not exported with the vocabulary " << vocPath << std::endl;
+        return;
+    }
+    ready = true;
+}
+
+bool Localizer::localize(const cv::Mat &image, cv::Mat &Tcw, int *inliers) {
+    if (inliers)
+        *inliers = 0;
+    if (!ready)
+        return false;
+
+    cv::Mat gray = image;
+    if (gray.channels() == 3)
+        cv::cvtColor(gray, gray, rgb ? CV_RGB2GRAY : CV_BGR2GRAY);
+    else if (gray.channels() == 4)
+        cv::cvtColor(gray, gray, rgb ? CV_RGBA2GRAY : CV_BGRA2GRAY);
+
+    std::vector<cv::KeyPoint> keys;
+    cv::Mat descriptors;
+    (*extractor)(gray, cv::Mat(), keys, descriptors);
+    if (keys.size() < (size_t) MIN_MATCHES)
+        return false;
+
+    std::vector<cv::Point2f> keysUn(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+        keysUn[i] = keys[i].pt;
+    if (distCoef.at<float>(0) != 0.0) {
+        cv::Mat mat(keysUn.size(), 2, CV_32F, &keysUn[0]);
+        mat = mat.reshape(2);
+        cv::undistortPoints(mat, mat, K, distCoef, cv::Mat(), K);
+    }
+
+    std::vector<cv::Mat> vDescriptors(descriptors.rows);
+    for (int i = 0; i < descriptors.rows; i++)
+        vDescriptors[i] = descriptors.row(i);
+    DBoW2::BowVector bowVec;
+    DBoW2::FeatureVector featVec;
+    vocabulary.transform(vDescriptors, bowVec, featVec, 4);
+
+    // One PnP problem per candidate keyframe with enough matches
+    const std::vector<float> sigma2 = extractor->GetScaleSigmaSquares();
+    std::vector<std::unique_ptr<ORB_SLAM2::PnPsolver>> solvers;
+    for (uint32_t keyFrame: detectCandidates(bowVec)) {
+        std::vector<int> matches;
+        if (matchKeyFrame(keyFrame, descriptors, matches) < MIN_MATCHES)
+            continue;
+        std::vector<cv::Point2f> points2D;
+        std::vector<float> pointSigma2;
+        std::vector<cv::Point3f> points3D;
+        for (size_t i = 0; i < matches.size(); i++) {
+            if (matches[i] < 0)
+                continue;
+            float pos[3];
+            package.Position(matches[i], pos);
+            points2D.push_back(keysUn[i]);
+            pointSigma2.push_back(sigma2[keys[i].octave]);
+            points3D.emplace_back(pos[0], pos[1], pos[2]);
+        }
+        solvers.push_back(std::make_unique<ORB_SLAM2::PnPsolver>(points2D, pointSigma2, points3D, K.at<float>(0, 0),
+                                                                 K.at<float>(1, 1), K.at<float>(0, 2),
+                                                                 K.at<float>(1, 2)));
+        solvers.back()->SetRansacParameters(0.99, 10, 300, 4, 0.5, 5.991);
+    }
+
+    // A few RANSAC iterations on every candidate in turn until one pose has enough inliers
+    std::vector<bool> discarded(solvers.size(), false);
+    size_t remaining = solvers.size();
+    while (remaining > 0) {
+        for (size_t i = 0; i < solvers.size(); i++) {
+            if (discarded[i])
+                continue;
+            std::vector<bool> vbInliers;
+            int nInliers = 0;
+            bool noMore = false;
+            cv::Mat pose = solvers[i]->iterate(5, noMore, vbInliers, nInliers);
+            if (noMore) {
+                discarded[i] = true;
+                remaining--;
+            }
+            if (!pose.empty() && nInliers >= MIN_INLIERS) {
+                pose.copyTo(Tcw);
+                if (inliers)
+                    *inliers = nInliers;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+std::vector<uint32_t> Localizer::detectCandidates(const DBoW2::BowVector &bowVec) {
+    const ORB_SLAM2::RaspberryMapHeader &header = package.Header();
+    const uint32_t *invertedKeyFrames = package.InvertedKeyFrames();
+
+    // Keyframes sharing words with the query, as KeyFrameDatabase::DetectRelocalizationCandidates
+    std::vector<int> commonWords(header.nKeyFrames, 0);
+    std::vector<uint32_t> sharing;
+    for (auto &[word, weight]: bowVec) {
+        const ORB_SLAM2::RaspberryMapInvertedWord *entry = package.FindWord(word);
+        if (!entry)
+            continue;
+        for (uint32_t i = entry->keyFrameBegin; i < entry->keyFrameBegin + entry->nKeyFrames; i++) {
+            if (commonWords[invertedKeyFrames[i]]++ == 0)
+                sharing.push_back(invertedKeyFrames[i]);
+        }
+    }
+    if (sharing.empty())
+        return {};
+
+    int maxCommonWords = 0;
+    for (uint32_t keyFrame: sharing)
+        maxCommonWords = std::max(maxCommonWords, commonWords[keyFrame]);
+    const int minCommonWords = maxCommonWords * 0.8f;
+
+    const ORB_SLAM2::RaspberryMapKeyFrame *keyFrames = package.KeyFrames();
+    const ORB_SLAM2::RaspberryMapBowWord *bowWords = package.BowWords();
+    std::vector<std::pair<double, uint32_t>> scores;
+    for (uint32_t keyFrame: sharing) {
+        if (commonWords[keyFrame] < minCommonWords)
+            continue;
+        DBoW2::BowVector keyFrameBow;
+        const ORB_SLAM2::RaspberryMapKeyFrame &r = keyFrames[keyFrame];
+        for (uint32_t i = r.bowBegin; i < r.bowBegin + r.nBowWords; i++)
+            keyFrameBow.insert(keyFrameBow.end(), DBoW2::BowVector::value_type(bowWords[i].word, bowWords[i].weight));
+        scores.emplace_back(vocabulary.score(bowVec, keyFrameBow), keyFrame);
+    }
+
+    const size_t n = std::min(scores.size(), MAX_CANDIDATES);
+    std::partial_sort(scores.begin(), scores.begin() + n, scores.end(),
+                      [](const std::pair<double, uint32_t> &a, const std::pair<double, uint32_t> &b) {
+                          return a.first > b.first || (a.first == b.first && a.second < b.second);
+                      });
+    std::vector<uint32_t> candidates(n);
+    for (size_t i = 0; i < n; i++)
+        candidates[i] = scores[i].second;
+    return candidates;
+}
+
+int Localizer::matchKeyFrame(uint32_t keyFrame, const cv::Mat &descriptors, std::vector<int> &matches) {
+    matches.assign(descriptors.rows, -1);
+    std::vector<int> bestDistances(descriptors.rows, 256);
+
+    // Nearest query keypoint of every map point the keyframe observes, kept if distinctive and the
+    // closest map point to that keypoint
+    const ORB_SLAM2::RaspberryMapKeyFrame &r = package.KeyFrames()[keyFrame];
+    const ORB_SLAM2::RaspberryMapObservation *observations = package.Observations();
+    for (uint32_t o = r.observationBegin; o < r.observationBegin + r.nObservations; o++) {
+        const uint8_t *mapPointDescriptor = package.Descriptor(observations[o].mapPoint);
+        int bestDist = 256, secondDist = 256, bestIdx = -1;
+        for (int i = 0; i < descriptors.rows; i++) {
+            const int dist = ORB_SLAM2::DescriptorDistance(mapPointDescriptor, descriptors.ptr<unsigned char>(i));
+            if (dist < bestDist) {
+                secondDist = bestDist;
+                bestDist = dist;
+                bestIdx = i;
+            } else if (dist < secondDist) {
+                secondDist = dist;
+            }
+        }
+        if (bestDist > TH_LOW || bestDist >= NN_RATIO * secondDist || bestDist >= bestDistances[bestIdx])
+            continue;
+        bestDistances[bestIdx] = bestDist;
+        matches[bestIdx] = observations[o].mapPoint;
+    }
+
+    int nMatches = 0;
+    for (int match: matches)
+        nMatches += match >= 0;
+    return nMatches;
+}
@@ -3,6 +3,7 @@
 //
 
 #include "simulator.h"
+#include "MapJournal.h"
 
 cv::Mat Simulator::getCurrentLocation() {
     locationLock.lock();
@@ -158,10 +159,19 @@ void Simulator::simulatorRunThread() {
                 std::time(&now_t);
                 std::strftime(time_buf, 21, "%Y-%m-%d_%H:%S:%MZ", gmtime(&now_t));
                 std::string currentTime(time_buf);
-                saveMap(currentTime);
-                SLAM->SaveMap(simulatorOutputDir + "/simulatorCloudPoint" + currentTime + ".bin");
-                std::cout << "new map saved to " << simulatorOutputDir + "/simulatorCloudPoint" + currentTime + ".bin"
-                          << std::endl;
+                std::string mapPath = simulatorOutputDir + "/simulatorCloudPoint" + currentTime + ".bin";
+                if (SLAM->GetMapJournal()) {
+                    // Only the changes since the last checkpoint are written, the binary map is the
+                    // journal snapshot
+                    if (SLAM->CheckpointMap())
+                        std::cout << "map checkpoint written" << std::endl;
+                    SLAM->SaveMapInBackground(simulatorOutputDir + "/cloud" + currentTime + ".csv", "");
+                } else if (SLAM->SaveMapInBackground(simulatorOutputDir + "/cloud" + currentTime + ".csv", mapPath)) {
+                    std::cout << "saving map to " << mapPath << " in the background" << std::endl;
+                } else {
+                    std::cout << "previous map export still running ("
+                              << int(SLAM->GetMapExporter()->GetProgress() * 100) << "%), ignoring" << std::endl;
+                }
             }
             if (track) {
                 locationLock.lock();
@@ -187,10 +197,15 @@ void Simulator::simulatorRunThread() {
         pangolin::FinishFrame();
     }
     if (isSaveMap) {
-
+        SLAM->GetMapExporter()->Join();
         saveMap("final");
-        SLAM->SaveMap(simulatorOutputDir + "/finalSimulatorCloudPoint.bin");
-        std::cout << "new map saved to " << simulatorOutputDir + "/finalSimulatorCloudPoint.bin" << std::endl;
+        if (SLAM->GetMapJournal()) {
+            // Shutdown writes the last changes to the journal
+            std::cout << "map kept in " << SLAM->GetMapJournal()->GetSnapshotFilename() << " and its journal" << std::endl;
+        } else {
+            SLAM->SaveMap(simulatorOutputDir + "/finalSimulatorCloudPoint.bin");
+            std::cout << "new map saved to " << simulatorOutputDir + "/finalSimulatorCloudPoint.bin" << std::endl;
+        }
 
     }
     SLAM->Shutdown();
@@ -202,38 +217,8 @@ std::thread Simulator::run() {
 }
 
 void Simulator::saveMap(std::string prefix) {
-    std::ofstream pointData;
-
-    pointData.open(simulatorOutputDir + "/cloud" + prefix + ".csv");
-    for (auto &p: SLAM->GetMap()->GetAllMapPoints()) {
-        if (p != nullptr && !p->isBad()) {
-            auto point = p->GetWorldPos();
-            Eigen::Matrix<double, 3, 1> vector = ORB_SLAM2::Converter::toVector3d(point);
-            cv::Mat worldPos = cv::Mat::zeros(3, 1, CV_64F);
-            worldPos.at<double>(0) = vector.x();
-            worldPos.at<double>(1) = vector.y();
-            worldPos.at<double>(2) = vector.z();
-            p->UpdateNormalAndDepth();
-            cv::Mat Pn = p->GetNormal();
-            Pn.convertTo(Pn, CV_64F);
-            pointData << worldPos.at<double>(0) << "," << worldPos.at<double>(1) << "," << worldPos.at<double>(2);
-            pointData << "," << p->GetMinDistanceInvariance() << "," << p->GetMaxDistanceInvariance() << ","
-                      << Pn.at<double>(0) << "," << Pn.at<double>(1) << "," << Pn.at<double>(2);
-            std::map<ORB_SLAM2::KeyFrame *, size_t> observations = p->GetObservations();
-            for (auto obs: observations) {
-                ORB_SLAM2::KeyFrame *currentFrame = obs.first;
-                if (!currentFrame->image.empty()) {
-                    size_t pointIndex = obs.second;
-                    cv::KeyPoint keyPoint = currentFrame->mvKeysUn[pointIndex];
-                    cv::Point2f featurePoint = keyPoint.pt;
-                    pointData << "," << currentFrame->mnId << "," << featurePoint.x << "," << featurePoint.y;
-                }
-            }
-            pointData << std::endl;
-        }
-    }
-    pointData.close();
-
+    ORB_SLAM2::MapExporter::SaveCloudCsv(SLAM->GetMap()->CreateSnapshot(),
+                                         simulatorOutputDir + "/cloud" + prefix + ".csv");
 }
 
 void Simulator::extractSurface(const pangolin::Geometry &modelGeometry, std::string modelTextureNameToAlignTo,